@@ -18,6 +18,7 @@
 #include <cmgCore/resource/cmgResource.h>
 #include <cmgCore/resource/cmgResourceLoader.h>
 #include <cmgCore/os/cmgClipboard.h>
+#include <cmgCore/thread/cmgThreadPool.h>
 
 
 #endif // _CMG_CORE_INCLUDE_ALL_H_
\ No newline at end of file
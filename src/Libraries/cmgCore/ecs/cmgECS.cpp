@@ -1,224 +1,1993 @@
 #include "cmgECS.h"
 #include "cmgAssert.h"
+#include <cmgCore/time/cmgTimer.h>
 #include <cmgMath/cmgMathLib.h>
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
-ECSEntity::ECSEntity(ECS& ecs):
-	m_ecs(ecs)
+static const uint32 NO_FREE_ENTITY = (uint32) -1;
+
+// Maximum number of entities in a batch built from component pools
+static const uint32 MAX_BATCH_SIZE = 256;
+
+
+ECS::ECS(ECSStorageMode storageMode) :
+	m_storageMode(storageMode),
+	m_freeEntities(NO_FREE_ENTITY),
+	m_numEntities(0),
+	m_changeVersion(1),
+	m_threadPool(nullptr),
+	m_parallelGrainSize(DEFAULT_PARALLEL_GRAIN_SIZE)
+{
+}
+
+ECS::~ECS()
+{
+	// Detach the queries of any systems that outlive the ECS
+	for (uint32 i = 0; i < m_queries.size(); i++)
+	{
+		m_queries[i]->m_ecs = nullptr;
+		m_queries[i]->Clear();
+	}
+	m_queries.clear();
+	m_queriesByType.clear();
+
+	// Delete all component pools
+	for (uint32 i = 0; i < m_components.size(); i++)
+		delete m_components[i];
+	m_components.clear();
+
+	for (uint32 i = 0; i < m_commandBuffers.size(); i++)
+		delete m_commandBuffers[i];
+	m_commandBuffers.clear();
+
+	// Delete all archetypes along with their components
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+		delete m_archetypes[i];
+	m_archetypes.clear();
+	m_archetypeMap.clear();
+
+	m_entities.clear();
+}
+
+void ECS::UpdateSystems(ECSSystemList& systems, float deltaTime)
+{
+	Timer timer;
+	for (uint32 i = 0; i < systems.Size(); i++)
+	{
+		BaseECSSystem* system = systems[i];
+		timer.Start();
+		system->PreUpdate(deltaTime);
+		system->m_updateMilliseconds = timer.GetElapsedMilliseconds();
+		system->m_updateProcessed = 0;
+		system->m_updateBytesTouched = 0;
+	}
+
+	// Verify each component type has a pool created, register the system
+	// queries, and size the per-thread component parameter arrays
+	uint32 numThreads = (m_threadPool != nullptr ?
+		m_threadPool->GetNumThreads() : 1);
+	m_threadComponentParams.resize(Math::Max(
+		(uint32) m_threadComponentParams.size(), numThreads));
+	while (m_commandBuffers.size() < numThreads)
+		m_commandBuffers.push_back(new ECSCommandBuffer());
+	for (uint32 i = 0; i < systems.Size(); i++)
+	{
+		const Array<uint32>& componentTypes = systems[i]->GetComponentTypes();
+		if (m_storageMode == ECSStorageMode::k_componentPools)
+		{
+			for (uint32 j = 0; j < componentTypes.size(); j++)
+				GetComponentPool(componentTypes[j]);
+		}
+		RegisterQuery(systems[i]);
+		for (uint32 j = 0; j < numThreads; j++)
+		{
+			Array<BaseECSComponent*>& componentParam = m_threadComponentParams[j];
+			componentParam.resize(Math::Max(
+				componentParam.size(), componentTypes.size()));
+		}
+	}
+
+	if (numThreads > 1)
+	{
+		UpdateSystemsParallel(systems, deltaTime);
+	}
+	else
+	{
+		for (uint32 i = 0; i < systems.Size(); i++)
+		{
+			BeginSystemUpdate(systems[i]);
+			m_systemTasks.clear();
+			GatherSystemTasks(systems[i], (uint32) -1, m_systemTasks);
+			for (uint32 j = 0; j < m_systemTasks.size(); j++)
+			{
+				RunSystemTask(m_systemTasks[j], deltaTime,
+					m_threadComponentParams[0].data());
+			}
+			AddSystemTaskStats();
+			EndSystemUpdate(systems[i]);
+		}
+	}
+
+	for (uint32 i = 0; i < systems.Size(); i++)
+	{
+		BaseECSSystem* system = systems[i];
+		timer.Start();
+		system->PostUpdate(deltaTime);
+		system->m_stats.AddUpdate(system->m_updateMilliseconds +
+			timer.GetElapsedMilliseconds(), system->GetQuery().GetNumMatches(),
+			system->m_updateProcessed, system->m_updateBytesTouched);
+	}
+
+	// Sync point for structural changes
+	PlaybackCommandBuffers();
+}
+
+void ECS::BeginSystemUpdate(BaseECSSystem* system)
+{
+	// Each system update gets its own version, so a system never sees its
+	// own writes as changes
+	m_changeVersion++;
+	system->m_changeVersion = m_changeVersion;
+}
+
+void ECS::EndSystemUpdate(BaseECSSystem* system)
+{
+	// Changes made after the update are newer than it
+	system->m_lastChangeVersion = system->m_changeVersion;
+	m_changeVersion++;
+}
+
+void ECS::UpdateSystemsParallel(ECSSystemList& systems, float deltaTime)
+{
+	// Build the dependency graph: a system must run after every earlier
+	// system it conflicts with. Systems are grouped into waves, where the
+	// systems within a wave are independent and run concurrently.
+	uint32 numSystems = (uint32) systems.Size();
+	m_systemWaves.resize(numSystems);
+	uint32 numWaves = 0;
+	for (uint32 i = 0; i < numSystems; i++)
+	{
+		uint32 wave = 0;
+		for (uint32 j = 0; j < i; j++)
+		{
+			if (!systems[i]->IsThreadSafe() || !systems[j]->IsThreadSafe() ||
+				systems[i]->ConflictsWith(*systems[j]))
+			{
+				wave = Math::Max(wave, m_systemWaves[j] + 1);
+			}
+		}
+		m_systemWaves[i] = wave;
+		numWaves = Math::Max(numWaves, wave + 1);
+	}
+
+	for (uint32 wave = 0; wave < numWaves; wave++)
+	{
+		// Split the entities of each system in this wave into tasks
+		bool isThreadSafe = true;
+		m_systemTasks.clear();
+		for (uint32 i = 0; i < numSystems; i++)
+		{
+			if (m_systemWaves[i] == wave)
+			{
+				isThreadSafe = isThreadSafe && systems[i]->IsThreadSafe();
+				BeginSystemUpdate(systems[i]);
+				GatherSystemTasks(systems[i], m_parallelGrainSize, m_systemTasks);
+			}
+		}
+
+		if (!isThreadSafe)
+		{
+			for (uint32 i = 0; i < m_systemTasks.size(); i++)
+			{
+				RunSystemTask(m_systemTasks[i], deltaTime,
+					m_threadComponentParams[0].data());
+			}
+		}
+		else
+		{
+			m_threadPool->ParallelFor((uint32) m_systemTasks.size(),
+				[&](uint32 index, uint32 threadIndex) {
+				RunSystemTask(m_systemTasks[index], deltaTime,
+					m_threadComponentParams[threadIndex].data());
+			});
+		}
+
+		AddSystemTaskStats();
+		for (uint32 i = 0; i < numSystems; i++)
+		{
+			if (m_systemWaves[i] == wave)
+				EndSystemUpdate(systems[i]);
+		}
+	}
+}
+
+void ECS::GatherSystemTasks(BaseECSSystem* system, uint32 grainSize,
+	Array<SystemTask>& outTasks)
+{
+	const ECSQuery& query = system->GetQuery();
+	SystemTask task;
+	task.system = system;
+	task.archetype = nullptr;
+	task.numProcessed = 0;
+	task.bytesTouched = 0;
+	task.milliseconds = 0.0;
+
+	if (m_storageMode == ECSStorageMode::k_archetypes)
+	{
+		// One task per chunk when splitting, otherwise per archetype
+		const Array<ECSArchetype*>& archetypes = query.GetArchetypes();
+		for (uint32 i = 0; i < archetypes.size(); i++)
+		{
+			ECSArchetype* archetype = archetypes[i];
+			if (archetype->size() == 0)
+				continue;
+			task.archetype = archetype;
+			uint32 chunkStep = (grainSize == (uint32) -1 ?
+				archetype->GetNumChunks() : 1);
+			for (uint32 chunk = 0; chunk < archetype->GetNumChunks(); chunk += chunkStep)
+			{
+				task.begin = chunk;
+				task.end = Math::Min(chunk + chunkStep, archetype->GetNumChunks());
+				outTasks.push_back(task);
+			}
+		}
+	}
+	else
+	{
+		const Array<uint32>& componentTypes = system->GetComponentTypes();
+		const Array<uint32>& componentFlags = system->GetComponentFlags();
+		uint32 count = query.GetNumRows();
+		if (count == 0)
+			return;
+
+		// Skip the system if none of the pools it filters on have changed
+		if (system->HasChangeFilter())
+		{
+			bool isChanged = false;
+			for (uint32 j = 0; j < componentTypes.size(); j++)
+			{
+				if ((componentFlags[j] & BaseECSSystem::FLAG_CHANGED) != 0 &&
+					IsChangeVersionNewer(m_components[componentTypes[j]]->m_version,
+						system->m_lastChangeVersion))
+					isChanged = true;
+			}
+			if (!isChanged)
+				return;
+		}
+
+		// The pools the system writes to are marked here rather than by the
+		// tasks, which only mark their own components
+		for (uint32 j = 0; j < componentTypes.size(); j++)
+		{
+			if ((componentFlags[j] & BaseECSSystem::FLAG_READ_ONLY) == 0)
+				m_components[componentTypes[j]]->m_version = system->m_changeVersion;
+		}
+
+		// Split the rows of the query
+		task.end = 0;
+		while (task.end < count)
+		{
+			task.begin = task.end;
+			task.end = (count - task.begin > grainSize ?
+				task.begin + grainSize : count);
+			outTasks.push_back(task);
+		}
+	}
+}
+
+void ECS::RunSystemTask(SystemTask& task, float delta,
+	BaseECSComponent** componentParam)
+{
+	Timer timer;
+	timer.Start();
+	if (task.archetype != nullptr)
+	{
+		task.numProcessed = UpdateSystemWithArchetype(task.system,
+			task.archetype, delta, task.begin, task.end, componentParam,
+			task.bytesTouched);
+	}
+	else
+	{
+		task.numProcessed = UpdateSystemWithComponentPools(task.system,
+			delta, task.begin, task.end, componentParam, task.bytesTouched);
+	}
+	task.milliseconds = timer.GetElapsedMilliseconds();
+}
+
+void ECS::AddSystemTaskStats()
+{
+	for (uint32 i = 0; i < m_systemTasks.size(); i++)
+	{
+		const SystemTask& task = m_systemTasks[i];
+		task.system->m_updateMilliseconds += task.milliseconds;
+		task.system->m_updateProcessed += task.numProcessed;
+		task.system->m_updateBytesTouched += task.bytesTouched;
+	}
+}
+
+// Returns true if any of an entity's components with FLAG_CHANGED is newer
+// than a version
+static bool IsRowChanged(ECSComponentPool** pools,
+	const ECSComponentPool::ComponentHandle* handles,
+	const Array<uint32>& componentFlags, uint32 sinceVersion)
+{
+	for (uint32 j = 0; j < componentFlags.size(); j++)
+	{
+		if ((componentFlags[j] & BaseECSSystem::FLAG_CHANGED) != 0 &&
+			handles[j] != ECSComponentPool::INVALID_HANDLE &&
+			IsChangeVersionNewer(pools[j]->GetVersion(handles[j]), sinceVersion))
+			return true;
+	}
+	return false;
+}
+
+uint32 ECS::UpdateSystemWithComponentPools(BaseECSSystem* system,
+	float delta, uint32 begin, uint32 end,
+	BaseECSComponent** componentParam, uint64& bytesTouched)
+{
+	if (system->IsBatched())
+	{
+		return UpdateSystemBatchesWithComponentPools(system, delta,
+			begin, end, componentParam, bytesTouched);
+	}
+
+	const ECSQuery& query = system->GetQuery();
+	const Array<uint32>& componentTypes = system->GetComponentTypes();
+	const Array<uint32>& componentFlags = system->GetComponentFlags();
+	uint32 numTypes = (uint32) componentTypes.size();
+	const uint32 maxTypes = 32;
+	CMG_ASSERT(numTypes <= maxTypes);
+	ECSComponentPool* pools[maxTypes];
+	uint32* writeVersions[maxTypes];
+	for (uint32 j = 0; j < numTypes; j++)
+	{
+		pools[j] = m_components[componentTypes[j]];
+		writeVersions[j] = ((componentFlags[j] & BaseECSSystem::FLAG_READ_ONLY) == 0 ?
+			pools[j]->GetVersions() : nullptr);
+	}
+	bool hasChangeFilter = system->HasChangeFilter();
+	uint32 version = system->m_changeVersion;
+	uint32 numProcessed = 0;
+	uint64 bytes = 0;
+
+	// Every row of the query is a matching entity
+	for (uint32 row = begin; row < end; row++)
+	{
+		const component_handle* handles = query.GetRowHandles(row);
+		if (hasChangeFilter && !IsRowChanged(pools, handles,
+			componentFlags, system->m_lastChangeVersion))
+			continue;
+
+		for (uint32 j = 0; j < numTypes; j++)
+		{
+			componentParam[j] = nullptr;
+			if (handles[j] != ECSComponentPool::INVALID_HANDLE)
+			{
+				componentParam[j] = pools[j]->GetComponent(handles[j]);
+				bytes += pools[j]->m_componentSize;
+				if (writeVersions[j] != nullptr)
+					writeVersions[j][handles[j]] = version;
+			}
+		}
+		system->UpdateComponents(delta, componentParam);
+		numProcessed++;
+	}
+	bytesTouched += bytes;
+	return numProcessed;
+}
+
+uint32 ECS::UpdateSystemBatchesWithComponentPools(BaseECSSystem* system,
+	float delta, uint32 begin, uint32 end,
+	BaseECSComponent** componentParam, uint64& bytesTouched)
+{
+	const ECSQuery& query = system->GetQuery();
+	const Array<uint32>& componentTypes = system->GetComponentTypes();
+	const Array<uint32>& componentFlags = system->GetComponentFlags();
+	uint32 numTypes = (uint32) componentTypes.size();
+	const uint32 maxTypes = 32;
+	CMG_ASSERT(numTypes <= maxTypes);
+	ECSComponentPool* pools[maxTypes];
+	uint32* writeVersions[maxTypes];
+	for (uint32 j = 0; j < numTypes; j++)
+	{
+		pools[j] = m_components[componentTypes[j]];
+		writeVersions[j] = ((componentFlags[j] & BaseECSSystem::FLAG_READ_ONLY) == 0 ?
+			pools[j]->GetVersions() : nullptr);
+	}
+	bool hasChangeFilter = system->HasChangeFilter();
+	uint32 sinceVersion = system->m_lastChangeVersion;
+	uint32 version = system->m_changeVersion;
+	uint32 numProcessed = 0;
+
+	uint32 row = begin;
+	while (row < end)
+	{
+		const component_handle* handles = query.GetRowHandles(row);
+		if (hasChangeFilter && !IsRowChanged(pools, handles,
+			componentFlags, sinceVersion))
+		{
+			row++;
+			continue;
+		}
+
+		// Extend the run while the handles of every type in the following
+		// rows are consecutive. Runs are capped so their components are still
+		// in cache for the update.
+		uint32 count = 1;
+		uint32 maxCount = Math::Min(end - row, MAX_BATCH_SIZE);
+		for (; count < maxCount; count++)
+		{
+			const component_handle* next = handles + (count * numTypes);
+			uint32 j = 0;
+			for (; j < numTypes; j++)
+			{
+				if (handles[j] == ECSComponentPool::INVALID_HANDLE ?
+					next[j] != ECSComponentPool::INVALID_HANDLE :
+					next[j] != handles[j] + count)
+					break;
+			}
+			if (j < numTypes || (hasChangeFilter &&
+				!IsRowChanged(pools, next, componentFlags, sinceVersion)))
+				break;
+		}
+
+		for (uint32 j = 0; j < numTypes; j++)
+		{
+			componentParam[j] = nullptr;
+			if (handles[j] != ECSComponentPool::INVALID_HANDLE)
+			{
+				componentParam[j] = pools[j]->GetComponent(handles[j]);
+				bytesTouched += (uint64) count * pools[j]->m_componentSize;
+				if (writeVersions[j] != nullptr)
+				{
+					std::fill(writeVersions[j] + handles[j],
+						writeVersions[j] + handles[j] + count, version);
+				}
+			}
+		}
+		system->UpdateComponentBatch(delta, count, componentParam);
+		numProcessed += count;
+		row += count;
+	}
+	return numProcessed;
+}
+
+// Returns true if any of the components with FLAG_CHANGED in a chunk row is
+// newer than a version. Missing columns have null versions.
+static bool IsChunkRowChanged(uint32** versions,
+	const Array<uint32>& componentFlags, uint32 row, uint32 sinceVersion)
+{
+	for (uint32 j = 0; j < componentFlags.size(); j++)
+	{
+		if ((componentFlags[j] & BaseECSSystem::FLAG_CHANGED) != 0 &&
+			versions[j] != nullptr &&
+			IsChangeVersionNewer(versions[j][row], sinceVersion))
+			return true;
+	}
+	return false;
+}
+
+uint32 ECS::UpdateSystemWithArchetype(BaseECSSystem* system,
+	ECSArchetype* archetype, float delta, uint32 chunkBegin, uint32 chunkEnd,
+	BaseECSComponent** componentParam, uint64& bytesTouched)
+{
+	const Array<uint32>& componentTypes = system->GetComponentTypes();
+	const Array<uint32>& componentFlags = system->GetComponentFlags();
+	uint32 numTypes = (uint32) componentTypes.size();
+	const uint32 maxTypes = 32;
+	CMG_ASSERT(numTypes <= maxTypes);
+	int32 columns[maxTypes];
+	uint8* columnData[maxTypes];
+	uint32 strides[maxTypes];
+	uint32* versions[maxTypes];
+	bool hasChangeFilter = system->HasChangeFilter();
+	uint32 sinceVersion = system->m_lastChangeVersion;
+	uint32 version = system->m_changeVersion;
+	uint32 numProcessed = 0;
+
+	// Missing optional components are passed as null
+	uint32 entityBytes = 0;
+	for (uint32 j = 0; j < numTypes; j++)
+	{
+		columns[j] = archetype->GetColumn(componentTypes[j]);
+		strides[j] = (columns[j] >= 0 ?
+			archetype->GetColumnStride(columns[j]) : 0);
+		entityBytes += strides[j];
+		componentParam[j] = nullptr;
+	}
+
+	// Walk each chunk linearly, column by column
+	for (uint32 chunk = chunkBegin; chunk < chunkEnd; chunk++)
+	{
+		// Skip chunks where none of the filtered columns have changed
+		if (hasChangeFilter)
+		{
+			bool isChanged = false;
+			for (uint32 j = 0; j < numTypes; j++)
+			{
+				if ((componentFlags[j] & BaseECSSystem::FLAG_CHANGED) != 0 &&
+					columns[j] >= 0 && IsChangeVersionNewer(
+						archetype->GetChunkVersion(chunk, columns[j]), sinceVersion))
+					isChanged = true;
+			}
+			if (!isChanged)
+				continue;
+		}
+
+		for (uint32 j = 0; j < numTypes; j++)
+		{
+			columnData[j] = nullptr;
+			versions[j] = nullptr;
+			if (columns[j] >= 0)
+			{
+				columnData[j] = archetype->GetChunkColumn(chunk, columns[j]);
+				versions[j] = archetype->GetChunkVersions(chunk, columns[j]);
+				if ((componentFlags[j] & BaseECSSystem::FLAG_READ_ONLY) == 0)
+					archetype->SetChunkVersion(chunk, columns[j], version);
+			}
+		}
+
+		uint32 count = archetype->GetChunkSize(chunk);
+		uint32 row = 0;
+		while (row < count)
+		{
+			// Find the next run of rows to update. Without a change filter,
+			// this is the whole chunk.
+			uint32 runEnd = count;
+			if (hasChangeFilter)
+			{
+				for (; row < count && !IsChunkRowChanged(versions,
+					componentFlags, row, sinceVersion); row++)
+				{
+				}
+				for (runEnd = row; runEnd < count && IsChunkRowChanged(
+					versions, componentFlags, runEnd, sinceVersion); runEnd++)
+				{
+				}
+				if (row == count)
+					break;
+			}
+
+			for (uint32 j = 0; j < numTypes; j++)
+			{
+				if (columnData[j] != nullptr &&
+					(componentFlags[j] & BaseECSSystem::FLAG_READ_ONLY) == 0)
+					std::fill(versions[j] + row, versions[j] + runEnd, version);
+			}
+
+			numProcessed += runEnd - row;
+			if (system->IsBatched())
+			{
+				// Each column of a chunk is already contiguous
+				for (uint32 j = 0; j < numTypes; j++)
+				{
+					componentParam[j] = (columnData[j] != nullptr ? (BaseECSComponent*)
+						(columnData[j] + (row * strides[j])) : nullptr);
+				}
+				system->UpdateComponentBatch(delta, runEnd - row, componentParam);
+			}
+			else
+			{
+				for (; row < runEnd; row++)
+				{
+					for (uint32 j = 0; j < numTypes; j++)
+					{
+						if (columnData[j] != nullptr)
+						{
+							componentParam[j] = (BaseECSComponent*)
+								(columnData[j] + (row * strides[j]));
+						}
+					}
+					system->UpdateComponents(delta, componentParam);
+				}
+			}
+			row = runEnd;
+		}
+	}
+	bytesTouched += (uint64) numProcessed * entityBytes;
+	return numProcessed;
+}
+
+ECSCommandBuffer& ECS::GetCommandBuffer()
+{
+	uint32 threadIndex = ThreadPool::GetCurrentThreadIndex();
+	CMG_ASSERT(threadIndex < m_commandBuffers.size() ||
+		(threadIndex == 0 && m_commandBuffers.empty()));
+	if (m_commandBuffers.empty())
+		m_commandBuffers.push_back(new ECSCommandBuffer());
+	return *m_commandBuffers[threadIndex];
+}
+
+void ECS::PlaybackCommandBuffers()
+{
+	if (!m_commandBuffers.empty())
+		PlaybackCommands(m_commandBuffers.data(), (uint32) m_commandBuffers.size());
+}
+
+void ECS::PlaybackCommandBuffer(ECSCommandBuffer& commandBuffer)
+{
+	ECSCommandBuffer* commandBuffers[] = { &commandBuffer };
+	PlaybackCommands(commandBuffers, 1);
+}
+
+EntityHandle ECS::ResolveCommandEntity(EntityHandle entity, uint32 pendingOffset)
+{
+	if (ECSCommandBuffer::IsPendingEntity(entity))
+		return m_playbackEntities[pendingOffset + entity.index - 1];
+	return entity;
+}
+
+void ECS::PlaybackCommands(ECSCommandBuffer** commandBuffers, uint32 count)
+{
+	typedef ECSCommandBuffer::Command Command;
+	typedef ECSCommandBuffer::CommandType CommandType;
+
+	// Create the pending entities first, so the other commands can refer to
+	// them. Each buffer's pending entities start at its own offset.
+	m_playbackEntities.clear();
+	m_playbackCommands.clear();
+	for (uint32 i = 0; i < count; i++)
+	{
+		ECSCommandBuffer* commandBuffer = commandBuffers[i];
+		uint32 pendingOffset = (uint32) m_playbackEntities.size();
+		for (uint32 j = 0; j < commandBuffer->m_commands.size(); j++)
+		{
+			if (commandBuffer->m_commands[j].type == CommandType::k_createEntity)
+				m_playbackEntities.push_back(CreateEntity());
+		}
+
+		for (uint32 j = 0; j < commandBuffer->m_commands.size(); j++)
+		{
+			Command command = commandBuffer->m_commands[j];
+			if (command.type == CommandType::k_addComponent ||
+				command.type == CommandType::k_removeComponent)
+			{
+				command.entity = ResolveCommandEntity(command.entity, pendingOffset);
+				m_playbackCommands.push_back(command);
+			}
+		}
+	}
+
+	// Group component commands by type, keeping the recorded order within
+	// each type, so that each pool only has to grow once
+	std::stable_sort(m_playbackCommands.begin(), m_playbackCommands.end(),
+		[](const Command& a, const Command& b) {
+		return (a.componentId < b.componentId);
+	});
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		for (uint32 i = 0; i < m_playbackCommands.size(); )
+		{
+			uint32 componentId = m_playbackCommands[i].componentId;
+			uint32 numAdded = 0;
+			for (; i < m_playbackCommands.size() &&
+				m_playbackCommands[i].componentId == componentId; i++)
+			{
+				if (m_playbackCommands[i].type == CommandType::k_addComponent)
+					numAdded++;
+			}
+			GetComponentPool(componentId)->Grow(
+				GetComponentPool(componentId)->size() + numAdded);
+		}
+	}
+
+	// Commands for entities that no longer exist are ignored
+	for (uint32 i = 0; i < m_playbackCommands.size(); i++)
+	{
+		const Command& command = m_playbackCommands[i];
+		if (!IsEntityValid(command.entity))
+			continue;
+		if (command.type == CommandType::k_addComponent)
+			AddComponentInternal(command.entity, command.componentId, command.component);
+		else
+			RemoveComponentInternal(command.entity, command.componentId);
+	}
+
+	// Remove entities last
+	uint32 pendingOffset = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		ECSCommandBuffer* commandBuffer = commandBuffers[i];
+		for (uint32 j = 0; j < commandBuffer->m_commands.size(); j++)
+		{
+			const Command& command = commandBuffer->m_commands[j];
+			if (command.type == CommandType::k_removeEntity)
+			{
+				EntityHandle entity = ResolveCommandEntity(command.entity, pendingOffset);
+				if (IsEntityValid(entity))
+					RemoveEntity(entity);
+			}
+		}
+		pendingOffset += commandBuffer->m_numPendingEntities;
+		commandBuffer->Clear();
+	}
+	m_playbackCommands.clear();
+}
+
+bool ECS::IsEntityValid(EntityHandle handle) const
+{
+	return (handle.index < m_entities.size() &&
+		m_entities[handle.index].generation == handle.generation &&
+		m_entities[handle.index].isAlive);
+}
+
+ECSEntity* ECS::GetEntity(EntityHandle handle)
+{
+	CMG_ASSERT(IsEntityValid(handle));
+	return &m_entities[handle.index];
+}
+
+EntityHandle ECS::AllocateEntity()
+{
+	// Reuse a free slot if there is one
+	EntityHandle handle;
+	if (m_freeEntities != NO_FREE_ENTITY)
+	{
+		handle.index = m_freeEntities;
+		m_freeEntities = m_entities[handle.index].nextFree;
+	}
+	else
+	{
+		handle.index = (uint32) m_entities.size();
+		ECSEntity slot;
+		slot.generation = 1;
+		m_entities.push_back(slot);
+	}
+
+	ECSEntity& entity = m_entities[handle.index];
+	entity.isAlive = true;
+	entity.nextFree = NO_FREE_ENTITY;
+	entity.archetype = nullptr;
+	entity.archetypeIndex = 0;
+	handle.generation = entity.generation;
+	m_numEntities++;
+	return handle;
+}
+
+ECSComponentPool* ECS::GetComponentPool(uint32 componentId)
+{
+	if (componentId >= m_components.size())
+		m_components.resize(componentId + 1, nullptr);
+	if (m_components[componentId] == nullptr)
+		m_components[componentId] = new ECSComponentPool(componentId);
+	return m_components[componentId];
+}
+
+EntityHandle ECS::CreateEntity()
+{
+	EntityHandle handle = AllocateEntity();
+	if (m_storageMode == ECSStorageMode::k_archetypes)
+	{
+		ECSEntity& entity = m_entities[handle.index];
+		entity.archetype = GetArchetype(Array<uint32>());
+		entity.archetypeIndex = entity.archetype->Allocate(handle);
+	}
+	return handle;
+}
+
+EntityHandle ECS::CreateEntity(const BaseECSComponent* components,
+	const uint32* componentIds, size_t numComponents)
+{
+	Array<const BaseECSComponent*> componentList(numComponents);
+	for (uint32 i = 0; i < numComponents; i++)
+		componentList[i] = components + i;
+	return CreateEntityInternal(componentList.data(),
+		componentIds, numComponents);
+}
+
+EntityHandle ECS::CreateEntityInternal(const BaseECSComponent** components,
+	const uint32* componentIds, size_t numComponents)
+{
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		EntityHandle handle = AllocateEntity();
+
+		// Construct the components for the entity
+		for (uint32 i = 0; i < numComponents; i++)
+		{
+			CMG_ASSERT(BaseECSComponent::IsTypeValid(componentIds[i]));
+			DoCreateComponent(handle, componentIds[i], components[i]);
+		}
+		return handle;
+	}
+
+	// Place the entity directly into its final archetype
+	Array<uint32> componentTypes(componentIds, componentIds + numComponents);
+	std::sort(componentTypes.begin(), componentTypes.end());
+	componentTypes.erase(std::unique(componentTypes.begin(),
+		componentTypes.end()), componentTypes.end());
+	ECSArchetype* archetype = GetArchetype(componentTypes);
+
+	EntityHandle handle = AllocateEntity();
+	ECSEntity& entity = m_entities[handle.index];
+	entity.archetype = archetype;
+	entity.archetypeIndex = archetype->Allocate(handle);
+
+	// Construct each column, letting later duplicates win
+	for (uint32 column = 0; column < componentTypes.size(); column++)
+	{
+		const BaseECSComponent* source = nullptr;
+		for (uint32 i = 0; i < numComponents; i++)
+		{
+			if (componentIds[i] == componentTypes[column])
+				source = components[i];
+		}
+		BaseECSComponent* component = archetype->GetComponent(
+			entity.archetypeIndex, column);
+		archetype->m_createFunctions[column](component, source);
+		component->entity = handle;
+		archetype->MarkChanged(entity.archetypeIndex, column, m_changeVersion);
+	}
+	return handle;
+}
+
+EntityHandle ECS::Instantiate(const ECSPrefab& prefab)
+{
+	EntityHandle entity;
+	InstantiateInternal(prefab, &entity, 1);
+	return entity;
+}
+
+uint32 ECS::Instantiate(const ECSPrefab& prefab, uint32 count,
+	Array<EntityHandle>& outEntities)
+{
+	uint32 first = (uint32) outEntities.size();
+	outEntities.resize(first + count);
+	InstantiateInternal(prefab, outEntities.data() + first, count);
+	return first;
+}
+
+void ECS::InstantiateInternal(const ECSPrefab& prefab, EntityHandle* entities,
+	uint32 count)
+{
+	for (uint32 i = 0; i < count; i++)
+		entities[i] = AllocateEntity();
+
+	const Array<uint32>& componentTypes = prefab.GetComponentTypes();
+	uint32 numTypes = prefab.GetNumComponents();
+	if (m_storageMode == ECSStorageMode::k_archetypes)
+	{
+		// Every entity goes into the same archetype, whose columns are in
+		// the same order as the prefab's components
+		ECSArchetype* archetype = GetArchetype(componentTypes);
+		const uint32 maxTypes = 32;
+		CMG_ASSERT(numTypes <= maxTypes);
+		bool isTriviallyRelocatable[maxTypes];
+		for (uint32 column = 0; column < numTypes; column++)
+		{
+			isTriviallyRelocatable[column] =
+				BaseECSComponent::IsTypeTriviallyRelocatable(componentTypes[column]);
+		}
+
+		uint32 chunkCapacity = archetype->GetChunkCapacity();
+		for (uint32 i = 0; i < count; i++)
+		{
+			ECSEntity& entity = m_entities[entities[i].index];
+			entity.archetype = archetype;
+			entity.archetypeIndex = archetype->Allocate(entities[i]);
+			uint32 chunk = entity.archetypeIndex / chunkCapacity;
+			uint32 row = entity.archetypeIndex % chunkCapacity;
+			for (uint32 column = 0; column < numTypes; column++)
+			{
+				uint32 stride = archetype->GetColumnStride(column);
+				BaseECSComponent* component = (BaseECSComponent*)
+					(archetype->GetChunkColumn(chunk, column) + (row * stride));
+				if (isTriviallyRelocatable[column])
+					memcpy(component, prefab.GetComponentByIndex(column), stride);
+				else
+					archetype->m_createFunctions[column](component, prefab.GetComponentByIndex(column));
+				component->entity = entities[i];
+				archetype->GetChunkVersions(chunk, column)[row] = m_changeVersion;
+				archetype->SetChunkVersion(chunk, column, m_changeVersion);
+			}
+		}
+		return;
+	}
+
+	for (uint32 j = 0; j < numTypes; j++)
+	{
+		GetComponentPool(componentTypes[j])->CreateComponents(entities, count,
+			prefab.GetComponentByIndex(j), m_changeVersion);
+	}
+
+	// Either all or none of the new entities match each query
+	for (uint32 i = 0; i < m_queries.size(); i++)
+	{
+		ECSQuery* query = m_queries[i];
+		uint32 j = 0;
+		for (; j < query->m_componentTypes.size(); j++)
+		{
+			if ((query->m_componentFlags[j] & BaseECSSystem::FLAG_OPTIONAL) == 0 &&
+				!std::binary_search(componentTypes.begin(),
+					componentTypes.end(), query->m_componentTypes[j]))
+				break;
+		}
+		if (j < query->m_componentTypes.size())
+			continue;
+		for (uint32 k = 0; k < count; k++)
+			AddQueryRow(*query, entities[k].index);
+		query->m_numRowsAdded += count;
+	}
+}
+
+void ECS::ClearEntities()
+{
+	for (uint32 i = 0; i < m_entities.size(); i++)
+	{
+		if (m_entities[i].isAlive)
+		{
+			EntityHandle handle;
+			handle.index = i;
+			handle.generation = m_entities[i].generation;
+			RemoveEntity(handle);
+		}
+	}
+}
+
+void ECS::RemoveEntity(EntityHandle handle)
+{
+	ECSEntity* entity = GetEntity(handle);
+
+	// Delete all the entity's components from memory
+	if (entity->archetype != nullptr)
+	{
+		ECSArchetype* archetype = entity->archetype;
+		for (uint32 i = 0; i < archetype->GetNumColumns(); i++)
+		{
+			archetype->m_freeFunctions[i](archetype->GetComponent(
+				entity->archetypeIndex, i));
+		}
+		RemoveEntityFromArchetype(entity);
+	}
+	for (uint32 i = 0; i < m_components.size(); i++)
+	{
+		if (m_components[i] != nullptr)
+			DoRemoveComponent(handle, i);
+	}
+
+	// Recycle the slot. Generation zero is reserved for null handles.
+	entity->isAlive = false;
+	entity->generation++;
+	if (entity->generation == 0)
+		entity->generation = 1;
+	entity->nextFree = m_freeEntities;
+	m_freeEntities = handle.index;
+	m_numEntities--;
+}
+
+void ECS::AddComponentInternal(EntityHandle handle, uint32 componentId,
+	const BaseECSComponent* component)
+{
+	ECSEntity* entity = GetEntity(handle);
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		DoCreateComponent(handle, componentId, component);
+		return;
+	}
+
+	// An archetype holds one component per type, so replace an existing one
+	ECSArchetype* archetype = entity->archetype;
+	int32 column = archetype->GetColumn(componentId);
+	if (column < 0)
+	{
+		MoveEntityToArchetype(handle,
+			GetArchetypeWith(archetype, componentId));
+		archetype = entity->archetype;
+		column = archetype->GetColumn(componentId);
+	}
+	else
+	{
+		// Replacing a component with itself leaves it as it is, and freeing
+		// it first would leave nothing to copy from.
+		BaseECSComponent* existing = archetype->GetComponent(
+			entity->archetypeIndex, column);
+		if (existing == component)
+		{
+			archetype->MarkChanged(entity->archetypeIndex, column, m_changeVersion);
+			return;
+		}
+		archetype->m_freeFunctions[column](existing);
+	}
+	BaseECSComponent* newComponent = archetype->GetComponent(
+		entity->archetypeIndex, column);
+	archetype->m_createFunctions[column](newComponent, component);
+	newComponent->entity = handle;
+	archetype->MarkChanged(entity->archetypeIndex, column, m_changeVersion);
+}
+
+void ECS::RemoveComponentInternal(EntityHandle handle, uint32 componentId)
+{
+	ECSEntity* entity = GetEntity(handle);
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		if (componentId < m_components.size() &&
+			m_components[componentId] != nullptr)
+			DoRemoveComponent(handle, componentId);
+		return;
+	}
+
+	ECSArchetype* archetype = entity->archetype;
+	int32 column = archetype->GetColumn(componentId);
+	if (column >= 0)
+	{
+		archetype->m_freeFunctions[column](
+			archetype->GetComponent(entity->archetypeIndex, column));
+		MoveEntityToArchetype(handle,
+			GetArchetypeWithout(archetype, componentId));
+	}
+}
+
+BaseECSComponent* ECS::FindComponent(EntityHandle handle, uint32 componentId,
+	bool markChanged)
+{
+	if (!IsEntityValid(handle))
+		return nullptr;
+
+	ECSEntity& entity = m_entities[handle.index];
+	if (entity.archetype != nullptr)
+	{
+		int32 column = entity.archetype->GetColumn(componentId);
+		if (column < 0)
+			return nullptr;
+		if (markChanged)
+			entity.archetype->MarkChanged(entity.archetypeIndex, column, m_changeVersion);
+		return entity.archetype->GetComponent(entity.archetypeIndex, column);
+	}
+
+	if (componentId >= m_components.size() ||
+		m_components[componentId] == nullptr)
+		return nullptr;
+	ECSComponentPool* pool = m_components[componentId];
+	component_handle componentHandle = pool->FindHandle(handle.index);
+	if (componentHandle == ECSComponentPool::INVALID_HANDLE)
+		return nullptr;
+	if (markChanged)
+		pool->MarkChanged(componentHandle, m_changeVersion);
+	return pool->GetComponent(componentHandle);
+}
+
+uint32 ECS::FindComponentVersion(EntityHandle handle, uint32 componentId)
+{
+	if (!IsEntityValid(handle))
+		return 0;
+
+	ECSEntity& entity = m_entities[handle.index];
+	if (entity.archetype != nullptr)
+	{
+		int32 column = entity.archetype->GetColumn(componentId);
+		if (column < 0)
+			return 0;
+		return entity.archetype->GetVersion(entity.archetypeIndex, column);
+	}
+
+	if (componentId >= m_components.size() ||
+		m_components[componentId] == nullptr)
+		return 0;
+	component_handle componentHandle =
+		m_components[componentId]->FindHandle(handle.index);
+	if (componentHandle == ECSComponentPool::INVALID_HANDLE)
+		return 0;
+	return m_components[componentId]->GetVersion(componentHandle);
+}
+
+ECSArchetype* ECS::GetArchetype(const Array<uint32>& componentTypes)
+{
+	auto it = m_archetypeMap.find(componentTypes);
+	if (it != m_archetypeMap.end())
+		return it->second;
+	ECSArchetype* archetype = new ECSArchetype(componentTypes);
+	m_archetypes.push_back(archetype);
+	m_archetypeMap[componentTypes] = archetype;
+
+	// Add the new archetype to the queries it matches
+	for (uint32 i = 0; i < m_queries.size(); i++)
+	{
+		ECSQuery* query = m_queries[i];
+		if (archetype->HasComponentTypes(query->m_componentTypes,
+			query->m_componentFlags, BaseECSSystem::FLAG_OPTIONAL))
+			query->m_archetypes.push_back(archetype);
+	}
+	return archetype;
+}
+
+ECSArchetype* ECS::GetArchetypeWith(ECSArchetype* archetype, uint32 componentId)
+{
+	auto it = archetype->m_addEdges.find(componentId);
+	if (it != archetype->m_addEdges.end())
+		return it->second;
+
+	Array<uint32> componentTypes = archetype->GetComponentTypes();
+	componentTypes.insert(std::upper_bound(componentTypes.begin(),
+		componentTypes.end(), componentId), componentId);
+	ECSArchetype* result = GetArchetype(componentTypes);
+	archetype->m_addEdges[componentId] = result;
+	result->m_removeEdges[componentId] = archetype;
+	return result;
+}
+
+ECSArchetype* ECS::GetArchetypeWithout(ECSArchetype* archetype, uint32 componentId)
+{
+	auto it = archetype->m_removeEdges.find(componentId);
+	if (it != archetype->m_removeEdges.end())
+		return it->second;
+
+	Array<uint32> componentTypes = archetype->GetComponentTypes();
+	cmg::container::EraseIfFound(componentTypes, componentId);
+	ECSArchetype* result = GetArchetype(componentTypes);
+	archetype->m_removeEdges[componentId] = result;
+	result->m_addEdges[componentId] = archetype;
+	return result;
+}
+
+void ECS::MoveEntityToArchetype(EntityHandle handle, ECSArchetype* archetype)
+{
+	// Relocate the components shared by both archetypes. Columns only in the
+	// destination are left unconstructed, and columns only in the source
+	// must have already been destroyed.
+	ECSEntity* entity = &m_entities[handle.index];
+	ECSArchetype* source = entity->archetype;
+	uint32 sourceIndex = entity->archetypeIndex;
+	uint32 index = archetype->Allocate(handle);
+	for (uint32 i = 0; i < archetype->GetNumColumns(); i++)
+	{
+		int32 sourceColumn = source->GetColumn(archetype->m_componentTypes[i]);
+		if (sourceColumn >= 0)
+		{
+			BaseECSComponent::RelocateComponents(archetype->m_componentTypes[i],
+				archetype->GetComponent(index, i),
+				source->GetComponent(sourceIndex, sourceColumn), 1);
+			archetype->MarkChanged(index, i,
+				source->GetVersion(sourceIndex, sourceColumn));
+		}
+	}
+	RemoveEntityFromArchetype(entity);
+	entity->archetype = archetype;
+	entity->archetypeIndex = index;
+}
+
+void ECS::RemoveEntityFromArchetype(ECSEntity* entity)
+{
+	EntityHandle moved = entity->archetype->Deallocate(entity->archetypeIndex);
+	if (moved != NULL_ENTITY_HANDLE)
+		m_entities[moved.index].archetypeIndex = entity->archetypeIndex;
+	entity->archetype = nullptr;
+	entity->archetypeIndex = 0;
+}
+
+void ECS::DoCreateComponent(EntityHandle entity, uint32 componentId,
+	const BaseECSComponent* component)
 {
+	ECSComponentPool* pool = GetComponentPool(componentId);
+	component_handle handle = pool->FindHandle(entity.index);
+	if (handle != ECSComponentPool::INVALID_HANDLE)
+	{
+		// Replace the existing component in place, unless it is being
+		// replaced with itself
+		BaseECSComponent* existing = pool->GetComponent(handle);
+		if (existing != component)
+		{
+			pool->m_componentFreeFunc(existing);
+			pool->m_componentCreateFunc(existing, component);
+			existing->entity = entity;
+		}
+		pool->MarkChanged(handle, m_changeVersion);
+		return;
+	}
+
+	handle = pool->CreateComponent(entity, component, m_changeVersion);
+
+	// Add the entity to the queries it now matches, or fill in its optional
+	// component for queries it already matched
+	if (componentId < m_queriesByType.size())
+	{
+		const Array<ECSQuery*>& queries = m_queriesByType[componentId];
+		for (uint32 i = 0; i < queries.size(); i++)
+		{
+			ECSQuery* query = queries[i];
+			uint32 row = query->FindRow(entity.index);
+			if (row != ECSQuery::INVALID_ROW)
+				SetQueryHandle(*query, row, componentId, handle);
+			else if (AddQueryRow(*query, entity.index))
+				query->m_numRowsAdded++;
+		}
+	}
 }
 
-ECS& ECSEntity::GetECS()
+void ECS::DoRemoveComponent(EntityHandle entity, uint32 componentId)
 {
-	return m_ecs;
+	ECSComponentPool* pool = m_components[componentId];
+	component_handle handle = pool->FindHandle(entity.index);
+	if (handle == ECSComponentPool::INVALID_HANDLE)
+		return;
+	if (componentId >= m_queriesByType.size() ||
+		m_queriesByType[componentId].empty())
+	{
+		pool->DeleteComponent(handle);
+		return;
+	}
+
+	// The entity no longer matches queries that require the component
+	const Array<ECSQuery*>& queries = m_queriesByType[componentId];
+	for (uint32 i = 0; i < queries.size(); i++)
+	{
+		ECSQuery* query = queries[i];
+		uint32 row = query->FindRow(entity.index);
+		if (row == ECSQuery::INVALID_ROW)
+			continue;
+		uint32 j = 0;
+		for (; j < query->m_componentTypes.size(); j++)
+		{
+			if (query->m_componentTypes[j] == componentId &&
+				(query->m_componentFlags[j] & BaseECSSystem::FLAG_OPTIONAL) == 0)
+				break;
+		}
+		if (j < query->m_componentTypes.size())
+		{
+			query->RemoveRow(row);
+			query->m_numRowsRemoved++;
+		}
+		else
+		{
+			SetQueryHandle(*query, row, componentId,
+				ECSComponentPool::INVALID_HANDLE);
+		}
+	}
+
+	// The pool moves its last component into the deleted one's place
+	component_handle lastHandle = pool->size() - 1;
+	uint32 movedEntityIndex = pool->GetComponent(lastHandle)->entity.index;
+	pool->DeleteComponent(handle);
+	if (lastHandle != handle)
+	{
+		for (uint32 i = 0; i < queries.size(); i++)
+		{
+			uint32 row = queries[i]->FindRow(movedEntityIndex);
+			if (row != ECSQuery::INVALID_ROW)
+				SetQueryHandle(*queries[i], row, componentId, handle);
+		}
+	}
 }
 
-const ECS& ECSEntity::GetECS() const
+void ECS::RegisterQuery(BaseECSSystem* system)
 {
-	return m_ecs;
+	ECSQuery& query = system->GetQuery();
+	if (query.m_ecs == this)
+		return;
+
+	// A system moved to another ECS has to rebuild its query
+	if (query.m_ecs != nullptr)
+		query.m_ecs->UnregisterQuery(&query);
+	query.m_ecs = this;
+	query.m_componentTypes = system->GetComponentTypes();
+	query.m_componentFlags = system->GetComponentFlags();
+	m_queries.push_back(&query);
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		for (uint32 j = 0; j < query.m_componentTypes.size(); j++)
+		{
+			uint32 componentId = query.m_componentTypes[j];
+			if (componentId >= m_queriesByType.size())
+				m_queriesByType.resize(componentId + 1);
+			Array<ECSQuery*>& queries = m_queriesByType[componentId];
+			if (queries.empty() || queries.back() != &query)
+				queries.push_back(&query);
+		}
+	}
+	BuildQuery(query);
 }
 
-ECS::ECS()
+void ECS::UnregisterQuery(ECSQuery* query)
 {
+	cmg::container::EraseIfFound(m_queries, query);
+	for (uint32 j = 0; j < query->m_componentTypes.size(); j++)
+	{
+		uint32 componentId = query->m_componentTypes[j];
+		if (componentId < m_queriesByType.size())
+			cmg::container::EraseIfFound(m_queriesByType[componentId], query);
+	}
+	query->m_ecs = nullptr;
+	query->Clear();
 }
 
-ECS::~ECS()
+void ECS::BuildQuery(ECSQuery& query)
 {
-	// Delete all component pools
-	for (auto it = m_components.begin(); it != m_components.end(); ++it)
-		delete it->second;
-	m_components.clear();
+	query.Clear();
+	query.m_numRebuilds++;
 
-	// Delete all entities
-	for (uint32 i = 0; i < m_entities.size(); i++)
-		delete m_entities[i];
-	m_entities.clear();
+	if (m_storageMode == ECSStorageMode::k_archetypes)
+	{
+		for (uint32 i = 0; i < m_archetypes.size(); i++)
+		{
+			if (m_archetypes[i]->HasComponentTypes(query.m_componentTypes,
+				query.m_componentFlags, BaseECSSystem::FLAG_OPTIONAL))
+				query.m_archetypes.push_back(m_archetypes[i]);
+		}
+		return;
+	}
+
+	// Scan the smallest pool for matching entities
+	uint32 primaryIndex = FindLeastCommonComponent(
+		query.m_componentTypes, query.m_componentFlags);
+	CMG_ASSERT(primaryIndex != (uint32) -1);
+	ECSComponentPool* pool = m_components[query.m_componentTypes[primaryIndex]];
+	for (uint32 i = 0; i < pool->size(); i++)
+		AddQueryRow(query, pool->GetComponent(i)->entity.index);
 }
 
-BaseECSComponent* ECS::GetComponentInternal(ECSEntity& entity,
-	ECSComponentPool* pool, uint32 componentID)
+bool ECS::AddQueryRow(ECSQuery& query, uint32 entityIndex)
 {
-	for (uint32 i = 0; i < entity.components.size(); i++)
+	// The entity must have every required component
+	uint32 numTypes = (uint32) query.m_componentTypes.size();
+	for (uint32 j = 0; j < numTypes; j++)
 	{
-		if (entity.components[i].id == componentID)
-			return pool->GetComponent(entity.components[i].handle);
+		if ((query.m_componentFlags[j] & BaseECSSystem::FLAG_OPTIONAL) == 0 &&
+			m_components[query.m_componentTypes[j]]->FindHandle(entityIndex) ==
+				ECSComponentPool::INVALID_HANDLE)
+			return false;
 	}
-	return nullptr;
+
+	ECSQuery::ComponentHandle* handles = query.AddRow(entityIndex);
+	for (uint32 j = 0; j < numTypes; j++)
+		handles[j] = m_components[query.m_componentTypes[j]]->FindHandle(entityIndex);
+	return true;
 }
 
-void ECS::UpdateSystems(ECSSystemList& systems, float deltaTime)
+void ECS::SetQueryHandle(ECSQuery& query, uint32 row, uint32 componentId,
+	component_handle handle)
 {
-	Array<BaseECSComponent*> componentParam;
-	Array<ECSComponentPool*> componentPools;
-	for (uint32 i = 0; i < systems.Size(); i++)
+	uint32 numTypes = (uint32) query.m_componentTypes.size();
+	for (uint32 j = 0; j < numTypes; j++)
 	{
-		systems[i]->PreUpdate(deltaTime);
+		if (query.m_componentTypes[j] == componentId)
+			query.m_handles[(row * numTypes) + j] = handle;
 	}
-	for (uint32 i = 0; i < systems.Size(); i++)
+}
+
+void ECS::SwapPoolComponents(uint32 componentId, component_handle a,
+	component_handle b)
+{
+	ECSComponentPool* pool = m_components[componentId];
+	uint32 entityA = pool->GetComponent(a)->entity.index;
+	uint32 entityB = pool->GetComponent(b)->entity.index;
+	pool->SwapComponents(a, b);
+
+	const Array<ECSQuery*>& queries = m_queriesByType[componentId];
+	for (uint32 i = 0; i < queries.size(); i++)
 	{
-		const Array<uint32>& componentTypes = systems[i]->GetComponentTypes();
+		uint32 row = queries[i]->FindRow(entityA);
+		if (row != ECSQuery::INVALID_ROW)
+			SetQueryHandle(*queries[i], row, componentId, b);
+		row = queries[i]->FindRow(entityB);
+		if (row != ECSQuery::INVALID_ROW)
+			SetQueryHandle(*queries[i], row, componentId, a);
+	}
+}
 
-		// Verify each component type for this system has a pool created
-		for (uint32 j = 0; j < componentTypes.size(); j++)
-		{
-			if (m_components.find(componentTypes[j]) == m_components.end())
-				m_components[componentTypes[j]] = new ECSComponentPool(componentTypes[j]);
-		}
+bool ECS::CoSortComponents(BaseECSSystem& system, double budgetMilliseconds)
+{
+	// Rows are placed in slices, checking the time budget between them
+	static const uint32 SLICE_SIZE = 256;
+
+	if (m_storageMode != ECSStorageMode::k_componentPools)
+		return true;
+	RegisterQuery(&system);
+	ECSQuery& query = system.GetQuery();
+	uint32 numTypes = (uint32) query.m_componentTypes.size();
+	uint32 primary = 0;
+	while (primary < numTypes &&
+		(query.m_componentFlags[primary] & BaseECSSystem::FLAG_OPTIONAL) != 0)
+		primary++;
+	CMG_ASSERT(primary < numTypes);
+
+	Timer timer;
+	timer.Start();
 
-		if (componentTypes.size() == 1)
+	// Start a pass by putting the rows in the primary pool's order. Rows
+	// added since then are placed when the pass reaches them, and rows
+	// removed may leave the order imperfect until the next pass.
+	uint32 numRows = query.GetNumRows();
+	if (query.m_coSortRow == 0 || query.m_coSortRow > numRows)
+	{
+		query.SortRows(primary,
+			m_components[query.m_componentTypes[primary]]->size());
+		query.m_coSortRow = 0;
+		query.m_coSortSlots.assign(numTypes, 0);
+	}
+
+	// Move each row's secondary components into the next slot of their pool
+	while (query.m_coSortRow < numRows)
+	{
+		uint32 end = Math::Min(query.m_coSortRow + SLICE_SIZE, numRows);
+		for (uint32 row = query.m_coSortRow; row < end; row++)
 		{
-			ECSComponentPool* pool = m_components[componentTypes[0]];
-			for (uint32 j = 0; j < pool->size(); j++)
+			for (uint32 j = 0; j < numTypes; j++)
 			{
-				BaseECSComponent* component = pool->GetComponent(j);
-				systems[i]->UpdateComponents(deltaTime, &component);
+				component_handle handle = query.m_handles[(row * numTypes) + j];
+				if (j == primary || handle == ECSComponentPool::INVALID_HANDLE)
+					continue;
+				uint32 componentId = query.m_componentTypes[j];
+				uint32 slot = query.m_coSortSlots[j]++;
+				if (slot >= m_components[componentId]->size())
+				{
+					// Components were removed mid-pass, so start over
+					query.m_coSortRow = 0;
+					return false;
+				}
+				if (handle != slot)
+					SwapPoolComponents(componentId, handle, slot);
 			}
 		}
-		else
-		{
-			UpdateSystemWithMultipleComponents(i, systems, deltaTime,
-				componentTypes, componentParam, componentPools);
-		}
+		query.m_coSortRow = end;
+		if (timer.GetElapsedMilliseconds() >= budgetMilliseconds)
+			break;
 	}
-	for (uint32 i = 0; i < systems.Size(); i++)
+	if (query.m_coSortRow < numRows)
+		return false;
+	query.m_coSortRow = 0;
+	return true;
+}
+
+// Snapshot layout, in order:
+//   SnapshotHeader
+//   A SnapshotEntity for each entity slot
+//   With component pools, a block for each non-empty pool: a SnapshotPool,
+//     the pool's sparse array, then its components
+//   With archetypes, a block for each non-empty archetype: a
+//     SnapshotArchetype, a SnapshotComponentType for each column, the entity
+//     handles, then the components of each column in turn
+// Trivially copyable components are stored as raw bytes. Other components
+// are written by their type's save function, one at a time, preceded by
+// their entity handle when stored in a pool.
+static const uint32 SNAPSHOT_MAGIC = 0x53534345; // "ECSS"
+static const uint32 SNAPSHOT_FORMAT_VERSION = 1;
+
+struct SnapshotHeader
+{
+	uint32 magic;
+	uint32 formatVersion;
+	uint32 storageMode;
+	uint32 numSlots;
+	uint32 freeEntities;
+	uint32 numEntities;
+	uint32 numBlocks;
+};
+
+struct SnapshotEntity
+{
+	uint32 generation;
+	uint32 nextFree;
+	uint32 isAlive;
+};
+
+struct SnapshotPool
+{
+	uint32 componentId;
+	uint32 componentSize;
+	uint32 count;
+	uint32 sparseSize;
+};
+
+struct SnapshotArchetype
+{
+	uint32 numTypes;
+	uint32 count;
+};
+
+struct SnapshotComponentType
+{
+	uint32 componentId;
+	uint32 componentSize;
+};
+
+static bool CanSnapshotComponentType(uint32 componentId)
+{
+	return (BaseECSComponent::IsTypeTriviallyCopyable(componentId) ||
+		(BaseECSComponent::GetTypeSaveFunction(componentId) != nullptr &&
+		BaseECSComponent::GetTypeLoadFunction(componentId) != nullptr));
+}
+
+static void SaveComponents(ECSSnapshotWriter& writer, uint32 componentId,
+	const uint8* components, uint32 count, uint32 stride, bool saveEntities)
+{
+	if (BaseECSComponent::IsTypeTriviallyCopyable(componentId))
+	{
+		writer.Write(components, count * stride);
+		return;
+	}
+
+	ECSComponentSaveFunction saveFunction =
+		BaseECSComponent::GetTypeSaveFunction(componentId);
+	for (uint32 i = 0; i < count; i++)
 	{
-		systems[i]->PostUpdate(deltaTime);
+		const BaseECSComponent* component =
+			(const BaseECSComponent*) (components + (i * stride));
+		if (saveEntities)
+			writer.Write(component->entity);
+		saveFunction(component, writer);
 	}
 }
 
-void ECS::UpdateSystemWithMultipleComponents(uint32 index, ECSSystemList& systems, float delta,
-	const Array<uint32>& componentTypes, Array<BaseECSComponent*>& componentParam,
-	Array<ECSComponentPool*>& componentPools)
+// Construct components from a snapshot into uninitialized memory. Returns the
+// number of components that were constructed. If the data runs out, the
+// reader becomes invalid and the constructed components must be freed.
+static uint32 LoadComponents(ECSSnapshotReader& reader, uint32 componentId,
+	uint8* components, uint32 count, uint32 stride, bool loadEntities)
 {
-	const Array<uint32>& componentFlags = systems[index]->GetComponentFlags();
+	if (BaseECSComponent::IsTypeTriviallyCopyable(componentId))
+		return (reader.Read(components, count * stride) ? count : 0);
 
-	componentParam.resize(Math::Max(componentParam.size(), componentTypes.size()));
-	componentPools.resize(Math::Max(componentPools.size(), componentTypes.size()));
-	for (uint32 i = 0; i < componentTypes.size(); i++)
-		componentPools[i] = m_components[componentTypes[i]];
-	uint32 minSizeIndex = FindLeastCommonComponent(componentTypes, componentFlags);
+	ECSComponentLoadFunction loadFunction =
+		BaseECSComponent::GetTypeLoadFunction(componentId);
+	for (uint32 i = 0; i < count; i++)
+	{
+		EntityHandle entity = NULL_ENTITY_HANDLE;
+		if (loadEntities && !reader.Read(entity))
+			return i;
+		BaseECSComponent* component =
+			loadFunction(components + (i * stride), reader);
+		component->entity = entity;
+		if (!reader.IsValid())
+			return i + 1;
+	}
+	return count;
+}
 
-	ECSComponentPool* pool = componentPools[minSizeIndex];
-	for (uint32 i = 0; i < pool->size(); i++)
+// Free the components restored into an archetype, up to a row of a chunk of
+// a column, when restoring stops partway through
+static void FreeRestoredComponents(ECSArchetype* archetype, uint32 column,
+	uint32 chunk, uint32 row)
+{
+	for (uint32 i = 0; i <= column; i++)
 	{
-		componentParam[minSizeIndex] = pool->GetComponent(i);
-		ECSEntity* entity = (ECSEntity*) componentParam[minSizeIndex]->entity;
+		ECSComponentFreeFunction freeFunction =
+			BaseECSComponent::GetTypeFreeFunction(
+				archetype->GetComponentTypes()[i]);
+		uint32 stride = archetype->GetColumnStride(i);
+		uint32 numChunks = (i < column ? archetype->GetNumChunks() : chunk + 1);
+		for (uint32 j = 0; j < numChunks; j++)
+		{
+			uint8* columnData = archetype->GetChunkColumn(j, i);
+			uint32 numRows = (i == column && j == chunk ?
+				row : archetype->GetChunkSize(j));
+			for (uint32 k = 0; k < numRows; k++)
+				freeFunction((BaseECSComponent*) (columnData + (k * stride)));
+		}
+	}
+}
 
-		bool isValid = true;
-		for (uint32 j = 0; j < componentTypes.size(); j++)
+Error ECS::SaveSnapshot(Array<uint8>& outData)
+{
+	outData.clear();
+
+	// Every component type must be saveable before anything is written.
+	// Count the non-empty blocks and the space needed for raw data.
+	uint32 numBlocks = 0;
+	size_t dataSize = sizeof(SnapshotHeader) +
+		(m_entities.size() * sizeof(SnapshotEntity));
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		for (uint32 i = 0; i < m_components.size(); i++)
 		{
-			if (j == minSizeIndex)
-			{
+			ECSComponentPool* pool = m_components[i];
+			if (pool == nullptr || pool->size() == 0)
 				continue;
+			if (!CanSnapshotComponentType(i))
+			{
+				return CMG_ERROR_MSG(Error::kNotImplemented,
+					"Component type has no snapshot functions");
 			}
-
-			componentParam[j] = GetComponentInternal(*entity,
-				componentPools[j], componentTypes[j]);
-			if (componentParam[j] == nullptr && (componentFlags[j] & BaseECSSystem::FLAG_OPTIONAL) == 0)
+			numBlocks++;
+			dataSize += sizeof(SnapshotPool) +
+				(pool->m_sparse.size() * sizeof(component_handle)) +
+				(pool->size() * pool->m_componentSize);
+		}
+	}
+	else
+	{
+		for (uint32 i = 0; i < m_archetypes.size(); i++)
+		{
+			ECSArchetype* archetype = m_archetypes[i];
+			if (archetype->size() == 0)
+				continue;
+			for (uint32 column = 0; column < archetype->GetNumColumns(); column++)
 			{
-				isValid = false;
-				break;
+				if (!CanSnapshotComponentType(archetype->GetComponentTypes()[column]))
+				{
+					return CMG_ERROR_MSG(Error::kNotImplemented,
+						"Component type has no snapshot functions");
+				}
+				dataSize += sizeof(SnapshotComponentType) +
+					(archetype->size() * archetype->GetColumnStride(column));
 			}
+			numBlocks++;
+			dataSize += sizeof(SnapshotArchetype) +
+				(archetype->size() * sizeof(EntityHandle));
 		}
+	}
+	outData.reserve(dataSize);
+	ECSSnapshotWriter writer(outData);
+
+	SnapshotHeader header;
+	header.magic = SNAPSHOT_MAGIC;
+	header.formatVersion = SNAPSHOT_FORMAT_VERSION;
+	header.storageMode = (uint32) m_storageMode;
+	header.numSlots = (uint32) m_entities.size();
+	header.freeEntities = m_freeEntities;
+	header.numEntities = m_numEntities;
+	header.numBlocks = numBlocks;
+	writer.Write(header);
+
+	uint8* slots = writer.Allocate(header.numSlots * sizeof(SnapshotEntity));
+	for (uint32 i = 0; i < header.numSlots; i++)
+	{
+		SnapshotEntity slot;
+		slot.generation = m_entities[i].generation;
+		slot.nextFree = m_entities[i].nextFree;
+		slot.isAlive = (m_entities[i].isAlive ? 1 : 0);
+		memcpy(slots + (i * sizeof(SnapshotEntity)), &slot, sizeof(slot));
+	}
 
-		if (isValid)
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+	{
+		for (uint32 i = 0; i < m_components.size(); i++)
+		{
+			ECSComponentPool* pool = m_components[i];
+			if (pool == nullptr || pool->size() == 0)
+				continue;
+			SnapshotPool block;
+			block.componentId = i;
+			block.componentSize = pool->m_componentSize;
+			block.count = pool->size();
+			block.sparseSize = (uint32) pool->m_sparse.size();
+			writer.Write(block);
+			writer.Write(pool->m_sparse.data(),
+				block.sparseSize * sizeof(component_handle));
+			SaveComponents(writer, i, pool->m_data, block.count,
+				block.componentSize, true);
+		}
+	}
+	else
+	{
+		for (uint32 i = 0; i < m_archetypes.size(); i++)
 		{
-			systems[index]->UpdateComponents(delta, &componentParam[0]);
+			ECSArchetype* archetype = m_archetypes[i];
+			if (archetype->size() == 0)
+				continue;
+			SnapshotArchetype block;
+			block.numTypes = archetype->GetNumColumns();
+			block.count = archetype->size();
+			writer.Write(block);
+			for (uint32 column = 0; column < block.numTypes; column++)
+			{
+				SnapshotComponentType type;
+				type.componentId = archetype->GetComponentTypes()[column];
+				type.componentSize = archetype->GetColumnStride(column);
+				writer.Write(type);
+			}
+			for (uint32 chunk = 0; chunk < archetype->GetNumChunks(); chunk++)
+			{
+				writer.Write(archetype->GetChunkEntities(chunk),
+					archetype->GetChunkSize(chunk) * sizeof(EntityHandle));
+			}
+			for (uint32 column = 0; column < block.numTypes; column++)
+			{
+				for (uint32 chunk = 0; chunk < archetype->GetNumChunks(); chunk++)
+				{
+					SaveComponents(writer, archetype->GetComponentTypes()[column],
+						archetype->GetChunkColumn(chunk, column),
+						archetype->GetChunkSize(chunk),
+						archetype->GetColumnStride(column), false);
+				}
+			}
 		}
 	}
+	return CMG_ERROR_SUCCESS;
 }
 
-
-EntityHandle ECS::CreateEntity()
+Error ECS::RestoreSnapshot(const Array<uint8>& data)
 {
-	ECSEntity* entity = new ECSEntity(*this);
-	entity->index = m_entities.size();
-	m_entities.push_back(entity);
-	return (EntityHandle) entity;
+	return RestoreSnapshot(data.data(), (uint32) data.size());
 }
 
-EntityHandle ECS::CreateEntity(const BaseECSComponent* components,
-	const uint32* componentIds, size_t numComponents)
+Error ECS::RestoreSnapshot(const uint8* data, uint32 size)
 {
-	ECSEntity* entity = (ECSEntity*) CreateEntity();
-
-	// Construct the components for the entity
-	for (uint32 i = 0; i < numComponents; i++)
+	ECSSnapshotReader reader(data, size);
+	SnapshotHeader header;
+	if (!reader.Read(header) || header.magic != SNAPSHOT_MAGIC)
+		return CMG_ERROR_MSG(Error::kCorruptData, "Data is not an ECS snapshot");
+	if (header.formatVersion != SNAPSHOT_FORMAT_VERSION)
 	{
-		CMG_ASSERT(BaseECSComponent::IsTypeValid(componentIds[i]));
+		return CMG_ERROR_MSG(Error::kCorruptData,
+			"Unsupported ECS snapshot format version");
+	}
+	if (header.storageMode != (uint32) m_storageMode)
+	{
+		return CMG_ERROR_MSG(Error::kOperationNotPermitted,
+			"ECS snapshot has a different storage mode");
+	}
 
-		// Create the component then add it to the entity
-		ECSEntity::EntityComponent pair;
-		pair.id = componentIds[i];
-		pair.handle = DoCreateComponent(entity,
-			componentIds[i], components + i);
-		entity->components.push_back(pair);
+	// The entity slots are overwritten in place
+	DestroyAllComponents();
+	m_freeEntities = header.freeEntities;
+	m_numEntities = header.numEntities;
+	Error error = RestoreSnapshotContents(reader,
+		header.numSlots, header.numBlocks);
+	if (error.Failed())
+	{
+		DestroyAllComponents();
+		m_entities.clear();
+		m_freeEntities = NO_FREE_ENTITY;
+		m_numEntities = 0;
 	}
 
-	return (EntityHandle) entity;
+	// Rebuild the queries from scratch
+	for (uint32 i = 0; i < m_queries.size(); i++)
+		BuildQuery(*m_queries[i]);
+	return error.Uncheck();
 }
 
-void ECS::ClearEntities()
+void ECS::DestroyAllComponents()
 {
-	while (m_entities.size() > 0)
+	// Pools keep their memory for reuse
+	for (uint32 i = 0; i < m_components.size(); i++)
 	{
-		RemoveEntity((EntityHandle) m_entities[0]);
+		if (m_components[i] != nullptr)
+			m_components[i]->Clear();
 	}
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+		m_archetypes[i]->Clear();
 }
 
-void ECS::RemoveEntity(EntityHandle handle)
+bool ECS::IsEntityTableValid() const
+{
+	uint32 numSlots = (uint32) m_entities.size();
+	uint32 numAlive = 0;
+	for (uint32 i = 0; i < numSlots; i++)
+	{
+		if (m_entities[i].isAlive)
+		{
+			if (m_entities[i].generation == 0)
+				return false;
+			numAlive++;
+		}
+	}
+	if (numAlive != m_numEntities)
+		return false;
+
+	// The free list must visit every dead slot exactly once
+	uint32 numFree = 0;
+	for (uint32 index = m_freeEntities; index != NO_FREE_ENTITY;
+		index = m_entities[index].nextFree)
+	{
+		if (index >= numSlots || m_entities[index].isAlive ||
+			++numFree > numSlots - numAlive)
+			return false;
+	}
+	return (numFree == numSlots - numAlive);
+}
+
+Error ECS::RestoreSnapshotContents(ECSSnapshotReader& reader,
+	uint32 numSlots, uint32 numBlocks)
 {
-	ECSEntity* entity = (ECSEntity*) handle;
+	// Entity table
+	const uint8* slots = nullptr;
+	if (numSlots <= reader.GetBytesLeft() / sizeof(SnapshotEntity))
+		slots = reader.Skip(numSlots * sizeof(SnapshotEntity));
+	if (slots == nullptr)
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+	m_entities.resize(numSlots);
+	for (uint32 i = 0; i < numSlots; i++)
+	{
+		SnapshotEntity slot;
+		memcpy(&slot, slots + (i * sizeof(SnapshotEntity)), sizeof(slot));
+		ECSEntity& entity = m_entities[i];
+		entity.generation = slot.generation;
+		entity.isAlive = (slot.isAlive != 0);
+		entity.nextFree = slot.nextFree;
+		entity.archetype = nullptr;
+		entity.archetypeIndex = 0;
+	}
+	if (!IsEntityTableValid())
+	{
+		return CMG_ERROR_MSG(Error::kCorruptData,
+			"ECS snapshot has an invalid entity table");
+	}
 
-	// Delete all the entity's components from memory
-	for (uint32 i = 0; i < entity->components.size(); i++)
+	// Component blocks
+	for (uint32 i = 0; i < numBlocks; i++)
 	{
-		DoRemoveComponent(entity->components[i].id,
-			entity->components[i].handle);
+		Error error = (m_storageMode == ECSStorageMode::k_componentPools ?
+			RestoreComponentPool(reader) : RestoreArchetype(reader));
+		if (error.Failed())
+			return error.Uncheck();
 	}
 
-	// Move the last entity to where the removed entity was
-	uint32 destIndex = entity->index;
-	uint32 srcIndex = m_entities.size() - 1;
-	delete m_entities[destIndex];
-	if (destIndex != srcIndex)
+	// With archetypes, every entity has a row in one
+	if (m_storageMode == ECSStorageMode::k_archetypes)
 	{
-		m_entities[destIndex] = m_entities[srcIndex];
-		m_entities[destIndex]->index = destIndex;
+		for (uint32 i = 0; i < numSlots; i++)
+		{
+			if (m_entities[i].isAlive && m_entities[i].archetype == nullptr)
+			{
+				return CMG_ERROR_MSG(Error::kCorruptData,
+					"ECS snapshot has an entity without an archetype");
+			}
+		}
 	}
-	m_entities.pop_back();
+
+	if (reader.GetBytesLeft() > 0)
+		return CMG_ERROR_MSG(Error::kSizeMismatch, "ECS snapshot has extra data");
+	return CMG_ERROR_SUCCESS;
 }
 
-ECSComponentPool::ComponentHandle ECS::DoCreateComponent(
-	EntityHandle entity, uint32 componentId,
-	const BaseECSComponent* component)
+Error ECS::RestoreComponentPool(ECSSnapshotReader& reader)
 {
-	if (m_components.find(componentId) == m_components.end())
-		m_components[componentId] = new ECSComponentPool(componentId);
-	ECSComponentPool* pool = m_components[componentId];
-	ECSComponentPool::ComponentHandle handle = pool->CreateComponent(component);
-	pool->GetComponent(handle)->entity = entity;
-	return handle;
+	SnapshotPool block;
+	if (!reader.Read(block))
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+	if (!BaseECSComponent::IsTypeValid(block.componentId))
+		return CMG_ERROR_MSG(Error::kCorruptData, "Unknown component type");
+	if (block.componentSize != BaseECSComponent::GetTypeSize(block.componentId))
+		return CMG_ERROR_MSG(Error::kSizeMismatch, "Component size mismatch");
+	if (!CanSnapshotComponentType(block.componentId))
+	{
+		return CMG_ERROR_MSG(Error::kNotImplemented,
+			"Component type has no snapshot functions");
+	}
+	ECSComponentPool* pool = GetComponentPool(block.componentId);
+	if (pool->size() > 0 || block.count > m_numEntities ||
+		block.sparseSize > m_entities.size() || block.count > block.sparseSize)
+		return CMG_ERROR_MSG(Error::kCorruptData, "Invalid component pool");
+
+	const uint8* sparse = reader.Skip(block.sparseSize * sizeof(component_handle));
+	if (sparse == nullptr)
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+	pool->m_sparse.resize(block.sparseSize);
+	memcpy(pool->m_sparse.data(), sparse,
+		block.sparseSize * sizeof(component_handle));
+
+	// Each component takes up at least its entity handle in the snapshot
+	uint32 minSize = (BaseECSComponent::IsTypeTriviallyCopyable(
+		block.componentId) ? block.componentSize : sizeof(EntityHandle));
+	if (block.count > reader.GetBytesLeft() / minSize)
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+
+	// Copy the components straight into the pool's buffer
+	pool->Reserve(block.count);
+	pool->m_count = LoadComponents(reader, block.componentId, pool->m_data,
+		block.count, block.componentSize, true);
+	pool->m_versions.assign(pool->m_count, m_changeVersion);
+	pool->m_version = m_changeVersion;
+	if (!reader.IsValid())
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+
+	// The sparse array and the components must agree, and each component
+	// must belong to a living entity
+	const component_handle* handles = pool->m_sparse.data();
+	uint32 numHandles = 0;
+	for (uint32 i = 0; i < block.sparseSize; i++)
+		numHandles += (handles[i] != ECSComponentPool::INVALID_HANDLE ? 1 : 0);
+	if (numHandles != block.count)
+		return CMG_ERROR_MSG(Error::kCorruptData, "Invalid component pool");
+	const ECSEntity* slots = m_entities.data();
+	const uint8* componentData = pool->m_data;
+	for (uint32 i = 0; i < block.count; i++)
+	{
+		EntityHandle entity = ((const BaseECSComponent*) componentData)->entity;
+		if (entity.index >= block.sparseSize || handles[entity.index] != i ||
+			slots[entity.index].generation != entity.generation ||
+			!slots[entity.index].isAlive)
+			return CMG_ERROR_MSG(Error::kCorruptData, "Invalid component pool");
+		componentData += block.componentSize;
+	}
+	return CMG_ERROR_SUCCESS;
 }
 
-void ECS::DoRemoveComponent(uint32 componentId, component_handle handle)
+Error ECS::RestoreArchetype(ECSSnapshotReader& reader)
 {
-	ECSComponentPool* pool = m_components[componentId];
+	SnapshotArchetype block;
+	if (!reader.Read(block))
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+	if (block.count == 0 || block.count > m_numEntities)
+		return CMG_ERROR_MSG(Error::kCorruptData, "Invalid archetype");
 
-	// Update the reference to the shifted component's offset
-	BaseECSComponent* shiftedComponent = pool->back();
-	component_handle oldHandle = (component_handle) (pool->size() - 1);
-	ECSEntity* entity = (ECSEntity*) shiftedComponent->entity;
-	for (uint32 i = 0; i < entity->components.size(); i++)
+	// Component types must be valid and sorted by ID
+	Array<uint32> componentTypes;
+	for (uint32 i = 0; i < block.numTypes; i++)
 	{
-		if (entity->components[i].id == componentId &&
-			entity->components[i].handle == oldHandle)
+		SnapshotComponentType type;
+		if (!reader.Read(type))
+			return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+		if (!BaseECSComponent::IsTypeValid(type.componentId) ||
+			(i > 0 && type.componentId <= componentTypes.back()))
+			return CMG_ERROR_MSG(Error::kCorruptData, "Invalid archetype");
+		if (type.componentSize != BaseECSComponent::GetTypeSize(type.componentId))
+			return CMG_ERROR_MSG(Error::kSizeMismatch, "Component size mismatch");
+		if (!CanSnapshotComponentType(type.componentId))
 		{
-			entity->components[i].handle = handle;
-			break;
+			return CMG_ERROR_MSG(Error::kNotImplemented,
+				"Component type has no snapshot functions");
 		}
+		componentTypes.push_back(type.componentId);
 	}
 
-	pool->DeleteComponent(handle);
+	const uint8* entities = reader.Skip(block.count * sizeof(EntityHandle));
+	if (entities == nullptr)
+		return CMG_ERROR_MSG(Error::kCorruptData, "ECS snapshot is truncated");
+	ECSArchetype* archetype = GetArchetype(componentTypes);
+	if (archetype->size() > 0)
+		return CMG_ERROR_MSG(Error::kCorruptData, "Invalid archetype");
+	archetype->AllocateRows((const EntityHandle*) entities, block.count);
+
+	// Link the entities to their rows
+	for (uint32 i = 0; i < block.count; i++)
+	{
+		EntityHandle handle = archetype->GetEntity(i);
+		if (!IsEntityValid(handle) ||
+			m_entities[handle.index].archetype != nullptr)
+		{
+			archetype->ReleaseChunks();
+			return CMG_ERROR_MSG(Error::kCorruptData, "Invalid archetype");
+		}
+		m_entities[handle.index].archetype = archetype;
+		m_entities[handle.index].archetypeIndex = i;
+	}
+
+	// Copy each column straight into the chunks
+	for (uint32 column = 0; column < block.numTypes; column++)
+	{
+		uint32 componentId = componentTypes[column];
+		uint32 stride = archetype->GetColumnStride(column);
+		bool isTriviallyCopyable =
+			BaseECSComponent::IsTypeTriviallyCopyable(componentId);
+		for (uint32 chunk = 0; chunk < archetype->GetNumChunks(); chunk++)
+		{
+			uint32 chunkSize = archetype->GetChunkSize(chunk);
+			uint8* columnData = archetype->GetChunkColumn(chunk, column);
+			uint32 numLoaded = LoadComponents(reader, componentId,
+				columnData, chunkSize, stride, false);
+			if (!reader.IsValid())
+			{
+				FreeRestoredComponents(archetype, column, chunk, numLoaded);
+				archetype->ReleaseChunks();
+				return CMG_ERROR_MSG(Error::kCorruptData,
+					"ECS snapshot is truncated");
+			}
+			if (!isTriviallyCopyable)
+			{
+				const EntityHandle* chunkEntities =
+					archetype->GetChunkEntities(chunk);
+				for (uint32 row = 0; row < chunkSize; row++)
+				{
+					((BaseECSComponent*) (columnData + (row * stride)))->entity =
+						chunkEntities[row];
+				}
+			}
+			uint32* versions = archetype->GetChunkVersions(chunk, column);
+			for (uint32 row = 0; row < chunkSize; row++)
+				versions[row] = m_changeVersion;
+			archetype->SetChunkVersion(chunk, column, m_changeVersion);
+		}
+	}
+	return CMG_ERROR_SUCCESS;
+}
+
+void ECS::ReserveComponentsInternal(uint32 componentId, uint32 capacity)
+{
+	if (m_storageMode == ECSStorageMode::k_componentPools)
+		GetComponentPool(componentId)->Reserve(capacity);
+}
+
+void ECS::ShrinkToFit()
+{
+	for (uint32 i = 0; i < m_components.size(); i++)
+	{
+		if (m_components[i] != nullptr)
+			m_components[i]->ShrinkToFit();
+	}
 }
 
 uint32 ECS::FindLeastCommonComponent(const Array<uint32>& componentTypes, const Array<uint32>& componentFlags)
@@ -240,6 +2009,127 @@ uint32 ECS::FindLeastCommonComponent(const Array<uint32>& componentTypes, const
 	return minIndex;
 }
 
+void ECS::GetPoolStats(Array<ECSPoolStats>& outStats) const
+{
+	for (uint32 i = 0; i < m_components.size(); i++)
+	{
+		const ECSComponentPool* pool = m_components[i];
+		if (pool == nullptr)
+			continue;
+		ECSPoolStats stats;
+		stats.componentId = i;
+		stats.componentSize = pool->GetComponentSize();
+		stats.size = pool->size();
+		stats.capacity = pool->GetCapacity();
+		stats.bytes = pool->GetMemoryBytes();
+		stats.numGrowths = pool->GetNumGrowths();
+		outStats.push_back(stats);
+	}
+}
+
+void ECS::GetArchetypeStats(Array<ECSArchetypeStats>& outStats) const
+{
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+	{
+		const ECSArchetype* archetype = m_archetypes[i];
+		ECSArchetypeStats stats;
+		stats.componentTypes = archetype->GetComponentTypes();
+		stats.size = archetype->size();
+		stats.numChunks = archetype->GetNumChunks();
+		stats.chunkCapacity = archetype->GetChunkCapacity();
+		stats.bytes = (uint64) stats.numChunks * archetype->m_chunkBytes;
+		outStats.push_back(stats);
+	}
+}
+
+// Append formatted text to a string
+static void AppendFormat(String& out, const char* format, ...)
+{
+	char buffer[256];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (length > 0)
+		out.append(buffer, Math::Min((size_t) length, sizeof(buffer) - 1));
+}
+
+// Append a string as a JSON string literal
+static void AppendJSONString(String& out, const String& str)
+{
+	out += '"';
+	for (uint32 i = 0; i < str.length(); i++)
+	{
+		char c = str[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char) c < 0x20)
+			AppendFormat(out, "\\u%04x", (unsigned char) c);
+		else
+			out += c;
+	}
+	out += '"';
+}
+
+String ECS::GetStatsJSON(ECSSystemList& systems) const
+{
+	String json = "{\n  \"systems\": [";
+	for (uint32 i = 0; i < systems.Size(); i++)
+	{
+		BaseECSSystem* system = systems[i];
+		const ECSSystemStats& stats = system->GetStats();
+		json += (i > 0 ? ",\n    {\"name\": " : "\n    {\"name\": ");
+		if (system->GetName().empty())
+			AppendJSONString(json, "system " + std::to_string(i));
+		else
+			AppendJSONString(json, system->GetName());
+		AppendFormat(json, ", \"updates\": %u, \"matched\": %u, "
+			"\"processed\": %u, \"bytes_touched\": %llu, ",
+			stats.GetNumUpdates(), stats.GetNumMatched(),
+			stats.GetNumProcessed(),
+			(unsigned long long) stats.GetBytesTouched());
+		AppendFormat(json, "\"ms_last\": %.6f, \"ms_min\": %.6f, "
+			"\"ms_avg\": %.6f, \"ms_max\": %.6f, \"ms_total\": %.6f}",
+			stats.GetLastMilliseconds(), stats.GetMinMilliseconds(),
+			stats.GetAverageMilliseconds(), stats.GetMaxMilliseconds(),
+			stats.GetTotalMilliseconds());
+	}
+	json += "\n  ],\n  \"pools\": [";
+
+	Array<ECSPoolStats> pools;
+	GetPoolStats(pools);
+	for (uint32 i = 0; i < pools.size(); i++)
+	{
+		const ECSPoolStats& stats = pools[i];
+		AppendFormat(json, "%s\n    {\"component\": %u, "
+			"\"component_size\": %u, \"size\": %u, \"capacity\": %u, "
+			"\"bytes\": %llu, \"growths\": %u}", (i > 0 ? "," : ""),
+			stats.componentId, stats.componentSize, stats.size,
+			stats.capacity, (unsigned long long) stats.bytes,
+			stats.numGrowths);
+	}
+	json += "\n  ],\n  \"archetypes\": [";
+
+	Array<ECSArchetypeStats> archetypes;
+	GetArchetypeStats(archetypes);
+	for (uint32 i = 0; i < archetypes.size(); i++)
+	{
+		const ECSArchetypeStats& stats = archetypes[i];
+		json += (i > 0 ? ",\n    {\"components\": [" : "\n    {\"components\": [");
+		for (uint32 j = 0; j < stats.componentTypes.size(); j++)
+			AppendFormat(json, (j > 0 ? ", %u" : "%u"), stats.componentTypes[j]);
+		AppendFormat(json, "], \"size\": %u, \"chunks\": %u, "
+			"\"chunk_capacity\": %u, \"bytes\": %llu}", stats.size,
+			stats.numChunks, stats.chunkCapacity,
+			(unsigned long long) stats.bytes);
+	}
+	json += "\n  ]\n}\n";
+	return json;
+}
+
 #include <iostream>
 void ECS::PrintDebug()
 {
@@ -247,29 +2137,48 @@ void ECS::PrintDebug()
 	cout << "Entities:" << endl;
 	for (uint32 i = 0; i < m_entities.size(); i++)
 	{
-		auto entity = m_entities[i];
-		cout << "  " << entity->index << ". 0x" << hex << (uint64) entity << endl;
-		for (uint32 j = 0; j < entity->components.size(); j++)
+		const ECSEntity& entity = m_entities[i];
+		if (!entity.isAlive)
+			continue;
+		printf("  %u. generation=%u\n", i, entity.generation);
+		for (uint32 j = 0; j < m_components.size(); j++)
 		{
-			auto comp = entity->components[j];
-			printf("    index=%u, id=%u, handle=%u\n", j, comp.id, comp.handle);
+			if (m_components[j] == nullptr)
+				continue;
+			component_handle handle = m_components[j]->FindHandle(i);
+			if (handle != ECSComponentPool::INVALID_HANDLE)
+				printf("    id=%u, handle=%u\n", j, handle);
 		}
 	}
 
 	cout << endl << "Components:" << endl;
-	for (auto it = m_components.begin(); it != m_components.end(); it++)
+	for (uint32 i = 0; i < m_components.size(); i++)
 	{
+		ECSComponentPool* pool = m_components[i];
+		if (pool == nullptr)
+			continue;
 		printf("  id=%u, count=%u, capacity=%u\n",
-			it->first,
-			it->second->m_capacity,
-			it->second->m_count);
+			i, pool->m_count, pool->m_capacity);
 			
-		for (uint32 j = 0; j < it->second->m_count; j++)
+		for (uint32 j = 0; j < pool->m_count; j++)
 		{
-			auto comp = it->second->GetComponent(j);
-			printf("    handle=%u, entity=0x%x\n", j, (uint64) comp->entity);
+			auto comp = pool->GetComponent(j);
+			printf("    handle=%u, entity=%u:%u\n", j,
+				comp->entity.index, comp->entity.generation);
 		}
 	}
+
+	cout << endl << "Archetypes:" << endl;
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+	{
+		ECSArchetype* archetype = m_archetypes[i];
+		printf("  index=%u, count=%u, chunks=%u, chunkCapacity=%u, types=",
+			i, archetype->size(), archetype->GetNumChunks(),
+			archetype->GetChunkCapacity());
+		for (uint32 j = 0; j < archetype->GetNumColumns(); j++)
+			printf("%s%u", (j > 0 ? "," : ""), archetype->GetComponentTypes()[j]);
+		printf("\n");
+	}
 }
 
 
@@ -3,303 +3,465 @@
 
 #include <cmgCore/ecs/cmgECSSystem.h>
 #include <cmgCore/ecs/cmgECSComponentPool.h>
+#include <cmgCore/ecs/cmgECSArchetype.h>
+#include <cmgCore/ecs/cmgECSCommandBuffer.h>
+#include <cmgCore/ecs/cmgECSPrefab.h>
+#include <cmgCore/ecs/cmgECSSnapshot.h>
+#include <cmgCore/error/cmgError.h>
+#include <cmgCore/thread/cmgThreadPool.h>
 
 
-class ECSEntity
+// How an ECS lays out its component data in memory
+enum class ECSStorageMode
 {
-	friend class ECS;
-
-public:
-	ECSEntity(ECS& ecs);
-
-	ECS& GetECS();
-	const ECS& GetECS() const;
-
-	template <class T_Component>
-	T_Component* GetComponent()
-	{
-		return m_ecs.GetComponent<T_Component>(this);
-	}
-
-	template <class T_Component>
-	bool HasComponent()
-	{
-		return m_ecs.HasComponent<T_Component>(this);
-	}
-
-	template <class T_Component>
-	void AddComponent(const T_Component& component)
-	{
-		return m_ecs.AddComponent(this, component);
-	}
+	// One pool per component type. Systems that need several components
+	// join the pools per entity.
+	k_componentPools = 0,
+
+	// Entities with the same set of component types share fixed-size chunks
+	// with one column per component type. Systems walk matching chunks
+	// linearly without any per-entity lookup.
+	k_archetypes,
+};
 
-	template <class T_Component>
-	void RemoveComponent()
-	{
-		return m_ecs.RemoveComponent<T_Component>(this);
-	}
 
+// Slot in the ECS's entity array. Slots of removed entities are recycled
+// through a free list, and their generation is bumped so that any handles
+// to the removed entity no longer match.
+struct ECSEntity
+{
+	uint32 generation;
+	bool isAlive;
 
-private:
-	struct EntityComponent
-	{
-		uint32 id;
-		ECSComponentPool::ComponentHandle handle;
-	};
+	// Next slot in the free list, when this slot is free
+	uint32 nextFree;
 
-	uint32 index;
-	Array<EntityComponent> components;
-	ECS& m_ecs;
+	// Location of the entity when using archetype storage
+	ECSArchetype* archetype;
+	uint32 archetypeIndex;
 };
 
 
 class ECS
 {
 public:
-	ECS();
+	friend class ECSQuery;
+
+public:
+	// Default number of pool entities per parallel update task
+	static const uint32 DEFAULT_PARALLEL_GRAIN_SIZE = 1024;
+
+public:
+	ECS(ECSStorageMode storageMode = ECSStorageMode::k_componentPools);
 	~ECS();
 
+	inline ECSStorageMode GetStorageMode() const { return m_storageMode; }
+
 	// Entity methods
-	ECSEntity* CreateEntity(const BaseECSComponent* components,
+	EntityHandle CreateEntity(const BaseECSComponent* components,
 		const uint32* componentIds, size_t numComponents);
-	ECSEntity* CreateEntity();
+	EntityHandle CreateEntity();
 	template <class T1>
-	ECSEntity* CreateEntity(const T1& c1);
+	EntityHandle CreateEntity(const T1& c1);
 	template <class T1, class T2>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2);
 	template <class T1, class T2, class T3>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3);
 	template <class T1, class T2, class T3, class T4>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4);
 	template <class T1, class T2, class T3, class T4, class T5>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5);
 	template <class T1, class T2, class T3, class T4, class T5, class T6>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6);
 	template <class T1, class T2, class T3, class T4, class T5, class T6, class T7>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7);
 	template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8);
 	template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9);
 	template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10>
-	ECSEntity* CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9, const T10& c10);
+	EntityHandle CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9, const T10& c10);
+
+	// Create entities with copies of a prefab's components. Every pool is
+	// grown once, and the components are constructed in a tight loop. The
+	// new handles are appended to outEntities as one contiguous run, and the
+	// index of the first is returned.
+	EntityHandle Instantiate(const ECSPrefab& prefab);
+	uint32 Instantiate(const ECSPrefab& prefab, uint32 count,
+		Array<EntityHandle>& outEntities);
 
 	void ClearEntities();
 	void RemoveEntity(EntityHandle handle);
 
+	// Returns true if the handle refers to an entity that has not been removed
+	bool IsEntityValid(EntityHandle handle) const;
+	inline uint32 GetNumEntities() const { return m_numEntities; }
+
 	// Component methods
+	// An entity has at most one component of each type. Adding a component
+	// that the entity already has replaces it.
 	template <class T_Component>
 	void AddComponent(EntityHandle entity, const T_Component& component);
 
 	template <class T_Component>
 	void RemoveComponent(EntityHandle entity);
 
+	// Getting a mutable component marks it as changed
 	template <class T_Component>
 	T_Component* GetComponent(EntityHandle entity);
 
+	template <class T_Component>
+	const T_Component* GetComponentReadOnly(EntityHandle entity);
+
 	template <class T_Component>
 	bool HasComponent(EntityHandle entity);
 
+	// Change tracking. Components are marked with the current change version
+	// whenever they are created or written to. The version advances around
+	// each system update, and systems can use FLAG_CHANGED to only update
+	// entities whose components changed since their last update.
+	inline uint32 GetChangeVersion() const { return m_changeVersion; }
+
+	// Returns the change version of an entity's component, or zero if the
+	// entity doesn't have the component
+	template <class T_Component>
+	uint32 GetComponentVersion(EntityHandle entity);
+
+	template <class T_Component>
+	bool HasComponentChanged(EntityHandle entity, uint32 sinceVersion);
+
+	// Component pool capacity. Pools can be reserved up front, for example
+	// when loading a level, to avoid reallocating during a frame. These have
+	// no effect with archetype storage.
+	template <class T_Component>
+	void ReserveComponents(uint32 capacity);
+	template <class T_Component>
+	void SetComponentGrowthPolicy(const ECSGrowthPolicy& growthPolicy);
+	template <class T_Component>
+	uint32 GetComponentCapacity();
+	void ShrinkToFit();
+
+	// Join locality. Component pools end up in unrelated orders as entities
+	// are created and removed, so a system joining several pools jumps
+	// around memory for each entity. CoSortComponents sorts a system's rows
+	// by its primary (first required) component, and moves its entities'
+	// other components to the front of their pools in the same order. The
+	// work is done a slice at a time until the time budget runs out, and
+	// continues on the next call. Returns true when a full pass completed.
+	// It must not be called during an update, and only one system should
+	// co-sort a given pool or they will undo each other's work. It has no
+	// effect with archetype storage, where components are already together.
+	bool CoSortComponents(BaseECSSystem& system, double budgetMilliseconds);
+
+	// Snapshots. SaveSnapshot writes every entity and component into one
+	// versioned binary blob, and RestoreSnapshot replaces the contents of
+	// the ECS with one. Trivially copyable components are stored as raw
+	// bytes, and other component types need snapshot functions (see
+	// RegisterECSSnapshotFunctions). Component IDs depend on registration
+	// order, so a snapshot can only be restored by the same build, into an
+	// ECS with the same storage mode. Restored components are marked as
+	// changed. If restoring fails, the ECS is left empty.
+	Error SaveSnapshot(Array<uint8>& outData);
+	Error RestoreSnapshot(const uint8* data, uint32 size);
+	Error RestoreSnapshot(const Array<uint8>& data);
+
 	// System methods
 	void UpdateSystems(ECSSystemList& systems, float deltaTime);
+
+	// Run UpdateSystems on a thread pool (which the ECS does not own). Thread
+	// safe systems that don't conflict are updated concurrently, and their
+	// entities are split into tasks across the threads. Entities and
+	// components must not be created or removed during a parallel update.
+	inline void SetThreadPool(ThreadPool* threadPool) { m_threadPool = threadPool; }
+	inline ThreadPool* GetThreadPool() const { return m_threadPool; }
+	inline void SetParallelGrainSize(uint32 grainSize) { m_parallelGrainSize = (grainSize > 0 ? grainSize : 1); }
+	inline uint32 GetParallelGrainSize() const { return m_parallelGrainSize; }
+
+	// Command buffers record structural changes made while systems are
+	// updating. Each thread of the thread pool has its own command buffer,
+	// and they are all played back at the end of UpdateSystems.
+	ECSCommandBuffer& GetCommandBuffer();
+	void PlaybackCommandBuffers();
+	void PlaybackCommandBuffer(ECSCommandBuffer& commandBuffer);
 	//void RemoveSystem(BaseECSSystem& system);
 
+	// Statistics. Each system records its own update statistics (see
+	// BaseECSSystem::GetStats). These append the memory use of each
+	// component pool or archetype, depending on the storage mode.
+	void GetPoolStats(Array<ECSPoolStats>& outStats) const;
+	void GetArchetypeStats(Array<ECSArchetypeStats>& outStats) const;
+
+	// Write the statistics of the systems and of the storage as JSON, for
+	// comparing the cost of the ECS between builds
+	String GetStatsJSON(ECSSystemList& systems) const;
+
 	void PrintDebug();
 
 private:
 	typedef ECSComponentPool::ComponentHandle component_handle;
 	
-	ECSComponentPool::ComponentHandle DoCreateComponent(
-		EntityHandle entity, uint32 componentId,
+	ECSEntity* GetEntity(EntityHandle handle);
+	EntityHandle AllocateEntity();
+	ECSComponentPool* GetComponentPool(uint32 componentId);
+	EntityHandle CreateEntityInternal(const BaseECSComponent** components,
+		const uint32* componentIds, size_t numComponents);
+	void InstantiateInternal(const ECSPrefab& prefab, EntityHandle* entities,
+		uint32 count);
+	void AddComponentInternal(EntityHandle entity, uint32 componentId,
 		const BaseECSComponent* component);
-	void DoRemoveComponent(uint32 componentId, component_handle handle);
-	void UpdateSystemWithMultipleComponents(uint32 index, ECSSystemList& systems, float delta,
-		const Array<uint32>& componentTypes, Array<BaseECSComponent*>& componentParam,
-		Array<ECSComponentPool*>& componentPools);
-	BaseECSComponent* GetComponentInternal(ECSEntity& entity, ECSComponentPool* pool, uint32 componentID);
+	void RemoveComponentInternal(EntityHandle entity, uint32 componentId);
+	BaseECSComponent* FindComponent(EntityHandle entity, uint32 componentId,
+		bool markChanged);
+	uint32 FindComponentVersion(EntityHandle entity, uint32 componentId);
+	void ReserveComponentsInternal(uint32 componentId, uint32 capacity);
+	void DoCreateComponent(EntityHandle entity, uint32 componentId,
+		const BaseECSComponent* component);
+	void DoRemoveComponent(EntityHandle entity, uint32 componentId);
+
+	// A range of entities to update for one system. For component pools this
+	// is a range of rows in the system's query, and for archetypes it is a
+	// range of chunks.
+	struct SystemTask
+	{
+		BaseECSSystem* system;
+		ECSArchetype* archetype;
+		uint32 begin;
+		uint32 end;
+
+		// Work done by the task, added to the system's statistics
+		uint32 numProcessed;
+		uint64 bytesTouched;
+		double milliseconds;
+	};
+
+	void BeginSystemUpdate(BaseECSSystem* system);
+	void EndSystemUpdate(BaseECSSystem* system);
+	void UpdateSystemsParallel(ECSSystemList& systems, float deltaTime);
+	void GatherSystemTasks(BaseECSSystem* system, uint32 grainSize,
+		Array<SystemTask>& outTasks);
+	void RunSystemTask(SystemTask& task, float delta,
+		BaseECSComponent** componentParam);
+	void AddSystemTaskStats();
+
+	// These return the number of entities updated, and add the bytes of the
+	// components passed to the system
+	uint32 UpdateSystemWithComponentPools(BaseECSSystem* system,
+		float delta, uint32 begin, uint32 end,
+		BaseECSComponent** componentParam, uint64& bytesTouched);
 	uint32 FindLeastCommonComponent(const Array<uint32>& componentTypes, const Array<uint32>& componentFlags);
 
+	// Archetype storage
+	ECSArchetype* GetArchetype(const Array<uint32>& componentTypes);
+	ECSArchetype* GetArchetypeWith(ECSArchetype* archetype, uint32 componentId);
+	ECSArchetype* GetArchetypeWithout(ECSArchetype* archetype, uint32 componentId);
+	void MoveEntityToArchetype(EntityHandle handle, ECSArchetype* archetype);
+	void RemoveEntityFromArchetype(ECSEntity* entity);
+
+	// Cached system queries
+	void RegisterQuery(BaseECSSystem* system);
+	void UnregisterQuery(ECSQuery* query);
+	void BuildQuery(ECSQuery& query);
+	bool AddQueryRow(ECSQuery& query, uint32 entityIndex);
+	void SetQueryHandle(ECSQuery& query, uint32 row, uint32 componentId,
+		component_handle handle);
+	void SwapPoolComponents(uint32 componentId, component_handle a,
+		component_handle b);
+
+	// Snapshots
+	void DestroyAllComponents();
+	bool IsEntityTableValid() const;
+	Error RestoreSnapshotContents(ECSSnapshotReader& reader,
+		uint32 numSlots, uint32 numBlocks);
+	Error RestoreComponentPool(ECSSnapshotReader& reader);
+	Error RestoreArchetype(ECSSnapshotReader& reader);
+
+	// Command buffer playback
+	void PlaybackCommands(ECSCommandBuffer** commandBuffers, uint32 count);
+	EntityHandle ResolveCommandEntity(EntityHandle entity, uint32 pendingOffset);
+	uint32 UpdateSystemBatchesWithComponentPools(BaseECSSystem* system,
+		float delta, uint32 begin, uint32 end,
+		BaseECSComponent** componentParam, uint64& bytesTouched);
+	uint32 UpdateSystemWithArchetype(BaseECSSystem* system,
+		ECSArchetype* archetype, float delta, uint32 chunkBegin,
+		uint32 chunkEnd, BaseECSComponent** componentParam,
+		uint64& bytesTouched);
+
+	ECSStorageMode m_storageMode;
+
 	//Array<BaseECSSystem*> m_systems;
-	Map<uint32, ECSComponentPool*> m_components;
-	Array<ECSEntity*> m_entities;
+
+	// Component pools indexed by component ID, created on demand
+	Array<ECSComponentPool*> m_components;
+
+	// Entity slots, and the head of the list of free slots
+	Array<ECSEntity> m_entities;
+	uint32 m_freeEntities;
+	uint32 m_numEntities;
+
+	Array<ECSArchetype*> m_archetypes;
+	Map<Array<uint32>, ECSArchetype*> m_archetypeMap;
+
+	// Queries of the systems updated by this ECS, and for component pools,
+	// the queries that use each component type
+	Array<ECSQuery*> m_queries;
+	Array<Array<ECSQuery*>> m_queriesByType;
+
+	// Current version for change tracking
+	uint32 m_changeVersion;
+
+	// System scheduling
+	ThreadPool* m_threadPool;
+	uint32 m_parallelGrainSize;
+	Array<SystemTask> m_systemTasks;
+	Array<uint32> m_systemWaves;
+	Array<Array<BaseECSComponent*>> m_threadComponentParams;
+
+	// Per-thread command buffers, and scratch space for their playback
+	Array<ECSCommandBuffer*> m_commandBuffers;
+	Array<EntityHandle> m_playbackEntities;
+	Array<ECSCommandBuffer::Command> m_playbackCommands;
 };
 
 
 template <class T_Component>
 void ECS::AddComponent(EntityHandle entity, const T_Component& component)
 {
-	// Create the component then add it to the entity
-	ECSEntity::EntityComponent pair;
-	pair.id = T_Component::ID;
-	pair.handle = DoCreateComponent(entity, T_Component::ID, &component);
-	((ECSEntity*) entity)->components.push_back(pair);
+	AddComponentInternal(entity, T_Component::ID, &component);
 }
 
 template <class T_Component>
 void ECS::RemoveComponent(EntityHandle entity)
 {
-	Array<ECSEntity::EntityComponent>& components = ((ECSEntity*) entity)->components;
-	for (uint32 i = 0; i < components.size(); i++)
-	{
-		if (components[i].id == T_Component::ID)
-		{
-			DoRemoveComponent(T_Component::ID, components[i].handle);
-			components.erase(components.begin() + i);
-			i--;
-		}
-	}
+	RemoveComponentInternal(entity, T_Component::ID);
 }
 
 template <class T_Component>
 T_Component* ECS::GetComponent(EntityHandle entity)
 {
-	Array<ECSEntity::EntityComponent>& components = ((ECSEntity*) entity)->components;
-	for (uint32 i = 0; i < components.size(); i++)
-	{
-		if (components[i].id == T_Component::ID)
-		{
-			return (T_Component*) m_components[
-				T_Component::ID]->GetComponent(components[i].handle);
-		}
-	}
-	return nullptr;
+	return (T_Component*) FindComponent(entity, T_Component::ID, true);
+}
+
+template <class T_Component>
+const T_Component* ECS::GetComponentReadOnly(EntityHandle entity)
+{
+	return (const T_Component*) FindComponent(entity, T_Component::ID, false);
 }
 
 template <class T_Component>
 bool ECS::HasComponent(EntityHandle entity)
 {
-	Array<ECSEntity::EntityComponent>& components = ((ECSEntity*) entity)->components;
-	for (uint32 i = 0; i < components.size(); i++)
-	{
-		if (components[i].id == T_Component::ID)
-			return true;
-	}
-	return false;
+	return (FindComponent(entity, T_Component::ID, false) != nullptr);
+}
+
+template <class T_Component>
+void ECS::ReserveComponents(uint32 capacity)
+{
+	ReserveComponentsInternal(T_Component::ID, capacity);
+}
+
+template <class T_Component>
+void ECS::SetComponentGrowthPolicy(const ECSGrowthPolicy& growthPolicy)
+{
+	GetComponentPool(T_Component::ID)->SetGrowthPolicy(growthPolicy);
+}
+
+template <class T_Component>
+uint32 ECS::GetComponentCapacity()
+{
+	return GetComponentPool(T_Component::ID)->GetCapacity();
+}
+
+template <class T_Component>
+uint32 ECS::GetComponentVersion(EntityHandle entity)
+{
+	return FindComponentVersion(entity, T_Component::ID);
+}
+
+template <class T_Component>
+bool ECS::HasComponentChanged(EntityHandle entity, uint32 sinceVersion)
+{
+	uint32 version = FindComponentVersion(entity, T_Component::ID);
+	return (version != 0 && IsChangeVersionNewer(version, sinceVersion));
 }
 
 template <class T1>
 EntityHandle ECS::CreateEntity(const T1& component)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, component);
-	return entity;
+	const BaseECSComponent* components[] = { &component };
+	uint32 componentIds[] = { T1::ID };
+	return CreateEntityInternal(components, componentIds, 1);
 }
 
 template <class T1, class T2>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2 };
+	uint32 componentIds[] = { T1::ID, T2::ID };
+	return CreateEntityInternal(components, componentIds, 2);
 }
 
 template <class T1, class T2, class T3>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID };
+	return CreateEntityInternal(components, componentIds, 3);
 }
 
 template <class T1, class T2, class T3, class T4>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID };
+	return CreateEntityInternal(components, componentIds, 4);
 }
 
 template <class T1, class T2, class T3, class T4, class T5>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID };
+	return CreateEntityInternal(components, componentIds, 5);
 }
 
 template <class T1, class T2, class T3, class T4, class T5, class T6>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	AddComponent(entity, c6);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5, &c6 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID, T6::ID };
+	return CreateEntityInternal(components, componentIds, 6);
 }
 
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	AddComponent(entity, c6);
-	AddComponent(entity, c7);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5, &c6, &c7 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID, T6::ID, T7::ID };
+	return CreateEntityInternal(components, componentIds, 7);
 }
 
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	AddComponent(entity, c6);
-	AddComponent(entity, c7);
-	AddComponent(entity, c8);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5, &c6, &c7, &c8 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID, T6::ID, T7::ID, T8::ID };
+	return CreateEntityInternal(components, componentIds, 8);
 }
 
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	AddComponent(entity, c6);
-	AddComponent(entity, c7);
-	AddComponent(entity, c8);
-	AddComponent(entity, c9);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5, &c6, &c7, &c8, &c9 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID, T6::ID, T7::ID, T8::ID, T9::ID };
+	return CreateEntityInternal(components, componentIds, 9);
 }
 
 template <class T1, class T2, class T3, class T4, class T5, class T6, class T7, class T8, class T9, class T10>
 EntityHandle ECS::CreateEntity(const T1& c1, const T2& c2, const T3& c3, const T4& c4, const T5& c5, const T6& c6, const T7& c7, const T8& c8, const T9& c9, const T10& c10)
 {
-	EntityHandle entity = CreateEntity();
-	AddComponent(entity, c1);
-	AddComponent(entity, c2);
-	AddComponent(entity, c3);
-	AddComponent(entity, c4);
-	AddComponent(entity, c5);
-	AddComponent(entity, c6);
-	AddComponent(entity, c7);
-	AddComponent(entity, c8);
-	AddComponent(entity, c9);
-	AddComponent(entity, c10);
-	return entity;
+	const BaseECSComponent* components[] = { &c1, &c2, &c3, &c4, &c5, &c6, &c7, &c8, &c9, &c10 };
+	uint32 componentIds[] = { T1::ID, T2::ID, T3::ID, T4::ID, T5::ID, T6::ID, T7::ID, T8::ID, T9::ID, T10::ID };
+	return CreateEntityInternal(components, componentIds, 10);
 }
 
 
@@ -0,0 +1,256 @@
+#include "cmgECSArchetype.h"
+#include <cmgCore/cmgAssert.h>
+#include <cstring>
+
+
+static inline uint32 AlignColumnOffset(uint32 offset)
+{
+	return (offset + ECSArchetype::COLUMN_ALIGNMENT - 1) &
+		~(ECSArchetype::COLUMN_ALIGNMENT - 1);
+}
+
+
+ECSArchetype::ECSArchetype(const Array<uint32>& componentTypes)
+	: m_componentTypes(componentTypes)
+	, m_count(0)
+{
+	uint32 rowSize = sizeof(EntityHandle) +
+		(sizeof(uint32) * (uint32) m_componentTypes.size());
+	for (uint32 i = 0; i < m_componentTypes.size(); i++)
+	{
+		uint32 componentId = m_componentTypes[i];
+		CMG_ASSERT(BaseECSComponent::IsTypeValid(componentId));
+		CMG_ASSERT(i == 0 || m_componentTypes[i - 1] < componentId);
+		m_componentSizes.push_back((uint32)
+			BaseECSComponent::GetTypeSize(componentId));
+		m_createFunctions.push_back(
+			BaseECSComponent::GetTypeCreateFunction(componentId));
+		m_freeFunctions.push_back(
+			BaseECSComponent::GetTypeFreeFunction(componentId));
+		rowSize += m_componentSizes[i];
+	}
+
+	// Fit as many rows as possible into a chunk, leaving room for the
+	// padding between columns. Very large components get one row per chunk.
+	uint32 padding = COLUMN_ALIGNMENT * ((GetNumColumns() * 2) + 1);
+	m_chunkCapacity = 1;
+	if (CHUNK_SIZE > padding + rowSize)
+		m_chunkCapacity = (CHUNK_SIZE - padding) / rowSize;
+
+	// Lay out the columns: the entity column comes first, followed by the
+	// change versions of each component column
+	uint32 offset = AlignColumnOffset(m_chunkCapacity * sizeof(EntityHandle));
+	for (uint32 i = 0; i < m_componentTypes.size(); i++)
+	{
+		m_versionOffsets.push_back(offset);
+		offset = AlignColumnOffset(offset + (m_chunkCapacity * sizeof(uint32)));
+	}
+	for (uint32 i = 0; i < m_componentTypes.size(); i++)
+	{
+		m_columnOffsets.push_back(offset);
+		offset = AlignColumnOffset(offset +
+			(m_chunkCapacity * m_componentSizes[i]));
+	}
+	m_chunkBytes = offset;
+}
+
+ECSArchetype::~ECSArchetype()
+{
+	Clear();
+}
+
+uint32 ECSArchetype::size() const
+{
+	return m_count;
+}
+
+int32 ECSArchetype::GetColumn(uint32 componentId) const
+{
+	// Archetypes are small, so a linear scan over sorted IDs is fastest
+	for (uint32 i = 0; i < m_componentTypes.size(); i++)
+	{
+		if (m_componentTypes[i] == componentId)
+			return (int32) i;
+		else if (m_componentTypes[i] > componentId)
+			break;
+	}
+	return -1;
+}
+
+bool ECSArchetype::HasComponentType(uint32 componentId) const
+{
+	return (GetColumn(componentId) >= 0);
+}
+
+bool ECSArchetype::HasComponentTypes(const Array<uint32>& componentTypes,
+	const Array<uint32>& componentFlags, uint32 optionalFlag) const
+{
+	for (uint32 i = 0; i < componentTypes.size(); i++)
+	{
+		if ((componentFlags[i] & optionalFlag) == 0 &&
+			!HasComponentType(componentTypes[i]))
+			return false;
+	}
+	return true;
+}
+
+EntityHandle ECSArchetype::GetEntity(uint32 index) const
+{
+	CMG_ASSERT(index < m_count);
+	const Chunk& chunk = m_chunks[index / m_chunkCapacity];
+	return ((const EntityHandle*) chunk.data)[index % m_chunkCapacity];
+}
+
+BaseECSComponent* ECSArchetype::GetComponent(uint32 index, uint32 column)
+{
+	CMG_ASSERT(index < m_count);
+	CMG_ASSERT(column < m_componentTypes.size());
+	Chunk& chunk = m_chunks[index / m_chunkCapacity];
+	return (BaseECSComponent*) (chunk.data + m_columnOffsets[column] +
+		((index % m_chunkCapacity) * m_componentSizes[column]));
+}
+
+EntityHandle* ECSArchetype::GetChunkEntities(uint32 chunk)
+{
+	return (EntityHandle*) m_chunks[chunk].data;
+}
+
+uint8* ECSArchetype::GetChunkColumn(uint32 chunk, uint32 column)
+{
+	return m_chunks[chunk].data + m_columnOffsets[column];
+}
+
+uint32 ECSArchetype::GetVersion(uint32 index, uint32 column) const
+{
+	CMG_ASSERT(index < m_count);
+	const Chunk& chunk = m_chunks[index / m_chunkCapacity];
+	return ((const uint32*) (chunk.data + m_versionOffsets[column]))
+		[index % m_chunkCapacity];
+}
+
+void ECSArchetype::MarkChanged(uint32 index, uint32 column, uint32 version)
+{
+	CMG_ASSERT(index < m_count);
+	uint32 chunk = index / m_chunkCapacity;
+	GetChunkVersions(chunk, column)[index % m_chunkCapacity] = version;
+	if (IsChangeVersionNewer(version, GetChunkVersion(chunk, column)))
+		SetChunkVersion(chunk, column, version);
+}
+
+uint32* ECSArchetype::GetChunkVersions(uint32 chunk, uint32 column)
+{
+	return (uint32*) (m_chunks[chunk].data + m_versionOffsets[column]);
+}
+
+uint32 ECSArchetype::Allocate(EntityHandle entity)
+{
+	uint32 index = m_count;
+	if (index == m_chunks.size() * m_chunkCapacity)
+	{
+		Chunk chunk;
+		chunk.data = new uint8[m_chunkBytes];
+		chunk.count = 0;
+		m_chunks.push_back(chunk);
+		m_chunkVersions.resize(m_chunkVersions.size() +
+			m_componentTypes.size(), 0);
+	}
+
+	Chunk& chunk = m_chunks.back();
+	((EntityHandle*) chunk.data)[chunk.count] = entity;
+	chunk.count++;
+	m_count++;
+	return index;
+}
+
+uint32 ECSArchetype::AllocateRows(const EntityHandle* entities, uint32 count)
+{
+	uint32 first = m_count;
+	while (count > 0)
+	{
+		if (m_count == m_chunks.size() * m_chunkCapacity)
+		{
+			Chunk chunk;
+			chunk.data = new uint8[m_chunkBytes];
+			chunk.count = 0;
+			m_chunks.push_back(chunk);
+			m_chunkVersions.resize(m_chunkVersions.size() +
+				m_componentTypes.size(), 0);
+		}
+
+		// Fill the rest of the last chunk
+		Chunk& chunk = m_chunks.back();
+		uint32 rows = m_chunkCapacity - chunk.count;
+		if (rows > count)
+			rows = count;
+		memcpy(((EntityHandle*) chunk.data) + chunk.count, entities,
+			rows * sizeof(EntityHandle));
+		chunk.count += rows;
+		m_count += rows;
+		entities += rows;
+		count -= rows;
+	}
+	return first;
+}
+
+EntityHandle ECSArchetype::Deallocate(uint32 index)
+{
+	CMG_ASSERT(index < m_count);
+	uint32 lastIndex = m_count - 1;
+	EntityHandle movedEntity = NULL_ENTITY_HANDLE;
+
+	// Relocate the last row into the hole
+	if (index != lastIndex)
+	{
+		movedEntity = GetEntity(lastIndex);
+		Chunk& dest = m_chunks[index / m_chunkCapacity];
+		((EntityHandle*) dest.data)[index % m_chunkCapacity] = movedEntity;
+		for (uint32 i = 0; i < m_componentTypes.size(); i++)
+		{
+			BaseECSComponent::RelocateComponents(m_componentTypes[i],
+				GetComponent(index, i), GetComponent(lastIndex, i), 1);
+			MarkChanged(index, i, GetVersion(lastIndex, i));
+		}
+	}
+
+	// Release the last chunk once it becomes empty
+	Chunk& last = m_chunks.back();
+	last.count--;
+	m_count--;
+	if (last.count == 0)
+	{
+		delete [] last.data;
+		m_chunks.pop_back();
+		m_chunkVersions.resize(m_chunkVersions.size() -
+			m_componentTypes.size());
+	}
+	return movedEntity;
+}
+
+void ECSArchetype::Clear()
+{
+	for (uint32 i = 0; i < m_chunks.size(); i++)
+	{
+		Chunk& chunk = m_chunks[i];
+		for (uint32 column = 0; column < m_componentTypes.size(); column++)
+		{
+			if (BaseECSComponent::IsTypeTriviallyCopyable(m_componentTypes[column]))
+				continue;
+			uint8* columnData = chunk.data + m_columnOffsets[column];
+			for (uint32 j = 0; j < chunk.count; j++)
+			{
+				m_freeFunctions[column]((BaseECSComponent*)
+					(columnData + (j * m_componentSizes[column])));
+			}
+		}
+	}
+	ReleaseChunks();
+}
+
+void ECSArchetype::ReleaseChunks()
+{
+	for (uint32 i = 0; i < m_chunks.size(); i++)
+		delete [] m_chunks[i].data;
+	m_chunks.clear();
+	m_chunkVersions.clear();
+	m_count = 0;
+}
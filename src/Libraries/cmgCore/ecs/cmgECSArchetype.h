@@ -0,0 +1,105 @@
+#ifndef _CMG_CORE_ECS_ARCHETYPE_H_
+#define _CMG_CORE_ECS_ARCHETYPE_H_
+
+#include <cmgCore/ecs/cmgECSComponent.h>
+
+
+//-----------------------------------------------------------------------------
+// ECSArchetype - Storage for every entity that has the same set of component
+// types. Entities are packed into fixed-size chunks, and inside a chunk each
+// component type is stored as its own contiguous column.
+//-----------------------------------------------------------------------------
+class ECSArchetype
+{
+public:
+	friend class ECS;
+
+	// Target size in bytes of a single chunk
+	static const uint32 CHUNK_SIZE = 16 * 1024;
+
+	// Alignment of each column within a chunk
+	static const uint32 COLUMN_ALIGNMENT = 16;
+
+public:
+	// Component types must be sorted by ID
+	ECSArchetype(const Array<uint32>& componentTypes);
+	~ECSArchetype();
+
+	uint32 size() const;
+	inline const Array<uint32>& GetComponentTypes() const { return m_componentTypes; }
+	inline uint32 GetNumColumns() const { return (uint32) m_componentTypes.size(); }
+	inline uint32 GetChunkCapacity() const { return m_chunkCapacity; }
+	inline uint32 GetNumChunks() const { return (uint32) m_chunks.size(); }
+	inline uint32 GetChunkSize(uint32 chunk) const { return m_chunks[chunk].count; }
+	inline uint32 GetColumnStride(uint32 column) const { return m_componentSizes[column]; }
+
+	// Returns the column for a component type, or -1 if not in this archetype
+	int32 GetColumn(uint32 componentId) const;
+	bool HasComponentType(uint32 componentId) const;
+	bool HasComponentTypes(const Array<uint32>& componentTypes,
+		const Array<uint32>& componentFlags, uint32 optionalFlag) const;
+
+	// Data access
+	EntityHandle GetEntity(uint32 index) const;
+	BaseECSComponent* GetComponent(uint32 index, uint32 column);
+	EntityHandle* GetChunkEntities(uint32 chunk);
+	uint8* GetChunkColumn(uint32 chunk, uint32 column);
+
+	// Change versions. Each component records the ECS change version when it
+	// was last written to, and each chunk column records the latest of them.
+	// Marking a component never makes its chunk's version older.
+	uint32 GetVersion(uint32 index, uint32 column) const;
+	void MarkChanged(uint32 index, uint32 column, uint32 version);
+	uint32* GetChunkVersions(uint32 chunk, uint32 column);
+	inline uint32 GetChunkVersion(uint32 chunk, uint32 column) const
+	{
+		return m_chunkVersions[(chunk * m_componentTypes.size()) + column];
+	}
+	inline void SetChunkVersion(uint32 chunk, uint32 column, uint32 version)
+	{
+		m_chunkVersions[(chunk * m_componentTypes.size()) + column] = version;
+	}
+
+private:
+	// Reserve a row at the end of the archetype. Components in the new row
+	// are left unconstructed.
+	uint32 Allocate(EntityHandle entity);
+
+	// Reserve rows for several entities at once, returning the first index
+	uint32 AllocateRows(const EntityHandle* entities, uint32 count);
+
+	// Release a row whose components have already been destroyed or moved
+	// out. The last row is relocated into the hole, and the entity that was
+	// moved is returned (or NULL_ENTITY_HANDLE if nothing moved).
+	EntityHandle Deallocate(uint32 index);
+
+	void Clear();
+
+	// Free the chunks without destroying the components in them
+	void ReleaseChunks();
+
+	struct Chunk
+	{
+		uint8* data;
+		uint32 count;
+	};
+
+	Array<uint32> m_componentTypes;
+	Array<uint32> m_componentSizes;
+	Array<uint32> m_columnOffsets;
+	Array<uint32> m_versionOffsets;
+	Array<ECSComponentCreateFunction> m_createFunctions;
+	Array<ECSComponentFreeFunction> m_freeFunctions;
+	uint32 m_chunkCapacity;
+	uint32 m_chunkBytes;
+	uint32 m_count;
+	Array<Chunk> m_chunks;
+	Array<uint32> m_chunkVersions;
+
+	// Cached transitions to the archetypes with one component added/removed
+	Map<uint32, ECSArchetype*> m_addEdges;
+	Map<uint32, ECSArchetype*> m_removeEdges;
+};
+
+
+#endif // _CMG_CORE_ECS_ARCHETYPE_H_
@@ -0,0 +1,116 @@
+#include "cmgECSCommandBuffer.h"
+#include <cmgCore/cmgAssert.h>
+
+
+// Alignment of components stored in the command buffer
+static const uint32 COMPONENT_ALIGNMENT = 16;
+
+
+ECSCommandBuffer::ECSCommandBuffer()
+	: m_numPendingEntities(0)
+	, m_currentBlock(0)
+{
+}
+
+ECSCommandBuffer::~ECSCommandBuffer()
+{
+	Clear();
+	for (uint32 i = 0; i < m_blocks.size(); i++)
+		delete [] m_blocks[i].data;
+	m_blocks.clear();
+}
+
+void ECSCommandBuffer::Clear()
+{
+	// Destroy the recorded components, but keep the blocks for reuse
+	for (uint32 i = 0; i < m_commands.size(); i++)
+	{
+		Command& command = m_commands[i];
+		if (command.component != nullptr)
+		{
+			BaseECSComponent::GetTypeFreeFunction(
+				command.componentId)(command.component);
+		}
+	}
+	for (uint32 i = 0; i < m_blocks.size(); i++)
+		m_blocks[i].used = 0;
+	m_currentBlock = 0;
+	m_commands.clear();
+	m_numPendingEntities = 0;
+}
+
+EntityHandle ECSCommandBuffer::CreateEntity()
+{
+	// Pending handles have a generation of zero, which never matches a live
+	// entity. The index is offset by one so it can't be a null handle.
+	m_numPendingEntities++;
+	Command command;
+	command.type = CommandType::k_createEntity;
+	command.entity.index = m_numPendingEntities;
+	command.entity.generation = 0;
+	command.componentId = 0;
+	command.component = nullptr;
+	m_commands.push_back(command);
+	return command.entity;
+}
+
+void ECSCommandBuffer::RemoveEntity(EntityHandle entity)
+{
+	Command command;
+	command.type = CommandType::k_removeEntity;
+	command.entity = entity;
+	command.componentId = 0;
+	command.component = nullptr;
+	m_commands.push_back(command);
+}
+
+void ECSCommandBuffer::AddComponent(EntityHandle entity, uint32 componentId,
+	const BaseECSComponent* component)
+{
+	CMG_ASSERT(BaseECSComponent::IsTypeValid(componentId));
+
+	// Copy the component into the buffer's own memory
+	Command command;
+	command.type = CommandType::k_addComponent;
+	command.entity = entity;
+	command.componentId = componentId;
+	command.component = BaseECSComponent::GetTypeCreateFunction(componentId)(
+		AllocateComponentMemory((uint32) BaseECSComponent::GetTypeSize(componentId)),
+		component);
+	m_commands.push_back(command);
+}
+
+void ECSCommandBuffer::RemoveComponent(EntityHandle entity, uint32 componentId)
+{
+	Command command;
+	command.type = CommandType::k_removeComponent;
+	command.entity = entity;
+	command.componentId = componentId;
+	command.component = nullptr;
+	m_commands.push_back(command);
+}
+
+void* ECSCommandBuffer::AllocateComponentMemory(uint32 size)
+{
+	size = (size + COMPONENT_ALIGNMENT - 1) & ~(COMPONENT_ALIGNMENT - 1);
+
+	// Fill the blocks in order. Blocks are never moved, so recorded
+	// components keep their address until the buffer is cleared.
+	for (; m_currentBlock < m_blocks.size(); m_currentBlock++)
+	{
+		Block& block = m_blocks[m_currentBlock];
+		if (block.used + size <= block.size)
+		{
+			void* memory = block.data + block.used;
+			block.used += size;
+			return memory;
+		}
+	}
+
+	Block block;
+	block.size = (size > BLOCK_SIZE ? size : BLOCK_SIZE);
+	block.data = new uint8[block.size];
+	block.used = size;
+	m_blocks.push_back(block);
+	return block.data;
+}
@@ -0,0 +1,113 @@
+#ifndef _CMG_CORE_ECS_COMMAND_BUFFER_H_
+#define _CMG_CORE_ECS_COMMAND_BUFFER_H_
+
+#include <cmgCore/ecs/cmgECSComponent.h>
+
+
+//-----------------------------------------------------------------------------
+// ECSCommandBuffer - Records structural changes (creating and removing
+// entities and components) so they can be applied later at a sync point,
+// when no systems are iterating the component storage.
+//
+// Entities created through a command buffer get a pending handle that can be
+// used with the same command buffer until it is played back.
+//-----------------------------------------------------------------------------
+class ECSCommandBuffer
+{
+public:
+	friend class ECS;
+
+	enum class CommandType
+	{
+		k_createEntity = 0,
+		k_removeEntity,
+		k_addComponent,
+		k_removeComponent,
+	};
+
+	struct Command
+	{
+		CommandType type;
+		EntityHandle entity;
+		uint32 componentId;
+		BaseECSComponent* component;
+	};
+
+	// Size of each block used to store recorded components
+	static const uint32 BLOCK_SIZE = 16 * 1024;
+
+public:
+	ECSCommandBuffer();
+	~ECSCommandBuffer();
+
+	inline bool IsEmpty() const { return m_commands.empty(); }
+	inline uint32 GetNumCommands() const { return (uint32) m_commands.size(); }
+	inline uint32 GetNumPendingEntities() const { return m_numPendingEntities; }
+	inline const Command& GetCommand(uint32 index) const { return m_commands[index]; }
+
+	// Returns true if the handle was returned by CreateEntity on a command
+	// buffer and hasn't been played back yet
+	static inline bool IsPendingEntity(EntityHandle entity)
+	{
+		return (entity.generation == 0 && entity.index != 0);
+	}
+
+	// Discard all recorded commands
+	void Clear();
+
+	// Command recording
+	EntityHandle CreateEntity();
+	template <class... T_Components>
+	EntityHandle CreateEntity(const T_Components&... components);
+	void RemoveEntity(EntityHandle entity);
+	template <class T_Component>
+	void AddComponent(EntityHandle entity, const T_Component& component);
+	template <class T_Component>
+	void RemoveComponent(EntityHandle entity);
+	void AddComponent(EntityHandle entity, uint32 componentId,
+		const BaseECSComponent* component);
+	void RemoveComponent(EntityHandle entity, uint32 componentId);
+
+private:
+	ECSCommandBuffer(const ECSCommandBuffer& copy) = delete;
+	ECSCommandBuffer& operator=(const ECSCommandBuffer& copy) = delete;
+
+	void* AllocateComponentMemory(uint32 size);
+
+	struct Block
+	{
+		uint8* data;
+		uint32 size;
+		uint32 used;
+	};
+
+	Array<Command> m_commands;
+	Array<Block> m_blocks;
+	uint32 m_numPendingEntities;
+	uint32 m_currentBlock;
+};
+
+
+template <class... T_Components>
+EntityHandle ECSCommandBuffer::CreateEntity(const T_Components&... components)
+{
+	EntityHandle entity = CreateEntity();
+	int unpack[] = { 0, (AddComponent(entity, components), 0)... };
+	(void) unpack;
+	return entity;
+}
+
+template <class T_Component>
+void ECSCommandBuffer::AddComponent(EntityHandle entity, const T_Component& component)
+{
+	AddComponent(entity, T_Component::ID, &component);
+}
+
+template <class T_Component>
+void ECSCommandBuffer::RemoveComponent(EntityHandle entity)
+{
+	RemoveComponent(entity, T_Component::ID);
+}
+
+
+#endif // _CMG_CORE_ECS_COMMAND_BUFFER_H_
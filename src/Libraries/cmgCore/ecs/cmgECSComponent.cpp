@@ -1,6 +1,7 @@
 #include "cmgECS.h"
 #include "cmgAssert.h"
 #include <cmgMath/cmgMathLib.h>
+#include <cstring>
 
 
 Array<BaseECSComponent::ComponentTypeInfo>* BaseECSComponent::componentTypes = nullptr;
@@ -15,14 +16,51 @@ Array<BaseECSComponent::ComponentTypeInfo>& BaseECSComponent::GetComponentTypes(
 
 uint32 BaseECSComponent::RegisterComponentType(
 	ECSComponentCreateFunction createFunction,
-	ECSComponentFreeFunction freeFunction, size_t size)
+	ECSComponentFreeFunction freeFunction,
+	ECSComponentMoveFunction moveFunction, size_t size,
+	bool isTriviallyCopyable, bool isTriviallyRelocatable)
 {
 	uint32 componentId = GetComponentTypes().size();
 	ComponentTypeInfo typeInfo;
 	typeInfo.createFunction = createFunction;
 	typeInfo.freeFunction = freeFunction;
+	typeInfo.moveFunction = moveFunction;
+	typeInfo.saveFunction = nullptr;
+	typeInfo.loadFunction = nullptr;
 	typeInfo.size = size;
+	typeInfo.isTriviallyCopyable = isTriviallyCopyable;
+	typeInfo.isTriviallyRelocatable = isTriviallyRelocatable;
 	GetComponentTypes().push_back(typeInfo);
 	return componentId;
 }
 
+void BaseECSComponent::SetTypeSnapshotFunctions(uint32 id,
+	ECSComponentSaveFunction saveFunction,
+	ECSComponentLoadFunction loadFunction)
+{
+	CMG_ASSERT(IsTypeValid(id));
+	ComponentTypeInfo& typeInfo = GetComponentTypes()[id];
+	typeInfo.saveFunction = saveFunction;
+	typeInfo.loadFunction = loadFunction;
+}
+
+void BaseECSComponent::RelocateComponents(uint32 id, void* destination,
+	BaseECSComponent* source, size_t count)
+{
+	const ComponentTypeInfo& typeInfo = GetComponentTypes()[id];
+	if (typeInfo.isTriviallyRelocatable)
+	{
+		memcpy(destination, source, typeInfo.size * count);
+		return;
+	}
+
+	uint8* dest = (uint8*) destination;
+	uint8* src = (uint8*) source;
+	for (size_t i = 0; i < count; i++)
+	{
+		typeInfo.moveFunction(dest, (BaseECSComponent*) src);
+		typeInfo.freeFunction((BaseECSComponent*) src);
+		dest += typeInfo.size;
+		src += typeInfo.size;
+	}
+}
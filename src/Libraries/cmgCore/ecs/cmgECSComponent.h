@@ -3,30 +3,75 @@
 
 #include <cmgCore/containers/cmgArray.h>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 
 struct BaseECSComponent;
-class ECSEntity;
+class ECSSnapshotWriter;
+class ECSSnapshotReader;
+
+
+// Handle to an entity: the index of the entity's slot in the ECS, and the
+// generation of that slot when the entity was created. A slot's generation
+// changes when its entity is removed, so stale handles can be detected.
+struct EntityHandle
+{
+	uint32 index;
+	uint32 generation;
+
+	inline bool operator==(const EntityHandle& other) const
+	{
+		return (index == other.index && generation == other.generation);
+	}
+
+	inline bool operator!=(const EntityHandle& other) const
+	{
+		return (index != other.index || generation != other.generation);
+	}
+};
 
-typedef ECSEntity* EntityHandle;
 typedef BaseECSComponent* (*ECSComponentCreateFunction)(
 	void* location, const BaseECSComponent* component);
 typedef void(*ECSComponentFreeFunction)(BaseECSComponent* component);
-constexpr ECSEntity* NULL_ENTITY_HANDLE = nullptr;
+typedef BaseECSComponent* (*ECSComponentMoveFunction)(
+	void* location, BaseECSComponent* component);
+typedef void (*ECSComponentSaveFunction)(
+	const BaseECSComponent* component, ECSSnapshotWriter& writer);
+typedef BaseECSComponent* (*ECSComponentLoadFunction)(
+	void* location, ECSSnapshotReader& reader);
+
+// Live entities never have a generation of zero
+constexpr EntityHandle NULL_ENTITY_HANDLE = { 0, 0 };
+
+// Returns true if a component change version is newer than another. Versions
+// wrap around, so they are compared by their signed difference.
+inline bool IsChangeVersionNewer(uint32 version, uint32 sinceVersion)
+{
+	return ((int32) (version - sinceVersion) > 0);
+}
 
 
 struct BaseECSComponent
 {
 public:
-	ECSEntity* entity = nullptr;
+	EntityHandle entity = NULL_ENTITY_HANDLE;
 
-	virtual ~BaseECSComponent()
-	{
-	}
+	// Components are always destroyed through their type's free function, so
+	// the destructor isn't virtual. This keeps plain data components
+	// trivially copyable.
 
 public:
 	static uint32 RegisterComponentType(
 		ECSComponentCreateFunction createFunction,
-		ECSComponentFreeFunction freeFunction, size_t size);
+		ECSComponentFreeFunction freeFunction,
+		ECSComponentMoveFunction moveFunction, size_t size,
+		bool isTriviallyCopyable, bool isTriviallyRelocatable);
+
+	// Set the functions that write and read components of a type in ECS
+	// snapshots. Only needed for types that aren't trivially copyable.
+	static void SetTypeSnapshotFunctions(uint32 id,
+		ECSComponentSaveFunction saveFunction,
+		ECSComponentLoadFunction loadFunction);
 
 	inline static ECSComponentCreateFunction GetTypeCreateFunction(uint32 id)
 	{
@@ -38,11 +83,43 @@ public:
 		return GetComponentTypes()[id].freeFunction;
 	}
 
+	inline static ECSComponentMoveFunction GetTypeMoveFunction(uint32 id)
+	{
+		return GetComponentTypes()[id].moveFunction;
+	}
+
 	inline static size_t GetTypeSize(uint32 id)
 	{
 		return GetComponentTypes()[id].size;
 	}
 
+	inline static ECSComponentSaveFunction GetTypeSaveFunction(uint32 id)
+	{
+		return GetComponentTypes()[id].saveFunction;
+	}
+
+	inline static ECSComponentLoadFunction GetTypeLoadFunction(uint32 id)
+	{
+		return GetComponentTypes()[id].loadFunction;
+	}
+
+	inline static bool IsTypeTriviallyCopyable(uint32 id)
+	{
+		return GetComponentTypes()[id].isTriviallyCopyable;
+	}
+
+	// Returns true if components of the type can be moved by copying their
+	// bytes, without calling constructors or destructors
+	inline static bool IsTypeTriviallyRelocatable(uint32 id)
+	{
+		return GetComponentTypes()[id].isTriviallyRelocatable;
+	}
+
+	// Move components of a type into uninitialized memory, leaving the
+	// source components destroyed. The two ranges must not overlap.
+	static void RelocateComponents(uint32 id, void* destination,
+		BaseECSComponent* source, size_t count);
+
 	inline static bool IsTypeValid(uint32 id)
 	{
 		return (id < GetComponentTypes().size());
@@ -54,7 +131,12 @@ private:
 	{
 		ECSComponentCreateFunction createFunction;
 		ECSComponentFreeFunction freeFunction;
+		ECSComponentMoveFunction moveFunction;
+		ECSComponentSaveFunction saveFunction;
+		ECSComponentLoadFunction loadFunction;
 		size_t size;
+		bool isTriviallyCopyable;
+		bool isTriviallyRelocatable;
 	};
 
 	static Array<BaseECSComponent::ComponentTypeInfo>& GetComponentTypes();
@@ -81,6 +163,20 @@ BaseECSComponent* ECSComponentCreate(void* location, const BaseECSComponent* com
 	return new (location) T_Component(*(T_Component*) component);
 }
 
+template <typename T_Component>
+BaseECSComponent* ECSComponentMove(void* location, BaseECSComponent* component)
+{
+	return new (location) T_Component(std::move(*(T_Component*) component));
+}
+
+// Components that are trivially copyable are relocated with memcpy.
+// Specialize this for other types that are safe to move byte-wise.
+template <typename T_Component>
+struct ECSComponentIsTriviallyRelocatable :
+	public std::is_trivially_copyable<T_Component>
+{
+};
+
 template <typename T_Component>
 void ECSComponentFree(BaseECSComponent* component)
 {
@@ -97,7 +193,9 @@ ECSComponent<T>::ECSComponent()
 
 template <typename T>
 const uint32 ECSComponent<T>::ID(BaseECSComponent::RegisterComponentType(
-	ECSComponentCreate<T>, ECSComponentFree<T>, sizeof(T)));
+	ECSComponentCreate<T>, ECSComponentFree<T>, ECSComponentMove<T>, sizeof(T),
+	std::is_trivially_copyable<T>::value,
+	ECSComponentIsTriviallyRelocatable<T>::value));
 
 template <typename T>
 const size_t ECSComponent<T>::SIZE(sizeof(T));
@@ -1,12 +1,16 @@
 #include "cmgECSComponentPool.h"
 #include <cmgCore/cmgAssert.h>
+#include <cstring>
 
+const ECSComponentPool::ComponentHandle ECSComponentPool::INVALID_HANDLE;
 
 ECSComponentPool::ECSComponentPool(uint32 componentId)
 	: m_data(nullptr)
 	, m_componentId(componentId)
 	, m_capacity(0)
+	, m_numGrowths(0)
 	, m_count(0)
+	, m_version(0)
 {
 	m_componentSize = 
 		BaseECSComponent::GetTypeSize(m_componentId);
@@ -14,6 +18,10 @@ ECSComponentPool::ECSComponentPool(uint32 componentId)
 		BaseECSComponent::GetTypeCreateFunction(m_componentId);
 	m_componentFreeFunc =
 		BaseECSComponent::GetTypeFreeFunction(m_componentId);
+	m_isTriviallyCopyable =
+		BaseECSComponent::IsTypeTriviallyCopyable(m_componentId);
+	m_isTriviallyRelocatable =
+		BaseECSComponent::IsTypeTriviallyRelocatable(m_componentId);
 }
 
 ECSComponentPool::~ECSComponentPool()
@@ -49,25 +57,70 @@ BaseECSComponent * ECSComponentPool::GetComponent(ComponentHandle handle)
 
 void ECSComponentPool::Clear()
 {
-	for (uint32 i = 0; i < m_count; i++)
-		m_componentFreeFunc((BaseECSComponent*) &m_data[i * m_componentSize]);
+	// Trivially copyable components have nothing to destroy
+	if (!m_isTriviallyCopyable)
+	{
+		for (uint32 i = 0; i < m_count; i++)
+			m_componentFreeFunc((BaseECSComponent*) &m_data[i * m_componentSize]);
+	}
 	m_count = 0;
+	m_sparse.clear();
+	m_versions.clear();
 }
 
-ECSComponentPool::ComponentHandle ECSComponentPool::CreateComponent(const BaseECSComponent* component)
+ECSComponentPool::ComponentHandle ECSComponentPool::CreateComponent(
+	EntityHandle entity, const BaseECSComponent* component, uint32 version)
 {
-	if (m_capacity == 0)
-		Reserve(1);
-	else if (m_count + 1 > m_capacity)
-		Reserve(m_capacity * 2);
+	CMG_ASSERT(FindHandle(entity.index) == INVALID_HANDLE);
+	Grow(m_count + 1);
 
 	uint32 offset = m_count * m_componentSize;
 	BaseECSComponent* address = (BaseECSComponent*) &m_data[offset];
 	m_componentCreateFunc(address, component);
+	address->entity = entity;
 	m_count++;
+
+	if (entity.index >= m_sparse.size())
+		m_sparse.resize(entity.index + 1, INVALID_HANDLE);
+	m_sparse[entity.index] = (ComponentHandle) (m_count - 1);
+	m_versions.push_back(version);
+	m_version = version;
 	return (ComponentHandle) (m_count - 1);
 }
 
+void ECSComponentPool::CreateComponents(const EntityHandle* entities,
+	uint32 count, const BaseECSComponent* component, uint32 version)
+{
+	if (count == 0)
+		return;
+	Grow(m_count + count);
+
+	uint32 maxEntityIndex = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (entities[i].index > maxEntityIndex)
+			maxEntityIndex = entities[i].index;
+	}
+	if (maxEntityIndex >= m_sparse.size())
+		m_sparse.resize(maxEntityIndex + 1, INVALID_HANDLE);
+
+	uint8* address = &m_data[m_count * m_componentSize];
+	for (uint32 i = 0; i < count; i++)
+	{
+		CMG_ASSERT(m_sparse[entities[i].index] == INVALID_HANDLE);
+		if (m_isTriviallyRelocatable)
+			memcpy(address, component, m_componentSize);
+		else
+			m_componentCreateFunc(address, component);
+		((BaseECSComponent*) address)->entity = entities[i];
+		m_sparse[entities[i].index] = m_count + i;
+		address += m_componentSize;
+	}
+	m_count += count;
+	m_versions.resize(m_count, version);
+	m_version = version;
+}
+
 void ECSComponentPool::DeleteComponent(ComponentHandle handle)
 {
 	CMG_ASSERT((uint32) handle < m_count);
@@ -76,6 +129,7 @@ void ECSComponentPool::DeleteComponent(ComponentHandle handle)
 	uint32 offset = (uint32) handle * m_componentSize;
 	BaseECSComponent* deletedComponent = (BaseECSComponent*)
 		&m_data[(uint32) handle * m_componentSize];
+	m_sparse[deletedComponent->entity.index] = INVALID_HANDLE;
 	m_componentFreeFunc(deletedComponent);
 
 	m_count--;
@@ -85,33 +139,119 @@ void ECSComponentPool::DeleteComponent(ComponentHandle handle)
 		&m_data[m_count * m_componentSize];
 	if (lastComponent != deletedComponent)
 	{
-		m_componentCreateFunc(deletedComponent, lastComponent);
-		m_componentFreeFunc(lastComponent);
+		if (m_isTriviallyRelocatable)
+		{
+			memcpy(deletedComponent, lastComponent, m_componentSize);
+		}
+		else
+		{
+			BaseECSComponent::RelocateComponents(m_componentId,
+				deletedComponent, lastComponent, 1);
+		}
+		m_sparse[deletedComponent->entity.index] = handle;
+		m_versions[handle] = m_versions[m_count];
 	}
+	m_versions.pop_back();
+}
+
+void ECSComponentPool::SwapComponents(ComponentHandle a, ComponentHandle b)
+{
+	CMG_ASSERT((uint32) a < m_count && (uint32) b < m_count);
+	if (a == b)
+		return;
+
+	BaseECSComponent* componentA = GetComponent(a);
+	BaseECSComponent* componentB = GetComponent(b);
+	m_sparse[componentA->entity.index] = b;
+	m_sparse[componentB->entity.index] = a;
+	uint32 version = m_versions[a];
+	m_versions[a] = m_versions[b];
+	m_versions[b] = version;
+
+	if (m_isTriviallyRelocatable)
+	{
+		// Swap the bytes through a small stack buffer
+		uint8 buffer[256];
+		uint8* bytesA = (uint8*) componentA;
+		uint8* bytesB = (uint8*) componentB;
+		for (uint32 offset = 0; offset < m_componentSize; offset += sizeof(buffer))
+		{
+			uint32 size = m_componentSize - offset;
+			if (size > sizeof(buffer))
+				size = sizeof(buffer);
+			memcpy(buffer, bytesA + offset, size);
+			memcpy(bytesA + offset, bytesB + offset, size);
+			memcpy(bytesB + offset, buffer, size);
+		}
+	}
+	else
+	{
+		m_swapBuffer.resize(m_componentSize);
+		BaseECSComponent* temp = (BaseECSComponent*) m_swapBuffer.data();
+		BaseECSComponent::RelocateComponents(m_componentId, temp, componentA, 1);
+		BaseECSComponent::RelocateComponents(m_componentId, componentA, componentB, 1);
+		BaseECSComponent::RelocateComponents(m_componentId, componentB, temp, 1);
+	}
+}
+
+uint64 ECSComponentPool::GetMemoryBytes() const
+{
+	return ((uint64) m_capacity * m_componentSize) +
+		(m_versions.capacity() * sizeof(uint32)) +
+		(m_sparse.capacity() * sizeof(ComponentHandle));
 }
 
 void ECSComponentPool::Reserve(uint32 capacity)
+{
+	if (capacity > m_capacity)
+		SetCapacity(capacity);
+}
+
+void ECSComponentPool::Grow(uint32 capacity)
+{
+	if (capacity <= m_capacity)
+		return;
+
+	// Grow geometrically, so that repeated growth is amortized
+	uint32 newCapacity = (uint32) (m_capacity * m_growthPolicy.growthFactor);
+	if (newCapacity < m_growthPolicy.minCapacity)
+		newCapacity = m_growthPolicy.minCapacity;
+	if (newCapacity < capacity)
+		newCapacity = capacity;
+	SetCapacity(newCapacity);
+}
+
+void ECSComponentPool::ShrinkToFit()
+{
+	SetCapacity(m_count);
+	m_versions.shrink_to_fit();
+
+	// Trim the sparse array past the last entity with a component
+	uint32 sparseSize = (uint32) m_sparse.size();
+	while (sparseSize > 0 && m_sparse[sparseSize - 1] == INVALID_HANDLE)
+		sparseSize--;
+	m_sparse.resize(sparseSize);
+	m_sparse.shrink_to_fit();
+}
+
+void ECSComponentPool::SetCapacity(uint32 capacity)
 {
 	CMG_ASSERT(capacity >= m_count);
 	if (capacity == m_capacity)
 		return;
 
-	uint8* oldData = m_data;
-	uint8* newData = new uint8[capacity * m_componentSize];
-	BaseECSComponent* oldAddress;
-	BaseECSComponent* newAddress;
-
-	for (uint32 i = 0; i < m_count; i++)
+	// Relocate the components into the new buffer all at once
+	uint8* newData = (capacity > 0 ? new uint8[capacity * m_componentSize] : nullptr);
+	if (m_count > 0)
 	{
-
-		oldAddress = (BaseECSComponent*) &oldData[i * m_componentSize];
-		newAddress = (BaseECSComponent*) &newData[i * m_componentSize];
-		m_componentCreateFunc(newAddress, oldAddress);
-		m_componentFreeFunc(oldAddress);
+		BaseECSComponent::RelocateComponents(m_componentId, newData,
+			(BaseECSComponent*) m_data, m_count);
 	}
 
-	if (oldData != nullptr)
-		delete [] oldData;
+	delete [] m_data;
 	m_data = newData;
+	if (capacity > m_capacity)
+		m_numGrowths++;
 	m_capacity = capacity;
+	m_versions.reserve(capacity);
 }
@@ -4,37 +4,127 @@
 #include <cmgCore/ecs/cmgECSComponent.h>
 
 
+// How a component pool grows when it runs out of capacity
+struct ECSGrowthPolicy
+{
+	// The new capacity as a multiple of the old one
+	float growthFactor = 2.0f;
+
+	// Smallest capacity to allocate when the pool first grows
+	uint32 minCapacity = 16;
+};
+
+
+//-----------------------------------------------------------------------------
+// ECSComponentPool - Densely packed components of a single type, along with a
+// sparse array that maps entity indices to components. This makes looking up
+// an entity's component a pair of array reads.
+//-----------------------------------------------------------------------------
 class ECSComponentPool
 {
 public:
 	using ComponentHandle = uint32;
 	friend class ECS;
 
+	static const ComponentHandle INVALID_HANDLE = (ComponentHandle) -1;
+
 public:
 	ECSComponentPool(uint32 componentId);
 	~ECSComponentPool();
 
 	uint32 size() const;
+	inline uint32 GetCapacity() const { return m_capacity; }
 	BaseECSComponent* front();
 	BaseECSComponent* back();
 	BaseECSComponent* GetComponent(ComponentHandle handle);
 
+	// Returns the handle of the component for an entity index, or
+	// INVALID_HANDLE if the entity has no component in this pool
+	inline ComponentHandle FindHandle(uint32 entityIndex) const
+	{
+		if (entityIndex < m_sparse.size())
+			return m_sparse[entityIndex];
+		return INVALID_HANDLE;
+	}
+
+	// Returns the component for an entity index, or null if none exists
+	inline BaseECSComponent* FindComponent(uint32 entityIndex)
+	{
+		ComponentHandle handle = FindHandle(entityIndex);
+		if (handle == INVALID_HANDLE)
+			return nullptr;
+		return (BaseECSComponent*) &m_data[handle * m_componentSize];
+	}
+
 	void Clear();
-	ComponentHandle CreateComponent(const BaseECSComponent* component);
+
+	// Capacity control. Reserving ahead of time avoids reallocating in the
+	// middle of a frame.
+	void Reserve(uint32 capacity);
+	void ShrinkToFit();
+	inline uint32 GetNumGrowths() const { return m_numGrowths; }
+	inline uint32 GetComponentSize() const { return m_componentSize; }
+
+	// Bytes allocated for the components, their change versions and the
+	// sparse entity map
+	uint64 GetMemoryBytes() const;
+
+	inline const ECSGrowthPolicy& GetGrowthPolicy() const { return m_growthPolicy; }
+	inline void SetGrowthPolicy(const ECSGrowthPolicy& growthPolicy) { m_growthPolicy = growthPolicy; }
+
+	ComponentHandle CreateComponent(EntityHandle entity,
+		const BaseECSComponent* component, uint32 version);
 	void DeleteComponent(ComponentHandle handle);
 
-	
+	// Create a copy of one component for each of several entities, which
+	// must not already have a component in this pool
+	void CreateComponents(const EntityHandle* entities, uint32 count,
+		const BaseECSComponent* component, uint32 version);
+
+	// Exchange the places of two components, which keep their change
+	// versions. Handles to either component must be fixed up by the caller.
+	void SwapComponents(ComponentHandle a, ComponentHandle b);
+
+	// Change versions. Each component records the ECS change version when it
+	// was last written to, and the pool records the latest of them.
+	inline uint32 GetVersion() const { return m_version; }
+	inline uint32 GetVersion(ComponentHandle handle) const { return m_versions[handle]; }
+	inline uint32* GetVersions() { return m_versions.data(); }
+	inline void MarkChanged(ComponentHandle handle, uint32 version)
+	{
+		m_versions[handle] = version;
+		m_version = version;
+	}
+
+
 private:
-	void Reserve(uint32 capacity);
+	// Grow according to the growth policy to fit at least 'capacity'
+	void Grow(uint32 capacity);
+	void SetCapacity(uint32 capacity);
 
 	uint8* m_data;
 	uint32 m_count;
 	uint32 m_capacity;
+	uint32 m_numGrowths;
+	ECSGrowthPolicy m_growthPolicy;
+
+	// Entity index -> component handle
+	Array<ComponentHandle> m_sparse;
+
+	// Change version of each component, and of the pool as a whole
+	Array<uint32> m_versions;
+	uint32 m_version;
+
+	// Space for one component while swapping components that aren't
+	// trivially relocatable
+	Array<uint8> m_swapBuffer;
 
 	uint32 m_componentId;
 	uint32 m_componentSize;
 	ECSComponentCreateFunction m_componentCreateFunc;
 	ECSComponentFreeFunction m_componentFreeFunc;
+	bool m_isTriviallyCopyable;
+	bool m_isTriviallyRelocatable;
 };
 
 
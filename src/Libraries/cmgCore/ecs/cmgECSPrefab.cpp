@@ -0,0 +1,75 @@
+#include "cmgECSPrefab.h"
+#include <cmgCore/cmgAssert.h>
+#include <algorithm>
+
+
+ECSPrefab::ECSPrefab()
+{
+}
+
+ECSPrefab::~ECSPrefab()
+{
+	Clear();
+}
+
+void ECSPrefab::Clear()
+{
+	for (uint32 i = 0; i < m_components.size(); i++)
+		FreeComponent(i);
+	m_componentTypes.clear();
+	m_components.clear();
+}
+
+void ECSPrefab::AddComponent(uint32 componentId,
+	const BaseECSComponent* component)
+{
+	CMG_ASSERT(BaseECSComponent::IsTypeValid(componentId));
+
+	// Keep the types sorted, to match the order of archetype columns
+	auto it = std::lower_bound(m_componentTypes.begin(),
+		m_componentTypes.end(), componentId);
+	uint32 index = (uint32) (it - m_componentTypes.begin());
+	if (it != m_componentTypes.end() && *it == componentId)
+	{
+		FreeComponent(index);
+	}
+	else
+	{
+		m_componentTypes.insert(it, componentId);
+		m_components.insert(m_components.begin() + index, nullptr);
+	}
+
+	uint8* memory = new uint8[BaseECSComponent::GetTypeSize(componentId)];
+	m_components[index] = BaseECSComponent::GetTypeCreateFunction(
+		componentId)(memory, component);
+	m_components[index]->entity = NULL_ENTITY_HANDLE;
+}
+
+void ECSPrefab::RemoveComponent(uint32 componentId)
+{
+	auto it = std::lower_bound(m_componentTypes.begin(),
+		m_componentTypes.end(), componentId);
+	if (it == m_componentTypes.end() || *it != componentId)
+		return;
+	uint32 index = (uint32) (it - m_componentTypes.begin());
+	FreeComponent(index);
+	m_componentTypes.erase(it);
+	m_components.erase(m_components.begin() + index);
+}
+
+BaseECSComponent* ECSPrefab::FindComponent(uint32 componentId) const
+{
+	auto it = std::lower_bound(m_componentTypes.begin(),
+		m_componentTypes.end(), componentId);
+	if (it == m_componentTypes.end() || *it != componentId)
+		return nullptr;
+	return m_components[it - m_componentTypes.begin()];
+}
+
+void ECSPrefab::FreeComponent(uint32 index)
+{
+	BaseECSComponent::GetTypeFreeFunction(m_componentTypes[index])(
+		m_components[index]);
+	delete [] (uint8*) m_components[index];
+	m_components[index] = nullptr;
+}
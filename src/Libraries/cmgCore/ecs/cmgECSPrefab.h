@@ -0,0 +1,83 @@
+#ifndef _CMG_CORE_ECS_PREFAB_H_
+#define _CMG_CORE_ECS_PREFAB_H_
+
+#include <cmgCore/ecs/cmgECSComponent.h>
+
+
+//-----------------------------------------------------------------------------
+// ECSPrefab - A template for entities: a set of components, at most one of
+// each type, that ECS::Instantiate copies onto every entity it creates.
+//-----------------------------------------------------------------------------
+class ECSPrefab
+{
+public:
+	ECSPrefab();
+	template <class... T_Components>
+	ECSPrefab(const T_Components&... components);
+	~ECSPrefab();
+
+	// Component types sorted by ID, and the component of each type
+	inline const Array<uint32>& GetComponentTypes() const { return m_componentTypes; }
+	inline uint32 GetNumComponents() const { return (uint32) m_componentTypes.size(); }
+	inline const BaseECSComponent* GetComponentByIndex(uint32 index) const { return m_components[index]; }
+
+	void Clear();
+
+	// Adding a component of a type the prefab already has replaces it
+	template <class T_Component>
+	void AddComponent(const T_Component& component);
+	template <class T_Component>
+	void RemoveComponent();
+	template <class T_Component>
+	T_Component* GetComponent();
+	template <class T_Component>
+	bool HasComponent() const;
+
+	void AddComponent(uint32 componentId, const BaseECSComponent* component);
+	void RemoveComponent(uint32 componentId);
+	BaseECSComponent* FindComponent(uint32 componentId) const;
+
+private:
+	ECSPrefab(const ECSPrefab& copy) = delete;
+	ECSPrefab& operator=(const ECSPrefab& copy) = delete;
+
+	void FreeComponent(uint32 index);
+
+	Array<uint32> m_componentTypes;
+	Array<BaseECSComponent*> m_components;
+};
+
+
+template <class... T_Components>
+ECSPrefab::ECSPrefab(const T_Components&... components)
+{
+	int unpack[] = { 0, (AddComponent(components), 0)... };
+	(void) unpack;
+}
+
+template <class T_Component>
+void ECSPrefab::AddComponent(const T_Component& component)
+{
+	AddComponent(T_Component::ID, &component);
+}
+
+template <class T_Component>
+void ECSPrefab::RemoveComponent()
+{
+	RemoveComponent(T_Component::ID);
+}
+
+template <class T_Component>
+T_Component* ECSPrefab::GetComponent()
+{
+	return (T_Component*) FindComponent(T_Component::ID);
+}
+
+template <class T_Component>
+bool ECSPrefab::HasComponent() const
+{
+	return (FindComponent(T_Component::ID) != nullptr);
+}
+
+
+#endif // _CMG_CORE_ECS_PREFAB_H_
@@ -0,0 +1,194 @@
+#include "cmgECSQuery.h"
+#include <cmgCore/cmgAssert.h>
+#include <cmgCore/ecs/cmgECS.h>
+
+
+const uint32 ECSQuery::INVALID_ROW;
+
+
+ECSQuery::ECSQuery()
+	: m_ecs(nullptr)
+	, m_coSortRow(0)
+	, m_numRebuilds(0)
+	, m_numRowsAdded(0)
+	, m_numRowsRemoved(0)
+{
+}
+
+ECSQuery::~ECSQuery()
+{
+	if (m_ecs != nullptr)
+		m_ecs->UnregisterQuery(this);
+}
+
+uint32 ECSQuery::GetNumMatches() const
+{
+	if (m_archetypes.empty())
+		return (uint32) m_rowEntities.size();
+	uint32 count = 0;
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+		count += m_archetypes[i]->size();
+	return count;
+}
+
+void ECSQuery::GetEntities(Array<EntityHandle>& outEntities) const
+{
+	for (uint32 i = 0; i < m_archetypes.size(); i++)
+	{
+		ECSArchetype* archetype = m_archetypes[i];
+		for (uint32 index = 0; index < archetype->size(); index++)
+			outEntities.push_back(archetype->GetEntity(index));
+	}
+	if (m_rowEntities.empty())
+		return;
+
+	// Every row has a component of each required type, which knows its entity
+	uint32 numTypes = (uint32) m_componentTypes.size();
+	uint32 column = 0;
+	while (column < numTypes &&
+		(m_componentFlags[column] & BaseECSSystem::FLAG_OPTIONAL) != 0)
+		column++;
+	CMG_ASSERT(column < numTypes);
+	ECSComponentPool* pool = m_ecs->m_components[m_componentTypes[column]];
+	for (uint32 row = 0; row < m_rowEntities.size(); row++)
+	{
+		outEntities.push_back(pool->GetComponent(
+			m_handles[(row * numTypes) + column])->entity);
+	}
+}
+
+float ECSQuery::GetSequentialAccessRatio() const
+{
+	uint32 numTypes = (uint32) m_componentTypes.size();
+	uint32 numSteps = 0;
+	uint32 numSequential = 0;
+	for (uint32 row = 1; row < m_rowEntities.size(); row++)
+	{
+		const ComponentHandle* prev = &m_handles[(row - 1) * numTypes];
+		const ComponentHandle* next = prev + numTypes;
+		for (uint32 j = 0; j < numTypes; j++)
+		{
+			if (prev[j] == ECSComponentPool::INVALID_HANDLE ||
+				next[j] == ECSComponentPool::INVALID_HANDLE)
+				continue;
+			numSteps++;
+			if (next[j] == prev[j] + 1)
+				numSequential++;
+		}
+	}
+	if (numSteps == 0)
+		return 1.0f;
+	return (float) numSequential / (float) numSteps;
+}
+
+void ECSQuery::ResetStats()
+{
+	m_numRebuilds = 0;
+	m_numRowsAdded = 0;
+	m_numRowsRemoved = 0;
+}
+
+void ECSQuery::Clear()
+{
+	m_handles.clear();
+	m_rowEntities.clear();
+	m_entityRows.clear();
+	m_archetypes.clear();
+	m_coSortRow = 0;
+}
+
+uint32 ECSQuery::FindRow(uint32 entityIndex) const
+{
+	if (entityIndex < m_entityRows.size())
+		return m_entityRows[entityIndex];
+	return INVALID_ROW;
+}
+
+ECSQuery::ComponentHandle* ECSQuery::AddRow(uint32 entityIndex)
+{
+	uint32 row = (uint32) m_rowEntities.size();
+	if (entityIndex >= m_entityRows.size())
+		m_entityRows.resize(entityIndex + 1, INVALID_ROW);
+	m_entityRows[entityIndex] = row;
+	m_rowEntities.push_back(entityIndex);
+	m_handles.resize(m_handles.size() + m_componentTypes.size());
+	return &m_handles[row * m_componentTypes.size()];
+}
+
+void ECSQuery::RemoveRow(uint32 row)
+{
+	// Move the last row into the removed one
+	uint32 numTypes = (uint32) m_componentTypes.size();
+	uint32 lastRow = (uint32) m_rowEntities.size() - 1;
+	m_entityRows[m_rowEntities[row]] = INVALID_ROW;
+	if (row != lastRow)
+	{
+		m_rowEntities[row] = m_rowEntities[lastRow];
+		m_entityRows[m_rowEntities[row]] = row;
+		for (uint32 j = 0; j < numTypes; j++)
+			m_handles[(row * numTypes) + j] = m_handles[(lastRow * numTypes) + j];
+	}
+	m_rowEntities.pop_back();
+	m_handles.resize(m_handles.size() - numTypes);
+}
+
+void ECSQuery::SortRows(uint32 column, uint32 numHandles)
+{
+	uint32 numTypes = (uint32) m_componentTypes.size();
+	uint32 numRows = (uint32) m_rowEntities.size();
+
+	// Nothing to do if the rows are already in order
+	uint32 row = 1;
+	for (; row < numRows; row++)
+	{
+		if (m_handles[(row * numTypes) + column] <
+			m_handles[((row - 1) * numTypes) + column])
+			break;
+	}
+	if (row >= numRows)
+		return;
+
+	// Handles are unique within a column, so the rows can be placed by
+	// walking the handles in order
+	m_sortRows.assign(numHandles > numRows ? numHandles : numRows, INVALID_ROW);
+	uint32 numMissing = 0;
+	for (row = 0; row < numRows; row++)
+	{
+		ComponentHandle handle = m_handles[(row * numTypes) + column];
+		if (handle == ECSComponentPool::INVALID_HANDLE)
+			numMissing++;
+		else
+			m_sortRows[handle] = row;
+	}
+	m_sortHandles.resize(m_handles.size());
+	uint32 sortedRow = 0;
+	for (uint32 handle = 0; handle < numHandles; handle++)
+	{
+		if (m_sortRows[handle] == INVALID_ROW)
+			continue;
+		m_sortRows[sortedRow++] = m_sortRows[handle];
+	}
+	if (numMissing > 0)
+	{
+		for (row = 0; row < numRows; row++)
+		{
+			if (m_handles[(row * numTypes) + column] == ECSComponentPool::INVALID_HANDLE)
+				m_sortRows[sortedRow++] = row;
+		}
+	}
+	CMG_ASSERT(sortedRow == numRows);
+
+	for (row = 0; row < numRows; row++)
+	{
+		uint32 oldRow = m_sortRows[row];
+		for (uint32 j = 0; j < numTypes; j++)
+			m_sortHandles[(row * numTypes) + j] = m_handles[(oldRow * numTypes) + j];
+		m_sortRows[row] = m_rowEntities[oldRow];
+	}
+	m_handles.swap(m_sortHandles);
+	for (row = 0; row < numRows; row++)
+	{
+		m_rowEntities[row] = m_sortRows[row];
+		m_entityRows[m_rowEntities[row]] = row;
+	}
+}
@@ -0,0 +1,100 @@
+#ifndef _CMG_CORE_ECS_QUERY_H_
+#define _CMG_CORE_ECS_QUERY_H_
+
+#include <cmgCore/ecs/cmgECSComponent.h>
+
+class ECS;
+class ECSArchetype;
+
+
+//-----------------------------------------------------------------------------
+// ECSQuery - The cached set of entities that match a system's component
+// types. The ECS keeps it up to date as components are added and removed,
+// so a system update is a walk over dense arrays.
+//
+// With component pool storage, each matching entity is a row holding the
+// pool handle of each of its components. With archetype storage, the query
+// holds the list of matching archetypes.
+//-----------------------------------------------------------------------------
+class ECSQuery
+{
+public:
+	friend class ECS;
+
+	using ComponentHandle = uint32;
+
+	static const uint32 INVALID_ROW = (uint32) -1;
+
+public:
+	ECSQuery();
+	~ECSQuery();
+
+	inline ECS* GetECS() const { return m_ecs; }
+	inline uint32 GetNumComponentTypes() const { return (uint32) m_componentTypes.size(); }
+
+	// Number of matching entities
+	uint32 GetNumMatches() const;
+	inline uint32 GetNumRows() const { return (uint32) m_rowEntities.size(); }
+	inline const Array<ECSArchetype*>& GetArchetypes() const { return m_archetypes; }
+
+	// Append the handles of all matching entities
+	void GetEntities(Array<EntityHandle>& outEntities) const;
+
+	// Component handles for a row, one per component type. Missing optional
+	// components have an invalid handle.
+	inline const ComponentHandle* GetRowHandles(uint32 row) const
+	{
+		return &m_handles[row * m_componentTypes.size()];
+	}
+
+	// Fraction of join steps, from one row to the next in each column, that
+	// move to the adjacent component in the pool. This is 1 when every pool
+	// is walked in order, and 1 with archetype storage.
+	float GetSequentialAccessRatio() const;
+
+	// Statistics
+	inline uint32 GetNumRebuilds() const { return m_numRebuilds; }
+	inline uint32 GetNumRowsAdded() const { return m_numRowsAdded; }
+	inline uint32 GetNumRowsRemoved() const { return m_numRowsRemoved; }
+	void ResetStats();
+
+private:
+	ECSQuery(const ECSQuery& copy) = delete;
+	ECSQuery& operator=(const ECSQuery& copy) = delete;
+
+	void Clear();
+	uint32 FindRow(uint32 entityIndex) const;
+	ComponentHandle* AddRow(uint32 entityIndex);
+	void RemoveRow(uint32 row);
+
+	// Reorder the rows by their handle in a column, where every handle is
+	// less than numHandles. Rows without a handle in the column go last.
+	void SortRows(uint32 column, uint32 numHandles);
+
+	ECS* m_ecs;
+	Array<uint32> m_componentTypes;
+	Array<uint32> m_componentFlags;
+
+	// Component pool storage: rows of component handles, the entity index
+	// of each row, and the row of each entity index
+	Array<ComponentHandle> m_handles;
+	Array<uint32> m_rowEntities;
+	Array<uint32> m_entityRows;
+
+	// Archetype storage
+	Array<ECSArchetype*> m_archetypes;
+
+	// Progress of ECS::CoSortComponents: the next row to place, and the next
+	// pool slot to fill in each column
+	uint32 m_coSortRow;
+	Array<uint32> m_coSortSlots;
+	Array<uint32> m_sortRows;
+	Array<ComponentHandle> m_sortHandles;
+
+	uint32 m_numRebuilds;
+	uint32 m_numRowsAdded;
+	uint32 m_numRowsRemoved;
+};
+
+
+#endif // _CMG_CORE_ECS_QUERY_H_
@@ -0,0 +1,79 @@
+#include "cmgECSSnapshot.h"
+#include <cstring>
+
+
+//-----------------------------------------------------------------------------
+// ECSSnapshotWriter
+//-----------------------------------------------------------------------------
+
+ECSSnapshotWriter::ECSSnapshotWriter(Array<uint8>& data) :
+	m_data(data)
+{
+}
+
+void ECSSnapshotWriter::Write(const void* data, uint32 size)
+{
+	if (size > 0)
+		memcpy(Allocate(size), data, size);
+}
+
+void ECSSnapshotWriter::WriteString(const String& str)
+{
+	uint32 length = (uint32) str.length();
+	Write(length);
+	Write(str.data(), length);
+}
+
+uint8* ECSSnapshotWriter::Allocate(uint32 size)
+{
+	size_t offset = m_data.size();
+	m_data.resize(offset + size);
+	return m_data.data() + offset;
+}
+
+
+//-----------------------------------------------------------------------------
+// ECSSnapshotReader
+//-----------------------------------------------------------------------------
+
+ECSSnapshotReader::ECSSnapshotReader(const uint8* data, uint32 size) :
+	m_data(data),
+	m_size(size),
+	m_offset(0),
+	m_isValid(data != nullptr || size == 0)
+{
+}
+
+bool ECSSnapshotReader::Read(void* data, uint32 size)
+{
+	const uint8* source = Skip(size);
+	if (source == nullptr)
+		return false;
+	if (size > 0)
+		memcpy(data, source, size);
+	return true;
+}
+
+bool ECSSnapshotReader::ReadString(String& str)
+{
+	uint32 length;
+	if (!Read(length))
+		return false;
+	const uint8* source = Skip(length);
+	if (source == nullptr)
+		return false;
+	str.assign((const char*) source, length);
+	return true;
+}
+
+const uint8* ECSSnapshotReader::Skip(uint32 size)
+{
+	if (!m_isValid || size > m_size - m_offset)
+	{
+		m_isValid = false;
+		return nullptr;
+	}
+	const uint8* data = m_data + m_offset;
+	m_offset += size;
+	return data;
+}
@@ -0,0 +1,118 @@
+#ifndef _CMG_CORE_ECS_SNAPSHOT_H_
+#define _CMG_CORE_ECS_SNAPSHOT_H_
+
+#include <cmgCore/ecs/cmgECSComponent.h>
+#include <cmgCore/string/cmgString.h>
+#include <new>
+#include <type_traits>
+
+
+//-----------------------------------------------------------------------------
+// ECSSnapshotWriter - Appends raw bytes to a snapshot blob
+//-----------------------------------------------------------------------------
+class ECSSnapshotWriter
+{
+public:
+	ECSSnapshotWriter(Array<uint8>& data);
+
+	inline uint32 GetSize() const { return (uint32) m_data.size(); }
+
+	void Write(const void* data, uint32 size);
+	void WriteString(const String& str);
+
+	// Write a value of a trivially copyable type
+	template <class T>
+	void Write(const T& value);
+
+	// Reserve space at the end of the blob to be filled in directly
+	uint8* Allocate(uint32 size);
+
+private:
+	Array<uint8>& m_data;
+};
+
+
+//-----------------------------------------------------------------------------
+// ECSSnapshotReader - Reads raw bytes from a snapshot blob. Reading past the
+// end of the blob fails, and every later read fails too, so a sequence of
+// reads can be checked once at the end.
+//-----------------------------------------------------------------------------
+class ECSSnapshotReader
+{
+public:
+	ECSSnapshotReader(const uint8* data, uint32 size);
+
+	inline bool IsValid() const { return m_isValid; }
+	inline uint32 GetOffset() const { return m_offset; }
+	inline uint32 GetBytesLeft() const { return (m_size - m_offset); }
+
+	bool Read(void* data, uint32 size);
+	bool ReadString(String& str);
+
+	// Read a value of a trivially copyable type
+	template <class T>
+	bool Read(T& value);
+
+	// Returns a pointer to the next bytes and skips past them, or null if
+	// there aren't enough bytes left
+	const uint8* Skip(uint32 size);
+
+private:
+	const uint8* m_data;
+	uint32 m_size;
+	uint32 m_offset;
+	bool m_isValid;
+};
+
+
+template <class T>
+void ECSSnapshotWriter::Write(const T& value)
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+		"Only trivially copyable values can be written directly");
+	Write(&value, sizeof(T));
+}
+
+template <class T>
+bool ECSSnapshotReader::Read(T& value)
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+		"Only trivially copyable values can be read directly");
+	return Read(&value, sizeof(T));
+}
+
+
+//-----------------------------------------------------------------------------
+// Snapshot functions for component types that aren't trivially copyable.
+// The component type must be default constructible and define:
+//
+//   void Save(ECSSnapshotWriter& writer) const;
+//   void Load(ECSSnapshotReader& reader);
+//
+// The entity handle is saved and restored by the ECS.
+//-----------------------------------------------------------------------------
+
+template <typename T_Component>
+void ECSComponentSave(const BaseECSComponent* component,
+	ECSSnapshotWriter& writer)
+{
+	((const T_Component*) component)->Save(writer);
+}
+
+template <typename T_Component>
+BaseECSComponent* ECSComponentLoad(void* location, ECSSnapshotReader& reader)
+{
+	T_Component* component = new (location) T_Component();
+	component->Load(reader);
+	return component;
+}
+
+template <typename T_Component>
+void RegisterECSSnapshotFunctions()
+{
+	BaseECSComponent::SetTypeSnapshotFunctions(T_Component::ID,
+		ECSComponentSave<T_Component>, ECSComponentLoad<T_Component>);
+}
+
+
+#endif // _CMG_CORE_ECS_SNAPSHOT_H_
@@ -0,0 +1,75 @@
+#include "cmgECSStats.h"
+
+const uint32 ECSSystemStats::WINDOW_SIZE;
+
+
+ECSSystemStats::ECSSystemStats()
+{
+	Reset();
+}
+
+void ECSSystemStats::Reset()
+{
+	m_numUpdates = 0;
+	m_totalProcessed = 0;
+	m_totalBytesTouched = 0;
+	m_totalMilliseconds = 0.0;
+	m_numMatched = 0;
+	m_numProcessed = 0;
+	m_bytesTouched = 0;
+	m_lastMilliseconds = 0.0;
+	m_numSamples = 0;
+	m_nextSample = 0;
+}
+
+void ECSSystemStats::AddUpdate(double milliseconds, uint32 numMatched,
+	uint32 numProcessed, uint64 bytesTouched)
+{
+	m_numUpdates++;
+	m_totalProcessed += numProcessed;
+	m_totalBytesTouched += bytesTouched;
+	m_totalMilliseconds += milliseconds;
+	m_numMatched = numMatched;
+	m_numProcessed = numProcessed;
+	m_bytesTouched = bytesTouched;
+	m_lastMilliseconds = milliseconds;
+
+	m_samples[m_nextSample] = milliseconds;
+	m_nextSample = (m_nextSample + 1) % WINDOW_SIZE;
+	if (m_numSamples < WINDOW_SIZE)
+		m_numSamples++;
+}
+
+double ECSSystemStats::GetMinMilliseconds() const
+{
+	if (m_numSamples == 0)
+		return 0.0;
+	double result = m_samples[0];
+	for (uint32 i = 1; i < m_numSamples; i++)
+	{
+		if (m_samples[i] < result)
+			result = m_samples[i];
+	}
+	return result;
+}
+
+double ECSSystemStats::GetAverageMilliseconds() const
+{
+	if (m_numSamples == 0)
+		return 0.0;
+	double sum = 0.0;
+	for (uint32 i = 0; i < m_numSamples; i++)
+		sum += m_samples[i];
+	return (sum / m_numSamples);
+}
+
+double ECSSystemStats::GetMaxMilliseconds() const
+{
+	double result = 0.0;
+	for (uint32 i = 0; i < m_numSamples; i++)
+	{
+		if (m_samples[i] > result)
+			result = m_samples[i];
+	}
+	return result;
+}
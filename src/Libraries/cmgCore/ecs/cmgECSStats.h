@@ -0,0 +1,89 @@
+#ifndef _CMG_CORE_ECS_STATS_H_
+#define _CMG_CORE_ECS_STATS_H_
+
+#include <cmgCore/containers/cmgArray.h>
+
+
+//-----------------------------------------------------------------------------
+// ECSSystemStats - Counters for a system's updates, which the ECS always
+// records. Times include PreUpdate and PostUpdate, and when entities are
+// split across threads, the time each thread spent on them is added up.
+// Bytes touched counts the components passed to the system.
+//-----------------------------------------------------------------------------
+class ECSSystemStats
+{
+public:
+	// Number of updates that the min/avg/max times are taken over
+	static const uint32 WINDOW_SIZE = 60;
+
+public:
+	ECSSystemStats();
+
+	void Reset();
+	void AddUpdate(double milliseconds, uint32 numMatched,
+		uint32 numProcessed, uint64 bytesTouched);
+
+	// Totals since the last reset
+	inline uint32 GetNumUpdates() const { return m_numUpdates; }
+	inline uint64 GetTotalProcessed() const { return m_totalProcessed; }
+	inline uint64 GetTotalBytesTouched() const { return m_totalBytesTouched; }
+	inline double GetTotalMilliseconds() const { return m_totalMilliseconds; }
+
+	// The last update. Entities are matched by the system's component types,
+	// and processed unless they were skipped by a change filter.
+	inline uint32 GetNumMatched() const { return m_numMatched; }
+	inline uint32 GetNumProcessed() const { return m_numProcessed; }
+	inline uint64 GetBytesTouched() const { return m_bytesTouched; }
+	inline double GetLastMilliseconds() const { return m_lastMilliseconds; }
+
+	// Times over the last WINDOW_SIZE updates, or zero before the first
+	inline uint32 GetNumSamples() const { return m_numSamples; }
+	double GetMinMilliseconds() const;
+	double GetAverageMilliseconds() const;
+	double GetMaxMilliseconds() const;
+
+private:
+	uint32 m_numUpdates;
+	uint64 m_totalProcessed;
+	uint64 m_totalBytesTouched;
+	double m_totalMilliseconds;
+
+	uint32 m_numMatched;
+	uint32 m_numProcessed;
+	uint64 m_bytesTouched;
+	double m_lastMilliseconds;
+
+	// Ring buffer of recent update times
+	double m_samples[WINDOW_SIZE];
+	uint32 m_numSamples;
+	uint32 m_nextSample;
+};
+
+
+// Memory use of the pool of one component type
+struct ECSPoolStats
+{
+	uint32 componentId;
+	uint32 componentSize;
+	uint32 size;
+	uint32 capacity;
+
+	// Components, change versions and the sparse entity map
+	uint64 bytes;
+
+	// Number of times the pool has reallocated to grow
+	uint32 numGrowths;
+};
+
+// Memory use of an archetype's chunks
+struct ECSArchetypeStats
+{
+	Array<uint32> componentTypes;
+	uint32 size;
+	uint32 numChunks;
+	uint32 chunkCapacity;
+	uint64 bytes;
+};
+
+
+#endif // _CMG_CORE_ECS_STATS_H_
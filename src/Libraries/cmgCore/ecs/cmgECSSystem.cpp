@@ -1,4 +1,5 @@
 #include "cmgECSSystem.h"
+#include <cmgCore/cmgAssert.h>
 
 
 bool BaseECSSystem::IsValid()
@@ -13,6 +14,42 @@ bool BaseECSSystem::IsValid()
 	return false;
 }
 
+void BaseECSSystem::UpdateComponentBatch(float timeDelta, uint32 count,
+	BaseECSComponent** components)
+{
+	const uint32 maxTypes = 32;
+	uint32 numTypes = (uint32) m_componentTypes.size();
+	CMG_ASSERT(numTypes <= maxTypes);
+	BaseECSComponent* entityComponents[maxTypes];
+	for (uint32 i = 0; i < count; i++)
+	{
+		for (uint32 j = 0; j < numTypes; j++)
+		{
+			entityComponents[j] = (components[j] == nullptr ? nullptr :
+				(BaseECSComponent*) (((uint8*) components[j]) +
+				(i * BaseECSComponent::GetTypeSize(m_componentTypes[j]))));
+		}
+		UpdateComponents(timeDelta, entityComponents);
+	}
+}
+
+bool BaseECSSystem::ConflictsWith(BaseECSSystem& other)
+{
+	for (uint32 i = 0; i < m_componentTypes.size(); i++)
+	{
+		for (uint32 j = 0; j < other.m_componentTypes.size(); j++)
+		{
+			if (m_componentTypes[i] == other.m_componentTypes[j] &&
+				((m_componentFlags[i] & FLAG_READ_ONLY) == 0 ||
+				(other.m_componentFlags[j] & FLAG_READ_ONLY) == 0))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
 bool ECSSystemList::RemoveSystem(BaseECSSystem& system)
 {
 	for (uint32 i = 0; i < m_systems.size(); i++)
@@ -3,24 +3,78 @@
 
 #include <cmgCore/containers/cmgArray.h>
 #include <cmgCore/ecs/cmgECSComponent.h>
+#include <cmgCore/ecs/cmgECSQuery.h>
+#include <cmgCore/ecs/cmgECSStats.h>
+#include <cmgCore/string/cmgString.h>
+#include <utility>
+
+
+// A contiguous run of components of one type, passed to batched system
+// updates. The data is null for a missing optional component.
+template <class T_Component>
+struct ComponentSpan
+{
+	T_Component* data;
+
+	ComponentSpan(T_Component* data) :
+		data(data)
+	{
+	}
+
+	inline bool IsValid() const { return (data != nullptr); }
+	inline T_Component& operator[](uint32 index) const { return data[index]; }
+};
 
 
 class BaseECSSystem
 {
 public:
+	friend class ECS;
+
 	enum Flags
 	{
 		FLAG_NONE = 0,
 		FLAG_OPTIONAL = 1,
+
+		// The system only reads this component type. Components are assumed
+		// to be written to unless they are flagged as read-only.
+		FLAG_READ_ONLY = 2,
+
+		// Only update entities where a component of this type has changed
+		// since the system was last updated. If several types have this flag,
+		// a change in any of them is enough.
+		FLAG_CHANGED = 4,
 	};
 
 public:
-	BaseECSSystem()
+	BaseECSSystem() :
+		m_isThreadSafe(false),
+		m_isBatched(false),
+		m_hasChangeFilter(false),
+		m_changeVersion(0),
+		m_lastChangeVersion(0),
+		m_updateMilliseconds(0.0),
+		m_updateProcessed(0),
+		m_updateBytesTouched(0)
 	{
 	}
 
 	bool IsValid();
 
+	// Returns true if the two systems cannot run at the same time, because
+	// one writes to a component type that the other accesses
+	bool ConflictsWith(BaseECSSystem& other);
+
+	// A thread-safe system only touches the components passed to
+	// UpdateComponents (plus its own read-only state), so it may run
+	// concurrently with other non-conflicting systems and have its entities
+	// split across threads. PreUpdate and PostUpdate are always called on the
+	// thread calling ECS::UpdateSystems.
+	inline bool IsThreadSafe() const
+	{
+		return m_isThreadSafe;
+	}
+
 	inline const Array<uint32>& GetComponentTypes()
 	{
 		return m_componentTypes;
@@ -31,11 +85,71 @@ public:
 		return m_componentFlags;
 	}
 
+	// Returns true if the ECS should call UpdateComponentBatch with runs of
+	// contiguous components rather than UpdateComponents per entity
+	inline bool IsBatched() const
+	{
+		return m_isBatched;
+	}
+
+	// Returns true if any component type has FLAG_CHANGED
+	inline bool HasChangeFilter() const
+	{
+		return m_hasChangeFilter;
+	}
+
+	// ECS change version of the system's last update. Components this system
+	// writes to are marked with this version.
+	inline uint32 GetLastChangeVersion() const
+	{
+		return m_lastChangeVersion;
+	}
+
+	// The entities matching this system's component types, which the ECS
+	// keeps up to date as components are added and removed
+	inline const ECSQuery& GetQuery() const
+	{
+		return m_query;
+	}
+
+	inline ECSQuery& GetQuery()
+	{
+		return m_query;
+	}
+
+	// Name used to identify the system in statistics
+	inline const String& GetName() const
+	{
+		return m_name;
+	}
+
+	inline void SetName(const String& name)
+	{
+		m_name = name;
+	}
+
+	// Timing and entity counts of the system's updates
+	inline const ECSSystemStats& GetStats() const
+	{
+		return m_stats;
+	}
+
+	inline void ResetStats()
+	{
+		m_stats.Reset();
+	}
+
 	virtual void UpdateComponents(float timeDelta,
 		BaseECSComponent** components)
 	{
 	}
 
+	// Update a run of entities. Each pointer is the first of 'count'
+	// contiguous components of the corresponding type, or null for a missing
+	// optional component. The default falls back to UpdateComponents.
+	virtual void UpdateComponentBatch(float timeDelta, uint32 count,
+		BaseECSComponent** components);
+
 	virtual void PreUpdate(float timeDelta)
 	{
 	}
@@ -49,18 +163,86 @@ protected:
 	{
 		m_componentTypes.push_back(componentType);
 		m_componentFlags.push_back(componentFlag);
+		m_hasChangeFilter = m_hasChangeFilter || (componentFlag & FLAG_CHANGED) != 0;
 	}
 
 	template <class T_Component>
 	void AddComponentType(uint32 componentFlag = FLAG_NONE)
 	{
-		m_componentTypes.push_back(T_Component::ID);
-		m_componentFlags.push_back(componentFlag);
+		AddComponentType(T_Component::ID, componentFlag);
+	}
+
+	void SetThreadSafe(bool isThreadSafe)
+	{
+		m_isThreadSafe = isThreadSafe;
+	}
+
+	void SetBatched(bool isBatched)
+	{
+		m_isBatched = isBatched;
 	}
 
 private:
 	Array<uint32> m_componentTypes;
 	Array<uint32> m_componentFlags;
+	bool m_isThreadSafe;
+	bool m_isBatched;
+	bool m_hasChangeFilter;
+	ECSQuery m_query;
+
+	// Change version of the current update, and of the previous one
+	uint32 m_changeVersion;
+	uint32 m_lastChangeVersion;
+
+	// Statistics, and the work done so far in the current update
+	String m_name;
+	ECSSystemStats m_stats;
+	double m_updateMilliseconds;
+	uint32 m_updateProcessed;
+	uint64 m_updateBytesTouched;
+};
+
+
+//-----------------------------------------------------------------------------
+// ECSBatchSystem - A system that updates whole runs of entities at once with
+// typed component spans, so its loop can be inlined and vectorized. The
+// derived class must add its component types in the same order as T_Types.
+//-----------------------------------------------------------------------------
+template <class... T_Types>
+class ECSBatchSystem : public BaseECSSystem
+{
+public:
+	ECSBatchSystem() : BaseECSSystem()
+	{
+		SetBatched(true);
+	}
+
+	virtual void UpdateBatch(float delta, uint32 count,
+		ComponentSpan<T_Types>... spans) = 0;
+
+	virtual void UpdateComponentBatch(float delta, uint32 count,
+		BaseECSComponent** components) override
+	{
+		UnpackBatch(delta, count, components,
+			std::index_sequence_for<T_Types...>());
+	}
+
+	// Per-entity fallback, as a batch of one
+	virtual void UpdateComponents(float delta,
+		BaseECSComponent** components) override
+	{
+		UnpackBatch(delta, 1, components,
+			std::index_sequence_for<T_Types...>());
+	}
+
+private:
+	template <size_t... T_Indices>
+	void UnpackBatch(float delta, uint32 count, BaseECSComponent** components,
+		std::index_sequence<T_Indices...>)
+	{
+		UpdateBatch(delta, count, ComponentSpan<T_Types>(
+			(T_Types*) components[T_Indices])...);
+	}
 };
 
 class ECSSystemList
@@ -0,0 +1,118 @@
+#include "cmgThreadPool.h"
+#include <cmgCore/cmgAssert.h>
+
+
+// Set while the current thread is running part of a parallel loop
+static thread_local bool g_isInsideParallelFor = false;
+
+// Index of the current thread in its pool
+static thread_local uint32 g_threadIndex = 0;
+
+
+ThreadPool::ThreadPool(uint32 numThreads)
+	: m_isRunning(true)
+	, m_function(nullptr)
+	, m_count(0)
+	, m_jobId(0)
+	, m_nextIndex(0)
+	, m_numCompleted(0)
+	, m_numActiveWorkers(0)
+{
+	if (numThreads == 0)
+		numThreads = (uint32) std::thread::hardware_concurrency();
+	if (numThreads == 0)
+		numThreads = 1;
+	for (uint32 i = 1; i < numThreads; i++)
+		m_workers.push_back(std::thread(&ThreadPool::WorkerMain, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isRunning = false;
+	}
+	m_jobCondition.notify_all();
+	for (uint32 i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+}
+
+void ThreadPool::ParallelFor(uint32 count, const ParallelForFunction& function)
+{
+	if (count == 0)
+		return;
+
+	// Run serially when there is nothing to gain from waking workers
+	if (m_workers.empty() || count == 1 || g_isInsideParallelFor)
+	{
+		for (uint32 i = 0; i < count; i++)
+			function(i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_function = &function;
+		m_count = count;
+		m_nextIndex = 0;
+		m_numCompleted = 0;
+		m_jobId++;
+	}
+	m_jobCondition.notify_all();
+
+	RunJob(0);
+
+	// Wait for the other threads to finish their last indices and leave the
+	// job, so it is safe for the function to go out of scope
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() {
+		return (m_numCompleted == m_count && m_numActiveWorkers == 0);
+	});
+	m_function = nullptr;
+}
+
+uint32 ThreadPool::GetCurrentThreadIndex()
+{
+	return g_threadIndex;
+}
+
+void ThreadPool::WorkerMain(uint32 threadIndex)
+{
+	g_threadIndex = threadIndex;
+	uint32 lastJobId = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobCondition.wait(lock, [&]() {
+				return (!m_isRunning || (m_function != nullptr && m_jobId != lastJobId));
+			});
+			if (!m_isRunning)
+				return;
+			lastJobId = m_jobId;
+			m_numActiveWorkers++;
+		}
+
+		RunJob(threadIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_numActiveWorkers--;
+		}
+		m_doneCondition.notify_all();
+	}
+}
+
+void ThreadPool::RunJob(uint32 threadIndex)
+{
+	g_isInsideParallelFor = true;
+	while (true)
+	{
+		uint32 index = m_nextIndex++;
+		if (index >= m_count)
+			break;
+		(*m_function)(index, threadIndex);
+		m_numCompleted++;
+	}
+	g_isInsideParallelFor = false;
+}
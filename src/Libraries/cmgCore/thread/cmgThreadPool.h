@@ -0,0 +1,60 @@
+#ifndef _CMG_CORE_THREAD_THREAD_POOL_H_
+#define _CMG_CORE_THREAD_THREAD_POOL_H_
+
+#include <cmgCore/containers/cmgArray.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+//-----------------------------------------------------------------------------
+// ThreadPool - A fixed set of worker threads used to run parallel loops.
+// The thread that calls ParallelFor participates in the work as thread 0.
+//-----------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+	// Function called for each index of a parallel loop, along with the
+	// index of the thread running it (in the range [0, GetNumThreads()))
+	using ParallelForFunction = std::function<void(uint32 index, uint32 threadIndex)>;
+
+public:
+	// Create a pool with the given total number of threads (including the
+	// calling thread). Zero uses the number of hardware threads.
+	ThreadPool(uint32 numThreads = 0);
+	~ThreadPool();
+
+	inline uint32 GetNumThreads() const { return (uint32) m_workers.size() + 1; }
+
+	// Returns the index of the calling thread within its pool. Threads that
+	// are not pool workers (such as the main thread) are always thread 0.
+	static uint32 GetCurrentThreadIndex();
+
+	// Call a function for every index in [0, count) spread across the
+	// threads, returning once all calls have completed. Nested calls from
+	// inside a parallel loop run serially on the current thread.
+	void ParallelFor(uint32 count, const ParallelForFunction& function);
+
+private:
+	void WorkerMain(uint32 threadIndex);
+	void RunJob(uint32 threadIndex);
+
+	Array<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_jobCondition;
+	std::condition_variable m_doneCondition;
+	bool m_isRunning;
+
+	// The current job
+	const ParallelForFunction* m_function;
+	uint32 m_count;
+	uint32 m_jobId;
+	std::atomic<uint32> m_nextIndex;
+	std::atomic<uint32> m_numCompleted;
+	uint32 m_numActiveWorkers;
+};
+
+
+#endif // _CMG_CORE_THREAD_THREAD_POOL_H_
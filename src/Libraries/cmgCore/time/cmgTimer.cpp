@@ -55,6 +55,17 @@ static double cmgGetCurrentTime()
 	return (double(li.QuadPart) / g_freq);
 }
 
+#else
+
+#include <chrono>
+
+// Get the current time in seconds from the standard monotonic clock.
+static double cmgGetCurrentTime()
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 #endif
 
 
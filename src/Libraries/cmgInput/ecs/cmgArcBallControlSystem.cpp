@@ -9,6 +9,7 @@ ArcBallControlSystem::ArcBallControlSystem()
 {
 	AddComponentType<TransformComponent>();
 	AddComponentType<ArcBall>();
+	SetName("ArcBallControlSystem");
 }
 void ArcBallControlSystem::SetMouse(Mouse* mouse)
 {
@@ -0,0 +1,365 @@
+#include "cmgTransformHierarchy.h"
+
+
+const uint32 TransformHierarchySystem::INVALID_NODE;
+
+
+// Put values into a new order, given the old index of each new element
+template <typename T>
+static void ReorderArray(Array<T>& values, const Array<uint32>& order)
+{
+	Array<T> result(order.size());
+	for (uint32 i = 0; i < order.size(); i++)
+		result[i] = values[order[i]];
+	values.swap(result);
+}
+
+
+TransformHierarchySystem::TransformHierarchySystem() :
+	BaseECSSystem(),
+	m_isOrderValid(true),
+	m_hasDirtyNodes(false),
+	m_numRoots(0),
+	m_numRebuilds(0),
+	m_numUpdated(0)
+{
+	// World transforms are only written in PostUpdate, so the update itself
+	// doesn't conflict with systems reading them
+	AddComponentType<TransformComponent>(FLAG_READ_ONLY | FLAG_CHANGED);
+	AddComponentType<HierarchyComponent>(FLAG_OPTIONAL | FLAG_READ_ONLY | FLAG_CHANGED);
+	AddComponentType<WorldTransformComponent>(FLAG_READ_ONLY);
+	SetName("TransformHierarchySystem");
+}
+
+void TransformHierarchySystem::UpdateComponents(float,
+	BaseECSComponent** components)
+{
+	const TransformComponent* transform = (const TransformComponent*) components[0];
+	const HierarchyComponent* hierarchy = (const HierarchyComponent*) components[1];
+	EntityHandle entity = transform->entity;
+
+	uint32 node = FindNode(entity);
+	if (node == INVALID_NODE)
+		node = AddNode(entity);
+	SetNodeChanged(node, (hierarchy != nullptr ?
+		hierarchy->parent : NULL_ENTITY_HANDLE), transform);
+}
+
+void TransformHierarchySystem::PostUpdate(float)
+{
+	m_numUpdated = 0;
+	ECS* ecs = GetQuery().GetECS();
+	if (ecs == nullptr)
+		return;
+
+	// Removed entities, and entities that matched without their transform
+	// changing (such as by adding a WorldTransformComponent later), only
+	// show up in the number of matches
+	if (m_entities.size() != GetQuery().GetNumMatches())
+		Resync(ecs);
+	if (!m_isOrderValid)
+		RebuildOrder(ecs->GetParallelGrainSize());
+	if (!m_hasDirtyNodes)
+		return;
+
+	m_updateTasks.clear();
+	for (uint32 i = 0; i < m_tasks.size(); i++)
+	{
+		if (m_dirtyTasks[i])
+			m_updateTasks.push_back(i);
+	}
+	ThreadPool* threadPool = ecs->GetThreadPool();
+	if (threadPool != nullptr && m_updateTasks.size() > 1)
+	{
+		threadPool->ParallelFor((uint32) m_updateTasks.size(),
+			[this](uint32 index, uint32) {
+			UpdateTask(m_tasks[m_updateTasks[index]]);
+		});
+	}
+	else
+	{
+		for (uint32 i = 0; i < m_updateTasks.size(); i++)
+			UpdateTask(m_tasks[m_updateTasks[i]]);
+	}
+
+	// Write the results on this thread, which marks the components changed
+	for (uint32 i = 0; i < m_updateTasks.size(); i++)
+	{
+		const Task& task = m_tasks[m_updateTasks[i]];
+		for (uint32 node = task.begin; node < task.end; node++)
+		{
+			if (!m_dirty[node])
+				continue;
+			WorldTransformComponent* world =
+				ecs->GetComponent<WorldTransformComponent>(m_entities[node]);
+			if (world != nullptr)
+				world->worldMatrix = m_worldMatrices[node];
+			m_dirty[node] = 0;
+			m_numUpdated++;
+		}
+		m_dirtyTasks[m_updateTasks[i]] = 0;
+	}
+	m_hasDirtyNodes = false;
+}
+
+uint32 TransformHierarchySystem::FindNode(EntityHandle entity) const
+{
+	if (entity.index < m_nodeIndices.size())
+	{
+		uint32 node = m_nodeIndices[entity.index];
+		if (node != INVALID_NODE && m_entities[node] == entity)
+			return node;
+	}
+	return INVALID_NODE;
+}
+
+uint32 TransformHierarchySystem::AddNode(EntityHandle entity)
+{
+	// Reuse the node of a removed entity in the same slot
+	uint32 node = INVALID_NODE;
+	if (entity.index < m_nodeIndices.size())
+		node = m_nodeIndices[entity.index];
+	else
+		m_nodeIndices.resize(entity.index + 1, INVALID_NODE);
+
+	if (node == INVALID_NODE)
+	{
+		node = (uint32) m_entities.size();
+		m_nodeIndices[entity.index] = node;
+		m_entities.push_back(entity);
+		m_parentEntities.push_back(NULL_ENTITY_HANDLE);
+		m_attachedParents.push_back(NULL_ENTITY_HANDLE);
+		m_parents.push_back(INVALID_NODE);
+		m_nodeTasks.push_back(0);
+		m_localMatrices.push_back(Matrix4f::IDENTITY);
+		m_worldMatrices.push_back(Matrix4f::IDENTITY);
+		m_dirty.push_back(0);
+	}
+	else
+	{
+		m_entities[node] = entity;
+	}
+	m_isOrderValid = false;
+	return node;
+}
+
+void TransformHierarchySystem::SetNodeChanged(uint32 node, EntityHandle parent,
+	const TransformComponent* transform)
+{
+	if (m_parentEntities[node] != parent)
+	{
+		m_parentEntities[node] = parent;
+		m_isOrderValid = false;
+	}
+	m_localMatrices[node] = transform->transform.GetMatrix();
+	m_dirty[node] = 1;
+	m_hasDirtyNodes = true;
+	if (m_isOrderValid)
+		m_dirtyTasks[m_nodeTasks[node]] = 1;
+}
+
+void TransformHierarchySystem::Resync(ECS* ecs)
+{
+	m_queryEntities.clear();
+	GetQuery().GetEntities(m_queryEntities);
+
+	// Find the nodes of all matching entities, adding any that are missing
+	m_isMatching.assign(m_entities.size(), 0);
+	for (uint32 i = 0; i < m_queryEntities.size(); i++)
+	{
+		EntityHandle entity = m_queryEntities[i];
+		uint32 node = FindNode(entity);
+		if (node == INVALID_NODE)
+		{
+			node = AddNode(entity);
+			const HierarchyComponent* hierarchy =
+				ecs->GetComponentReadOnly<HierarchyComponent>(entity);
+			SetNodeChanged(node, (hierarchy != nullptr ?
+				hierarchy->parent : NULL_ENTITY_HANDLE),
+				ecs->GetComponentReadOnly<TransformComponent>(entity));
+		}
+		if (node >= m_isMatching.size())
+			m_isMatching.resize(node + 1, 0);
+		m_isMatching[node] = 1;
+	}
+
+	// Remove the rest
+	uint32 count = 0;
+	for (uint32 node = 0; node < m_entities.size(); node++)
+	{
+		uint32 index = m_entities[node].index;
+		if (!m_isMatching[node])
+		{
+			if (m_nodeIndices[index] == node)
+				m_nodeIndices[index] = INVALID_NODE;
+			continue;
+		}
+		m_nodeIndices[index] = count;
+		m_entities[count] = m_entities[node];
+		m_parentEntities[count] = m_parentEntities[node];
+		m_attachedParents[count] = m_attachedParents[node];
+		m_localMatrices[count] = m_localMatrices[node];
+		m_worldMatrices[count] = m_worldMatrices[node];
+		m_dirty[count] = m_dirty[node];
+		count++;
+	}
+	if (count != m_entities.size())
+	{
+		m_entities.resize(count);
+		m_parentEntities.resize(count);
+		m_attachedParents.resize(count);
+		m_parents.resize(count);
+		m_nodeTasks.resize(count);
+		m_localMatrices.resize(count);
+		m_worldMatrices.resize(count);
+		m_dirty.resize(count);
+	}
+	m_isOrderValid = false;
+}
+
+void TransformHierarchySystem::RebuildOrder(uint32 grainSize)
+{
+	uint32 numNodes = (uint32) m_entities.size();
+
+	// Link each node to its parent's node, then list the children of each
+	// node, grouped by parent
+	m_childOffsets.assign(numNodes + 1, 0);
+	for (uint32 node = 0; node < numNodes; node++)
+	{
+		uint32 parent = FindNode(m_parentEntities[node]);
+		if (parent == node)
+			parent = INVALID_NODE;
+		m_parents[node] = parent;
+		if (parent != INVALID_NODE)
+			m_childOffsets[parent + 1]++;
+	}
+	for (uint32 node = 0; node < numNodes; node++)
+		m_childOffsets[node + 1] += m_childOffsets[node];
+	m_children.resize(m_childOffsets[numNodes]);
+	m_newIndices.assign(m_childOffsets.begin(), m_childOffsets.end() - 1);
+	for (uint32 node = 0; node < numNodes; node++)
+	{
+		if (m_parents[node] != INVALID_NODE)
+			m_children[m_newIndices[m_parents[node]]++] = node;
+	}
+
+	// Breadth-first order within each root's subtree
+	m_order.clear();
+	m_tasks.clear();
+	m_numRoots = 0;
+	m_newIndices.assign(numNodes, INVALID_NODE);
+	for (uint32 node = 0; node < numNodes; node++)
+	{
+		if (m_parents[node] == INVALID_NODE)
+			AppendSubtree(node);
+	}
+
+	// Nodes left over are in or below a parent cycle. Walking up from one
+	// for as many steps as there are nodes ends inside the cycle, where it is
+	// broken by making that node a root.
+	for (uint32 node = 0; node < numNodes; node++)
+	{
+		if (m_newIndices[node] != INVALID_NODE)
+			continue;
+		uint32 root = node;
+		for (uint32 step = 0; step < numNodes; step++)
+			root = m_parents[root];
+		m_parents[root] = INVALID_NODE;
+		AppendSubtree(root);
+	}
+
+	// A node must be recomputed if it was attached to a different parent
+	for (uint32 node = 0; node < numNodes; node++)
+	{
+		uint32 parent = m_parents[node];
+		EntityHandle attachedParent = (parent != INVALID_NODE ?
+			m_entities[parent] : NULL_ENTITY_HANDLE);
+		if (m_attachedParents[node] != attachedParent)
+		{
+			m_attachedParents[node] = attachedParent;
+			m_dirty[node] = 1;
+			m_hasDirtyNodes = true;
+		}
+		if (parent != INVALID_NODE)
+			m_parents[node] = m_newIndices[parent];
+	}
+
+	ReorderArray(m_entities, m_order);
+	ReorderArray(m_parentEntities, m_order);
+	ReorderArray(m_attachedParents, m_order);
+	ReorderArray(m_parents, m_order);
+	ReorderArray(m_localMatrices, m_order);
+	ReorderArray(m_worldMatrices, m_order);
+	ReorderArray(m_dirty, m_order);
+	for (uint32 node = 0; node < numNodes; node++)
+		m_nodeIndices[m_entities[node].index] = node;
+
+	// Group consecutive subtrees into tasks of at least the grain size
+	uint32 numTasks = 0;
+	for (uint32 i = 0; i < m_tasks.size(); i++)
+	{
+		if (numTasks > 0 && m_tasks[numTasks - 1].end -
+			m_tasks[numTasks - 1].begin < grainSize)
+			m_tasks[numTasks - 1].end = m_tasks[i].end;
+		else
+			m_tasks[numTasks++] = m_tasks[i];
+	}
+	m_tasks.resize(numTasks);
+	m_dirtyTasks.assign(numTasks, 0);
+	for (uint32 task = 0; task < numTasks; task++)
+	{
+		for (uint32 node = m_tasks[task].begin; node < m_tasks[task].end; node++)
+		{
+			m_nodeTasks[node] = task;
+			if (m_dirty[node])
+				m_dirtyTasks[task] = 1;
+		}
+	}
+
+	m_isOrderValid = true;
+	m_numRebuilds++;
+}
+
+void TransformHierarchySystem::AppendSubtree(uint32 root)
+{
+	Task task;
+	task.begin = (uint32) m_order.size();
+	m_newIndices[root] = task.begin;
+	m_order.push_back(root);
+	for (uint32 i = task.begin; i < m_order.size(); i++)
+	{
+		uint32 node = m_order[i];
+		for (uint32 j = m_childOffsets[node]; j < m_childOffsets[node + 1]; j++)
+		{
+			uint32 child = m_children[j];
+			if (m_newIndices[child] == INVALID_NODE)
+			{
+				m_newIndices[child] = (uint32) m_order.size();
+				m_order.push_back(child);
+			}
+		}
+	}
+	task.end = (uint32) m_order.size();
+	m_tasks.push_back(task);
+	m_numRoots++;
+}
+
+void TransformHierarchySystem::UpdateTask(const Task& task)
+{
+	// Parents come first, so their dirty flags and world matrices are
+	// already up to date
+	for (uint32 node = task.begin; node < task.end; node++)
+	{
+		uint32 parent = m_parents[node];
+		if (parent == INVALID_NODE)
+		{
+			if (m_dirty[node])
+				m_worldMatrices[node] = m_localMatrices[node];
+		}
+		else if (m_dirty[node] || m_dirty[parent])
+		{
+			m_dirty[node] = 1;
+			m_worldMatrices[node] = m_worldMatrices[parent] * m_localMatrices[node];
+		}
+	}
+}
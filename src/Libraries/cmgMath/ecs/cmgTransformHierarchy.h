@@ -0,0 +1,112 @@
+#ifndef _CMG_MATH_TRANSFORM_HIERARCHY_H_
+#define _CMG_MATH_TRANSFORM_HIERARCHY_H_
+
+#include <cmgCore/ecs/cmgECS.h>
+#include <cmgMath/ecs/cmgTransformComponent.h>
+#include <cmgMath/types/cmgMatrix4f.h>
+
+
+// Attaches an entity to a parent entity, making its TransformComponent
+// relative to the parent's world transform
+struct HierarchyComponent : public ECSComponent<HierarchyComponent>
+{
+	EntityHandle parent = NULL_ENTITY_HANDLE;
+};
+
+// World space matrix of an entity, written by TransformHierarchySystem
+struct WorldTransformComponent : public ECSComponent<WorldTransformComponent>
+{
+	Matrix4f worldMatrix = Matrix4f::IDENTITY;
+};
+
+
+//-----------------------------------------------------------------------------
+// TransformHierarchySystem - Computes the WorldTransformComponent of every
+// entity that has one along with a TransformComponent, following the parent
+// links of HierarchyComponents. Entities without a parent (or whose parent
+// isn't part of the hierarchy) are roots.
+//
+// The nodes are kept in contiguous arrays, sorted breadth-first within each
+// root's subtree, so every parent comes before its children and each subtree
+// is one contiguous range. Only nodes whose transform or parent changed, and
+// their descendants, are recomputed, and independent subtrees are spread
+// across the ECS thread pool. World transforms are written in PostUpdate.
+//-----------------------------------------------------------------------------
+class TransformHierarchySystem : public BaseECSSystem
+{
+public:
+	static const uint32 INVALID_NODE = (uint32) -1;
+
+public:
+	TransformHierarchySystem();
+
+	virtual void UpdateComponents(float delta,
+		BaseECSComponent** components) override;
+	virtual void PostUpdate(float delta) override;
+
+	// Returns the index of an entity's node, or INVALID_NODE
+	uint32 FindNode(EntityHandle entity) const;
+
+	inline uint32 GetNumNodes() const { return (uint32) m_entities.size(); }
+	inline EntityHandle GetNodeEntity(uint32 node) const { return m_entities[node]; }
+	inline uint32 GetNodeParent(uint32 node) const { return m_parents[node]; }
+	inline const Matrix4f& GetNodeWorldMatrix(uint32 node) const { return m_worldMatrices[node]; }
+
+	// Statistics
+	inline uint32 GetNumRoots() const { return m_numRoots; }
+	inline uint32 GetNumTasks() const { return (uint32) m_tasks.size(); }
+	inline uint32 GetNumRebuilds() const { return m_numRebuilds; }
+
+	// Number of world transforms recomputed by the last update
+	inline uint32 GetNumUpdated() const { return m_numUpdated; }
+
+private:
+	// A range of whole subtrees that is updated as one piece of work
+	struct Task
+	{
+		uint32 begin;
+		uint32 end;
+	};
+
+	uint32 AddNode(EntityHandle entity);
+	void SetNodeChanged(uint32 node, EntityHandle parent,
+		const TransformComponent* transform);
+	void Resync(ECS* ecs);
+	void RebuildOrder(uint32 grainSize);
+	void AppendSubtree(uint32 root);
+	void UpdateTask(const Task& task);
+
+	// Node data
+	Array<EntityHandle> m_entities;
+	Array<EntityHandle> m_parentEntities;
+	Array<EntityHandle> m_attachedParents;
+	Array<uint32> m_parents;
+	Array<uint32> m_nodeTasks;
+	Array<Matrix4f> m_localMatrices;
+	Array<Matrix4f> m_worldMatrices;
+	Array<uint8> m_dirty;
+
+	// Node of each entity index
+	Array<uint32> m_nodeIndices;
+
+	Array<Task> m_tasks;
+	Array<uint8> m_dirtyTasks;
+	Array<uint32> m_updateTasks;
+	bool m_isOrderValid;
+	bool m_hasDirtyNodes;
+
+	// Scratch space, kept to avoid allocating every frame
+	Array<EntityHandle> m_queryEntities;
+	Array<uint8> m_isMatching;
+	Array<uint32> m_childOffsets;
+	Array<uint32> m_children;
+	Array<uint32> m_order;
+	Array<uint32> m_newIndices;
+
+	uint32 m_numRoots;
+	uint32 m_numRebuilds;
+	uint32 m_numUpdated;
+};
+
+
+#endif // _CMG_MATH_TRANSFORM_HIERARCHY_H_
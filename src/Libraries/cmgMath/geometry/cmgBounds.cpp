@@ -32,13 +32,14 @@ bool Bounds::Intersects(const Bounds& bounds) const
 {
 	return !(bounds.mins.x - maxs.x >= 0.0f || mins.x - bounds.maxs.x >= 0.0f ||
 				bounds.mins.y - maxs.y >= 0.0f || mins.y - bounds.maxs.y >= 0.0f ||
-				bounds.mins.z - maxs.y >= 0.0f || mins.z - bounds.maxs.z >= 0.0f);
+				bounds.mins.z - maxs.z >= 0.0f || mins.z - bounds.maxs.z >= 0.0f);
 }
 
 // Does ray intersect this bounding-box?
 bool Bounds::IntersectsRay(const Ray& ray) const
 {
-	return CastRayAtBox(mins, maxs, ray.origin, ray.direction, Vector3f());
+	Vector3f intersection;
+	return CastRayAtBox(mins, maxs, ray.origin, ray.direction, intersection);
 }
 
 // Cast a ray at this bounding-box, and output the distance
@@ -0,0 +1,76 @@
+#include "cmgAABBTreeBroadphase.h"
+#include <cmgMath/cmgMathLib.h>
+
+
+AABBTreeBroadphase::AABBTreeBroadphase() :
+	Broadphase(BroadphaseType::k_aabbTree)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Broadphase implementations
+//-----------------------------------------------------------------------------
+
+void AABBTreeBroadphase::Clear()
+{
+	m_tree.Clear();
+	ClearProxyFlags();
+}
+
+int32 AABBTreeBroadphase::CreateProxy(const Bounds& bounds, void* userData, bool isStatic)
+{
+	int32 proxyId = m_tree.CreateProxy(bounds, userData);
+	SetProxyFlags(proxyId, isStatic);
+	return proxyId;
+}
+
+void AABBTreeBroadphase::DestroyProxy(int32 proxyId)
+{
+	m_tree.DestroyProxy(proxyId);
+}
+
+void AABBTreeBroadphase::MoveProxy(int32 proxyId, const Bounds& bounds,
+	const Vector3f& displacement)
+{
+	m_tree.MoveProxy(proxyId, bounds, displacement);
+}
+
+void* AABBTreeBroadphase::GetUserData(int32 proxyId) const
+{
+	return m_tree.GetUserData(proxyId);
+}
+
+const Bounds& AABBTreeBroadphase::GetFatBounds(int32 proxyId) const
+{
+	return m_tree.GetFatBounds(proxyId);
+}
+
+uint32 AABBTreeBroadphase::GetNumProxies() const
+{
+	return m_tree.GetNumProxies();
+}
+
+void AABBTreeBroadphase::UpdatePairs()
+{
+	m_pairs.clear();
+
+	// Each dynamic proxy finds its overlaps. Two dynamic proxies would find
+	// each other, so only the one with the lower ID reports the pair.
+	uint32 capacity = m_tree.GetNodeCapacity();
+	for (int32 proxyId = 0; proxyId < (int32) capacity; proxyId++)
+	{
+		if (!m_tree.IsProxy(proxyId) || m_isStatic[proxyId])
+			continue;
+		m_tree.Query(m_tree.GetFatBounds(proxyId), [&](int32 otherId) {
+			if (m_isStatic[otherId])
+				m_pairs.push_back(BroadphasePair(
+					Math::Min(proxyId, otherId), Math::Max(proxyId, otherId)));
+			else if (otherId > proxyId)
+				m_pairs.push_back(BroadphasePair(proxyId, otherId));
+			return true;
+		});
+	}
+
+	SortPairs();
+}
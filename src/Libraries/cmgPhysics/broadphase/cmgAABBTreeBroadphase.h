@@ -0,0 +1,36 @@
+#ifndef _CMG_PHYSICS_BROADPHASE_AABB_TREE_BROADPHASE_H_
+#define _CMG_PHYSICS_BROADPHASE_AABB_TREE_BROADPHASE_H_
+
+#include <cmgPhysics/broadphase/cmgBroadphase.h>
+#include <cmgPhysics/cmgDynamicAABBTree.h>
+
+
+//-----------------------------------------------------------------------------
+// AABBTreeBroadphase - Keeps the proxies in a dynamic AABB tree, and each
+// dynamic proxy queries the tree for its overlaps. Works well for any layout
+// of bodies.
+//-----------------------------------------------------------------------------
+class AABBTreeBroadphase : public Broadphase
+{
+public:
+	AABBTreeBroadphase();
+
+	// Broadphase implementations
+	void Clear() override;
+	int32 CreateProxy(const Bounds& bounds, void* userData, bool isStatic) override;
+	void DestroyProxy(int32 proxyId) override;
+	void MoveProxy(int32 proxyId, const Bounds& bounds, const Vector3f& displacement) override;
+	void* GetUserData(int32 proxyId) const override;
+	const Bounds& GetFatBounds(int32 proxyId) const override;
+	uint32 GetNumProxies() const override;
+	void UpdatePairs() override;
+
+	inline DynamicAABBTree& GetTree() { return m_tree; }
+	inline const DynamicAABBTree& GetTree() const { return m_tree; }
+
+private:
+	DynamicAABBTree m_tree;
+};
+
+
+#endif // _CMG_PHYSICS_BROADPHASE_AABB_TREE_BROADPHASE_H_
@@ -0,0 +1,27 @@
+#include "cmgBroadphase.h"
+#include <algorithm>
+
+
+Broadphase::Broadphase(BroadphaseType type) :
+	m_type(type)
+{
+}
+
+void Broadphase::ClearProxyFlags()
+{
+	m_isStatic.clear();
+	m_pairs.clear();
+}
+
+void Broadphase::SetProxyFlags(int32 proxyId, bool isStatic)
+{
+	if ((int32) m_isStatic.size() <= proxyId)
+		m_isStatic.resize(proxyId + 1, 0);
+	m_isStatic[proxyId] = (isStatic ? 1 : 0);
+}
+
+void Broadphase::SortPairs()
+{
+	std::sort(m_pairs.begin(), m_pairs.end());
+	m_pairs.erase(std::unique(m_pairs.begin(), m_pairs.end()), m_pairs.end());
+}
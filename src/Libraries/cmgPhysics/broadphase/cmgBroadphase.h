@@ -0,0 +1,92 @@
+#ifndef _CMG_PHYSICS_BROADPHASE_BROADPHASE_H_
+#define _CMG_PHYSICS_BROADPHASE_BROADPHASE_H_
+
+#include <cmgCore/containers/cmgArray.h>
+#include <cmgMath/geometry/cmgBounds.h>
+
+
+//-----------------------------------------------------------------------------
+// BroadphaseType
+//-----------------------------------------------------------------------------
+enum class BroadphaseType
+{
+	k_aabbTree = 0,
+	k_sweepAndPrune,
+
+	k_count,
+};
+
+
+// Two proxies whose fat boxes overlap, with proxyA < proxyB
+struct BroadphasePair
+{
+	int32 proxyA;
+	int32 proxyB;
+
+	BroadphasePair(int32 proxyA, int32 proxyB) :
+		proxyA(proxyA),
+		proxyB(proxyB)
+	{
+	}
+
+	inline bool operator <(const BroadphasePair& other) const
+	{
+		if (proxyA != other.proxyA)
+			return (proxyA < other.proxyA);
+		return (proxyB < other.proxyB);
+	}
+
+	inline bool operator ==(const BroadphasePair& other) const
+	{
+		return (proxyA == other.proxyA && proxyB == other.proxyB);
+	}
+};
+
+
+//-----------------------------------------------------------------------------
+// Broadphase - Finds the pairs of bodies that might be touching, so the
+// narrowphase doesn't have to test every pair. Each body has a proxy with a
+// fattened box, and UpdatePairs finds every pair of proxies whose fat boxes
+// overlap. Pairs of two static proxies are never reported.
+//-----------------------------------------------------------------------------
+class Broadphase
+{
+public:
+	Broadphase(BroadphaseType type);
+	virtual ~Broadphase() {}
+
+	// Getters
+	inline BroadphaseType GetType() const { return m_type; }
+	inline const Array<BroadphasePair>& GetPairs() const { return m_pairs; }
+	inline bool IsProxyStatic(int32 proxyId) const { return (m_isStatic[proxyId] != 0); }
+	inline void SetProxyStatic(int32 proxyId, bool isStatic) { m_isStatic[proxyId] = (isStatic ? 1 : 0); }
+
+	// Virtual functions
+	virtual void Clear() = 0;
+	virtual int32 CreateProxy(const Bounds& bounds, void* userData, bool isStatic) = 0;
+	virtual void DestroyProxy(int32 proxyId) = 0;
+	virtual void MoveProxy(int32 proxyId, const Bounds& bounds, const Vector3f& displacement) = 0;
+	virtual void* GetUserData(int32 proxyId) const = 0;
+	virtual const Bounds& GetFatBounds(int32 proxyId) const = 0;
+	virtual uint32 GetNumProxies() const = 0;
+
+	// Find the overlapping pairs, sorted and without duplicates
+	virtual void UpdatePairs() = 0;
+
+protected:
+	void ClearProxyFlags();
+	void SetProxyFlags(int32 proxyId, bool isStatic);
+
+	// Sort the pairs and remove duplicates
+	void SortPairs();
+
+	BroadphaseType m_type;
+
+	// Static flags indexed by proxy ID
+	Array<uint8> m_isStatic;
+
+	Array<BroadphasePair> m_pairs;
+};
+
+
+#endif // _CMG_PHYSICS_BROADPHASE_BROADPHASE_H_
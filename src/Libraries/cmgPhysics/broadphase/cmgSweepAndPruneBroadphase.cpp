@@ -0,0 +1,367 @@
+#include "cmgSweepAndPruneBroadphase.h"
+#include <cmgMath/cmgMathLib.h>
+#include <algorithm>
+
+const uint32 SweepAndPruneBroadphase::MAX_INSERTION_SORT_ADDS;
+
+// Axes of the region grid
+static const uint32 GRID_AXES[2] = { 0, 2 };
+
+// Same as Bounds::Intersects, but inlined for the sweep
+static inline bool TestOverlap(const Bounds& a, const Bounds& b)
+{
+	return (a.mins.x < b.maxs.x && b.mins.x < a.maxs.x &&
+		a.mins.y < b.maxs.y && b.mins.y < a.maxs.y &&
+		a.mins.z < b.maxs.z && b.mins.z < a.maxs.z);
+}
+
+
+SweepAndPruneBroadphase::SweepAndPruneBroadphase() :
+	Broadphase(BroadphaseType::k_sweepAndPrune),
+	m_freeList(-1),
+	m_numProxies(0),
+	m_sortAxis(0),
+	m_margin(0.1f),
+	m_worldBounds(Vector3f::ZERO, Vector3f::ZERO)
+{
+	m_numRegions[0] = 1;
+	m_numRegions[1] = 1;
+	m_regions.resize(1);
+	m_regions[0].numAdded = 0;
+}
+
+void SweepAndPruneBroadphase::SetSortAxis(uint32 axis)
+{
+	CMG_ASSERT(axis < 3);
+	m_sortAxis = axis;
+
+	// The endpoints are no longer in order, so sort them from scratch
+	for (uint32 i = 0; i < m_regions.size(); i++)
+		m_regions[i].numAdded = (uint32) m_regions[i].endpoints.size();
+}
+
+void SweepAndPruneBroadphase::SetRegionGrid(const Bounds& worldBounds,
+	uint32 numRegionsX, uint32 numRegionsZ)
+{
+	CMG_ASSERT(numRegionsX > 0 && numRegionsZ > 0);
+	m_worldBounds = worldBounds;
+	m_numRegions[0] = numRegionsX;
+	m_numRegions[1] = numRegionsZ;
+	m_regions.clear();
+	m_regions.resize(numRegionsX * numRegionsZ);
+	for (uint32 i = 0; i < m_regions.size(); i++)
+		m_regions[i].numAdded = 0;
+
+	// Add the existing proxies to their new regions
+	for (uint32 i = 0; i < m_proxies.size(); i++)
+	{
+		Proxy& proxy = m_proxies[i];
+		if (!proxy.inUse)
+			continue;
+		GetRegionRange(proxy.bounds, proxy.regionMins, proxy.regionMaxs);
+		for (uint32 z = proxy.regionMins[1]; z <= proxy.regionMaxs[1]; z++)
+		{
+			for (uint32 x = proxy.regionMins[0]; x <= proxy.regionMaxs[0]; x++)
+				AddToRegion((z * m_numRegions[0]) + x, (int32) i);
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Broadphase implementations
+//-----------------------------------------------------------------------------
+
+void SweepAndPruneBroadphase::Clear()
+{
+	m_proxies.clear();
+	m_freeList = -1;
+	m_numProxies = 0;
+	for (uint32 i = 0; i < m_regions.size(); i++)
+	{
+		m_regions[i].endpoints.clear();
+		m_regions[i].numAdded = 0;
+	}
+	ClearProxyFlags();
+}
+
+int32 SweepAndPruneBroadphase::CreateProxy(const Bounds& bounds,
+	void* userData, bool isStatic)
+{
+	int32 proxyId;
+	if (m_freeList >= 0)
+	{
+		proxyId = m_freeList;
+		m_freeList = m_proxies[proxyId].next;
+	}
+	else
+	{
+		proxyId = (int32) m_proxies.size();
+		m_proxies.push_back(Proxy());
+	}
+
+	Proxy& proxy = m_proxies[proxyId];
+	proxy.bounds = bounds;
+	proxy.bounds.Expand(m_margin);
+	proxy.userData = userData;
+	proxy.next = -1;
+	proxy.inUse = true;
+	GetRegionRange(proxy.bounds, proxy.regionMins, proxy.regionMaxs);
+	for (uint32 z = proxy.regionMins[1]; z <= proxy.regionMaxs[1]; z++)
+	{
+		for (uint32 x = proxy.regionMins[0]; x <= proxy.regionMaxs[0]; x++)
+			AddToRegion((z * m_numRegions[0]) + x, proxyId);
+	}
+
+	SetProxyFlags(proxyId, isStatic);
+	m_numProxies++;
+	return proxyId;
+}
+
+void SweepAndPruneBroadphase::DestroyProxy(int32 proxyId)
+{
+	Proxy& proxy = m_proxies[proxyId];
+	CMG_ASSERT(proxy.inUse);
+	for (uint32 z = proxy.regionMins[1]; z <= proxy.regionMaxs[1]; z++)
+	{
+		for (uint32 x = proxy.regionMins[0]; x <= proxy.regionMaxs[0]; x++)
+			RemoveFromRegion((z * m_numRegions[0]) + x, proxyId);
+	}
+	proxy.inUse = false;
+	proxy.userData = nullptr;
+	proxy.next = m_freeList;
+	m_freeList = proxyId;
+	m_numProxies--;
+}
+
+void SweepAndPruneBroadphase::MoveProxy(int32 proxyId, const Bounds& bounds,
+	const Vector3f& displacement)
+{
+	Proxy& proxy = m_proxies[proxyId];
+	CMG_ASSERT(proxy.inUse);
+	proxy.bounds = bounds;
+	proxy.bounds.Expand(m_margin);
+
+	// Stretch the box along this step's displacement. Boxes are refitted
+	// every step, so unlike the tree's they only need to cover one step.
+	for (uint32 axis = 0; axis < 3; axis++)
+	{
+		if (displacement.v[axis] < 0.0f)
+			proxy.bounds.mins.v[axis] += displacement.v[axis];
+		else
+			proxy.bounds.maxs.v[axis] += displacement.v[axis];
+	}
+
+	// Move between regions if the proxy's range of regions changed. The
+	// endpoint values are updated when sorting.
+	uint32 mins[2];
+	uint32 maxs[2];
+	GetRegionRange(proxy.bounds, mins, maxs);
+	if (mins[0] == proxy.regionMins[0] && mins[1] == proxy.regionMins[1] &&
+		maxs[0] == proxy.regionMaxs[0] && maxs[1] == proxy.regionMaxs[1])
+		return;
+	for (uint32 z = proxy.regionMins[1]; z <= proxy.regionMaxs[1]; z++)
+	{
+		for (uint32 x = proxy.regionMins[0]; x <= proxy.regionMaxs[0]; x++)
+		{
+			if (x < mins[0] || x > maxs[0] || z < mins[1] || z > maxs[1])
+				RemoveFromRegion((z * m_numRegions[0]) + x, proxyId);
+		}
+	}
+	for (uint32 z = mins[1]; z <= maxs[1]; z++)
+	{
+		for (uint32 x = mins[0]; x <= maxs[0]; x++)
+		{
+			if (x < proxy.regionMins[0] || x > proxy.regionMaxs[0] ||
+				z < proxy.regionMins[1] || z > proxy.regionMaxs[1])
+				AddToRegion((z * m_numRegions[0]) + x, proxyId);
+		}
+	}
+	for (uint32 k = 0; k < 2; k++)
+	{
+		proxy.regionMins[k] = mins[k];
+		proxy.regionMaxs[k] = maxs[k];
+	}
+}
+
+void* SweepAndPruneBroadphase::GetUserData(int32 proxyId) const
+{
+	return m_proxies[proxyId].userData;
+}
+
+const Bounds& SweepAndPruneBroadphase::GetFatBounds(int32 proxyId) const
+{
+	return m_proxies[proxyId].bounds;
+}
+
+uint32 SweepAndPruneBroadphase::GetNumProxies() const
+{
+	return m_numProxies;
+}
+
+void SweepAndPruneBroadphase::UpdatePairs()
+{
+	m_pairs.clear();
+	if (m_activeIndices.size() < m_proxies.size())
+		m_activeIndices.resize(m_proxies.size());
+
+	for (uint32 i = 0; i < m_regions.size(); i++)
+	{
+		Region& region = m_regions[i];
+		SortRegion(region);
+		SweepRegion(region);
+	}
+
+	// A pair touching several regions is found in each of them
+	SortPairs();
+}
+
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+bool SweepAndPruneBroadphase::LessEndpoint(const Endpoint& a, const Endpoint& b)
+{
+	// Mins come before maxes of the same value, so touching boxes are both
+	// in the sweep and then rejected by the overlap test
+	if (a.value != b.value)
+		return (a.value < b.value);
+	return (!a.IsMax() && b.IsMax());
+}
+
+void SweepAndPruneBroadphase::GetRegionRange(const Bounds& bounds,
+	uint32* mins, uint32* maxs) const
+{
+	for (uint32 k = 0; k < 2; k++)
+	{
+		uint32 count = m_numRegions[k];
+		if (count == 1)
+		{
+			mins[k] = 0;
+			maxs[k] = 0;
+			continue;
+		}
+		uint32 axis = GRID_AXES[k];
+		float worldMin = m_worldBounds.mins[axis];
+		float scale = count / (m_worldBounds.maxs[axis] - worldMin);
+		float last = (float) (count - 1);
+		mins[k] = (uint32) Math::Clamp(
+			(bounds.mins[axis] - worldMin) * scale, 0.0f, last);
+		maxs[k] = (uint32) Math::Clamp(
+			(bounds.maxs[axis] - worldMin) * scale, 0.0f, last);
+	}
+}
+
+void SweepAndPruneBroadphase::AddToRegion(uint32 regionIndex, int32 proxyId)
+{
+	// Added to the end, and moved into place when sorting
+	Region& region = m_regions[regionIndex];
+	const Bounds& bounds = m_proxies[proxyId].bounds;
+	Endpoint endpoint;
+	endpoint.value = bounds.mins[m_sortAxis];
+	endpoint.data = ((uint32) proxyId << 1);
+	region.endpoints.push_back(endpoint);
+	endpoint.value = bounds.maxs[m_sortAxis];
+	endpoint.data = ((uint32) proxyId << 1) | 1;
+	region.endpoints.push_back(endpoint);
+	region.numAdded += 2;
+}
+
+void SweepAndPruneBroadphase::RemoveFromRegion(uint32 regionIndex, int32 proxyId)
+{
+	// Removing keeps the rest in order
+	Array<Endpoint>& endpoints = m_regions[regionIndex].endpoints;
+	endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(),
+		[proxyId](const Endpoint& endpoint) {
+			return (endpoint.GetProxyId() == proxyId);
+		}), endpoints.end());
+}
+
+void SweepAndPruneBroadphase::SortRegion(Region& region)
+{
+	Array<Endpoint>& endpoints = region.endpoints;
+	uint32 count = (uint32) endpoints.size();
+	for (uint32 i = 0; i < count; i++)
+	{
+		Endpoint& endpoint = endpoints[i];
+		const Bounds& bounds = m_proxies[endpoint.GetProxyId()].bounds;
+		endpoint.value = (endpoint.IsMax() ?
+			bounds.maxs[m_sortAxis] : bounds.mins[m_sortAxis]);
+	}
+
+	if (region.numAdded > MAX_INSERTION_SORT_ADDS)
+	{
+		std::sort(endpoints.begin(), endpoints.end(), LessEndpoint);
+	}
+	else
+	{
+		// Bodies only move a little each step, so most endpoints are already
+		// in place
+		for (uint32 i = 1; i < count; i++)
+		{
+			Endpoint endpoint = endpoints[i];
+			uint32 j = i;
+			while (j > 0 && LessEndpoint(endpoint, endpoints[j - 1]))
+			{
+				endpoints[j] = endpoints[j - 1];
+				j--;
+			}
+			endpoints[j] = endpoint;
+		}
+	}
+	region.numAdded = 0;
+}
+
+void SweepAndPruneBroadphase::SweepRegion(const Region& region)
+{
+	// Static and dynamic proxies are kept apart so static proxies are never
+	// tested against each other
+	m_activeStatic.clear();
+	m_activeDynamic.clear();
+	for (uint32 i = 0; i < region.endpoints.size(); i++)
+	{
+		const Endpoint& endpoint = region.endpoints[i];
+		int32 proxyId = endpoint.GetProxyId();
+		bool isStatic = (m_isStatic[proxyId] != 0);
+		Array<ActiveProxy>& active = (isStatic ? m_activeStatic : m_activeDynamic);
+
+		if (endpoint.IsMax())
+		{
+			uint32 index = m_activeIndices[proxyId];
+			active[index] = active.back();
+			m_activeIndices[active[index].proxyId] = index;
+			active.pop_back();
+			continue;
+		}
+
+		const Bounds& bounds = m_proxies[proxyId].bounds;
+		for (uint32 j = 0; j < m_activeDynamic.size(); j++)
+		{
+			const ActiveProxy& other = m_activeDynamic[j];
+			if (TestOverlap(bounds, other.bounds))
+			{
+				m_pairs.push_back(BroadphasePair(Math::Min(proxyId, other.proxyId),
+					Math::Max(proxyId, other.proxyId)));
+			}
+		}
+		if (!isStatic)
+		{
+			for (uint32 j = 0; j < m_activeStatic.size(); j++)
+			{
+				const ActiveProxy& other = m_activeStatic[j];
+				if (TestOverlap(bounds, other.bounds))
+				{
+					m_pairs.push_back(BroadphasePair(Math::Min(proxyId, other.proxyId),
+						Math::Max(proxyId, other.proxyId)));
+				}
+			}
+		}
+
+		ActiveProxy activeProxy;
+		activeProxy.bounds = bounds;
+		activeProxy.proxyId = proxyId;
+		m_activeIndices[proxyId] = (uint32) active.size();
+		active.push_back(activeProxy);
+	}
+}
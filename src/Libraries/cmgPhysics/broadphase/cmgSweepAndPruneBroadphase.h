@@ -0,0 +1,117 @@
+#ifndef _CMG_PHYSICS_BROADPHASE_SWEEP_AND_PRUNE_BROADPHASE_H_
+#define _CMG_PHYSICS_BROADPHASE_SWEEP_AND_PRUNE_BROADPHASE_H_
+
+#include <cmgPhysics/broadphase/cmgBroadphase.h>
+
+
+//-----------------------------------------------------------------------------
+// SweepAndPruneBroadphase - Keeps the min and max endpoints of the proxies
+// along one axis in a sorted array. Each step, the endpoints are updated and
+// re-sorted by insertion sort, which is close to linear when bodies move a
+// little, then swept in order to find the proxies overlapping along that
+// axis. Those are tested on the other two axes.
+//
+// Works best when bodies are spread out along the sort axis, such as large,
+// flat levels. The world can also be split into a grid of regions along the
+// X and Z axes (multi-box pruning), each sorting only the proxies that touch
+// it, so bodies far apart never meet in the same sweep.
+//
+// Fat boxes are grown by a margin and stretched along the displacement
+// passed to MoveProxy.
+//-----------------------------------------------------------------------------
+class SweepAndPruneBroadphase : public Broadphase
+{
+public:
+	SweepAndPruneBroadphase();
+
+	// Getters
+	inline uint32 GetSortAxis() const { return m_sortAxis; }
+	inline uint32 GetNumRegions() const { return (uint32) m_regions.size(); }
+	inline float GetMargin() const { return m_margin; }
+
+	// Setters
+	void SetSortAxis(uint32 axis);
+	inline void SetMargin(float margin) { m_margin = margin; }
+
+	// Split the world bounds into a grid of regions along the X and Z axes.
+	// Proxies outside the world bounds belong to the nearest edge regions. A
+	// 1 by 1 grid is plain sweep-and-prune.
+	void SetRegionGrid(const Bounds& worldBounds, uint32 numRegionsX, uint32 numRegionsZ);
+
+	// Broadphase implementations
+	void Clear() override;
+	int32 CreateProxy(const Bounds& bounds, void* userData, bool isStatic) override;
+	void DestroyProxy(int32 proxyId) override;
+	void MoveProxy(int32 proxyId, const Bounds& bounds, const Vector3f& displacement) override;
+	void* GetUserData(int32 proxyId) const override;
+	const Bounds& GetFatBounds(int32 proxyId) const override;
+	uint32 GetNumProxies() const override;
+	void UpdatePairs() override;
+
+private:
+	// Regions with more endpoints than this added since the last step are
+	// sorted from scratch instead of by insertion sort
+	static const uint32 MAX_INSERTION_SORT_ADDS = 32;
+
+	struct Endpoint
+	{
+		float value;
+
+		// Proxy ID in the upper bits, and 1 in the lowest bit for a max
+		uint32 data;
+
+		inline int32 GetProxyId() const { return (int32) (data >> 1); }
+		inline bool IsMax() const { return ((data & 1) != 0); }
+	};
+
+	struct Proxy
+	{
+		Bounds bounds;
+		void* userData;
+		int32 next;
+		bool inUse;
+
+		// Range of regions the fat box touches, along X and Z
+		uint32 regionMins[2];
+		uint32 regionMaxs[2];
+	};
+
+	struct Region
+	{
+		Array<Endpoint> endpoints;
+		uint32 numAdded;
+	};
+
+	// A proxy in the sweep whose max endpoint hasn't been reached yet
+	struct ActiveProxy
+	{
+		Bounds bounds;
+		int32 proxyId;
+	};
+
+	static bool LessEndpoint(const Endpoint& a, const Endpoint& b);
+
+	void GetRegionRange(const Bounds& bounds, uint32* mins, uint32* maxs) const;
+	void AddToRegion(uint32 regionIndex, int32 proxyId);
+	void RemoveFromRegion(uint32 regionIndex, int32 proxyId);
+	void SortRegion(Region& region);
+	void SweepRegion(const Region& region);
+
+	Array<Proxy> m_proxies;
+	int32 m_freeList;
+	uint32 m_numProxies;
+	uint32 m_sortAxis;
+	float m_margin;
+
+	Array<Region> m_regions;
+	Bounds m_worldBounds;
+	uint32 m_numRegions[2];
+
+	// Scratch space for sweeping
+	Array<ActiveProxy> m_activeStatic;
+	Array<ActiveProxy> m_activeDynamic;
+	Array<uint32> m_activeIndices;
+};
+
+
+#endif // _CMG_PHYSICS_BROADPHASE_SWEEP_AND_PRUNE_BROADPHASE_H_
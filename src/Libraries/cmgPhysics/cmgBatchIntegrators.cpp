@@ -0,0 +1,259 @@
+#include "cmgBatchIntegrators.h"
+#include "cmgBatchLanes.h"
+#include <cmgMath/cmgMathLib.h>
+#include <cmgMath/types/cmgQuaternion.h>
+#include <cmgMath/types/cmgVector3f.h>
+
+namespace integrators
+{
+
+using namespace lanes;
+
+
+//-----------------------------------------------------------------------------
+// Kernels. Each processes bodies from 'begin' in groups of the lane width,
+// and returns the index of the first body left over.
+//-----------------------------------------------------------------------------
+
+template <class T_Lanes>
+static uint32 ModifiedEulerLanes(const LinearMotionStreams& s,
+	uint32 begin, uint32 count, float delta)
+{
+	using L = T_Lanes;
+	typename L::Type dt = L::Set(delta);
+	uint32 i = begin;
+	for (; i + L::WIDTH <= count; i += L::WIDTH)
+	{
+		typename L::Type vx = L::Add(L::Load(s.velocityX + i), L::Mul(L::Load(s.accelerationX + i), dt));
+		typename L::Type vy = L::Add(L::Load(s.velocityY + i), L::Mul(L::Load(s.accelerationY + i), dt));
+		typename L::Type vz = L::Add(L::Load(s.velocityZ + i), L::Mul(L::Load(s.accelerationZ + i), dt));
+		L::Store(s.velocityX + i, vx);
+		L::Store(s.velocityY + i, vy);
+		L::Store(s.velocityZ + i, vz);
+		L::Store(s.positionX + i, L::Add(L::Load(s.positionX + i), L::Mul(vx, dt)));
+		L::Store(s.positionY + i, L::Add(L::Load(s.positionY + i), L::Mul(vy, dt)));
+		L::Store(s.positionZ + i, L::Add(L::Load(s.positionZ + i), L::Mul(vz, dt)));
+	}
+	return i;
+}
+
+// Rotate a vector by a unit quaternion and add a translation, as
+// Matrix4f::InitRotation followed by TransformAffine does
+template <class T_Lanes>
+static inline void RotateAndTranslate(
+	typename T_Lanes::Type qx, typename T_Lanes::Type qy,
+	typename T_Lanes::Type qz, typename T_Lanes::Type qw,
+	typename T_Lanes::Type vx, typename T_Lanes::Type vy,
+	typename T_Lanes::Type vz, typename T_Lanes::Type tx,
+	typename T_Lanes::Type ty, typename T_Lanes::Type tz,
+	float* outX, float* outY, float* outZ)
+{
+	using L = T_Lanes;
+	typename L::Type two = L::Set(2.0f);
+	typename L::Type xx = L::Mul(qx, qx);
+	typename L::Type yy = L::Mul(qy, qy);
+	typename L::Type zz = L::Mul(qz, qz);
+	typename L::Type ww = L::Mul(qw, qw);
+	typename L::Type xy = L::Mul(qx, qy);
+	typename L::Type yz = L::Mul(qy, qz);
+	typename L::Type zx = L::Mul(qz, qx);
+	typename L::Type xw = L::Mul(qx, qw);
+	typename L::Type yw = L::Mul(qy, qw);
+	typename L::Type zw = L::Mul(qz, qw);
+
+	typename L::Type m0 = L::Sub(L::Sub(L::Add(ww, xx), zz), yy);
+	typename L::Type m1 = L::Mul(two, L::Add(xy, zw));
+	typename L::Type m2 = L::Mul(two, L::Sub(zx, yw));
+	typename L::Type m4 = L::Mul(two, L::Sub(xy, zw));
+	typename L::Type m5 = L::Sub(L::Sub(L::Add(ww, yy), zz), xx);
+	typename L::Type m6 = L::Mul(two, L::Add(yz, xw));
+	typename L::Type m8 = L::Mul(two, L::Add(zx, yw));
+	typename L::Type m9 = L::Mul(two, L::Sub(yz, xw));
+	typename L::Type m10 = L::Sub(L::Sub(L::Add(ww, zz), xx), yy);
+
+	L::Store(outX, L::Add(L::Add(L::Add(L::Mul(m0, vx), L::Mul(m4, vy)), L::Mul(m8, vz)), tx));
+	L::Store(outY, L::Add(L::Add(L::Add(L::Mul(m1, vx), L::Mul(m5, vy)), L::Mul(m9, vz)), ty));
+	L::Store(outZ, L::Add(L::Add(L::Add(L::Mul(m2, vx), L::Mul(m6, vy)), L::Mul(m10, vz)), tz));
+}
+
+// Integrate the angular velocity, and write the world position of the
+// origin offset before the orientation changes
+template <class T_Lanes>
+static uint32 AngularVelocityLanes(const AngularMotionStreams& s,
+	uint32 begin, uint32 count, float delta)
+{
+	using L = T_Lanes;
+	typename L::Type dt = L::Set(delta);
+	uint32 i = begin;
+	for (; i + L::WIDTH <= count; i += L::WIDTH)
+	{
+		L::Store(s.velocityX + i, L::Add(L::Load(s.velocityX + i), L::Mul(L::Load(s.accelerationX + i), dt)));
+		L::Store(s.velocityY + i, L::Add(L::Load(s.velocityY + i), L::Mul(L::Load(s.accelerationY + i), dt)));
+		L::Store(s.velocityZ + i, L::Add(L::Load(s.velocityZ + i), L::Mul(L::Load(s.accelerationZ + i), dt)));
+		RotateAndTranslate<L>(
+			L::Load(s.rotationX + i), L::Load(s.rotationY + i),
+			L::Load(s.rotationZ + i), L::Load(s.rotationW + i),
+			L::Load(s.originOffsetX + i), L::Load(s.originOffsetY + i),
+			L::Load(s.originOffsetZ + i), L::Load(s.positionX + i),
+			L::Load(s.positionY + i), L::Load(s.positionZ + i),
+			s.originOffsetWorldX + i, s.originOffsetWorldY + i,
+			s.originOffsetWorldZ + i);
+	}
+	return i;
+}
+
+// Integrate and normalize the orientation, then write the world position
+// of the origin offset
+template <class T_Lanes>
+static uint32 OrientationLanes(const AngularMotionStreams& s,
+	uint32 begin, uint32 count, float delta)
+{
+	using L = T_Lanes;
+	typename L::Type halfDelta = L::Set(delta * 0.5f);
+	typename L::Type one = L::Set(1.0f);
+	uint32 i = begin;
+	for (; i + L::WIDTH <= count; i += L::WIDTH)
+	{
+		typename L::Type wx = L::Load(s.velocityX + i);
+		typename L::Type wy = L::Load(s.velocityY + i);
+		typename L::Type wz = L::Load(s.velocityZ + i);
+		typename L::Type qx = L::Load(s.rotationX + i);
+		typename L::Type qy = L::Load(s.rotationY + i);
+		typename L::Type qz = L::Load(s.rotationZ + i);
+		typename L::Type qw = L::Load(s.rotationW + i);
+
+		// q += (w * q) * (delta / 2), with w as a quaternion with no real part
+		typename L::Type dx = L::Sub(L::Add(L::Mul(wx, qw), L::Mul(wy, qz)), L::Mul(wz, qy));
+		typename L::Type dy = L::Sub(L::Add(L::Mul(wy, qw), L::Mul(wz, qx)), L::Mul(wx, qz));
+		typename L::Type dz = L::Sub(L::Add(L::Mul(wz, qw), L::Mul(wx, qy)), L::Mul(wy, qx));
+		typename L::Type dw = L::Sub(L::Sub(L::Sub(L::Set(0.0f),
+			L::Mul(wx, qx)), L::Mul(wy, qy)), L::Mul(wz, qz));
+		qx = L::Add(qx, L::Mul(dx, halfDelta));
+		qy = L::Add(qy, L::Mul(dy, halfDelta));
+		qz = L::Add(qz, L::Mul(dz, halfDelta));
+		qw = L::Add(qw, L::Mul(dw, halfDelta));
+
+		typename L::Type length = L::Sqrt(L::Add(L::Add(L::Mul(qx, qx),
+			L::Mul(qy, qy)), L::Add(L::Mul(qz, qz), L::Mul(qw, qw))));
+		typename L::Type invLength = L::SelectPositive(length, L::Div(one, length), one);
+		qx = L::Mul(qx, invLength);
+		qy = L::Mul(qy, invLength);
+		qz = L::Mul(qz, invLength);
+		qw = L::Mul(qw, invLength);
+		L::Store(s.rotationX + i, qx);
+		L::Store(s.rotationY + i, qy);
+		L::Store(s.rotationZ + i, qz);
+		L::Store(s.rotationW + i, qw);
+
+		RotateAndTranslate<L>(qx, qy, qz, qw,
+			L::Load(s.originOffsetX + i), L::Load(s.originOffsetY + i),
+			L::Load(s.originOffsetZ + i), L::Load(s.positionX + i),
+			L::Load(s.positionY + i), L::Load(s.positionZ + i),
+			s.originOffsetWorldX + i, s.originOffsetWorldY + i,
+			s.originOffsetWorldZ + i);
+	}
+	return i;
+}
+
+// Rotate the positions about the origin offsets, which is rare enough (and
+// needs a sine and cosine) to be left to one body at a time
+static void RotateAboutOrigins(const AngularMotionStreams& s,
+	uint32 count, float delta)
+{
+	for (uint32 i = 0; i < count; i++)
+	{
+		Vector3f momentArm(s.positionX[i] - s.originOffsetWorldX[i],
+			s.positionY[i] - s.originOffsetWorldY[i],
+			s.positionZ[i] - s.originOffsetWorldZ[i]);
+		float wLengthSquared = (s.velocityX[i] * s.velocityX[i]) +
+			(s.velocityY[i] * s.velocityY[i]) + (s.velocityZ[i] * s.velocityZ[i]);
+		if (wLengthSquared <= 0.0f || (momentArm.x * momentArm.x) +
+			(momentArm.y * momentArm.y) + (momentArm.z * momentArm.z) <= 0.0f)
+			continue;
+		Vector3f velocity(s.velocityX[i], s.velocityY[i], s.velocityZ[i]);
+		float wLength = velocity.Length();
+		Quaternion originRotation(velocity / wLength, wLength * delta);
+		originRotation.RotateVector(momentArm);
+		s.positionX[i] = momentArm.x + s.originOffsetWorldX[i];
+		s.positionY[i] = momentArm.y + s.originOffsetWorldY[i];
+		s.positionZ[i] = momentArm.z + s.originOffsetWorldZ[i];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Batch integrators
+//-----------------------------------------------------------------------------
+
+const char* GetBatchInstructionSet()
+{
+#if defined(CMG_BATCH_AVX2)
+	return "avx2";
+#elif defined(CMG_BATCH_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+uint32 GetBatchWidth()
+{
+#if defined(CMG_BATCH_AVX2)
+	return AVXLanes::WIDTH;
+#elif defined(CMG_BATCH_SSE2)
+	return SSELanes::WIDTH;
+#else
+	return ScalarLanes::WIDTH;
+#endif
+}
+
+void ModifiedEulerBatch(const LinearMotionStreams& streams, uint32 count, float delta)
+{
+	uint32 i = 0;
+#ifdef CMG_BATCH_AVX2
+	i = ModifiedEulerLanes<AVXLanes>(streams, i, count, delta);
+#endif
+#ifdef CMG_BATCH_SSE2
+	i = ModifiedEulerLanes<SSELanes>(streams, i, count, delta);
+#endif
+	ModifiedEulerLanes<ScalarLanes>(streams, i, count, delta);
+}
+
+void ModifiedEulerBatchScalar(const LinearMotionStreams& streams, uint32 count, float delta)
+{
+	ModifiedEulerLanes<ScalarLanes>(streams, 0, count, delta);
+}
+
+void AngularMotionBatch(const AngularMotionStreams& streams, uint32 count, float delta)
+{
+	// The position rotation only depends on the orientation before it is
+	// integrated, and the orientation doesn't depend on the position
+	uint32 i = 0;
+#ifdef CMG_BATCH_AVX2
+	i = AngularVelocityLanes<AVXLanes>(streams, i, count, delta);
+#endif
+#ifdef CMG_BATCH_SSE2
+	i = AngularVelocityLanes<SSELanes>(streams, i, count, delta);
+#endif
+	AngularVelocityLanes<ScalarLanes>(streams, i, count, delta);
+
+	RotateAboutOrigins(streams, count, delta);
+
+	i = 0;
+#ifdef CMG_BATCH_AVX2
+	i = OrientationLanes<AVXLanes>(streams, i, count, delta);
+#endif
+#ifdef CMG_BATCH_SSE2
+	i = OrientationLanes<SSELanes>(streams, i, count, delta);
+#endif
+	OrientationLanes<ScalarLanes>(streams, i, count, delta);
+}
+
+void AngularMotionBatchScalar(const AngularMotionStreams& streams, uint32 count, float delta)
+{
+	AngularVelocityLanes<ScalarLanes>(streams, 0, count, delta);
+	RotateAboutOrigins(streams, count, delta);
+	OrientationLanes<ScalarLanes>(streams, 0, count, delta);
+}
+
+}
@@ -0,0 +1,78 @@
+#ifndef _CMG_PHYSICS_BATCH_INTEGRATORS_H_
+#define _CMG_PHYSICS_BATCH_INTEGRATORS_H_
+
+#include <cmgCore/cmgBase.h>
+
+namespace integrators
+{
+
+//-----------------------------------------------------------------------------
+// Batch integrators - The motion integrators applied to many bodies at once,
+// stored as structure-of-arrays streams of floats. Bodies are processed 8 at
+// a time with AVX2, 4 at a time with SSE2, and one at a time for the rest or
+// when neither is available. The instruction set is chosen when compiling
+// (AVX2 needs /arch:AVX2 or -mavx2).
+//
+// The scalar versions always process one body at a time, as a reference.
+//-----------------------------------------------------------------------------
+
+// Linear motion of 'count' bodies, each pointer being an array of 'count'
+// floats
+struct LinearMotionStreams
+{
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	float* velocityX;
+	float* velocityY;
+	float* velocityZ;
+	const float* accelerationX;
+	const float* accelerationY;
+	const float* accelerationZ;
+};
+
+// Angular motion of 'count' bodies about a body-space origin offset. The
+// world space position of the origin offset is written after integrating.
+struct AngularMotionStreams
+{
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	float* rotationX;
+	float* rotationY;
+	float* rotationZ;
+	float* rotationW;
+	float* velocityX;
+	float* velocityY;
+	float* velocityZ;
+	const float* accelerationX;
+	const float* accelerationY;
+	const float* accelerationZ;
+	const float* originOffsetX;
+	const float* originOffsetY;
+	const float* originOffsetZ;
+	float* originOffsetWorldX;
+	float* originOffsetWorldY;
+	float* originOffsetWorldZ;
+};
+
+// Name of the instruction set used by the batch integrators: "avx2", "sse2"
+// or "scalar"
+const char* GetBatchInstructionSet();
+
+// Number of bodies processed at once by the batch integrators
+uint32 GetBatchWidth();
+
+// Same as ModifiedEuler for each body
+void ModifiedEulerBatch(const LinearMotionStreams& streams, uint32 count, float delta);
+void ModifiedEulerBatchScalar(const LinearMotionStreams& streams, uint32 count, float delta);
+
+// Same as AngularMotionSystem for each body: integrate the angular velocity
+// and the orientation to first order, rotate the position about the origin
+// offset, and normalize the orientation
+void AngularMotionBatch(const AngularMotionStreams& streams, uint32 count, float delta);
+void AngularMotionBatchScalar(const AngularMotionStreams& streams, uint32 count, float delta);
+
+}
+
+#endif // _CMG_PHYSICS_BATCH_INTEGRATORS_H_
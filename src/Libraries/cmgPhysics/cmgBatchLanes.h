@@ -0,0 +1,111 @@
+#ifndef _CMG_PHYSICS_BATCH_LANES_H_
+#define _CMG_PHYSICS_BATCH_LANES_H_
+
+#include <cmgCore/cmgBase.h>
+#include <cmgMath/cmgMathLib.h>
+
+// The instruction set is chosen when compiling (AVX2 needs /arch:AVX2 or
+// -mavx2). Only include this from source files, as it pulls in the
+// intrinsics headers.
+#if defined(__AVX2__)
+	#define CMG_BATCH_AVX2
+	#define CMG_BATCH_SSE2
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CMG_BATCH_SSE2
+	#include <emmintrin.h>
+#endif
+
+namespace lanes
+{
+
+//-----------------------------------------------------------------------------
+// Lane types. Each batch kernel is written once against these, and
+// instantiated for every instruction set.
+//-----------------------------------------------------------------------------
+
+struct ScalarLanes
+{
+	using Type = float;
+	static const uint32 WIDTH = 1;
+
+	static inline Type Load(const float* data) { return *data; }
+	static inline void Store(float* data, Type value) { *data = value; }
+	static inline Type Set(float value) { return value; }
+	static inline Type Add(Type a, Type b) { return a + b; }
+	static inline Type Sub(Type a, Type b) { return a - b; }
+	static inline Type Mul(Type a, Type b) { return a * b; }
+	static inline Type Div(Type a, Type b) { return a / b; }
+	static inline Type Sqrt(Type a) { return Math::Sqrt(a); }
+	static inline Type Min(Type a, Type b) { return (a < b ? a : b); }
+	static inline Type Max(Type a, Type b) { return (a > b ? a : b); }
+
+	// Returns a where the condition is positive, and b elsewhere
+	static inline Type SelectPositive(Type condition, Type a, Type b)
+	{
+		return (condition > 0.0f ? a : b);
+	}
+};
+
+#ifdef CMG_BATCH_SSE2
+struct SSELanes
+{
+	using Type = __m128;
+	static const uint32 WIDTH = 4;
+
+	static inline Type Load(const float* data) { return _mm_loadu_ps(data); }
+	static inline void Store(float* data, Type value) { _mm_storeu_ps(data, value); }
+	static inline Type Set(float value) { return _mm_set1_ps(value); }
+	static inline Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+	static inline Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+	static inline Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+	static inline Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+	static inline Type Sqrt(Type a) { return _mm_sqrt_ps(a); }
+	static inline Type Min(Type a, Type b) { return _mm_min_ps(a, b); }
+	static inline Type Max(Type a, Type b) { return _mm_max_ps(a, b); }
+
+	static inline Type SelectPositive(Type condition, Type a, Type b)
+	{
+		Type mask = _mm_cmpgt_ps(condition, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+};
+#endif
+
+#ifdef CMG_BATCH_AVX2
+struct AVXLanes
+{
+	using Type = __m256;
+	static const uint32 WIDTH = 8;
+
+	static inline Type Load(const float* data) { return _mm256_loadu_ps(data); }
+	static inline void Store(float* data, Type value) { _mm256_storeu_ps(data, value); }
+	static inline Type Set(float value) { return _mm256_set1_ps(value); }
+	static inline Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+	static inline Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+	static inline Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+	static inline Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+	static inline Type Sqrt(Type a) { return _mm256_sqrt_ps(a); }
+	static inline Type Min(Type a, Type b) { return _mm256_min_ps(a, b); }
+	static inline Type Max(Type a, Type b) { return _mm256_max_ps(a, b); }
+
+	static inline Type SelectPositive(Type condition, Type a, Type b)
+	{
+		Type mask = _mm256_cmp_ps(condition, _mm256_setzero_ps(), _CMP_GT_OQ);
+		return _mm256_blendv_ps(b, a, mask);
+	}
+};
+#endif
+
+// The widest lanes available
+#if defined(CMG_BATCH_AVX2)
+	typedef AVXLanes WidestLanes;
+#elif defined(CMG_BATCH_SSE2)
+	typedef SSELanes WidestLanes;
+#else
+	typedef ScalarLanes WidestLanes;
+#endif
+
+}
+
+#endif // _CMG_PHYSICS_BATCH_LANES_H_
@@ -2,12 +2,114 @@
 #include <cmgPhysics/cmgRigidBody.h>
 
 
+//-----------------------------------------------------------------------------
+// CollisionMap
+//-----------------------------------------------------------------------------
+
+const int32 CollisionMap::EMPTY_SLOT;
+
+CollisionMap::CollisionMap() :
+	m_slots(16, EMPTY_SLOT),
+	m_slotMask(15)
+{
+}
+
+void CollisionMap::Clear()
+{
+	m_entries.clear();
+	std::fill(m_slots.begin(), m_slots.end(), EMPTY_SLOT);
+}
+
+CollisionData* CollisionMap::Find(const IDPair& ids)
+{
+	int32 index = m_slots[FindSlot(ids)];
+	return (index == EMPTY_SLOT ? nullptr : &m_entries[index].second);
+}
+
+CollisionData* CollisionMap::Insert(const IDPair& ids)
+{
+	uint32 slot = FindSlot(ids);
+	if (m_slots[slot] != EMPTY_SLOT)
+		return &m_entries[m_slots[slot]].second;
+
+	// Keep the table at most half full
+	if ((m_entries.size() + 1) * 2 > m_slots.size())
+	{
+		Rehash((uint32) m_slots.size() * 2);
+		slot = FindSlot(ids);
+	}
+	m_slots[slot] = (int32) m_entries.size();
+	m_entries.push_back(Entry(ids));
+	return &m_entries.back().second;
+}
+
+CollisionMap::iterator CollisionMap::Erase(iterator it)
+{
+	uint32 index = (uint32) (it - m_entries.begin());
+
+	// Empty the slot, then shift back the slots after it in its cluster
+	// that would no longer be found past the hole.
+	uint32 hole = FindSlot(it->first);
+	uint32 slot = (hole + 1) & m_slotMask;
+	while (m_slots[slot] != EMPTY_SLOT)
+	{
+		uint32 home = Hash(m_entries[m_slots[slot]].first) & m_slotMask;
+		if (((slot - home) & m_slotMask) >= ((slot - hole) & m_slotMask))
+		{
+			m_slots[hole] = m_slots[slot];
+			hole = slot;
+		}
+		slot = (slot + 1) & m_slotMask;
+	}
+	m_slots[hole] = EMPTY_SLOT;
+
+	// Move the last entry into the removed one's place
+	uint32 last = (uint32) m_entries.size() - 1;
+	if (index != last)
+	{
+		m_slots[FindSlot(m_entries[last].first)] = (int32) index;
+		m_entries[index] = m_entries[last];
+	}
+	m_entries.pop_back();
+	return m_entries.begin() + index;
+}
+
+uint32 CollisionMap::Hash(const IDPair& ids)
+{
+	uint32 hash = (ids.idA * 0x9E3779B1u) ^ ids.idB;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+uint32 CollisionMap::FindSlot(const IDPair& ids) const
+{
+	uint32 slot = Hash(ids) & m_slotMask;
+	while (m_slots[slot] != EMPTY_SLOT && !(m_entries[m_slots[slot]].first == ids))
+		slot = (slot + 1) & m_slotMask;
+	return slot;
+}
+
+void CollisionMap::Rehash(uint32 numSlots)
+{
+	m_slots.assign(numSlots, EMPTY_SLOT);
+	m_slotMask = numSlots - 1;
+	for (uint32 i = 0; i < m_entries.size(); i++)
+		m_slots[FindSlot(m_entries[i].first)] = (int32) i;
+}
+
+
+//-----------------------------------------------------------------------------
+// CollisionCache
+//-----------------------------------------------------------------------------
+
 CollisionCache::CollisionCache()
 {
-	m_persistentThresholdSqr = 0.3f;
+	m_persistentThresholdSqr = 0.05f;
 	m_persistentThresholdSqr *= m_persistentThresholdSqr;
 	m_maxContacts = 4;
-	m_enableCaching = false;
+	m_enableCaching = true;
 }
 
 CollisionCache::~CollisionCache()
@@ -16,7 +118,15 @@ CollisionCache::~CollisionCache()
 
 void CollisionCache::Clear()
 {
-	m_collisions.clear();
+	m_collisions.Clear();
+}
+
+CollisionData* CollisionCache::GetCollision(
+	const RigidBody* bodyA, const RigidBody* bodyB)
+{
+	if (bodyA->GetId() > bodyB->GetId())
+		std::swap(bodyA, bodyB);
+	return m_collisions.Find(IDPair(bodyA->GetId(), bodyB->GetId()));
 }
 
 void CollisionCache::RefreshContacts()
@@ -28,14 +138,14 @@ void CollisionCache::RefreshContacts()
 			it->second.RefreshContacts();
 			
 			if (it->second.numContacts == 0)
-				m_collisions.erase(it++);
+				it = m_collisions.Erase(it);
 			else
 				++it;
 		}
 	}
 	else
 	{
-		m_collisions.clear();
+		m_collisions.Clear();
 	}
 }
 
@@ -44,38 +154,38 @@ void CollisionCache::UpdateCollision(const CollisionData& collisionData)
 	// Find the collision in the cache.
 	IDPair ids(collisionData.firstBody->GetId(),
 		collisionData.secondBody->GetId());
-	auto it = (m_enableCaching ? m_collisions.find(ids) : m_collisions.end());
+	CollisionData* collision = (m_enableCaching ? m_collisions.Find(ids) : nullptr);
 	
-	if (it != m_collisions.end())
+	if (collision != nullptr)
 	{
 		// Remove any contacts that have become invalidated.
-		//RemoveInvalidatedContacts(&it->second);
+		//RemoveInvalidatedContacts(collision);
 
 		// Add any new contacts to the cached manifold.
 		for (unsigned int i = 0; i < collisionData.numContacts; ++i)
 		{
-			AddNewContact(&it->second, collisionData.contacts[i]);
+			AddNewContact(collision, collisionData.contacts[i]);
 		}
 
 		// Limit the number of contacts in a collision.
-		LimitContactCount(&it->second, m_maxContacts);
+		LimitContactCount(collision, m_maxContacts);
 
 		// Push the collision updates back to the cache.
-		it->second.active = true;
+		collision->active = true;
 	}
 	else
 	{
-		CollisionData newCollision = collisionData;
+		collision = m_collisions.Insert(ids);
+		*collision = collisionData;
 
 		// Limit the number of contacts in a collision.
-		LimitContactCount(&newCollision, m_maxContacts);
+		LimitContactCount(collision, m_maxContacts);
 
 		// Calculate internal data for the collision and its contacts.
-		//newCollision.CalcInternals();
+		//collision->CalcInternals();
 
 		// Push the collision updates back to the cache.
-		newCollision.active = true;
-		m_collisions[ids] = newCollision;
+		collision->active = true;
 	}
 }
 
@@ -86,7 +196,7 @@ void CollisionCache::RemoveInactiveCollisions()
 		for (auto it = m_collisions.begin(); it != m_collisions.end(); )
 		{
 			if (!it->second.active)
-				m_collisions.erase(it++);
+				it = m_collisions.Erase(it);
 			else
 				++it;
 		}
@@ -103,7 +213,18 @@ void CollisionCache::MarkCollisionsAsInactive()
 	}
 	else
 	{
-		m_collisions.clear();
+		m_collisions.Clear();
+	}
+}
+
+void CollisionCache::RemoveCollisions(const RigidBody* body)
+{
+	for (auto it = m_collisions.begin(); it != m_collisions.end(); )
+	{
+		if (it->second.firstBody == body || it->second.secondBody == body)
+			it = m_collisions.Erase(it);
+		else
+			++it;
 	}
 }
 
@@ -183,10 +304,20 @@ bool CollisionCache::AddNewContact(CollisionData* collision, const Contact& newC
 		bool rAFarEnough = (rA.LengthSquared() > m_persistentThresholdSqr);
 		bool rBFarEnough = (rB.LengthSquared() > m_persistentThresholdSqr);
  
-		// Proximity check  
+		// Proximity check. The matching contact is replaced, but keeps its
+		// accumulated impulses for warm starting.
 		if (!rAFarEnough || !rBFarEnough)
 		{
+			float normalImpulse = contact->normalImpulse;
+			float tangentImpulse0 = contact->tangentImpulse[0];
+			float tangentImpulse1 = contact->tangentImpulse[1];
+			unsigned int age = contact->age;
 			*contact = newContact;
+			contact->normalImpulse = normalImpulse;
+			contact->tangentImpulse[0] = tangentImpulse0;
+			contact->tangentImpulse[1] = tangentImpulse1;
+			contact->age = age;
+			contact->persistent = true;
 			return false;
 		}
 	}
@@ -1,7 +1,7 @@
 #ifndef _CMG_PHYSICS_COLLISION_CACHE_H_
 #define _CMG_PHYSICS_COLLISION_CACHE_H_
 
-#include <map>
+#include <cmgCore/containers/cmgArray.h>
 #include <cmgPhysics/cmgContact.h>
 
 
@@ -27,24 +27,101 @@ struct IDPair
 			return false;
 		return (idB < other.idB);
 	}
+
+	inline bool operator ==(const IDPair& other) const
+	{
+		return (idA == other.idA && idB == other.idB);
+	}
 };
 
-class CollisionCache
+
+//-----------------------------------------------------------------------------
+// CollisionMap - Flat hash table of collisions keyed by pairs of body IDs.
+//
+// The collisions are kept densely packed in an array, which is what gets
+// iterated, and a power-of-two table of slots indexes into it using open
+// addressing with linear probing. Removing a collision moves the last one
+// into its place, so erasing while iterating doesn't advance the iterator.
+//-----------------------------------------------------------------------------
+class CollisionMap
 {
-	typedef std::map<IDPair, CollisionData> CollisionMap;
+public:
+	struct Entry
+	{
+		IDPair first;
+		CollisionData second;
+
+		Entry(const IDPair& ids) :
+			first(ids)
+		{}
+	};
+
+	typedef Array<Entry>::iterator iterator;
+
+public:
+	CollisionMap();
+
+	void Clear();
+
+	// Returns null if there is no collision for the pair
+	CollisionData* Find(const IDPair& ids);
 
+	// Returns the collision for the pair, adding an empty one if needed
+	CollisionData* Insert(const IDPair& ids);
+
+	// Returns the iterator to visit next, which is the same position
+	iterator Erase(iterator it);
+
+	inline uint32 GetSize() const { return (uint32) m_entries.size(); }
+	inline iterator begin() { return m_entries.begin(); }
+	inline iterator end() { return m_entries.end(); }
+
+private:
+	static const int32 EMPTY_SLOT = -1;
+
+	static uint32 Hash(const IDPair& ids);
+
+	// Find the slot holding the pair, or the empty slot where it belongs
+	uint32 FindSlot(const IDPair& ids) const;
+	void Rehash(uint32 numSlots);
+
+	Array<Entry> m_entries;
+	Array<int32> m_slots; // Entry indices
+	uint32 m_slotMask;
+};
+
+
+//-----------------------------------------------------------------------------
+// CollisionCache - Persistent contact manifolds for each pair of bodies.
+//
+// Contacts found by the narrowphase are matched to the cached contacts by
+// proximity, keeping their accumulated impulses so that the solver can be
+// warm started from last step's solution. Cached contacts that have moved
+// too far apart are dropped each step.
+//-----------------------------------------------------------------------------
+class CollisionCache
+{
 public:
 	CollisionCache();
 	~CollisionCache();
 
 	void Clear();
 
+	// Getters
+	inline bool GetEnableCaching() const { return m_enableCaching; }
+	inline uint32 GetNumCollisions() const { return m_collisions.GetSize(); }
+	CollisionData* GetCollision(const RigidBody* bodyA, const RigidBody* bodyB);
+
+	// Setters
+	inline void SetEnableCaching(bool enableCaching) { m_enableCaching = enableCaching; Clear(); }
+
 	void RefreshContacts();
 
 	void UpdateCollision(const CollisionData& collisionData);
 
 	void RemoveInactiveCollisions();
 	void MarkCollisionsAsInactive();
+	void RemoveCollisions(const RigidBody* body);
 
 	//bool GetCollision(RigidBody* bodyA, RigidBody* bodyB, CollisionData* outCollisionData);
 	//void AddCollision(const CollisionData& collision);
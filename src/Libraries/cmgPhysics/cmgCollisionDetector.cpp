@@ -3,10 +3,517 @@
 #include <cmgMath/geometry/cmgPlane.h>
 #include <cmgMath/geometry/cmgRay.h>
 #include <cmgPhysics/cmgGJK.h>
+#include <algorithm>
+
+
+//-----------------------------------------------------------------------------
+// Collide functions
+//-----------------------------------------------------------------------------
+
+static inline Vector3f GetShapeCenter(const Collider* collider)
+{
+	return collider->GetShapeToWorld().col[3].xyz;
+}
+
+static inline Vector3f GetShapeAxis(const Collider* collider, uint32 index)
+{
+	return collider->GetShapeToWorld().col[index].xyz;
+}
+
+// The ends of a capsule's inner segment
+static inline void GetCapsuleSegment(const CapsuleCollider* capsule,
+	Vector3f& outStart, Vector3f& outEnd)
+{
+	Vector3f center = GetShapeCenter(capsule);
+	Vector3f offset = GetShapeAxis(capsule, 1) * capsule->GetHalfHeight();
+	outStart = center - offset;
+	outEnd = center + offset;
+}
+
+static Vector3f ClosestPointOnSegment(const Vector3f& start,
+	const Vector3f& end, const Vector3f& point)
+{
+	Vector3f direction = end - start;
+	float lengthSquared = direction.LengthSquared();
+	if (lengthSquared <= FLT_EPSILON)
+		return start;
+	float t = Math::Clamp((point - start).Dot(direction) / lengthSquared, 0.0f, 1.0f);
+	return start + (direction * t);
+}
+
+// Closest points between two segments, from Real-Time Collision Detection
+// by Christer Ericson
+static void ClosestPointsOnSegments(const Vector3f& start1, const Vector3f& end1,
+	const Vector3f& start2, const Vector3f& end2,
+	Vector3f& outPoint1, Vector3f& outPoint2)
+{
+	Vector3f d1 = end1 - start1;
+	Vector3f d2 = end2 - start2;
+	Vector3f r = start1 - start2;
+	float a = d1.Dot(d1);
+	float e = d2.Dot(d2);
+	float f = d2.Dot(r);
+	float s = 0.0f;
+	float t = 0.0f;
+
+	if (a <= FLT_EPSILON && e <= FLT_EPSILON)
+	{
+		// Both segments are points.
+	}
+	else if (a <= FLT_EPSILON)
+	{
+		t = Math::Clamp(f / e, 0.0f, 1.0f);
+	}
+	else
+	{
+		float c = d1.Dot(r);
+		if (e <= FLT_EPSILON)
+		{
+			s = Math::Clamp(-c / a, 0.0f, 1.0f);
+		}
+		else
+		{
+			float b = d1.Dot(d2);
+			float denom = (a * e) - (b * b);
+			if (denom > FLT_EPSILON)
+				s = Math::Clamp(((b * f) - (c * e)) / denom, 0.0f, 1.0f);
+			t = ((b * s) + f) / e;
+			if (t < 0.0f)
+			{
+				t = 0.0f;
+				s = Math::Clamp(-c / a, 0.0f, 1.0f);
+			}
+			else if (t > 1.0f)
+			{
+				t = 1.0f;
+				s = Math::Clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
+	}
+
+	outPoint1 = start1 + (d1 * s);
+	outPoint2 = start2 + (d2 * t);
+}
+
+// Contact between two spheres, also used between the closest points of
+// capsule segments
+static uint32 CollideSpheres(const Vector3f& centerA, float radiusA,
+	const Vector3f& centerB, float radiusB, ColliderContact* outContact)
+{
+	Vector3f offset = centerA - centerB;
+	float distanceSquared = offset.LengthSquared();
+	float radius = radiusA + radiusB;
+	if (distanceSquared > radius * radius)
+		return 0;
+
+	// Concentric spheres are pushed apart along an arbitrary axis.
+	float distance = Math::Sqrt(distanceSquared);
+	Vector3f normal = Vector3f::UP;
+	if (distance > FLT_EPSILON)
+		normal = offset * (1.0f / distance);
+	outContact->normal = normal;
+	outContact->pointA = centerA - (normal * radiusA);
+	outContact->pointB = centerB + (normal * radiusB);
+	return 1;
+}
+
+static uint32 CollideSphereSphere(const Collider* a, const Collider* b,
+	ColliderContact* outContacts)
+{
+	const SphereCollider* sphereA = (const SphereCollider*) a;
+	const SphereCollider* sphereB = (const SphereCollider*) b;
+	return CollideSpheres(GetShapeCenter(sphereA), sphereA->GetRadius(),
+		GetShapeCenter(sphereB), sphereB->GetRadius(), outContacts);
+}
+
+static uint32 CollideSphereBox(const Collider* a, const Collider* b,
+	ColliderContact* outContacts)
+{
+	const SphereCollider* sphere = (const SphereCollider*) a;
+	const BoxCollider* box = (const BoxCollider*) b;
+	Vector3f center = GetShapeCenter(sphere);
+	float radius = sphere->GetRadius();
+	const Vector3f& halfSize = box->GetHalfSize();
+
+	// Find the closest point on the box in its own space.
+	Vector3f localCenter = box->GetWorldToShape().TransformAffine(center);
+	Vector3f closest;
+	bool isInside = true;
+	for (uint32 i = 0; i < 3; i++)
+	{
+		closest[i] = Math::Clamp(localCenter[i], -halfSize[i], halfSize[i]);
+		if (closest[i] != localCenter[i])
+			isInside = false;
+	}
+
+	Vector3f localNormal = Vector3f::ZERO;
+	if (isInside)
+	{
+		// Push the sphere out through the nearest face.
+		uint32 axis = 0;
+		float minDistance = FLT_MAX;
+		for (uint32 i = 0; i < 3; i++)
+		{
+			float distance = halfSize[i] - Math::Abs(localCenter[i]);
+			if (distance < minDistance)
+			{
+				minDistance = distance;
+				axis = i;
+			}
+		}
+		localNormal[axis] = (localCenter[axis] >= 0.0f ? 1.0f : -1.0f);
+		closest[axis] = halfSize[axis] * localNormal[axis];
+	}
+	else
+	{
+		Vector3f offset = localCenter - closest;
+		float distanceSquared = offset.LengthSquared();
+		if (distanceSquared > radius * radius)
+			return 0;
+		localNormal = offset * (1.0f / Math::Sqrt(distanceSquared));
+	}
+
+	outContacts->normal = box->GetShapeToWorld().Rotate(localNormal);
+	outContacts->pointA = center - (outContacts->normal * radius);
+	outContacts->pointB = box->GetShapeToWorld().TransformAffine(closest);
+	return 1;
+}
+
+static uint32 CollideSphereCapsule(const Collider* a, const Collider* b,
+	ColliderContact* outContacts)
+{
+	const SphereCollider* sphere = (const SphereCollider*) a;
+	const CapsuleCollider* capsule = (const CapsuleCollider*) b;
+	Vector3f center = GetShapeCenter(sphere);
+	Vector3f start;
+	Vector3f end;
+	GetCapsuleSegment(capsule, start, end);
+	return CollideSpheres(center, sphere->GetRadius(),
+		ClosestPointOnSegment(start, end, center), capsule->GetRadius(),
+		outContacts);
+}
+
+static uint32 CollideCapsuleCapsule(const Collider* a, const Collider* b,
+	ColliderContact* outContacts)
+{
+	const CapsuleCollider* capsuleA = (const CapsuleCollider*) a;
+	const CapsuleCollider* capsuleB = (const CapsuleCollider*) b;
+	float radiusA = capsuleA->GetRadius();
+	float radiusB = capsuleB->GetRadius();
+	Vector3f startA;
+	Vector3f endA;
+	Vector3f startB;
+	Vector3f endB;
+	GetCapsuleSegment(capsuleA, startA, endA);
+	GetCapsuleSegment(capsuleB, startB, endB);
+
+	// Parallel capsules lying against each other touch along a line, so
+	// give a contact at each end of where their segments overlap.
+	Vector3f directionA = endA - startA;
+	Vector3f directionB = endB - startB;
+	float lengthSquaredA = directionA.LengthSquared();
+	float lengthSquaredB = directionB.LengthSquared();
+	if (lengthSquaredA > FLT_EPSILON && lengthSquaredB > FLT_EPSILON &&
+		directionA.Cross(directionB).LengthSquared() <=
+		0.000001f * lengthSquaredA * lengthSquaredB)
+	{
+		float t0 = (startB - startA).Dot(directionA) / lengthSquaredA;
+		float t1 = (endB - startA).Dot(directionA) / lengthSquaredA;
+		float minT = Math::Max(Math::Min(t0, t1), 0.0f);
+		float maxT = Math::Min(Math::Max(t0, t1), 1.0f);
+		if (minT < maxT)
+		{
+			uint32 numContacts = 0;
+			for (float t : { minT, maxT })
+			{
+				Vector3f pointA = startA + (directionA * t);
+				numContacts += CollideSpheres(pointA, radiusA,
+					ClosestPointOnSegment(startB, endB, pointA), radiusB,
+					outContacts + numContacts);
+			}
+			return numContacts;
+		}
+	}
+
+	Vector3f pointA;
+	Vector3f pointB;
+	ClosestPointsOnSegments(startA, endA, startB, endB, pointA, pointB);
+	return CollideSpheres(pointA, radiusA, pointB, radiusB, outContacts);
+}
+
+// Clip a polygon to the side of a plane where normal.Dot(point) <= offset
+static uint32 ClipPolygon(const Vector3f* points, uint32 count,
+	const Vector3f& normal, float offset, Vector3f* outPoints)
+{
+	uint32 outCount = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		const Vector3f& p = points[i];
+		const Vector3f& q = points[(i + 1) % count];
+		float distanceP = normal.Dot(p) - offset;
+		float distanceQ = normal.Dot(q) - offset;
+		if (distanceP <= 0.0f)
+			outPoints[outCount++] = p;
+		if ((distanceP < 0.0f && distanceQ > 0.0f) ||
+			(distanceP > 0.0f && distanceQ < 0.0f))
+		{
+			outPoints[outCount++] = p + ((q - p) * (distanceP / (distanceP - distanceQ)));
+		}
+	}
+	return outCount;
+}
+
+// Separating axis test over the 15 axes of two boxes. Face contacts clip
+// the incident face against the reference face for up to 8 contacts, and
+// edge contacts give one contact between the closest points of the edges.
+static uint32 CollideBoxBox(const Collider* a, const Collider* b,
+	ColliderContact* outContacts)
+{
+	// Face axes are preferred unless another axis separates clearly more,
+	// so that the contacts don't flicker between features.
+	const float relativeTolerance = 0.95f;
+	const float absoluteTolerance = 0.01f;
+
+	const BoxCollider* boxes[2] = { (const BoxCollider*) a, (const BoxCollider*) b };
+	Vector3f centers[2];
+	Vector3f axes[2][3];
+	Vector3f halfSizes[2];
+	for (uint32 k = 0; k < 2; k++)
+	{
+		centers[k] = GetShapeCenter(boxes[k]);
+		halfSizes[k] = boxes[k]->GetHalfSize();
+		for (uint32 i = 0; i < 3; i++)
+			axes[k][i] = GetShapeAxis(boxes[k], i);
+	}
+	Vector3f offset = centers[1] - centers[0];
+
+	// Separation along an axis, which is negative when the boxes overlap
+	auto getSeparation = [&](const Vector3f& axis) {
+		float separation = Math::Abs(offset.Dot(axis));
+		for (uint32 k = 0; k < 2; k++)
+		{
+			for (uint32 i = 0; i < 3; i++)
+				separation -= halfSizes[k][i] * Math::Abs(axes[k][i].Dot(axis));
+		}
+		return separation;
+	};
+
+	float faceSeparations[2] = { -FLT_MAX, -FLT_MAX };
+	uint32 faceAxes[2] = { 0, 0 };
+	for (uint32 k = 0; k < 2; k++)
+	{
+		for (uint32 i = 0; i < 3; i++)
+		{
+			float separation = getSeparation(axes[k][i]);
+			if (separation > 0.0f)
+				return 0;
+			if (separation > faceSeparations[k])
+			{
+				faceSeparations[k] = separation;
+				faceAxes[k] = i;
+			}
+		}
+	}
+
+	// Parallel edges are skipped, as the face axes cover them.
+	float edgeSeparation = -FLT_MAX;
+	Vector3f edgeAxis;
+	uint32 edgeAxes[2] = { 0, 0 };
+	for (uint32 i = 0; i < 3; i++)
+	{
+		for (uint32 j = 0; j < 3; j++)
+		{
+			Vector3f axis = axes[0][i].Cross(axes[1][j]);
+			float length = axis.Length();
+			if (length < 0.0001f)
+				continue;
+			axis *= 1.0f / length;
+			float separation = getSeparation(axis);
+			if (separation > 0.0f)
+				return 0;
+			if (separation > edgeSeparation)
+			{
+				edgeSeparation = separation;
+				edgeAxis = axis;
+				edgeAxes[0] = i;
+				edgeAxes[1] = j;
+			}
+		}
+	}
+
+	uint32 reference = 0;
+	if (faceSeparations[1] > (relativeTolerance * faceSeparations[0]) + absoluteTolerance)
+		reference = 1;
+
+	if (edgeSeparation > (relativeTolerance * faceSeparations[reference]) + absoluteTolerance)
+	{
+		// Find the edge of A furthest toward B and the edge of B furthest
+		// toward A.
+		Vector3f direction = (edgeAxis.Dot(offset) >= 0.0f ? edgeAxis : -edgeAxis);
+		Vector3f edgeCenters[2] = { centers[0], centers[1] };
+		for (uint32 k = 0; k < 2; k++)
+		{
+			float sign = (k == 0 ? 1.0f : -1.0f);
+			for (uint32 i = 0; i < 3; i++)
+			{
+				if (i == edgeAxes[k])
+					continue;
+				float side = (axes[k][i].Dot(direction) * sign >= 0.0f ? 1.0f : -1.0f);
+				edgeCenters[k] += axes[k][i] * (halfSizes[k][i] * side);
+			}
+		}
+		Vector3f edgeA = axes[0][edgeAxes[0]] * halfSizes[0][edgeAxes[0]];
+		Vector3f edgeB = axes[1][edgeAxes[1]] * halfSizes[1][edgeAxes[1]];
+		ClosestPointsOnSegments(edgeCenters[0] - edgeA, edgeCenters[0] + edgeA,
+			edgeCenters[1] - edgeB, edgeCenters[1] + edgeB,
+			outContacts->pointA, outContacts->pointB);
+		outContacts->normal = -direction;
+		return 1;
+	}
+
+	// The reference face faces the other box, and the incident face is the
+	// other box's face most opposed to it.
+	uint32 incident = 1 - reference;
+	uint32 referenceAxis = faceAxes[reference];
+	Vector3f referenceNormal = axes[reference][referenceAxis];
+	if (referenceNormal.Dot(centers[incident] - centers[reference]) < 0.0f)
+		referenceNormal = -referenceNormal;
+	Vector3f referenceCenter = centers[reference] +
+		(referenceNormal * halfSizes[reference][referenceAxis]);
+
+	uint32 incidentAxis = 0;
+	float maxDot = -1.0f;
+	for (uint32 i = 0; i < 3; i++)
+	{
+		float dot = Math::Abs(axes[incident][i].Dot(referenceNormal));
+		if (dot > maxDot)
+		{
+			maxDot = dot;
+			incidentAxis = i;
+		}
+	}
+	Vector3f incidentNormal = axes[incident][incidentAxis];
+	if (incidentNormal.Dot(referenceNormal) > 0.0f)
+		incidentNormal = -incidentNormal;
+	Vector3f incidentCenter = centers[incident] +
+		(incidentNormal * halfSizes[incident][incidentAxis]);
+	uint32 u = (incidentAxis + 1) % 3;
+	uint32 v = (incidentAxis + 2) % 3;
+	Vector3f incidentU = axes[incident][u] * halfSizes[incident][u];
+	Vector3f incidentV = axes[incident][v] * halfSizes[incident][v];
+
+	// Clip the incident face to the sides of the reference face.
+	Vector3f polygons[2][8] = {
+		{
+			incidentCenter + incidentU + incidentV,
+			incidentCenter - incidentU + incidentV,
+			incidentCenter - incidentU - incidentV,
+			incidentCenter + incidentU - incidentV,
+		}
+	};
+	uint32 count = 4;
+	uint32 polygon = 0;
+	for (uint32 side = 0; side < 4; side++)
+	{
+		uint32 axis = (referenceAxis + 1 + (side / 2)) % 3;
+		Vector3f planeNormal = axes[reference][axis] * (side % 2 == 0 ? 1.0f : -1.0f);
+		float planeOffset = planeNormal.Dot(centers[reference]) +
+			halfSizes[reference][axis];
+		count = ClipPolygon(polygons[polygon], count, planeNormal,
+			planeOffset, polygons[1 - polygon]);
+		polygon = 1 - polygon;
+	}
+
+	// Keep the points that are below the reference face.
+	uint32 numContacts = 0;
+	for (uint32 i = 0; i < count; i++)
+	{
+		const Vector3f& point = polygons[polygon][i];
+		float separation = (point - referenceCenter).Dot(referenceNormal);
+		if (separation > 0.0f)
+			continue;
+		ColliderContact& contact = outContacts[numContacts++];
+		Vector3f pointOnFace = point - (referenceNormal * separation);
+		if (reference == 0)
+		{
+			contact.pointA = pointOnFace;
+			contact.pointB = point;
+			contact.normal = -referenceNormal;
+		}
+		else
+		{
+			contact.pointA = point;
+			contact.pointB = pointOnFace;
+			contact.normal = referenceNormal;
+		}
+	}
+	return numContacts;
+}
+
+// Add a contact between two colliders to a collision.
+static void AddColliderContact(Collider* a, Collider* b,
+	const Vector3f& pointA, const Vector3f& pointB, const Vector3f& normal,
+	float depth, CollisionData* collisionData)
+{
+	if (collisionData->numContacts >= 16)
+		return;
+	collisionData->firstBody = a->GetBody();
+	collisionData->secondBody = b->GetBody();
+
+	Contact contact;
+	contact.body[0]			= a->GetBody();
+	contact.body[1]			= b->GetBody();
+	contact.contactNormal	= normal;
+	contact.penetration		= depth;
+	contact.contactPoint	= pointA;
+	contact.worldPositionA	= pointA;
+	contact.worldPositionB	= pointB;
+	contact.localPositionA	= a->GetBody()->GetWorldToBody().TransformAffine(pointA);
+	contact.localPositionB	= b->GetBody()->GetWorldToBody().TransformAffine(pointB);
+	contact.localNormal		= b->GetBody()->GetWorldToBody().Rotate(normal);
+	collisionData->AddContact(contact);
+}
+
+
+//-----------------------------------------------------------------------------
+// Collision detector
+//-----------------------------------------------------------------------------
 
 CollisionDetector::CollisionDetector()
 {
+	for (uint32 i = 0; i < (uint32) ColliderType::k_count; i++)
+	{
+		for (uint32 j = 0; j < (uint32) ColliderType::k_count; j++)
+		{
+			m_collideFunctions[i][j].function = nullptr;
+			m_collideFunctions[i][j].swapColliders = false;
+		}
+	}
+
+	SetCollideFunction(ColliderType::k_sphere, ColliderType::k_sphere, CollideSphereSphere);
+	SetCollideFunction(ColliderType::k_sphere, ColliderType::k_box, CollideSphereBox);
+	SetCollideFunction(ColliderType::k_sphere, ColliderType::k_capsule, CollideSphereCapsule);
+	SetCollideFunction(ColliderType::k_capsule, ColliderType::k_capsule, CollideCapsuleCapsule);
+	SetCollideFunction(ColliderType::k_box, ColliderType::k_box, CollideBoxBox);
+}
+
+void CollisionDetector::SetCollideFunction(ColliderType typeA,
+	ColliderType typeB, CollideFunction function)
+{
+	m_collideFunctions[(int) typeA][(int) typeB].function = function;
+	m_collideFunctions[(int) typeA][(int) typeB].swapColliders = false;
+	if (typeA != typeB)
+	{
+		m_collideFunctions[(int) typeB][(int) typeA].function = function;
+		m_collideFunctions[(int) typeB][(int) typeA].swapColliders = true;
+	}
+}
 
+bool CollisionDetector::HasCollideFunction(ColliderType typeA, ColliderType typeB) const
+{
+	if (typeA == ColliderType::k_unknown || typeB == ColliderType::k_unknown)
+		return false;
+	return (m_collideFunctions[(int) typeA][(int) typeB].function != nullptr);
 }
 
 void CollisionDetector::DetectCollision(RigidBody* one, RigidBody* two, CollisionData* collisionData)
@@ -29,30 +536,46 @@ void CollisionDetector::DetectCollision(RigidBody* one, RigidBody* two, Collisio
 
 void CollisionDetector::DetectCollision(
 	Collider* a, Collider* b, CollisionData* collisionData)
+{
+	if (!HasCollideFunction(a->GetType(), b->GetType()))
+	{
+		DetectCollisionGJK(a, b, collisionData);
+		return;
+	}
+
+	const CollideFunctionEntry& entry =
+		m_collideFunctions[(int) a->GetType()][(int) b->GetType()];
+	ColliderContact contacts[MAX_COLLIDER_CONTACTS];
+	uint32 numContacts = (entry.swapColliders ?
+		entry.function(b, a, contacts) : entry.function(a, b, contacts));
+	for (uint32 i = 0; i < numContacts; i++)
+	{
+		ColliderContact& contact = contacts[i];
+		if (entry.swapColliders)
+		{
+			std::swap(contact.pointA, contact.pointB);
+			contact.normal = -contact.normal;
+		}
+		AddColliderContact(a, b, contact.pointA, contact.pointB, contact.normal,
+			(contact.pointB - contact.pointA).Dot(contact.normal), collisionData);
+	}
+}
+
+void CollisionDetector::DetectCollisionGJK(
+	Collider* a, Collider* b, CollisionData* collisionData)
 {
 	Simplex simplex;
 	bool gjkResult = GJK::TestIntersection(a, b, &simplex);
 
 	if (gjkResult)
 	{
+		// Each pair of colliders adds one contact.
 		EPAResult epaResult = EPA::PerformEPA(a, b, simplex);
 		if (epaResult.passed)
 		{
-			collisionData->firstBody = a->GetBody();
-			collisionData->secondBody = b->GetBody();
-
-			collisionData->numContacts = 1;
-			collisionData->contacts[0].body[0]			= a->GetBody();
-			collisionData->contacts[0].body[1]			= b->GetBody();
-			collisionData->contacts[0].contactNormal	= epaResult.normal;
-			collisionData->contacts[0].penetration		= epaResult.depth;
-			collisionData->contacts[0].contactPoint		= epaResult.contactPoint;
-			collisionData->contacts[0].worldPositionA	= epaResult.contactPointA;
-			collisionData->contacts[0].worldPositionB	= epaResult.contactPointB;
-			collisionData->contacts[0].localPositionA	= a->GetBody()->GetWorldToBody().TransformAffine(epaResult.contactPointA);
-			collisionData->contacts[0].localPositionB	= b->GetBody()->GetWorldToBody().TransformAffine(epaResult.contactPointB);
-			collisionData->contacts[0].localNormal		= b->GetBody()->GetWorldToBody().Rotate(epaResult.normal);
-	
+			AddColliderContact(a, b, epaResult.contactPointA,
+				epaResult.contactPointB, epaResult.normal, epaResult.depth,
+				collisionData);
 		}
 	}
 }
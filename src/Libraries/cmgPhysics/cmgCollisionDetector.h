@@ -11,17 +11,52 @@
 #include <cmgPhysics/cmgGJK.h>
 
 
+//-----------------------------------------------------------------------------
+// ColliderContact - A contact point found between two colliders, with the
+// point of each collider that reaches furthest into the other. The normal
+// points from B toward A.
+//-----------------------------------------------------------------------------
+struct ColliderContact
+{
+	Vector3f pointA;
+	Vector3f pointB;
+	Vector3f normal;
+};
+
+
 //-----------------------------------------------------------------------------
 // CollisionDetector - Narrow phase collision detector.
+//
+// Pairs of collider types with a closed-form test (spheres, boxes and
+// capsules) are found in a table of collide functions. Other pairs use GJK
+// and EPA.
 //-----------------------------------------------------------------------------
 class CollisionDetector
 {
+public:
+	static const uint32 MAX_COLLIDER_CONTACTS = 8;
+
+	// Finds the contacts between two colliders of known types, returning
+	// how many were written
+	typedef uint32 (*CollideFunction)(const Collider* a, const Collider* b,
+		ColliderContact* outContacts);
+
 public:
 	CollisionDetector();
 	
 	void DetectCollision(RigidBody* one, RigidBody* two, CollisionData* collisionData);
 
+	// Find the contacts between two colliders with the collide function for
+	// their types, or with GJK and EPA if there is none
 	void DetectCollision(Collider* a, Collider* b, CollisionData* collisionData);
+	void DetectCollisionGJK(Collider* a, Collider* b, CollisionData* collisionData);
+
+	// Set the collide function for a pair of collider types, which is also
+	// used with the colliders swapped. Null uses GJK and EPA.
+	void SetCollideFunction(ColliderType typeA, ColliderType typeB,
+		CollideFunction function);
+	bool HasCollideFunction(ColliderType typeA, ColliderType typeB) const;
+
 	void GenerateContactsEPA(Collider* a, Collider* b, CollisionData* collisionData, const EPAResult& epa);
 
 	void DetectCollision(CollisionPrimitive* one, CollisionPrimitive* two, CollisionData* collisionData);
@@ -48,6 +83,13 @@ public:
 		const Vector3f& pointOnEdgeTwo);
 
 private:
+	struct CollideFunctionEntry
+	{
+		CollideFunction function;
+		bool swapColliders; // The function takes the colliders as (B, A)
+	};
+
+	CollideFunctionEntry m_collideFunctions[(int) ColliderType::k_count][(int) ColliderType::k_count];
 };
 
 
@@ -8,10 +8,13 @@ Contact::Contact() :
 	staticFriction(0.3f),
 	dynamicFriction(0.2f),
 	persistent(false),
-	age(0)
+	age(0),
+	normalImpulse(0.0f)
 {
 	bodyA = nullptr;
 	bodyB = nullptr;
+	tangentImpulse[0] = 0.0f;
+	tangentImpulse[1] = 0.0f;
 }
 
 Vector3f Contact::CalculateFrictionlessImpulse()
@@ -311,6 +314,8 @@ void CollisionData::RefreshContacts()
 	for (unsigned int i = 0; i < numContacts; ++i)
 	{
 		Contact& contact = contacts[i];
+		contact.contactNormal = contact.bodyB->GetBodyToWorld()
+			.Rotate(contact.localNormal);
 		contact.worldPositionA = contact.bodyA->GetBodyToWorld()
 			.TransformAffine(contact.localPositionA);
 		contact.worldPositionB = contact.bodyB->GetBodyToWorld()
@@ -321,7 +326,7 @@ void CollisionData::RefreshContacts()
 		contact.persistent = true;
 	}
 
-	float maxDist = 0.2f;
+	float maxDist = 0.05f;
 
 	Vector3f projectedDifference;
 	Vector3f projectedPoint;
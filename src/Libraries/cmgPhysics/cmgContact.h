@@ -65,6 +65,12 @@ public:
 	// The coefficient of restitution for the collision.
 	float restitution;
 
+	// Impulses accumulated by the solver along the normal and the two
+	// tangents of the contact basis. They are kept while the contact
+	// persists, to warm start the next step's solve.
+	float normalImpulse;
+	float tangentImpulse[2];
+
 	ContactType contactType;
 
 	// The colliding features.
@@ -92,6 +98,10 @@ public:
 	float CalcBaumgarteImpulse();
 
 
+	// Axes of the contact basis, perpendicular to the normal
+	inline Vector3f GetTangent() const { return Vector3f(contactToWorld.m[0], contactToWorld.m[1], contactToWorld.m[2]); }
+	inline Vector3f GetBitangent() const { return Vector3f(contactToWorld.m[6], contactToWorld.m[7], contactToWorld.m[8]); }
+
 	Vector3f TransformWorldToContact(const Vector3f& worldPoint) const;
 	Vector3f TransformContactToWorld(const Vector3f& contactPoint) const;
 
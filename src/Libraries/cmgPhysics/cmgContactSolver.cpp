@@ -0,0 +1,743 @@
+#include "cmgContactSolver.h"
+#include "cmgBatchLanes.h"
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <cmgCore/time/cmgTimer.h>
+#include <cmgMath/cmgMathLib.h>
+
+using namespace lanes;
+
+
+// Closing speeds below this don't bounce
+static const float RESTITUTION_THRESHOLD = 1.0f;
+
+// Fraction of the penetration removed by each position iteration, and the
+// penetration that is left alone so contacts don't jitter
+static const float BAUMGARTE = 0.9f;
+static const float PENETRATION_SLOP = 0.01f;
+
+
+// Velocity of body B relative to body A at a contact
+static inline Vector3f GetContactVelocity(const SolverBody& bodyA,
+	const SolverBody& bodyB, const SolverContact& contact)
+{
+	return (bodyB.velocity + bodyB.angularVelocity.Cross(contact.rB)) -
+		(bodyA.velocity + bodyA.angularVelocity.Cross(contact.rA));
+}
+
+// Mass felt by an impulse along an axis at a contact
+static inline float CalcContactMass(const SolverBody& bodyA,
+	const SolverBody& bodyB, const Vector3f& rA, const Vector3f& rB,
+	const Vector3f& axis)
+{
+	Vector3f rnA = rA.Cross(axis);
+	Vector3f rnB = rB.Cross(axis);
+	float inverseMass = bodyA.inverseMass + bodyB.inverseMass +
+		rnA.Dot(bodyA.inverseInertiaWorld * rnA) +
+		rnB.Dot(bodyB.inverseInertiaWorld * rnB);
+	return (inverseMass > 0.0f ? 1.0f / inverseMass : 0.0f);
+}
+
+// Push body A along the impulse and body B against it. Bodies without mass
+// are never written, as the parallel solver shares them between threads.
+static inline void ApplyContactImpulse(SolverBody& bodyA, SolverBody& bodyB,
+	const SolverContact& contact, const Vector3f& impulse)
+{
+	if (bodyA.inverseMass != 0.0f)
+	{
+		bodyA.velocity += impulse * bodyA.inverseMass;
+		bodyA.angularVelocity += bodyA.inverseInertiaWorld * contact.rA.Cross(impulse);
+	}
+	if (bodyB.inverseMass != 0.0f)
+	{
+		bodyB.velocity -= impulse * bodyB.inverseMass;
+		bodyB.angularVelocity -= bodyB.inverseInertiaWorld * contact.rB.Cross(impulse);
+	}
+}
+
+// Sequential impulses, clamping the total impulse of each contact rather
+// than each iteration's impulse, so that later iterations and warm starting
+// can take back impulse that turned out to be too much.
+static void SolveContactVelocity(SolverContact& contact, SolverBody* bodies,
+	bool enableFriction)
+{
+	SolverBody& bodyA = bodies[contact.bodyA];
+	SolverBody& bodyB = bodies[contact.bodyB];
+	Vector3f velocity;
+
+	// Friction, limited by the normal impulse.
+	if (enableFriction)
+	{
+		float maxFriction = contact.friction * contact.normalImpulse;
+		for (uint32 k = 0; k < 2; k++)
+		{
+			velocity = GetContactVelocity(bodyA, bodyB, contact);
+			float impulse = velocity.Dot(contact.tangents[k]) * contact.tangentMass[k];
+			float oldImpulse = contact.tangentImpulse[k];
+			contact.tangentImpulse[k] = Math::Clamp(oldImpulse + impulse,
+				-maxFriction, maxFriction);
+			ApplyContactImpulse(bodyA, bodyB, contact,
+				contact.tangents[k] * (contact.tangentImpulse[k] - oldImpulse));
+		}
+	}
+
+	// Normal impulse, which can only push.
+	velocity = GetContactVelocity(bodyA, bodyB, contact);
+	float impulse = (velocity.Dot(contact.normal) + contact.velocityBias) *
+		contact.normalMass;
+	float oldImpulse = contact.normalImpulse;
+	contact.normalImpulse = Math::Max(oldImpulse + impulse, 0.0f);
+	ApplyContactImpulse(bodyA, bodyB, contact,
+		contact.normal * (contact.normalImpulse - oldImpulse));
+}
+
+// Solve the contacts of a batch at once, one per lane. The lanes don't
+// share bodies that can move, so the bodies can be gathered at the start
+// and scattered back at the end.
+template <class T_Lanes>
+static void SolveContactBatch(ContactBatch& batch, SolverBody* bodies,
+	bool enableFriction)
+{
+	using L = T_Lanes;
+	typedef typename L::Type Lanes;
+
+	// Gather the velocities of the lanes' bodies.
+	float gathered[12][ContactBatch::MAX_WIDTH];
+	for (uint32 lane = 0; lane < L::WIDTH; lane++)
+	{
+		const SolverBody& bodyA = bodies[batch.bodyA[lane]];
+		const SolverBody& bodyB = bodies[batch.bodyB[lane]];
+		for (uint32 c = 0; c < 3; c++)
+		{
+			gathered[c][lane] = bodyA.velocity[c];
+			gathered[c + 3][lane] = bodyA.angularVelocity[c];
+			gathered[c + 6][lane] = bodyB.velocity[c];
+			gathered[c + 9][lane] = bodyB.angularVelocity[c];
+		}
+	}
+	Lanes vA[3], wA[3], vB[3], wB[3];
+	for (uint32 c = 0; c < 3; c++)
+	{
+		vA[c] = L::Load(gathered[c]);
+		wA[c] = L::Load(gathered[c + 3]);
+		vB[c] = L::Load(gathered[c + 6]);
+		wB[c] = L::Load(gathered[c + 9]);
+	}
+	Lanes inverseMassA = L::Load(batch.inverseMassA);
+	Lanes inverseMassB = L::Load(batch.inverseMassB);
+
+	// The tangents first, then the normal, as the sequential solver does.
+	for (uint32 n = (enableFriction ? 0 : 2); n < 3; n++)
+	{
+		uint32 k = (n + 1) % 3;
+
+		// Relative velocity along the axis
+		Lanes velocity = L::Set(0.0f);
+		for (uint32 c = 0; c < 3; c++)
+		{
+			velocity = L::Add(velocity, L::Mul(L::Load(batch.axis[k][c]), L::Sub(vB[c], vA[c])));
+			velocity = L::Add(velocity, L::Mul(L::Load(batch.angularAxisB[k][c]), wB[c]));
+			velocity = L::Sub(velocity, L::Mul(L::Load(batch.angularAxisA[k][c]), wA[c]));
+		}
+
+		// Accumulate and clamp the impulse.
+		Lanes oldImpulse = L::Load(batch.impulse[k]);
+		Lanes impulse;
+		if (k == 0)
+		{
+			velocity = L::Add(velocity, L::Load(batch.velocityBias));
+			impulse = L::Max(L::Add(oldImpulse, L::Mul(velocity,
+				L::Load(batch.mass[k]))), L::Set(0.0f));
+		}
+		else
+		{
+			Lanes maxFriction = L::Mul(L::Load(batch.friction), L::Load(batch.impulse[0]));
+			impulse = L::Add(oldImpulse, L::Mul(velocity, L::Load(batch.mass[k])));
+			impulse = L::Min(L::Max(impulse, L::Sub(L::Set(0.0f), maxFriction)), maxFriction);
+		}
+		L::Store(batch.impulse[k], impulse);
+
+		// Push body A along the axis and body B against it.
+		Lanes delta = L::Sub(impulse, oldImpulse);
+		Lanes deltaA = L::Mul(delta, inverseMassA);
+		Lanes deltaB = L::Mul(delta, inverseMassB);
+		for (uint32 c = 0; c < 3; c++)
+		{
+			Lanes axis = L::Load(batch.axis[k][c]);
+			vA[c] = L::Add(vA[c], L::Mul(axis, deltaA));
+			vB[c] = L::Sub(vB[c], L::Mul(axis, deltaB));
+			wA[c] = L::Add(wA[c], L::Mul(L::Load(batch.angularImpulseA[k][c]), delta));
+			wB[c] = L::Sub(wB[c], L::Mul(L::Load(batch.angularImpulseB[k][c]), delta));
+		}
+	}
+
+	// Scatter the velocities back, skipping the padding lanes.
+	for (uint32 c = 0; c < 3; c++)
+	{
+		L::Store(gathered[c], vA[c]);
+		L::Store(gathered[c + 3], wA[c]);
+		L::Store(gathered[c + 6], vB[c]);
+		L::Store(gathered[c + 9], wB[c]);
+	}
+	for (uint32 lane = 0; lane < batch.numLanes; lane++)
+	{
+		SolverBody& bodyA = bodies[batch.bodyA[lane]];
+		SolverBody& bodyB = bodies[batch.bodyB[lane]];
+		for (uint32 c = 0; c < 3; c++)
+		{
+			bodyA.velocity[c] = gathered[c][lane];
+			bodyA.angularVelocity[c] = gathered[c + 3][lane];
+			bodyB.velocity[c] = gathered[c + 6][lane];
+			bodyB.angularVelocity[c] = gathered[c + 9][lane];
+		}
+	}
+}
+
+// Turn a body by a small rotation vector
+static inline void RotateSolverBody(SolverBody& body, const Vector3f& rotation)
+{
+	Quaternion rotationQuat(rotation.x, rotation.y, rotation.z, 0.0f);
+	body.deltaOrientation += (rotationQuat * body.deltaOrientation) * 0.5f;
+	body.deltaOrientation.Normalize();
+}
+
+
+// Push the bodies of a contact apart along the normal
+static void SolveContactPosition(const SolverContact& contact,
+	SolverBody* bodies)
+{
+	SolverBody& bodyA = bodies[contact.bodyA];
+	SolverBody& bodyB = bodies[contact.bodyB];
+
+	// Find the penetration with the poses moved so far.
+	Vector3f rA;
+	Vector3f rB;
+	bodyA.deltaOrientation.RotateVector(contact.rA, rA);
+	bodyB.deltaOrientation.RotateVector(contact.rB, rB);
+	Vector3f moveA = bodyA.deltaPosition + rA - contact.rA;
+	Vector3f moveB = bodyB.deltaPosition + rB - contact.rB;
+	float penetration = contact.penetration +
+		(moveB - moveA).Dot(contact.normal);
+	if (penetration <= PENETRATION_SLOP)
+		return;
+
+	float mass = CalcContactMass(bodyA, bodyB, rA, rB, contact.normal);
+	Vector3f push = contact.normal *
+		(BAUMGARTE * (penetration - PENETRATION_SLOP) * mass);
+
+	if (bodyA.inverseMass != 0.0f)
+	{
+		bodyA.deltaPosition += push * bodyA.inverseMass;
+		RotateSolverBody(bodyA, bodyA.inverseInertiaWorld * rA.Cross(push));
+	}
+	if (bodyB.inverseMass != 0.0f)
+	{
+		bodyB.deltaPosition -= push * bodyB.inverseMass;
+		RotateSolverBody(bodyB, bodyB.inverseInertiaWorld * rB.Cross(-push));
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+ContactSolver::ContactSolver() :
+	m_mode(ContactSolverMode::k_sequential),
+	m_threadPool(nullptr),
+	m_enableFriction(true),
+	m_enableRestitution(true),
+	m_enableWarmStarting(true)
+{
+}
+
+void ContactSolver::Clear()
+{
+	for (uint32 i = 0; i < m_rigidBodies.size(); i++)
+		m_rigidBodies[i]->m_solverIndex = -1;
+	m_bodies.clear();
+	m_rigidBodies.clear();
+	m_contacts.clear();
+	m_batches.clear();
+}
+
+uint32 ContactSolver::GetBatchWidth()
+{
+	return WidestLanes::WIDTH;
+}
+
+const char* ContactSolver::GetBatchInstructionSet()
+{
+#if defined(CMG_BATCH_AVX2)
+	return "avx2";
+#elif defined(CMG_BATCH_SSE2)
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Velocities
+//-----------------------------------------------------------------------------
+
+void ContactSolver::Prepare(CollisionCache& cache, float invDT)
+{
+	Clear();
+	m_colors.clear();
+
+	for (auto it = cache.collisions_begin(); it != cache.collisions_end(); ++it)
+	{
+		CollisionData& collision = it->second;
+		for (uint32 i = 0; i < collision.numContacts; i++)
+		{
+			Contact& contact = collision.contacts[i];
+			contact.CalcDepth();
+			contact.CreateContactBasis();
+
+			SolverContact solverContact;
+			solverContact.contact = &contact;
+			solverContact.bodyA = AddBody(contact.bodyA);
+			solverContact.bodyB = AddBody(contact.bodyB);
+			solverContact.rA = contact.worldPositionA - contact.bodyA->m_centerOfMassWorld;
+			solverContact.rB = contact.worldPositionB - contact.bodyB->m_centerOfMassWorld;
+			solverContact.normal = contact.contactNormal;
+			solverContact.tangents[0] = contact.GetTangent();
+			solverContact.tangents[1] = contact.GetBitangent();
+			solverContact.friction = contact.staticFriction;
+			solverContact.penetration = contact.penetration;
+			m_contacts.push_back(solverContact);
+		}
+	}
+	if (m_mode == ContactSolverMode::k_parallel)
+		BuildColors();
+	else
+		BuildBatches();
+
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+	{
+		SolverContact& contact = m_contacts[i];
+		SolverBody& bodyA = m_bodies[contact.bodyA];
+		SolverBody& bodyB = m_bodies[contact.bodyB];
+		contact.normalMass = CalcContactMass(bodyA, bodyB,
+			contact.rA, contact.rB, contact.normal);
+		contact.tangentMass[0] = CalcContactMass(bodyA, bodyB,
+			contact.rA, contact.rB, contact.tangents[0]);
+		contact.tangentMass[1] = CalcContactMass(bodyA, bodyB,
+			contact.rA, contact.rB, contact.tangents[1]);
+
+		// Separated contacts let the bodies close the gap this step.
+		float closingSpeed = GetContactVelocity(bodyA, bodyB, contact).Dot(contact.normal);
+		contact.velocityBias = 0.0f;
+		if (contact.penetration < 0.0f)
+			contact.velocityBias = contact.penetration * invDT;
+		else if (m_enableRestitution && closingSpeed > RESTITUTION_THRESHOLD)
+			contact.velocityBias = contact.contact->restitution * closingSpeed;
+
+		// Apply last step's impulses, which are usually close to the
+		// solution, so that fewer iterations are needed to converge.
+		contact.normalImpulse = 0.0f;
+		contact.tangentImpulse[0] = 0.0f;
+		contact.tangentImpulse[1] = 0.0f;
+		if (m_enableWarmStarting)
+		{
+			contact.normalImpulse = contact.contact->normalImpulse;
+			if (m_enableFriction)
+			{
+				contact.tangentImpulse[0] = contact.contact->tangentImpulse[0];
+				contact.tangentImpulse[1] = contact.contact->tangentImpulse[1];
+			}
+			ApplyContactImpulse(bodyA, bodyB, contact,
+				(contact.normal * contact.normalImpulse) +
+				(contact.tangents[0] * contact.tangentImpulse[0]) +
+				(contact.tangents[1] * contact.tangentImpulse[1]));
+		}
+	}
+
+	if (m_mode == ContactSolverMode::k_wide)
+		FillBatches();
+}
+
+void ContactSolver::SolveVelocities()
+{
+	if (m_mode == ContactSolverMode::k_wide)
+	{
+		for (uint32 i = 0; i < m_batches.size(); i++)
+		{
+			SolveContactBatch<WidestLanes>(m_batches[i], m_bodies.data(),
+				m_enableFriction);
+		}
+		return;
+	}
+	else if (m_mode == ContactSolverMode::k_parallel)
+	{
+		SolveColors(false);
+		return;
+	}
+
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+		SolveContactVelocity(m_contacts[i], m_bodies.data(), m_enableFriction);
+}
+
+void ContactSolver::StoreVelocities()
+{
+	if (m_mode == ContactSolverMode::k_wide)
+	{
+		for (uint32 i = 0; i < m_batches.size(); i++)
+		{
+			const ContactBatch& batch = m_batches[i];
+			for (uint32 lane = 0; lane < batch.numLanes; lane++)
+			{
+				SolverContact& contact = m_contacts[batch.firstContact + lane];
+				contact.normalImpulse = batch.impulse[0][lane];
+				contact.tangentImpulse[0] = batch.impulse[1][lane];
+				contact.tangentImpulse[1] = batch.impulse[2][lane];
+			}
+		}
+	}
+
+	for (uint32 i = 0; i < m_bodies.size(); i++)
+	{
+		RigidBody* body = m_rigidBodies[i];
+		if (body->m_inverseMass != 0.0f)
+		{
+			body->m_velocity = m_bodies[i].velocity;
+			body->m_angularVelocity = m_bodies[i].angularVelocity;
+		}
+	}
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+	{
+		const SolverContact& contact = m_contacts[i];
+		contact.contact->normalImpulse = contact.normalImpulse;
+		contact.contact->tangentImpulse[0] = contact.tangentImpulse[0];
+		contact.contact->tangentImpulse[1] = contact.tangentImpulse[1];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Positions
+//-----------------------------------------------------------------------------
+
+void ContactSolver::PreparePositions()
+{
+	for (uint32 i = 0; i < m_bodies.size(); i++)
+	{
+		SolverBody& body = m_bodies[i];
+		if (body.inverseMass != 0.0f)
+			body.inverseInertiaWorld = m_rigidBodies[i]->m_inverseInertiaTensorWorld;
+		body.deltaPosition = Vector3f::ZERO;
+		body.deltaOrientation = Quaternion::IDENTITY;
+	}
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+	{
+		SolverContact& contact = m_contacts[i];
+		Contact* cachedContact = contact.contact;
+		contact.penetration = cachedContact->CalcDepth();
+		contact.normal = cachedContact->contactNormal;
+		contact.rA = cachedContact->worldPositionA - cachedContact->bodyA->m_centerOfMassWorld;
+		contact.rB = cachedContact->worldPositionB - cachedContact->bodyB->m_centerOfMassWorld;
+	}
+}
+
+void ContactSolver::SolvePositions()
+{
+	if (m_mode == ContactSolverMode::k_parallel)
+	{
+		SolveColors(true);
+		return;
+	}
+
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+		SolveContactPosition(m_contacts[i], m_bodies.data());
+}
+
+void ContactSolver::StorePositions()
+{
+	for (uint32 i = 0; i < m_bodies.size(); i++)
+	{
+		const SolverBody& solverBody = m_bodies[i];
+		RigidBody* body = m_rigidBodies[i];
+		if (body->m_inverseMass == 0.0f)
+			continue;
+
+		// Move the center of mass, then place the body's origin around it.
+		Vector3f centerOfMass = body->m_centerOfMassWorld + solverBody.deltaPosition;
+		body->m_orientation = solverBody.deltaOrientation * body->m_orientation;
+		body->m_orientation.Normalize();
+		Vector3f centerOfMassOffset;
+		body->m_orientation.RotateVector(body->m_centerOfMass, centerOfMassOffset);
+		body->m_position = centerOfMass - centerOfMassOffset;
+		body->CalculateDerivedData();
+	}
+	Clear();
+}
+
+//-----------------------------------------------------------------------------
+// Batches
+//-----------------------------------------------------------------------------
+
+void ContactSolver::BuildBatches()
+{
+	// Only the oldest batches with free lanes are searched, which keeps this
+	// linear in the number of contacts.
+	const uint32 maxBatchesSearched = 32;
+	const uint32 width = GetBatchWidth();
+
+	m_batches.clear();
+	m_batchLanes.clear();
+	uint32 firstOpenBatch = 0;
+
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+	{
+		uint32 bodyA = m_contacts[i].bodyA;
+		uint32 bodyB = m_contacts[i].bodyB;
+		bool movesA = (m_bodies[bodyA].inverseMass != 0.0f);
+		bool movesB = (m_bodies[bodyB].inverseMass != 0.0f);
+
+		// Find a batch with a free lane that doesn't have either body, as
+		// bodies that can't move are only read.
+		uint32 batchIndex = firstOpenBatch;
+		for (; batchIndex < m_batches.size() &&
+			batchIndex < firstOpenBatch + maxBatchesSearched; batchIndex++)
+		{
+			const ContactBatch& batch = m_batches[batchIndex];
+			bool free = (batch.numLanes < width);
+			for (uint32 lane = 0; lane < batch.numLanes && free; lane++)
+			{
+				free = !(movesA && (batch.bodyA[lane] == bodyA || batch.bodyB[lane] == bodyA)) &&
+					!(movesB && (batch.bodyA[lane] == bodyB || batch.bodyB[lane] == bodyB));
+			}
+			if (free)
+				break;
+		}
+		if (batchIndex == m_batches.size() ||
+			batchIndex == firstOpenBatch + maxBatchesSearched)
+		{
+			batchIndex = (uint32) m_batches.size();
+			m_batches.push_back(ContactBatch());
+			m_batches.back().numLanes = 0;
+			m_batchLanes.resize(m_batchLanes.size() + width);
+		}
+
+		ContactBatch& batch = m_batches[batchIndex];
+		m_batchLanes[(batchIndex * width) + batch.numLanes] = i;
+		batch.bodyA[batch.numLanes] = bodyA;
+		batch.bodyB[batch.numLanes] = bodyB;
+		batch.numLanes++;
+		while (firstOpenBatch < m_batches.size() &&
+			m_batches[firstOpenBatch].numLanes == width)
+		{
+			firstOpenBatch++;
+		}
+	}
+
+	// Reorder the contacts to match the batches, and have the padding lanes
+	// read lane 0's bodies.
+	m_unbatchedContacts.swap(m_contacts);
+	m_contacts.clear();
+	for (uint32 i = 0; i < m_batches.size(); i++)
+	{
+		ContactBatch& batch = m_batches[i];
+		batch.firstContact = (uint32) m_contacts.size();
+		for (uint32 lane = 0; lane < batch.numLanes; lane++)
+			m_contacts.push_back(m_unbatchedContacts[m_batchLanes[(i * width) + lane]]);
+		for (uint32 lane = batch.numLanes; lane < ContactBatch::MAX_WIDTH; lane++)
+		{
+			batch.bodyA[lane] = batch.bodyA[0];
+			batch.bodyB[lane] = batch.bodyB[0];
+		}
+	}
+}
+
+void ContactSolver::FillBatches()
+{
+	for (uint32 i = 0; i < m_batches.size(); i++)
+	{
+		ContactBatch& batch = m_batches[i];
+		for (uint32 lane = 0; lane < ContactBatch::MAX_WIDTH; lane++)
+		{
+			if (lane >= batch.numLanes)
+			{
+				// Padding, which has no mass along any axis
+				for (uint32 k = 0; k < 3; k++)
+				{
+					for (uint32 c = 0; c < 3; c++)
+					{
+						batch.axis[k][c][lane] = 0.0f;
+						batch.angularAxisA[k][c][lane] = 0.0f;
+						batch.angularAxisB[k][c][lane] = 0.0f;
+						batch.angularImpulseA[k][c][lane] = 0.0f;
+						batch.angularImpulseB[k][c][lane] = 0.0f;
+					}
+					batch.mass[k][lane] = 0.0f;
+					batch.impulse[k][lane] = 0.0f;
+				}
+				batch.inverseMassA[lane] = 0.0f;
+				batch.inverseMassB[lane] = 0.0f;
+				batch.velocityBias[lane] = 0.0f;
+				batch.friction[lane] = 0.0f;
+				continue;
+			}
+
+			const SolverContact& contact = m_contacts[batch.firstContact + lane];
+			const SolverBody& bodyA = m_bodies[contact.bodyA];
+			const SolverBody& bodyB = m_bodies[contact.bodyB];
+			const Vector3f axes[3] = { contact.normal,
+				contact.tangents[0], contact.tangents[1] };
+			const float masses[3] = { contact.normalMass,
+				contact.tangentMass[0], contact.tangentMass[1] };
+			const float impulses[3] = { contact.normalImpulse,
+				contact.tangentImpulse[0], contact.tangentImpulse[1] };
+			for (uint32 k = 0; k < 3; k++)
+			{
+				Vector3f angularAxisA = contact.rA.Cross(axes[k]);
+				Vector3f angularAxisB = contact.rB.Cross(axes[k]);
+				Vector3f angularImpulseA = bodyA.inverseInertiaWorld * angularAxisA;
+				Vector3f angularImpulseB = bodyB.inverseInertiaWorld * angularAxisB;
+				for (uint32 c = 0; c < 3; c++)
+				{
+					batch.axis[k][c][lane] = axes[k][c];
+					batch.angularAxisA[k][c][lane] = angularAxisA[c];
+					batch.angularAxisB[k][c][lane] = angularAxisB[c];
+					batch.angularImpulseA[k][c][lane] = angularImpulseA[c];
+					batch.angularImpulseB[k][c][lane] = angularImpulseB[c];
+				}
+				batch.mass[k][lane] = masses[k];
+				batch.impulse[k][lane] = impulses[k];
+			}
+			batch.inverseMassA[lane] = bodyA.inverseMass;
+			batch.inverseMassB[lane] = bodyB.inverseMass;
+			batch.velocityBias[lane] = contact.velocityBias;
+			batch.friction[lane] = contact.friction;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Colors
+//-----------------------------------------------------------------------------
+
+void ContactSolver::BuildColors()
+{
+	const uint32 maxColors = ContactColor::MAX_COLORS;
+
+	// Give each contact the first color that neither of its bodies is in.
+	// Bodies that can't move are only read, so they never take a color.
+	uint32 numColorContacts[maxColors + 1] = {};
+	m_bodyColors.assign(m_bodies.size(), 0);
+	m_contactColors.resize(m_contacts.size());
+	for (uint32 i = 0; i < m_contacts.size(); i++)
+	{
+		uint32 bodyA = m_contacts[i].bodyA;
+		uint32 bodyB = m_contacts[i].bodyB;
+		bool movesA = (m_bodies[bodyA].inverseMass != 0.0f);
+		bool movesB = (m_bodies[bodyB].inverseMass != 0.0f);
+		uint32 usedColors = (movesA ? m_bodyColors[bodyA] : 0) |
+			(movesB ? m_bodyColors[bodyB] : 0);
+
+		uint32 color = 0;
+		while (color < maxColors && (usedColors & (1u << color)) != 0)
+			color++;
+		if (color < maxColors)
+		{
+			if (movesA)
+				m_bodyColors[bodyA] |= (1u << color);
+			if (movesB)
+				m_bodyColors[bodyB] |= (1u << color);
+		}
+		m_contactColors[i] = color;
+		numColorContacts[color]++;
+	}
+
+	// Reorder the contacts by color. The contacts that didn't fit in a
+	// color come last.
+	uint32 colorOffsets[maxColors + 1];
+	uint32 firstContact = 0;
+	for (uint32 color = 0; color <= maxColors; color++)
+	{
+		colorOffsets[color] = firstContact;
+		if (numColorContacts[color] == 0)
+			continue;
+		ContactColor contactColor;
+		contactColor.firstContact = firstContact;
+		contactColor.numContacts = numColorContacts[color];
+		contactColor.isSerial = (color == maxColors);
+		contactColor.solveTime = 0.0;
+		m_colors.push_back(contactColor);
+		firstContact += numColorContacts[color];
+	}
+	m_unbatchedContacts.swap(m_contacts);
+	m_contacts.resize(m_unbatchedContacts.size());
+	for (uint32 i = 0; i < m_unbatchedContacts.size(); i++)
+		m_contacts[colorOffsets[m_contactColors[i]]++] = m_unbatchedContacts[i];
+}
+
+void ContactSolver::SolveColors(bool positions)
+{
+	// Contacts solved by each call of the parallel loop
+	const uint32 contactsPerTask = 16;
+
+	SolverBody* bodies = m_bodies.data();
+	bool enableFriction = m_enableFriction;
+	Timer timer;
+
+	for (uint32 i = 0; i < m_colors.size(); i++)
+	{
+		ContactColor& color = m_colors[i];
+		SolverContact* contacts = m_contacts.data() + color.firstContact;
+		auto solveContacts = [=](uint32 begin, uint32 end) {
+			for (uint32 j = begin; j < end; j++)
+			{
+				if (positions)
+					SolveContactPosition(contacts[j], bodies);
+				else
+					SolveContactVelocity(contacts[j], bodies, enableFriction);
+			}
+		};
+
+		// Each color must be finished before the next one starts, which
+		// ParallelFor does by returning once all its calls have completed.
+		timer.Start();
+		uint32 numTasks = (color.numContacts + contactsPerTask - 1) / contactsPerTask;
+		if (m_threadPool != nullptr && !color.isSerial && numTasks > 1)
+		{
+			uint32 numContacts = color.numContacts;
+			m_threadPool->ParallelFor(numTasks,
+				[&](uint32 index, uint32) {
+				uint32 begin = index * contactsPerTask;
+				solveContacts(begin, Math::Min(begin + contactsPerTask, numContacts));
+			});
+		}
+		else
+		{
+			solveContacts(0, color.numContacts);
+		}
+		timer.Stop();
+		color.solveTime += timer.GetElapsedSeconds();
+	}
+}
+
+uint32 ContactSolver::AddBody(RigidBody* body)
+{
+	if (body->m_solverIndex >= 0)
+		return (uint32) body->m_solverIndex;
+
+	// Bodies without mass can't be turned either.
+	SolverBody solverBody;
+	solverBody.velocity = body->m_velocity;
+	solverBody.angularVelocity = body->m_angularVelocity;
+	solverBody.inverseMass = body->m_inverseMass;
+	if (body->m_inverseMass != 0.0f)
+		solverBody.inverseInertiaWorld = body->m_inverseInertiaTensorWorld;
+	else
+		solverBody.inverseInertiaWorld.SetZero();
+	solverBody.deltaPosition = Vector3f::ZERO;
+	solverBody.deltaOrientation = Quaternion::IDENTITY;
+
+	body->m_solverIndex = (int32) m_bodies.size();
+	m_bodies.push_back(solverBody);
+	m_rigidBodies.push_back(body);
+	return (uint32) body->m_solverIndex;
+}
@@ -0,0 +1,207 @@
+#ifndef _CMG_PHYSICS_CONTACT_SOLVER_H_
+#define _CMG_PHYSICS_CONTACT_SOLVER_H_
+
+#include <cmgPhysics/cmgCollisionCache.h>
+#include <cmgPhysics/cmgRigidBody.h>
+
+class ThreadPool;
+
+//-----------------------------------------------------------------------------
+// ContactSolverMode
+//-----------------------------------------------------------------------------
+enum class ContactSolverMode
+{
+	k_sequential = 0,	// One contact at a time
+	k_wide,				// A batch of contacts at a time, with SIMD
+	k_parallel,			// A color of contacts at a time, across threads
+
+	k_count,
+};
+
+
+//-----------------------------------------------------------------------------
+// SolverBody - The part of a body's state that the contact solver reads and
+// writes, packed together so that solving a contact stays within a few
+// cache lines.
+//-----------------------------------------------------------------------------
+struct SolverBody
+{
+	Vector3f velocity;
+	Vector3f angularVelocity;
+	float inverseMass;
+	Matrix3f inverseInertiaWorld;
+
+	// Change to the pose made by the position iterations, rotating around
+	// the center of mass
+	Vector3f deltaPosition;
+	Quaternion deltaOrientation;
+};
+
+
+//-----------------------------------------------------------------------------
+// SolverContact - A contact constraint between two solver bodies.
+//-----------------------------------------------------------------------------
+struct SolverContact
+{
+	uint32 bodyA; // Indices into the solver bodies
+	uint32 bodyB;
+	Vector3f rA; // Contact points relative to the centers of mass
+	Vector3f rB;
+	Vector3f normal; // Points from B to A
+	Vector3f tangents[2];
+	float normalMass;
+	float tangentMass[2];
+	float velocityBias;
+	float friction;
+	float normalImpulse;
+	float tangentImpulse[2];
+	float penetration; // At the start of the position iterations
+	Contact* contact; // Where the impulses are kept between steps
+};
+
+
+//-----------------------------------------------------------------------------
+// ContactBatch - Contacts solved together by the wide solver, one per lane,
+// stored as structure-of-arrays. No two lanes share a body that can move.
+//
+// The three axes are the normal and the two tangents. Lanes past the number
+// of contacts are padding, with no mass so that they never apply an impulse.
+//-----------------------------------------------------------------------------
+struct ContactBatch
+{
+	static const uint32 MAX_WIDTH = 8;
+
+	uint32 firstContact; // Index of lane 0's solver contact
+	uint32 numLanes;
+	uint32 bodyA[MAX_WIDTH];
+	uint32 bodyB[MAX_WIDTH];
+
+	float axis[3][3][MAX_WIDTH];
+	float angularAxisA[3][3][MAX_WIDTH]; // rA x axis
+	float angularAxisB[3][3][MAX_WIDTH]; // rB x axis
+	float angularImpulseA[3][3][MAX_WIDTH]; // Angular velocity change per unit impulse
+	float angularImpulseB[3][3][MAX_WIDTH];
+	float mass[3][MAX_WIDTH];
+	float impulse[3][MAX_WIDTH];
+	float inverseMassA[MAX_WIDTH];
+	float inverseMassB[MAX_WIDTH];
+	float velocityBias[MAX_WIDTH];
+	float friction[MAX_WIDTH];
+};
+
+
+//-----------------------------------------------------------------------------
+// ContactColor - Contacts solved together by the parallel solver. No two
+// contacts of a color share a body that can move, so they can be solved in
+// any order, on any thread. Contacts that didn't fit in any color are kept
+// in a last color that is solved on one thread.
+//-----------------------------------------------------------------------------
+struct ContactColor
+{
+	static const uint32 MAX_COLORS = 32;
+
+	uint32 firstContact;
+	uint32 numContacts;
+	bool isSerial; // Holds the contacts left over once the colors ran out
+	double solveTime; // Seconds spent on this color in the last step
+};
+
+
+//-----------------------------------------------------------------------------
+// ContactSolver - Sequential impulse solver for the contacts of the
+// collision cache.
+//
+// The bodies touched by contacts are copied into an array of solver bodies
+// and the contacts refer to them by index, so the iterations never touch
+// the rigid bodies themselves. The results are written back to the bodies
+// once per step, after the velocity iterations and again after the position
+// iterations.
+//
+// The contacts are dealt into batches as wide as the SIMD lanes (8 with
+// AVX2, 4 with SSE2, or 1), and both modes visit them in the same order, so
+// the wide mode gives the same results as the sequential mode up to
+// rounding. Its position iterations are sequential.
+//
+// The parallel mode instead colors the contacts, keeping their order within
+// each color, and solves the colors one after another for both velocities
+// and positions, splitting each one across the threads of the thread pool.
+// The result doesn't depend on the number of threads.
+//-----------------------------------------------------------------------------
+class ContactSolver
+{
+public:
+	ContactSolver();
+
+	// Getters
+	inline uint32 GetNumBodies() const { return (uint32) m_bodies.size(); }
+	inline uint32 GetNumContacts() const { return (uint32) m_contacts.size(); }
+	inline const Array<SolverBody>& GetBodies() const { return m_bodies; }
+	inline const Array<SolverContact>& GetContacts() const { return m_contacts; }
+	inline uint32 GetNumBatches() const { return (uint32) m_batches.size(); }
+	inline ContactSolverMode GetMode() const { return m_mode; }
+	inline ThreadPool* GetThreadPool() const { return m_threadPool; }
+
+	// Colors of the last step solved in parallel mode
+	inline uint32 GetNumColors() const { return (uint32) m_colors.size(); }
+	inline const ContactColor& GetColor(uint32 index) const { return m_colors[index]; }
+
+	// Number of contacts in a batch, and the instruction set used to solve
+	// them: "avx2", "sse2" or "scalar"
+	static uint32 GetBatchWidth();
+	static const char* GetBatchInstructionSet();
+
+	// Setters
+	inline void SetMode(ContactSolverMode mode) { m_mode = mode; }
+	inline void SetThreadPool(ThreadPool* threadPool) { m_threadPool = threadPool; }
+	inline void SetEnableFriction(bool enableFriction) { m_enableFriction = enableFriction; }
+	inline void SetEnableRestitution(bool enableRestitution) { m_enableRestitution = enableRestitution; }
+	inline void SetEnableWarmStarting(bool enableWarmStarting) { m_enableWarmStarting = enableWarmStarting; }
+
+	// Copy the bodies and contacts of the cached collisions into the solver,
+	// then apply last step's impulses.
+	void Prepare(CollisionCache& cache, float invDT);
+	void SolveVelocities();
+
+	// Write the velocities back to the bodies and the accumulated impulses
+	// back to the contacts.
+	void StoreVelocities();
+
+	// Once the bodies have moved, find the contacts' new penetrations and
+	// push the bodies apart, then write their poses back.
+	void PreparePositions();
+	void SolvePositions();
+	void StorePositions();
+
+	void Clear();
+
+private:
+	uint32 AddBody(RigidBody* body);
+
+	// Reorder the contacts into batches, keeping their order where possible
+	void BuildBatches();
+	void FillBatches();
+
+	// Reorder the contacts by color, keeping their order within each color
+	void BuildColors();
+	void SolveColors(bool positions);
+
+	Array<SolverBody> m_bodies;
+	Array<RigidBody*> m_rigidBodies; // Parallel to the solver bodies
+	Array<SolverContact> m_contacts;
+	Array<ContactBatch> m_batches;
+	Array<uint32> m_batchLanes; // Contact indices while building batches
+	Array<SolverContact> m_unbatchedContacts;
+	Array<ContactColor> m_colors;
+	Array<uint32> m_bodyColors; // Mask of the colors each body is in
+	Array<uint32> m_contactColors; // Color of each contact while building colors
+
+	ContactSolverMode m_mode;
+	ThreadPool* m_threadPool;
+
+	bool m_enableFriction;
+	bool m_enableRestitution;
+	bool m_enableWarmStarting;
+};
+
+
+#endif // _CMG_PHYSICS_CONTACT_SOLVER_H_
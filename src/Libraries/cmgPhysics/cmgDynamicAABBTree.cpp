@@ -0,0 +1,403 @@
+#include "cmgDynamicAABBTree.h"
+#include <cmgMath/cmgMathLib.h>
+
+const int32 DynamicAABBTree::NULL_NODE;
+const uint32 DynamicAABBTree::QUERY_STACK_SIZE;
+const float DynamicAABBTree::DISPLACEMENT_MULTIPLIER = 2.0f;
+
+
+DynamicAABBTree::DynamicAABBTree() :
+	m_root(NULL_NODE),
+	m_freeList(NULL_NODE),
+	m_numProxies(0),
+	m_margin(0.1f)
+{
+}
+
+void DynamicAABBTree::Clear()
+{
+	m_nodes.clear();
+	m_root = NULL_NODE;
+	m_freeList = NULL_NODE;
+	m_numProxies = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Proxies
+//-----------------------------------------------------------------------------
+
+int32 DynamicAABBTree::CreateProxy(const Bounds& bounds, void* userData)
+{
+	int32 proxyId = AllocateNode();
+	Node& node = m_nodes[proxyId];
+	node.bounds = GetFatBounds(bounds, Vector3f::ZERO);
+	node.userData = userData;
+	node.height = 0;
+	InsertLeaf(proxyId);
+	m_numProxies++;
+	return proxyId;
+}
+
+void DynamicAABBTree::DestroyProxy(int32 proxyId)
+{
+	CMG_ASSERT(IsProxy(proxyId));
+	RemoveLeaf(proxyId);
+	FreeNode(proxyId);
+	m_numProxies--;
+}
+
+bool DynamicAABBTree::MoveProxy(int32 proxyId, const Bounds& bounds,
+	const Vector3f& displacement)
+{
+	CMG_ASSERT(IsProxy(proxyId));
+	Bounds fatBounds = GetFatBounds(bounds, displacement);
+
+	// Keep the fat box unless the proxy has left it, or it has become much
+	// larger than needed (after the proxy slows down)
+	const Bounds& oldBounds = m_nodes[proxyId].bounds;
+	if (ContainsBounds(oldBounds, bounds) &&
+		GetSurfaceArea(oldBounds) <= GetSurfaceArea(fatBounds) * 4.0f)
+		return false;
+
+	// Refit in place if the proxy is still inside its parent's box, which
+	// can then only shrink. Otherwise, find a new place in the tree.
+	int32 parent = m_nodes[proxyId].parent;
+	if (parent != NULL_NODE && ContainsBounds(m_nodes[parent].bounds, fatBounds))
+	{
+		m_nodes[proxyId].bounds = fatBounds;
+		Refit(parent);
+	}
+	else
+	{
+		RemoveLeaf(proxyId);
+		m_nodes[proxyId].bounds = fatBounds;
+		InsertLeaf(proxyId);
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Metrics
+//-----------------------------------------------------------------------------
+
+float DynamicAABBTree::GetAreaRatio() const
+{
+	if (m_root == NULL_NODE)
+		return 0.0f;
+	float rootArea = GetSurfaceArea(m_nodes[m_root].bounds);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+	float totalArea = 0.0f;
+	for (uint32 i = 0; i < m_nodes.size(); i++)
+	{
+		if (m_nodes[i].height > 0)
+			totalArea += GetSurfaceArea(m_nodes[i].bounds);
+	}
+	return (totalArea / rootArea);
+}
+
+bool DynamicAABBTree::Validate() const
+{
+	uint32 numLeaves = 0;
+	if (m_root != NULL_NODE)
+	{
+		if (m_nodes[m_root].parent != NULL_NODE ||
+			!ValidateNode(m_root, numLeaves))
+			return false;
+	}
+	if (numLeaves != m_numProxies)
+		return false;
+
+	// Every node is either in the tree or in the free list
+	uint32 numFree = 0;
+	for (int32 index = m_freeList; index != NULL_NODE;
+		index = m_nodes[index].parent)
+	{
+		if (m_nodes[index].height != -1)
+			return false;
+		numFree++;
+	}
+	uint32 numInTree = (numLeaves == 0 ? 0 : (numLeaves * 2) - 1);
+	return (numInTree + numFree == m_nodes.size());
+}
+
+bool DynamicAABBTree::ValidateNode(int32 index, uint32& numLeaves) const
+{
+	const Node& node = m_nodes[index];
+	if (node.IsLeaf())
+	{
+		numLeaves++;
+		return (node.height == 0 && node.child2 == NULL_NODE);
+	}
+
+	const Node& child1 = m_nodes[node.child1];
+	const Node& child2 = m_nodes[node.child2];
+	if (child1.parent != index || child2.parent != index)
+		return false;
+	if (node.height != 1 + Math::Max(child1.height, child2.height))
+		return false;
+	if (!ContainsBounds(node.bounds, child1.bounds) ||
+		!ContainsBounds(node.bounds, child2.bounds))
+		return false;
+	return (ValidateNode(node.child1, numLeaves) &&
+		ValidateNode(node.child2, numLeaves));
+}
+
+float DynamicAABBTree::GetSurfaceArea(const Bounds& bounds)
+{
+	// Half the surface area, which is all the heuristics need
+	Vector3f size = bounds.maxs - bounds.mins;
+	return ((size.x * size.y) + (size.y * size.z) + (size.z * size.x));
+}
+
+bool DynamicAABBTree::ContainsBounds(const Bounds& outer, const Bounds& inner)
+{
+	return (outer.mins.x <= inner.mins.x && outer.mins.y <= inner.mins.y &&
+		outer.mins.z <= inner.mins.z && inner.maxs.x <= outer.maxs.x &&
+		inner.maxs.y <= outer.maxs.y && inner.maxs.z <= outer.maxs.z);
+}
+
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+int32 DynamicAABBTree::AllocateNode()
+{
+	int32 index;
+	if (m_freeList != NULL_NODE)
+	{
+		index = m_freeList;
+		m_freeList = m_nodes[index].parent;
+	}
+	else
+	{
+		index = (int32) m_nodes.size();
+		m_nodes.push_back(Node());
+	}
+
+	Node& node = m_nodes[index];
+	node.userData = nullptr;
+	node.parent = NULL_NODE;
+	node.child1 = NULL_NODE;
+	node.child2 = NULL_NODE;
+	node.height = 0;
+	return index;
+}
+
+void DynamicAABBTree::FreeNode(int32 index)
+{
+	m_nodes[index].parent = m_freeList;
+	m_nodes[index].height = -1;
+	m_freeList = index;
+}
+
+Bounds DynamicAABBTree::GetFatBounds(const Bounds& bounds,
+	const Vector3f& displacement) const
+{
+	Bounds fatBounds = bounds;
+	fatBounds.Expand(m_margin);
+	for (uint32 axis = 0; axis < 3; axis++)
+	{
+		float offset = displacement.v[axis] * DISPLACEMENT_MULTIPLIER;
+		if (offset < 0.0f)
+			fatBounds.mins.v[axis] += offset;
+		else
+			fatBounds.maxs.v[axis] += offset;
+	}
+	return fatBounds;
+}
+
+void DynamicAABBTree::InsertLeaf(int32 leaf)
+{
+	if (m_root == NULL_NODE)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Walk down to the best sibling, choosing at each node between pairing
+	// with the node itself and descending into the cheaper child. Every
+	// ancestor of the new parent grows, which is the inherited cost.
+	Bounds leafBounds = m_nodes[leaf].bounds;
+	int32 index = m_root;
+	while (!m_nodes[index].IsLeaf())
+	{
+		const Node& node = m_nodes[index];
+		float area = GetSurfaceArea(node.bounds);
+		float combinedArea = GetSurfaceArea(Bounds::Union(node.bounds, leafBounds));
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		int32 children[2] = { node.child1, node.child2 };
+		for (uint32 i = 0; i < 2; i++)
+		{
+			const Node& child = m_nodes[children[i]];
+			float childArea = GetSurfaceArea(Bounds::Union(child.bounds, leafBounds));
+			if (!child.IsLeaf())
+				childArea -= GetSurfaceArea(child.bounds);
+			childCosts[i] = childArea + inheritedCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+			break;
+		index = (childCosts[0] < childCosts[1] ? children[0] : children[1]);
+	}
+
+	// Create a new parent for the leaf and its sibling
+	int32 sibling = index;
+	int32 oldParent = m_nodes[sibling].parent;
+	int32 newParent = AllocateNode();
+	Node& parentNode = m_nodes[newParent];
+	parentNode.parent = oldParent;
+	parentNode.bounds = Bounds::Union(leafBounds, m_nodes[sibling].bounds);
+	parentNode.height = m_nodes[sibling].height + 1;
+	parentNode.child1 = sibling;
+	parentNode.child2 = leaf;
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE)
+		m_root = newParent;
+	else if (m_nodes[oldParent].child1 == sibling)
+		m_nodes[oldParent].child1 = newParent;
+	else
+		m_nodes[oldParent].child2 = newParent;
+
+	Refit(newParent);
+}
+
+void DynamicAABBTree::RemoveLeaf(int32 leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = NULL_NODE;
+		return;
+	}
+
+	// Replace the leaf's parent with its sibling
+	int32 parent = m_nodes[leaf].parent;
+	int32 grandparent = m_nodes[parent].parent;
+	int32 sibling = (m_nodes[parent].child1 == leaf ?
+		m_nodes[parent].child2 : m_nodes[parent].child1);
+	m_nodes[sibling].parent = grandparent;
+	m_nodes[leaf].parent = NULL_NODE;
+	FreeNode(parent);
+
+	if (grandparent == NULL_NODE)
+	{
+		m_root = sibling;
+	}
+	else
+	{
+		if (m_nodes[grandparent].child1 == parent)
+			m_nodes[grandparent].child1 = sibling;
+		else
+			m_nodes[grandparent].child2 = sibling;
+		Refit(grandparent);
+	}
+}
+
+void DynamicAABBTree::Refit(int32 index)
+{
+	// Walk up to the root, rotating and then recomputing each ancestor
+	while (index != NULL_NODE)
+	{
+		Rotate(index);
+		Node& node = m_nodes[index];
+		const Node& child1 = m_nodes[node.child1];
+		const Node& child2 = m_nodes[node.child2];
+		node.bounds = Bounds::Union(child1.bounds, child2.bounds);
+		node.height = 1 + Math::Max(child1.height, child2.height);
+		index = node.parent;
+	}
+}
+
+void DynamicAABBTree::Rotate(int32 index)
+{
+	// Node A has children B and C. B and C's children are D, E and F, G. A
+	// child can swap with one of the other child's children (such as B with
+	// F), which changes only the box of the other child (C then holds B and
+	// G). Pick the swap that shrinks that box the most.
+	const Node& a = m_nodes[index];
+	if (a.height < 2)
+		return;
+	int32 b = a.child1;
+	int32 c = a.child2;
+	const Node& nodeB = m_nodes[b];
+	const Node& nodeC = m_nodes[c];
+
+	float bestGain = 0.0f;
+	int32 bestChild = NULL_NODE;
+	int32 bestOther = NULL_NODE;
+	int32 bestGrandchild = NULL_NODE;
+
+	if (!nodeC.IsLeaf())
+	{
+		// B with F or G
+		float areaC = GetSurfaceArea(nodeC.bounds);
+		int32 grandchildren[2] = { nodeC.child1, nodeC.child2 };
+		for (uint32 i = 0; i < 2; i++)
+		{
+			int32 kept = grandchildren[1 - i];
+			float gain = areaC - GetSurfaceArea(Bounds::Union(
+				nodeB.bounds, m_nodes[kept].bounds));
+			if (gain > bestGain)
+			{
+				bestGain = gain;
+				bestChild = b;
+				bestOther = c;
+				bestGrandchild = grandchildren[i];
+			}
+		}
+	}
+	if (!nodeB.IsLeaf())
+	{
+		// C with D or E
+		float areaB = GetSurfaceArea(nodeB.bounds);
+		int32 grandchildren[2] = { nodeB.child1, nodeB.child2 };
+		for (uint32 i = 0; i < 2; i++)
+		{
+			int32 kept = grandchildren[1 - i];
+			float gain = areaB - GetSurfaceArea(Bounds::Union(
+				nodeC.bounds, m_nodes[kept].bounds));
+			if (gain > bestGain)
+			{
+				bestGain = gain;
+				bestChild = c;
+				bestOther = b;
+				bestGrandchild = grandchildren[i];
+			}
+		}
+	}
+
+	if (bestChild != NULL_NODE)
+		SwapWithGrandchild(index, bestChild, bestOther, bestGrandchild);
+}
+
+void DynamicAABBTree::SwapWithGrandchild(int32 index, int32 child,
+	int32 otherChild, int32 grandchild)
+{
+	Node& node = m_nodes[index];
+	if (node.child1 == child)
+		node.child1 = grandchild;
+	else
+		node.child2 = grandchild;
+	m_nodes[grandchild].parent = index;
+
+	Node& other = m_nodes[otherChild];
+	if (other.child1 == grandchild)
+		other.child1 = child;
+	else
+		other.child2 = child;
+	m_nodes[child].parent = otherChild;
+
+	const Node& child1 = m_nodes[other.child1];
+	const Node& child2 = m_nodes[other.child2];
+	other.bounds = Bounds::Union(child1.bounds, child2.bounds);
+	other.height = 1 + Math::Max(child1.height, child2.height);
+}
@@ -0,0 +1,184 @@
+#ifndef _CMG_PHYSICS_DYNAMIC_AABB_TREE_H_
+#define _CMG_PHYSICS_DYNAMIC_AABB_TREE_H_
+
+#include <cmgCore/containers/cmgArray.h>
+#include <cmgMath/geometry/cmgBounds.h>
+
+
+//-----------------------------------------------------------------------------
+// DynamicAABBTree - A bounding volume hierarchy of axis-aligned boxes that
+// supports adding, removing and moving proxies each frame.
+//
+// Each proxy is a leaf storing a fattened box: the box given by the user
+// grown by a margin and stretched along its displacement, so small movements
+// don't change the tree at all. When a proxy leaves its fat box, it is
+// refitted in place if it still fits inside its parent's box, or else removed
+// and re-inserted. Leaves are inserted by the surface area heuristic, and
+// tree rotations are applied on the way back up to keep the tree tight.
+//
+// Proxy IDs are node indices, which are reused after a proxy is destroyed.
+//-----------------------------------------------------------------------------
+class DynamicAABBTree
+{
+public:
+	static const int32 NULL_NODE = -1;
+
+	// Fat boxes are stretched by this many times the displacement passed
+	// to MoveProxy
+	static const float DISPLACEMENT_MULTIPLIER;
+
+public:
+	DynamicAABBTree();
+
+	void Clear();
+
+	int32 CreateProxy(const Bounds& bounds, void* userData);
+	void DestroyProxy(int32 proxyId);
+
+	// Update a proxy's box, returning true if its fat box changed
+	bool MoveProxy(int32 proxyId, const Bounds& bounds,
+		const Vector3f& displacement);
+
+	// Call the callback with the ID of each proxy whose fat box overlaps the
+	// given bounds. The callback returns false to stop the query.
+	template <class T_Callback>
+	void Query(const Bounds& bounds, T_Callback callback) const;
+
+	// Depth-first traversal for custom queries, such as ray casts. The node
+	// test is called with the box of each node reached, and only nodes that
+	// pass it are descended into. For leaves that pass, the callback is
+	// called right after with the proxy ID, and returns false to stop.
+	template <class T_NodeTest, class T_Callback>
+	void Traverse(T_NodeTest nodeTest, T_Callback callback) const;
+
+	// Getters
+	inline void* GetUserData(int32 proxyId) const { return m_nodes[proxyId].userData; }
+	inline const Bounds& GetFatBounds(int32 proxyId) const { return m_nodes[proxyId].bounds; }
+	inline bool IsProxy(int32 id) const { return (m_nodes[id].height == 0); }
+	inline uint32 GetNumProxies() const { return m_numProxies; }
+	inline uint32 GetNodeCapacity() const { return (uint32) m_nodes.size(); }
+	inline int32 GetHeight() const { return (m_root == NULL_NODE ? 0 : m_nodes[m_root].height); }
+	inline float GetMargin() const { return m_margin; }
+
+	// Total surface area of the internal nodes relative to the root. Lower
+	// is better.
+	float GetAreaRatio() const;
+
+	// Check the links, heights and bounds of every node
+	bool Validate() const;
+
+	// Setters
+	inline void SetMargin(float margin) { m_margin = margin; }
+
+	static float GetSurfaceArea(const Bounds& bounds);
+	static bool ContainsBounds(const Bounds& outer, const Bounds& inner);
+
+private:
+	static const uint32 QUERY_STACK_SIZE = 256;
+
+	// Same as Bounds::Intersects, but inlined for queries
+	static inline bool TestOverlap(const Bounds& a, const Bounds& b)
+	{
+		return (a.mins.x < b.maxs.x && b.mins.x < a.maxs.x &&
+			a.mins.y < b.maxs.y && b.mins.y < a.maxs.y &&
+			a.mins.z < b.maxs.z && b.mins.z < a.maxs.z);
+	}
+
+	struct Node
+	{
+		// The fat box for leaves, or the union of the children
+		Bounds bounds;
+		void* userData;
+
+		// Next free node when this node is free
+		int32 parent;
+		int32 child1;
+		int32 child2;
+
+		// Zero for leaves, -1 for free nodes
+		int32 height;
+
+		inline bool IsLeaf() const { return (child1 == NULL_NODE); }
+	};
+
+	int32 AllocateNode();
+	void FreeNode(int32 index);
+	Bounds GetFatBounds(const Bounds& bounds, const Vector3f& displacement) const;
+
+	void InsertLeaf(int32 leaf);
+	void RemoveLeaf(int32 leaf);
+	void Refit(int32 index);
+	void Rotate(int32 index);
+	void SwapWithGrandchild(int32 index, int32 child,
+		int32 otherChild, int32 grandchild);
+	bool ValidateNode(int32 index, uint32& numLeaves) const;
+
+	Array<Node> m_nodes;
+	int32 m_root;
+	int32 m_freeList;
+	uint32 m_numProxies;
+	float m_margin;
+};
+
+
+template <class T_Callback>
+void DynamicAABBTree::Query(const Bounds& bounds, T_Callback callback) const
+{
+	Traverse(
+		[&bounds](const Bounds& nodeBounds) {
+			return TestOverlap(nodeBounds, bounds);
+		},
+		callback);
+}
+
+template <class T_NodeTest, class T_Callback>
+void DynamicAABBTree::Traverse(T_NodeTest nodeTest, T_Callback callback) const
+{
+	if (m_root == NULL_NODE)
+		return;
+
+	// Depth-first search with a fixed stack, spilling over into an array
+	// for unusually deep trees
+	int32 stack[QUERY_STACK_SIZE];
+	uint32 stackSize = 0;
+	Array<int32> overflow;
+	stack[stackSize++] = m_root;
+
+	while (stackSize > 0 || !overflow.empty())
+	{
+		int32 index;
+		if (!overflow.empty())
+		{
+			index = overflow.back();
+			overflow.pop_back();
+		}
+		else
+		{
+			index = stack[--stackSize];
+		}
+
+		const Node& node = m_nodes[index];
+		if (!nodeTest(node.bounds))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (!callback(index))
+				return;
+		}
+		else
+		{
+			int32 children[2] = { node.child1, node.child2 };
+			for (uint32 i = 0; i < 2; i++)
+			{
+				if (overflow.empty() && stackSize < QUERY_STACK_SIZE)
+					stack[stackSize++] = children[i];
+				else
+					overflow.push_back(children[i]);
+			}
+		}
+	}
+}
+
+
+#endif // _CMG_PHYSICS_DYNAMIC_AABB_TREE_H_
@@ -189,6 +189,322 @@ bool GJK::DoSimplex(Simplex& simplex, Vector3f& direction)
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// GJK ray casting
+//-----------------------------------------------------------------------------
+
+// "Ray Casting against General Convex Objects with Application to Continuous
+// Collision Detection", Gino van den Bergen, 2004
+
+namespace
+{
+	const unsigned int CAST_MAX_ITERATIONS = 64;
+
+	// Stop once the distance to the Minkowski difference is this small,
+	// relative to the size of the simplex
+	const float CAST_TOLERANCE = 1.0e-5f;
+
+	struct CastVertex
+	{
+		Vector3f p; // Support point on the Minkowski difference (B - A)
+		Vector3f b; // Support point on B
+	};
+
+	// The point on a simplex closest to the origin, as weights of the
+	// vertices needed to reach it
+	struct SimplexPoint
+	{
+		unsigned int numIndices;
+		unsigned int indices[4];
+		float weights[4];
+		float distSqr;
+
+		inline void Set(const Vector3f* y, unsigned int index)
+		{
+			numIndices = 1;
+			indices[0] = index;
+			weights[0] = 1.0f;
+			distSqr = y[index].LengthSquared();
+		}
+
+		inline void Set(const Vector3f* y, unsigned int ia, unsigned int ib, float t)
+		{
+			numIndices = 2;
+			indices[0] = ia;
+			indices[1] = ib;
+			weights[0] = 1.0f - t;
+			weights[1] = t;
+			distSqr = GetPoint(y).LengthSquared();
+		}
+
+		inline Vector3f GetPoint(const Vector3f* y) const
+		{
+			Vector3f point = Vector3f::ZERO;
+			for (unsigned int i = 0; i < numIndices; ++i)
+				point += y[indices[i]] * weights[i];
+			return point;
+		}
+	};
+
+	void ClosestOnSegment(const Vector3f* y, unsigned int ia,
+		unsigned int ib, SimplexPoint& result)
+	{
+		Vector3f ab = y[ib] - y[ia];
+		float t = -y[ia].Dot(ab);
+		float denom = ab.LengthSquared();
+		if (t <= 0.0f)
+			result.Set(y, ia);
+		else if (t >= denom)
+			result.Set(y, ib);
+		else
+			result.Set(y, ia, ib, t / denom);
+	}
+
+	// Real-Time Collision Detection, Christer Ericson, 5.1.5
+	void ClosestOnTriangle(const Vector3f* y, unsigned int ia,
+		unsigned int ib, unsigned int ic, SimplexPoint& result)
+	{
+		const Vector3f& a = y[ia];
+		const Vector3f& b = y[ib];
+		const Vector3f& c = y[ic];
+		Vector3f ab = b - a;
+		Vector3f ac = c - a;
+
+		float d1 = -ab.Dot(a);
+		float d2 = -ac.Dot(a);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return result.Set(y, ia);
+
+		float d3 = -ab.Dot(b);
+		float d4 = -ac.Dot(b);
+		if (d3 >= 0.0f && d4 <= d3)
+			return result.Set(y, ib);
+
+		float vc = (d1 * d4) - (d3 * d2);
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return result.Set(y, ia, ib, d1 / (d1 - d3));
+
+		float d5 = -ab.Dot(c);
+		float d6 = -ac.Dot(c);
+		if (d6 >= 0.0f && d5 <= d6)
+			return result.Set(y, ic);
+
+		float vb = (d5 * d2) - (d1 * d6);
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return result.Set(y, ia, ic, d2 / (d2 - d6));
+
+		float va = (d3 * d6) - (d5 * d4);
+		if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+			return result.Set(y, ib, ic, (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+		float sum = va + vb + vc;
+		if (sum <= 0.0f)
+		{
+			// Degenerate triangle, so use the closest edge
+			SimplexPoint edge;
+			ClosestOnSegment(y, ia, ib, result);
+			ClosestOnSegment(y, ia, ic, edge);
+			if (edge.distSqr < result.distSqr)
+				result = edge;
+			ClosestOnSegment(y, ib, ic, edge);
+			if (edge.distSqr < result.distSqr)
+				result = edge;
+			return;
+		}
+
+		result.numIndices = 3;
+		result.indices[0] = ia;
+		result.indices[1] = ib;
+		result.indices[2] = ic;
+		result.weights[1] = vb / sum;
+		result.weights[2] = vc / sum;
+		result.weights[0] = 1.0f - result.weights[1] - result.weights[2];
+		result.distSqr = result.GetPoint(y).LengthSquared();
+	}
+
+	// Real-Time Collision Detection, Christer Ericson, 5.1.6
+	void ClosestOnTetrahedron(const Vector3f* y, SimplexPoint& result)
+	{
+		static const unsigned int FACES[4][4] = {
+			{ 0, 1, 2, 3 },
+			{ 0, 2, 3, 1 },
+			{ 0, 3, 1, 2 },
+			{ 1, 3, 2, 0 },
+		};
+
+		bool inside = true;
+		result.distSqr = FLT_MAX;
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			// Test the faces the origin is outside of. Faces of a flat
+			// tetrahedron are always tested.
+			const unsigned int* face = FACES[i];
+			Vector3f normal = Vector3f::Cross(
+				y[face[1]] - y[face[0]], y[face[2]] - y[face[0]]);
+			float signOrigin = -normal.Dot(y[face[0]]);
+			float signOpposite = normal.Dot(y[face[3]] - y[face[0]]);
+			if (signOrigin * signOpposite > 0.0f)
+				continue;
+
+			inside = false;
+			SimplexPoint facePoint;
+			ClosestOnTriangle(y, face[0], face[1], face[2], facePoint);
+			if (facePoint.distSqr < result.distSqr)
+				result = facePoint;
+		}
+
+		if (inside)
+		{
+			// The origin is inside, so find its barycentric coordinates
+			Vector3f ab = y[1] - y[0];
+			Vector3f ac = y[2] - y[0];
+			Vector3f ad = y[3] - y[0];
+			Vector3f ap = -y[0];
+			float volume = ab.Dot(ac.Cross(ad));
+			result.numIndices = 4;
+			for (unsigned int i = 0; i < 4; ++i)
+				result.indices[i] = i;
+			result.weights[1] = ap.Dot(ac.Cross(ad)) / volume;
+			result.weights[2] = ab.Dot(ap.Cross(ad)) / volume;
+			result.weights[3] = ab.Dot(ac.Cross(ap)) / volume;
+			result.weights[0] = 1.0f - result.weights[1] -
+				result.weights[2] - result.weights[3];
+			result.distSqr = 0.0f;
+		}
+	}
+
+	CastVertex GetCastSupport(const Collider* shapeA,
+		const Collider* shapeB, const Vector3f& direction)
+	{
+		CastVertex vertex;
+		vertex.b = shapeB->GetSupportPoint(direction);
+		vertex.p = vertex.b;
+		if (shapeA != nullptr)
+			vertex.p -= shapeA->GetSupportPoint(-direction);
+		return vertex;
+	}
+}
+
+bool GJK::Cast(
+	const Collider* shapeA,
+	const Collider* shapeB,
+	const Vector3f& origin,
+	const Vector3f& direction,
+	float& inOutDistance,
+	Vector3f& outNormal,
+	Vector3f* outPoint)
+{
+	// March the point x = origin + (direction * distance) towards the
+	// Minkowski difference C = B - A, which A touches B when x is inside of.
+	// Each time the support plane in the direction of the closest point
+	// separates x from C, x is advanced onto that plane.
+	float distance = 0.0f;
+	Vector3f x = origin;
+	Vector3f normal = Vector3f::ZERO;
+
+	CastVertex vertices[4];
+	Vector3f y[4];
+	unsigned int numVertices = 0;
+	SimplexPoint closest;
+	closest.numIndices = 0;
+
+	Vector3f v = x - GetCastSupport(shapeA, shapeB, (direction.LengthSquared() > 0.0f ?
+		-direction : Vector3f::UNITX)).p;
+
+	for (unsigned int iteration = 0; iteration < CAST_MAX_ITERATIONS; ++iteration)
+	{
+		if (v.LengthSquared() == 0.0f)
+			break;
+
+		CastVertex vertex = GetCastSupport(shapeA, shapeB, v);
+		Vector3f w = x - vertex.p;
+		float vw = v.Dot(w);
+		bool advanced = false;
+		if (vw > 0.0f)
+		{
+			// The support plane separates x from C
+			float vr = v.Dot(direction);
+			if (vr >= 0.0f)
+				return false;
+			distance -= vw / vr;
+			if (distance >= inOutDistance)
+				return false;
+			x = origin + (direction * distance);
+			normal = v;
+			advanced = true;
+		}
+
+		// Stop when the new support point is already in the simplex, unless
+		// x moved and the closest point needs to be found again
+		bool duplicate = false;
+		float maxLengthSqr = 0.0f;
+		for (unsigned int i = 0; i < numVertices; ++i)
+		{
+			if ((vertices[i].p - vertex.p).LengthSquared() <= FLT_EPSILON *
+				Math::Max(1.0f, vertex.p.LengthSquared()))
+				duplicate = true;
+		}
+		if (!duplicate)
+			vertices[numVertices++] = vertex;
+		else if (!advanced)
+			break;
+
+		// Find the closest point to the origin on the simplex of x - p,
+		// and keep only the vertices needed to reach it
+		for (unsigned int i = 0; i < numVertices; ++i)
+		{
+			y[i] = x - vertices[i].p;
+			maxLengthSqr = Math::Max(maxLengthSqr, y[i].LengthSquared());
+		}
+		if (numVertices == 1)
+			closest.Set(y, 0);
+		else if (numVertices == 2)
+			ClosestOnSegment(y, 0, 1, closest);
+		else if (numVertices == 3)
+			ClosestOnTriangle(y, 0, 1, 2, closest);
+		else
+			ClosestOnTetrahedron(y, closest);
+
+		v = closest.GetPoint(y);
+		CastVertex reduced[4];
+		for (unsigned int i = 0; i < closest.numIndices; ++i)
+		{
+			reduced[i] = vertices[closest.indices[i]];
+			closest.indices[i] = i;
+		}
+		numVertices = closest.numIndices;
+		for (unsigned int i = 0; i < numVertices; ++i)
+			vertices[i] = reduced[i];
+
+		if (numVertices == 4 || closest.distSqr <=
+			CAST_TOLERANCE * CAST_TOLERANCE * maxLengthSqr)
+			break;
+	}
+
+	// Shapes that start out touching have no normal
+	if (normal.LengthSquared() > 0.0f)
+		outNormal = Vector3f::Normalize(normal);
+	else if (direction.LengthSquared() > 0.0f)
+		outNormal = -Vector3f::Normalize(direction);
+	else
+		outNormal = Vector3f::ZERO;
+	inOutDistance = distance;
+
+	if (outPoint != nullptr)
+	{
+		if (closest.numIndices == 0)
+		{
+			*outPoint = GetCastSupport(shapeA, shapeB, -outNormal).b;
+		}
+		else
+		{
+			*outPoint = Vector3f::ZERO;
+			for (unsigned int i = 0; i < closest.numIndices; ++i)
+				*outPoint += vertices[i].b * closest.weights[i];
+		}
+	}
+	return true;
+}
 
 
 
@@ -365,7 +681,7 @@ PolytopeFace* Polytope::FindFaceClosestOrigin()
 }
 
 
-void EPA::Barycentric(
+bool EPA::Barycentric(
 	const Vector3f& p, const Vector3f& a,
 	const Vector3f& b, const Vector3f& c,
 	float* u, float* v, float* w)
@@ -378,9 +694,12 @@ void EPA::Barycentric(
      float d20 = v2.Dot(v0);
      float d21 = v2.Dot(v1);
      float denom = d00 * d11 - d01 * d01;
+     if (denom <= FLT_EPSILON * d00 * d11)
+         return false;
      *v = (d11 * d20 - d01 * d21) / denom;
      *w = (d00 * d21 - d01 * d20) / denom;
      *u = 1.0f - *v - *w;
+     return true;
 }
 
 
@@ -420,10 +739,12 @@ EPAResult EPA::PerformEPA(Collider* shapeA, Collider* shapeB, const Simplex& gjk
 			// assume that we cannot expand the simplex any further and
 			// we have our solution.
 
+			// A sliver face has no contact point to interpolate.
 			float baryCoords[3];
-			EPA::Barycentric(face->normal * face->distToOrigin,
+			if (!EPA::Barycentric(face->normal * face->distToOrigin,
 				face->p0->p, face->p1->p, face->p2->p,
-				baryCoords + 0, baryCoords + 1, baryCoords + 2);
+				baryCoords + 0, baryCoords + 1, baryCoords + 2))
+				break;
 			result.contactPointA =
 				(face->p0->a * baryCoords[0] +
 				face->p1->a * baryCoords[1] +
@@ -61,6 +61,21 @@ public:
 		Collider* shapeA, Collider* shapeB);
 
 	static bool DoSimplex(Simplex& simplex, Vector3f& direction);
+
+	// Sweep shape A, offset by the origin, along the direction until it
+	// touches shape B, using GJK ray casting against the Minkowski
+	// difference. With a null shape A, this casts a ray from the origin
+	// instead. Only hits closer than inOutDistance are reported, and
+	// shapes that already touch hit at distance zero. The normal points from
+	// B towards A, and the point is the point of contact on B.
+	static bool Cast(
+		const Collider* shapeA,
+		const Collider* shapeB,
+		const Vector3f& origin,
+		const Vector3f& direction,
+		float& inOutDistance,
+		Vector3f& outNormal,
+		Vector3f* outPoint = nullptr);
 };
 
 
@@ -144,7 +159,8 @@ public:
 		const Simplex& gjkTerminationSimplex);
 
 private:
-	static void Barycentric(
+	// Returns false if the triangle is degenerate
+	static bool Barycentric(
 		const Vector3f& p, const Vector3f& a,
 		const Vector3f& b, const Vector3f& c,
 		float* u, float* v, float* w);
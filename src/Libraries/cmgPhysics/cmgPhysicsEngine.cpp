@@ -2,6 +2,9 @@
 #include <cmgMath/cmgMathLib.h>
 #include <cmgMath/geometry/cmgPlane.h>
 #include <cmgMath/geometry/cmgRay.h>
+#include <cmgPhysics/broadphase/cmgAABBTreeBroadphase.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <algorithm>
 
 
 PhysicsEngine::PhysicsEngine() :
@@ -9,13 +12,21 @@ PhysicsEngine::PhysicsEngine() :
 	m_idCounter(0),
 	m_enableFriction(true),
 	m_enableRestitution(true),
+	m_enableWarmStarting(true),
 	m_numIterations(1),
 	m_profiler("Physics"),
 	m_velocityIterations(6),
-	m_positionIterations(3)
-
+	m_positionIterations(3),
+	m_sceneQueriesDirty(false),
+	m_enableSleeping(true),
+	m_linearSleepThreshold(0.05f),
+	m_angularSleepThreshold(0.05f),
+	m_timeToSleep(0.5f),
+	m_numIslands(0),
+	m_threadPool(nullptr)
 {
 	m_gravity = Vector3f::DOWN * 9.81f;
+	m_broadphase = new AABBTreeBroadphase();
 }
 
 PhysicsEngine::~PhysicsEngine()
@@ -23,6 +34,7 @@ PhysicsEngine::~PhysicsEngine()
 	for (unsigned int i = 0; i < m_bodies.size(); ++i)
 		delete m_bodies[i];
 	m_bodies.clear();
+	delete m_broadphase;
 }
 
 
@@ -37,6 +49,17 @@ void PhysicsEngine::Initialize()
 // Getters
 //-----------------------------------------------------------------------------
 
+unsigned int PhysicsEngine::GetNumAwakeBodies() const
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < m_bodies.size(); ++i)
+	{
+		if (m_bodies[i]->m_isAwake && m_bodies[i]->m_inverseMass != 0.0f)
+			count++;
+	}
+	return count;
+}
+
 
 //-----------------------------------------------------------------------------
 // Setters
@@ -47,14 +70,43 @@ void PhysicsEngine::SetGravity(const Vector3f& gravity)
 	m_gravity = gravity;
 }
 
+void PhysicsEngine::SetSleepThresholds(float linearSpeed, float angularSpeed)
+{
+	m_linearSleepThreshold = linearSpeed;
+	m_angularSleepThreshold = angularSpeed;
+}
+
+void PhysicsEngine::SetEnableSleeping(bool enableSleeping)
+{
+	m_enableSleeping = enableSleeping;
+	if (!enableSleeping)
+	{
+		for (unsigned int i = 0; i < m_bodies.size(); ++i)
+			m_bodies[i]->WakeUp();
+	}
+}
+
+void PhysicsEngine::SetBroadphase(Broadphase* broadphase)
+{
+	delete m_broadphase;
+	m_broadphase = broadphase;
+
+	// Proxies are created in the new broadphase on the next step
+	for (unsigned int i = 0; i < m_bodies.size(); ++i)
+		m_bodies[i]->m_proxyId = -1;
+}
+
 
 void PhysicsEngine::AddBody(RigidBody* body)
 {
 	body->CalcInertia();
 	m_bodies.push_back(body);
 	body->m_id = m_idCounter;
+	body->m_proxyId = -1;
 	m_idCounter++;
 	body->m_physicsEngine = this;
+	body->CalculateDerivedData();
+	MarkSceneQueryDirty(body);
 }
 
 void PhysicsEngine::ClearBodies()
@@ -66,6 +118,10 @@ void PhysicsEngine::ClearBodies()
 	m_idCounter = 0;
 
 	m_collisionCache.Clear();
+	m_broadphase->Clear();
+	m_sceneQuery.Clear();
+	m_sceneQueryBodies.clear();
+	m_sceneQueriesDirty = false;
 }
 
 void PhysicsEngine::RemoveBody(RigidBody* body)
@@ -73,6 +129,19 @@ void PhysicsEngine::RemoveBody(RigidBody* body)
 	auto it = std::find(m_bodies.begin(), m_bodies.end(), body);
 	if (it != m_bodies.end())
 	{
+		// Bodies that were resting on this one must fall.
+		body->WakeUp();
+		WakeTouchingBodies(body);
+
+		if (body->m_proxyId >= 0)
+			m_broadphase->DestroyProxy(body->m_proxyId);
+		RemoveFromSceneQueries(body);
+		if (body->m_isSceneQueryDirty)
+		{
+			m_sceneQueryBodies.erase(std::find(m_sceneQueryBodies.begin(),
+				m_sceneQueryBodies.end(), body));
+		}
+		m_collisionCache.RemoveCollisions(body);
 		m_bodies.erase(it);
 		delete body;
 	}
@@ -81,18 +150,17 @@ void PhysicsEngine::RemoveBody(RigidBody* body)
 void PhysicsEngine::Simulate(float timeDelta)
 {
 	ProfileSection* profileIntegration = m_profiler.GetSubSection("Integration");
+	ProfileSection* profileBroadphase = m_profiler.GetSubSection("Broadphase");
 	ProfileSection* profileDetection = m_profiler.GetSubSection("Collision Detection");
 	ProfileSection* profilePositionalCorrection = m_profiler.GetSubSection("Positional Correction");
 	ProfileSection* profileResponse = m_profiler.GetSubSection("Collision Response");
+	ProfileSection* profileIslands = m_profiler.GetSubSection("Islands");
 
 	m_profiler.Reset();
 	m_profiler.StartInvocation();
 
 	unsigned int i, j;
 	RigidBody *body;
-	CollisionData collisionData;
-	CollisionData cachedCollision;
-	//CollisionData* collision;
 
 	timeDelta /= (float) m_numIterations;
 
@@ -105,7 +173,8 @@ void PhysicsEngine::Simulate(float timeDelta)
 	for (i = 0; i < m_bodies.size(); ++i)
 	{
 		body = m_bodies[i];
-		body->CalculateDerivedData();
+		if (body->m_isAwake)
+			body->CalculateDerivedData();
 	}
 
 	// Integrate velocities.
@@ -113,6 +182,10 @@ void PhysicsEngine::Simulate(float timeDelta)
 	for (i = 0; i < m_bodies.size(); ++i)
 	{
 		body = m_bodies[i];
+		if (!body->m_isAwake)
+			continue;
+		body->m_previousPosition = body->m_position;
+		body->m_previousOrientation = body->m_orientation;
 
 		//body->IntegrateLinear(timeDelta);
 		//body->IntegrateAngular(timeDelta);
@@ -124,45 +197,29 @@ void PhysicsEngine::Simulate(float timeDelta)
 	}
 	profileIntegration->StopInvocation();
 
+	// Find pairs of bodies that might be touching.
+	profileBroadphase->StartInvocation();
+	UpdateBroadphase(timeDelta);
+	profileBroadphase->StopInvocation();
+
 	// Detect collisions.
 	profileDetection->StartInvocation();
 	m_collisionCache.RefreshContacts();
-	for (i = 0; i < m_bodies.size(); ++i)
-	{
-		for (j = i + 1; j < m_bodies.size(); ++j)
-		{
-			m_collisionDetector.DetectCollision(
-				m_bodies[i], m_bodies[j], &collisionData);
-
-			if (collisionData.numContacts > 0)
-			{
-				collisionData.CalcInternals();
-				m_collisionCache.UpdateCollision(collisionData);
-			}
-		}
-	}
+	m_collisionCache.MarkCollisionsAsInactive();
+	DetectCollisions();
 	m_collisionCache.RemoveInactiveCollisions();
 	profileDetection->StopInvocation();
 
 	// Solve velocity constraints.
 	profileResponse->StartInvocation();
+	m_contactSolver.SetEnableFriction(m_enableFriction);
+	m_contactSolver.SetEnableRestitution(m_enableRestitution);
+	m_contactSolver.SetEnableWarmStarting(m_enableWarmStarting);
+	m_contactSolver.SetThreadPool(m_threadPool);
+	m_contactSolver.Prepare(m_collisionCache, invDT);
 	for (j = 0; j < m_velocityIterations; ++j)
-	{
-		for (auto it = m_collisionCache.collisions_begin();
-			it != m_collisionCache.collisions_end(); ++it)
-		{
-			SolveCollision(&it->second);
-			//collision->CalcInternals();
-			//SolveCollision(collision);
-		}
-		//for (i = 0; i < m_bodies.size(); ++i)
-		//{
-		//	body = m_bodies[i];
-		//	body->m_velocity += body->m_velocityAccumulator;
-		//	body->m_angularVelocity += body->m_angularVelocityAccumulator;
-		//	body->ClearAccumulators();
-		//}
-	}
+		m_contactSolver.SolveVelocities();
+	m_contactSolver.StoreVelocities();
 	profileResponse->StopInvocation();
 
 	// Integrate positions.
@@ -170,188 +227,273 @@ void PhysicsEngine::Simulate(float timeDelta)
 	for (i = 0; i < m_bodies.size(); ++i)
 	{
 		body = m_bodies[i];
+		if (!body->m_isAwake)
+			continue;
 		body->IntegrateLinear(timeDelta);
 		body->IntegrateAngular(timeDelta);
 		body->CalculateDerivedData();
 		body->ClearAccumulators();
+
+		// Only bodies with mass are moved by the contact solver, and static
+		// bodies only move with a velocity.
+		if (body->m_inverseMass != 0.0f ||
+			body->m_velocity.LengthSquared() > 0.0f ||
+			body->m_angularVelocity.LengthSquared() > 0.0f)
+			MarkSceneQueryDirty(body);
 	}
 	profileIntegration->StopInvocation();
 
 	// Solve position constraints.
 	profilePositionalCorrection->StartInvocation();
+	m_contactSolver.PreparePositions();
 	for (j = 0; j < m_positionIterations; ++j)
-	{
-		for (auto it = m_collisionCache.collisions_begin();
-			it != m_collisionCache.collisions_end(); ++it)
-		{
-			PositionalCorrection(&it->second, invDT);
-		}
-	}
+		m_contactSolver.SolvePositions();
+	m_contactSolver.StorePositions();
 	profilePositionalCorrection->StopInvocation();
 
-	for (i = 0; i < m_bodies.size(); ++i)
-	{
-		body = m_bodies[i];
-		body->CalculateDerivedData();
-	}
+	// Put resting islands to sleep.
+	profileIslands->StartInvocation();
+	UpdateIslands(timeDelta);
+	profileIslands->StopInvocation();
 
 	}
 	m_profiler.StopInvocation();
 }
 
-void PhysicsEngine::SolveCollision(CollisionData* collision)
+void PhysicsEngine::UpdateBroadphase(float timeDelta)
 {
-	for (unsigned int i = 0; i < collision->numContacts; ++i)
+	// Fit each body's proxy to its colliders, stretched by how far it will
+	// move this step. Bodies without colliders get no proxy.
+	for (unsigned int i = 0; i < m_bodies.size(); ++i)
 	{
-		/*
-		// NOTE: the contact normal will always face TOWARD body A.
-		Contact& contact = collision->contacts[i];
-		Vector3f contactNormal = contact.contactNormal;
+		RigidBody* body = m_bodies[i];
+
+		// Sleeping bodies don't move, and are static to the broadphase so
+		// that they only pair with awake bodies. Bodies without mass are
+		// static too unless they have a velocity, so that moving platforms
+		// still find and wake the sleeping bodies they touch.
+		bool isMoving = (body->m_velocity.LengthSquared() > 0.0f ||
+			body->m_angularVelocity.LengthSquared() > 0.0f);
+		bool isStatic = (!body->m_isAwake ||
+			(body->m_inverseMass == 0.0f && !isMoving));
+		if (body->m_colliders.empty())
+		{
+			if (body->m_proxyId >= 0)
+			{
+				m_broadphase->DestroyProxy(body->m_proxyId);
+				body->m_proxyId = -1;
+			}
+		}
+		else if (body->m_proxyId < 0)
+		{
+			body->m_proxyId = m_broadphase->CreateProxy(
+				body->GetBounds(), body, isStatic);
+		}
+		else
+		{
+			m_broadphase->SetProxyStatic(body->m_proxyId, isStatic);
+			if (body->m_isAwake)
+			{
+				m_broadphase->MoveProxy(body->m_proxyId, body->GetBounds(),
+					body->m_velocity * timeDelta);
+			}
+		}
+	}
 
-		// TEMP: temp stuff.
-		float restitution = 0.0f;
-		
-		// Calculate the contact point's position relative to each body's center of mass.
-		Vector3f ra = contact.contactPoint - contact.bodyA->m_position;
-		Vector3f rb = contact.contactPoint - contact.bodyB->m_position;
-
-		// Calculate the velocity of the contact along its normal.
-		// This is also called the closing speed.
-		Vector3f relativeVelocity =
-			(contact.bodyB->GetVelocity() + contact.bodyB->m_angularVelocity.Cross(rb)) - 
-			(contact.bodyA->GetVelocity() + contact.bodyA->m_angularVelocity.Cross(ra));
-		float contactVelocity = relativeVelocity.Dot(contactNormal);
-		
-		Vector3f contactPlanarVelocity = relativeVelocity - (contactNormal * contactVelocity);
-		//contactPlanarVelocity.Normalize();
+	m_broadphase->UpdatePairs();
+}
 
-		// Do not resolve if objects are separating (closing speed < 0).
-		if (contactVelocity < 0)
-			continue;
+void PhysicsEngine::DetectCollisions()
+{
+	// Pairs tested by each call of the parallel loop
+	const unsigned int pairsPerTask = 16;
+
+	// Each thread writes the collisions it finds to its own buffer.
+	const Array<BroadphasePair>& pairs = m_broadphase->GetPairs();
+	unsigned int numThreads = (m_threadPool != nullptr ?
+		m_threadPool->GetNumThreads() : 1);
+	if (m_threadCollisions.size() < numThreads)
+		m_threadCollisions.resize(numThreads);
+	for (unsigned int i = 0; i < m_threadCollisions.size(); ++i)
+		m_threadCollisions[i].clear();
+
+	auto detectCollisions = [&](unsigned int begin, unsigned int end,
+		Array<CollisionData>& collisions)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			// Keep bodies in the order they were added.
+			RigidBody* bodyA = (RigidBody*) m_broadphase->GetUserData(pairs[i].proxyA);
+			RigidBody* bodyB = (RigidBody*) m_broadphase->GetUserData(pairs[i].proxyB);
+			if (bodyA->m_id > bodyB->m_id)
+				std::swap(bodyA, bodyB);
+
+			collisions.push_back(CollisionData());
+			m_collisionDetector.DetectCollision(bodyA, bodyB, &collisions.back());
+			if (collisions.back().numContacts == 0)
+				collisions.pop_back();
+		}
+	};
 
-		// Calculate the change in contact velocity per unit impulse.
-		// This has linear and angular components.
-		float velocityChangePerUnitImpulse = 0.0f;
-		Vector3f deltaVelWorld = (contact.bodyA->m_inverseInertiaTensorWorld *
-			ra.Cross(contactNormal)).Cross(ra);
-		velocityChangePerUnitImpulse += deltaVelWorld.Dot(contactNormal);
-		velocityChangePerUnitImpulse += contact.bodyA->m_inverseMass;
-		deltaVelWorld = (contact.bodyB->m_inverseInertiaTensorWorld *
-			rb.Cross(contactNormal)).Cross(rb);
-		velocityChangePerUnitImpulse += deltaVelWorld.Dot(contactNormal);
-		velocityChangePerUnitImpulse += contact.bodyB->m_inverseMass;
-
-		// Calculate the desired contact velocity after applying the impulse.
-		float desiredDeltaVelocity = -contactVelocity * (1.0f + restitution);
-		
-		// Now calculate the impulse.
-		// This acts in the opposite direction of the contact normal.
-		float impulseScalar = desiredDeltaVelocity / velocityChangePerUnitImpulse;
-		//impulseScalar /= (float) collision->numContacts;
-		Vector3f impulse = contactNormal * impulseScalar;
+	unsigned int numPairs = pairs.size();
+	unsigned int numTasks = (numPairs + pairsPerTask - 1) / pairsPerTask;
+	if (m_threadPool != nullptr && numTasks > 1)
+	{
+		m_threadPool->ParallelFor(numTasks,
+			[&](uint32 index, uint32 threadIndex) {
+			unsigned int begin = index * pairsPerTask;
+			detectCollisions(begin, Math::Min(begin + pairsPerTask, numPairs),
+				m_threadCollisions[threadIndex]);
+		});
+	}
+	else
+	{
+		detectCollisions(0, numPairs, m_threadCollisions[0]);
+	}
 
-		//float dynamicDriction = 0.6f;
-		//impulse += -contactPlanarVelocity * dynamicDriction * impulseScalar;
-		//impulse += -contactPlanarVelocity * dynamicDriction * impulseScalar;
+	// Which thread found which collision depends on timing, so merge them
+	// in order of body IDs, so that the cache and the solver always see the
+	// same collisions in the same order.
+	m_detectedCollisions.clear();
+	for (unsigned int i = 0; i < m_threadCollisions.size(); ++i)
+	{
+		for (unsigned int j = 0; j < m_threadCollisions[i].size(); ++j)
+			m_detectedCollisions.push_back(&m_threadCollisions[i][j]);
+	}
+	std::sort(m_detectedCollisions.begin(), m_detectedCollisions.end(),
+		[](const CollisionData* a, const CollisionData* b) {
+		return (IDPair(a->firstBody->m_id, a->secondBody->m_id) <
+			IDPair(b->firstBody->m_id, b->secondBody->m_id));
+	});
 
-		//impulse += -contactPlanarVelocity / velocityChangePerUnitImpulse;
-		*/
+	for (unsigned int i = 0; i < m_detectedCollisions.size(); ++i)
+	{
+		CollisionData& collisionData = *m_detectedCollisions[i];
+
+		// Only pairs with an awake body are found, which wakes the other
+		// body's island when they touch.
+		collisionData.firstBody->WakeUp();
+		collisionData.secondBody->WakeUp();
+		collisionData.CalcInternals();
+		m_collisionCache.UpdateCollision(collisionData);
+	}
+}
 
-		Contact& contact = collision->contacts[i];
+void PhysicsEngine::UpdateIslands(float timeDelta)
+{
+	unsigned int i;
+	unsigned int numBodies = m_bodies.size();
+	RigidBody* body;
 
-		// Calculate the impulse in contact coordinates.
-		Vector3f impulse;
-		if (!m_enableFriction || (contact.staticFriction == 0.0f && contact.dynamicFriction == 0.0f))
-			impulse = contact.CalculateFrictionlessImpulse();
-		else
-			impulse = contact.CalculateFrictionImpulse();
+	m_islandParents.resize(numBodies);
+	m_islandSleepTimes.assign(numBodies, FLT_MAX);
+	for (i = 0; i < numBodies; ++i)
+	{
+		m_bodies[i]->m_islandIndex = i;
+		m_islandParents[i] = i;
+	}
 
-		// Scale the impulse by the number of contacts.
-		//impulse *= 1.0f / (float) collision->numContacts;
+	// Join bodies touching each other. Static bodies don't join islands, so
+	// that everything resting on the ground isn't one island.
+	for (auto it = m_collisionCache.collisions_begin();
+		it != m_collisionCache.collisions_end(); ++it)
+	{
+		RigidBody* bodyA = it->second.firstBody;
+		RigidBody* bodyB = it->second.secondBody;
+		if (bodyA->m_inverseMass == 0.0f || bodyB->m_inverseMass == 0.0f)
+			continue;
+		unsigned int islandA = FindIsland(bodyA->m_islandIndex);
+		unsigned int islandB = FindIsland(bodyB->m_islandIndex);
+		if (islandA != islandB)
+			m_islandParents[islandA] = islandB;
+	}
 
-		//if (contact.persistent)
-			//impulse *= 0.5f;
-		
-		// Transform the impulse into world coordinates.
-		impulse = contact.contactToWorld * impulse;
-		
-		Vector3f localToGlobalA = contact.bodyA->GetBodyToWorld().TransformAffine(contact.localPositionA);
-		Vector3f localToGlobalB = contact.bodyB->GetBodyToWorld().TransformAffine(contact.localPositionB);
-		//localToGlobalA = contact.worldPositionA;
-		//localToGlobalB = contact.worldPositionB;
+	// Each island's sleep time is the shortest of its bodies'. Speeds are
+	// measured from how far bodies actually moved this step, as resting
+	// contacts leave some velocity behind that positional correction undoes.
+	m_numIslands = 0;
+	float maxDistanceSquared = m_linearSleepThreshold * timeDelta;
+	maxDistanceSquared *= maxDistanceSquared;
+	float minRotationCosine = Math::Cos(m_angularSleepThreshold * timeDelta * 0.5f);
+	for (i = 0; i < numBodies; ++i)
+	{
+		body = m_bodies[i];
+		if (!body->m_isAwake || body->m_inverseMass == 0.0f)
+			continue;
+		float distanceSquared = (body->m_position -
+			body->m_previousPosition).LengthSquared();
+		float rotationCosine = Math::Abs(body->m_orientation.Dot(
+			body->m_previousOrientation));
+		if (!m_enableSleeping || !body->m_allowSleep ||
+			distanceSquared > maxDistanceSquared ||
+			rotationCosine < minRotationCosine)
+			body->m_sleepTime = 0.0f;
+		else
+			body->m_sleepTime += timeDelta;
 
-		// Apply equal and opposite impulses to each body.
-		contact.bodyA->ApplyImpulse(-impulse, localToGlobalA);
-		contact.bodyB->ApplyImpulse(impulse, localToGlobalB);
+		unsigned int island = FindIsland(i);
+		if (island == i)
+			m_numIslands++;
+		m_islandSleepTimes[island] = Math::Min(
+			m_islandSleepTimes[island], body->m_sleepTime);
+	}
+
+	// Put islands to sleep that have rested for long enough, linking each
+	// one's bodies into a circular list headed by its root body.
+	for (i = 0; i < numBodies; ++i)
+	{
+		body = m_bodies[i];
+		if (!body->m_isAwake || body->m_inverseMass == 0.0f)
+			continue;
+		unsigned int island = FindIsland(i);
+		if (m_islandSleepTimes[island] < m_timeToSleep)
+			continue;
 
-		contact.bodyA->CalculateDerivedData();
-		contact.bodyB->CalculateDerivedData();
+		RigidBody* head = m_bodies[island];
+		if (body != head)
+		{
+			body->m_nextInIsland = (head->m_nextInIsland != nullptr ?
+				head->m_nextInIsland : head);
+			head->m_nextInIsland = body;
+		}
+		else
+		{
+			if (head->m_nextInIsland == nullptr)
+				head->m_nextInIsland = head;
+			m_numIslands--;
+		}
+		body->m_isAwake = false;
+		body->m_velocity.SetZero();
+		body->m_angularVelocity.SetZero();
+		body->ClearAccumulators();
 	}
 }
 
-void PhysicsEngine::PositionalCorrection(CollisionData* collision, float invDT)
+unsigned int PhysicsEngine::FindIsland(unsigned int index)
 {
-	const float baumgarte = 0.2f;
-
-	if (collision->numContacts > 0)
+	// Find the root, halving the path along the way
+	while (m_islandParents[index] != index)
 	{
-		for (unsigned int i = 0; i < collision->numContacts; ++i)
-		{
-			Contact& contact = collision->contacts[i];
-
-			// Normal points from B to A.
-
-			/*Vector3f worldPosA = contact.bodyA->GetBodyToWorld()
-				.TransformAffine(contact.localPositionA);
-			Vector3f worldPosB = contact.bodyB->GetBodyToWorld()
-				.TransformAffine(contact.localPositionB);
-			Vector3f normal = contact.contactNormal;
-			float depth = (worldPosB - worldPosA).Dot(normal);
-
-			float b = depth * invDT * baumgarte;*/
-
-			// Compute the effective mass
-			//Vector3f rA = contact.contactPoint - contact.bodyA->m_centerOfMassWorld;
-			//Vector3f rB = contact.contactPoint - contact.bodyA->m_centerOfMassWorld;
-			//Vector3f rnA = rA.Cross(contactNormal);
-			//Vector3f rnB = rB.Cross(contactNormal);
-			//float effectiveMass =
-			//	contact.bodyA->m_inverseMass + contact.bodyB->m_inverseMass +
-			//	(contact.bodyA->m_inverseInertiaTensorWorld * (rnA * rnA)) +
-			//	(contact.bodyB->m_inverseInertiaTensorWorld * (rnB * rnB));
-			
-			Vector3f localToGlobalA = contact.bodyA->GetBodyToWorld().TransformAffine(contact.localPositionA);
-			Vector3f localToGlobalB = contact.bodyB->GetBodyToWorld().TransformAffine(contact.localPositionB);
-
-			Vector3f impulse = contact.CalcBaumgarteImpulse() * contact.contactNormal;
-			//contact.bodyA->ApplyImpulse(-impulse, contact.contactPoint);
-			//contact.bodyB->ApplyImpulse(impulse, contact.contactPoint);
-
-			float dt = 1.0f / invDT;
-
-			contact.bodyA->m_position -= impulse * contact.bodyA->m_inverseMass * dt;
-			contact.bodyB->m_position += impulse * contact.bodyB->m_inverseMass * dt;
-
-			Vector3f angImpulseA = contact.bodyA->m_inverseInertiaTensorWorld * (localToGlobalA - contact.bodyA->m_centerOfMassWorld).Cross(-impulse);
-			Vector3f angImpulseB = contact.bodyB->m_inverseInertiaTensorWorld * (localToGlobalB - contact.bodyB->m_centerOfMassWorld).Cross(impulse);
-			contact.bodyA->IntegrateAngularVelocity(angImpulseA, dt);
-			contact.bodyB->IntegrateAngularVelocity(angImpulseB, dt);
-			
-			contact.bodyA->CalculateDerivedData();
-			contact.bodyB->CalculateDerivedData();
-
-			/*
-			Vector3f contactNormal = contact.contactNormal;
-			float penetration = contact.penetration;
-			float invMassSum = contact.body[0]->GetInverseMass() + contact.body[1]->GetInverseMass();
-
-			//float k = 0.5f / (float) collision->numContacts;
-			float k = 1.0f / (float) collision->numContacts;
-			contact.body[0]->m_position += contactNormal * penetration * (contact.body[0]->m_inverseMass / invMassSum) * k;
-			contact.body[1]->m_position -= contactNormal * penetration * (contact.body[1]->m_inverseMass / invMassSum) * k;
-			*/
-		}
+		m_islandParents[index] = m_islandParents[m_islandParents[index]];
+		index = m_islandParents[index];
 	}
+	return index;
+}
+
+void PhysicsEngine::WakeTouchingBodies(RigidBody* body)
+{
+	if (body->m_colliders.empty())
+		return;
+	if (m_sceneQueriesDirty)
+		RefitSceneQueries();
+
+	const DynamicAABBTree& tree = m_sceneQuery.GetTree();
+	tree.Query(body->GetBounds(), [&tree, body](int32 proxyId) {
+		Collider* collider = (Collider*) tree.GetUserData(proxyId);
+		if (collider->GetBody() != body)
+			collider->GetBody()->WakeUp();
+		return true;
+	});
 }
 
 void PhysicsEngine::DebugDetectCollisions()
@@ -376,19 +518,86 @@ bool PhysicsEngine::CastRay(const Ray& ray, float& outDistance, Vector3f& outNor
 
 bool PhysicsEngine::CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal)
 {
-	RigidBody* body;
-	bool hit = false;
+	Array<SceneQueryHit> hits;
+	if (!CastRay(ray, inOutDistance, SceneQueryMode::k_closest, hits))
+		return false;
+	inOutDistance = hits[0].distance;
+	outNormal = hits[0].normal;
+	return true;
+}
+
+bool PhysicsEngine::CastRay(const Ray& ray, float maxDistance,
+	SceneQueryMode mode, Array<SceneQueryHit>& outHits)
+{
+	if (m_sceneQueriesDirty)
+		RefitSceneQueries();
+	return m_sceneQuery.CastRay(ray, maxDistance, mode, outHits);
+}
 
+void PhysicsEngine::CastRays(const Ray* rays, const float* maxDistances,
+	uint32 count, SceneQueryMode mode, Array<SceneQueryHit>& outHits)
+{
+	if (m_sceneQueriesDirty)
+		RefitSceneQueries();
+	m_sceneQuery.CastRays(rays, maxDistances, count, mode, outHits);
+}
+
+bool PhysicsEngine::Overlap(Collider* shape, SceneQueryMode mode,
+	Array<SceneQueryHit>& outHits)
+{
+	if (m_sceneQueriesDirty)
+		RefitSceneQueries();
+	return m_sceneQuery.Overlap(shape, mode, outHits);
+}
+
+bool PhysicsEngine::Sweep(Collider* shape, const Vector3f& direction,
+	float maxDistance, SceneQueryMode mode, Array<SceneQueryHit>& outHits)
+{
+	if (m_sceneQueriesDirty)
+		RefitSceneQueries();
+	return m_sceneQuery.Sweep(shape, direction, maxDistance, mode, outHits);
+}
+
+void PhysicsEngine::UpdateSceneQueries()
+{
 	for (unsigned int i = 0; i < m_bodies.size(); ++i)
 	{
-		body = m_bodies[i];
-		Collider* collider = body->GetCollider();
-		if (collider != nullptr &&
-			collider->CastBoundedRay(ray, inOutDistance, outNormal))
-		{
-			hit = true;
-		}
+		RigidBody* body = m_bodies[i];
+		body->CalculateDerivedData();
+		for (unsigned int j = 0; j < body->m_colliders.size(); ++j)
+			m_sceneQuery.UpdateCollider(body->m_colliders[j]);
+		body->m_isSceneQueryDirty = false;
 	}
-	
-	return hit;
+	m_sceneQueryBodies.clear();
+	m_sceneQueriesDirty = false;
+}
+
+void PhysicsEngine::MarkSceneQueryDirty(RigidBody* body)
+{
+	if (body->m_isSceneQueryDirty)
+		return;
+	body->m_isSceneQueryDirty = true;
+	m_sceneQueryBodies.push_back(body);
+	m_sceneQueriesDirty = true;
+}
+
+void PhysicsEngine::RefitSceneQueries()
+{
+	// The derived data is already up to date from the step, or from adding
+	// the body or collider.
+	for (unsigned int i = 0; i < m_sceneQueryBodies.size(); ++i)
+	{
+		RigidBody* body = m_sceneQueryBodies[i];
+		for (unsigned int j = 0; j < body->m_colliders.size(); ++j)
+			m_sceneQuery.UpdateCollider(body->m_colliders[j]);
+		body->m_isSceneQueryDirty = false;
+	}
+	m_sceneQueryBodies.clear();
+	m_sceneQueriesDirty = false;
+}
+
+void PhysicsEngine::RemoveFromSceneQueries(RigidBody* body)
+{
+	for (unsigned int i = 0; i < body->m_colliders.size(); ++i)
+		m_sceneQuery.RemoveCollider(body->m_colliders[i]);
 }
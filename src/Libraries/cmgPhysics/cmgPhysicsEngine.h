@@ -6,6 +6,9 @@
 #include <cmgPhysics/cmgRigidBody.h>
 #include <cmgPhysics/cmgCollisionDetector.h>
 #include <cmgPhysics/cmgCollisionCache.h>
+#include <cmgPhysics/cmgContactSolver.h>
+#include <cmgPhysics/cmgSceneQuery.h>
+#include <cmgPhysics/broadphase/cmgBroadphase.h>
 #include <cmgCore/time/cmgTimer.h>
 
 
@@ -14,6 +17,9 @@
 //-----------------------------------------------------------------------------
 class PhysicsEngine
 {
+public:
+	friend class RigidBody;
+
 public:
 	PhysicsEngine();
 	~PhysicsEngine();
@@ -30,39 +36,116 @@ public:
 	inline std::vector<RigidBody*>::iterator bodies_begin() { return m_bodies.begin(); }
 	inline std::vector<RigidBody*>::iterator bodies_end() { return m_bodies.end(); }
 	inline CollisionCache* GetCollisionCache() { return &m_collisionCache; }
+	inline const ContactSolver* GetContactSolver() const { return &m_contactSolver; }
 	inline CollisionDetector* GetCollisionDetector() { return &m_collisionDetector; }
+	inline Broadphase* GetBroadphase() { return m_broadphase; }
 	inline ProfileSection* GetProfiler() { return &m_profiler; }
 	inline const Vector3f& GetGravity() const { return m_gravity; }
 
 	inline unsigned int GetNumIterations() const { return m_numIterations; }
 	inline bool GetEnableFriction() const { return m_enableFriction; }
 	inline bool GetEnableRestitution() const { return m_enableRestitution; }
+	inline bool GetEnableWarmStarting() const { return m_enableWarmStarting; }
+	inline ContactSolverMode GetContactSolverMode() const { return m_contactSolver.GetMode(); }
+	inline ThreadPool* GetThreadPool() const { return m_threadPool; }
+	inline unsigned int GetNumVelocityIterations() const { return m_velocityIterations; }
+	inline unsigned int GetNumPositionIterations() const { return m_positionIterations; }
+	inline bool GetEnableSleeping() const { return m_enableSleeping; }
+	inline float GetLinearSleepThreshold() const { return m_linearSleepThreshold; }
+	inline float GetAngularSleepThreshold() const { return m_angularSleepThreshold; }
+	inline float GetTimeToSleep() const { return m_timeToSleep; }
+	inline unsigned int GetNumIslands() const { return m_numIslands; } // Awake islands
+	unsigned int GetNumAwakeBodies() const;
 
 	// Setters
 	inline void SetNumIterations(unsigned int numIterations) { m_numIterations = numIterations; }
 	inline void SetEnableFriction(bool enableFriction) { m_enableFriction = enableFriction; }
 	inline void SetEnableRestitution(bool enableRestitution) { m_enableRestitution = enableRestitution; }
+	inline void SetEnableWarmStarting(bool enableWarmStarting) { m_enableWarmStarting = enableWarmStarting; }
+	inline void SetContactSolverMode(ContactSolverMode mode) { m_contactSolver.SetMode(mode); }
+	inline void SetThreadPool(ThreadPool* threadPool) { m_threadPool = threadPool; } // Not owned
+	inline void SetNumVelocityIterations(unsigned int velocityIterations) { m_velocityIterations = velocityIterations; }
+	inline void SetNumPositionIterations(unsigned int positionIterations) { m_positionIterations = positionIterations; }
+	inline void SetTimeToSleep(float timeToSleep) { m_timeToSleep = timeToSleep; }
+	void SetSleepThresholds(float linearSpeed, float angularSpeed);
+	void SetEnableSleeping(bool enableSleeping);
 	void SetGravity(const Vector3f& gravity);
+
+	// Replace the broadphase, which the engine then owns. The default is an
+	// AABBTreeBroadphase.
+	void SetBroadphase(Broadphase* broadphase);
 	
-	void SolveCollision(CollisionData* collision);
-	void PositionalCorrection(CollisionData* collision, float invDT);
 	void DebugDetectCollisions();
 
 	// Operations
 	bool CastRay(const Ray& ray, float& outDistance, Vector3f& outNormal);
 	bool CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal);
 
+	// Scene queries, which replace the hits and return true if anything was
+	// hit. See SceneQuery.
+	bool CastRay(const Ray& ray, float maxDistance, SceneQueryMode mode,
+		Array<SceneQueryHit>& outHits);
+	void CastRays(const Ray* rays, const float* maxDistances, uint32 count,
+		SceneQueryMode mode, Array<SceneQueryHit>& outHits);
+	bool Overlap(Collider* shape, SceneQueryMode mode,
+		Array<SceneQueryHit>& outHits);
+	bool Sweep(Collider* shape, const Vector3f& direction, float maxDistance,
+		SceneQueryMode mode, Array<SceneQueryHit>& outHits);
+
+	// Fit the scene query tree to the colliders of every body. The bodies
+	// that are simulated or added are refitted automatically before the next
+	// query, but this must be called after moving bodies by hand.
+	void UpdateSceneQueries();
+	inline const SceneQuery* GetSceneQuery() const { return &m_sceneQuery; }
+
 private:
+	void UpdateBroadphase(float timeDelta);
+
+	// Test the broadphase pairs for contacts, spread across the threads of
+	// the thread pool, and update the collision cache with them
+	void DetectCollisions();
+
+	// Only the bodies that moved since the last query are refitted, so
+	// static and sleeping bodies cost nothing.
+	void MarkSceneQueryDirty(RigidBody* body);
+	void RefitSceneQueries();
+	void RemoveFromSceneQueries(RigidBody* body);
+
+	// Islands are groups of dynamic bodies joined by contacts, found with a
+	// union-find over the bodies each step. An island falls asleep once all
+	// of its bodies have been slower than the sleep thresholds for the time
+	// to sleep, and its bodies are then skipped until something wakes them.
+	void UpdateIslands(float timeDelta);
+	unsigned int FindIsland(unsigned int index);
+	void WakeTouchingBodies(RigidBody* body);
+
 	CollisionDetector m_collisionDetector;
+	Broadphase* m_broadphase;
+	SceneQuery m_sceneQuery;
+	bool m_sceneQueriesDirty;
+	Array<RigidBody*> m_sceneQueryBodies; // Bodies to refit before the next query
 
 	bool			m_enableFriction;
 	bool			m_enableRestitution;
+	bool			m_enableWarmStarting;
 	unsigned int	m_numIterations;
 
 	unsigned int	m_velocityIterations;
 	unsigned int	m_positionIterations;
 
+	bool			m_enableSleeping;
+	float			m_linearSleepThreshold;
+	float			m_angularSleepThreshold;
+	float			m_timeToSleep;
+	unsigned int	m_numIslands;
+	Array<unsigned int> m_islandParents;
+	Array<float>	m_islandSleepTimes;
+
 	CollisionCache m_collisionCache;
+	ContactSolver m_contactSolver;
+	ThreadPool* m_threadPool;
+	Array<Array<CollisionData>> m_threadCollisions; // Narrowphase output of each thread
+	Array<CollisionData*> m_detectedCollisions; // Sorted by body IDs
 
 	std::vector<RigidBody*> m_bodies;
 	unsigned int m_idCounter;
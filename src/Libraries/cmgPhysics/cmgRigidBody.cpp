@@ -1,4 +1,5 @@
 #include "cmgRigidBody.h"
+#include <cmgPhysics/cmgPhysicsEngine.h>
 
 
 RigidBody::RigidBody() :
@@ -19,7 +20,17 @@ RigidBody::RigidBody() :
 	m_acceleration(Vector3f::ZERO),
 	m_angularAcceleration(Vector3f::ZERO),
 	m_centerOfMass(Vector3f::ZERO),
-	m_physicsEngine(nullptr)
+	m_physicsEngine(nullptr),
+	m_proxyId(-1),
+	m_isAwake(true),
+	m_allowSleep(true),
+	m_sleepTime(0.0f),
+	m_previousPosition(Vector3f::ZERO),
+	m_previousOrientation(Quaternion::IDENTITY),
+	m_nextInIsland(nullptr),
+	m_islandIndex(0),
+	m_solverIndex(-1),
+	m_isSceneQueryDirty(false)
 {
 }
 
@@ -36,6 +47,20 @@ Vector3f RigidBody::GetVelocityAtPoint(const Vector3f& pointWorld) const
 	return m_velocity + m_angularVelocity.Cross(pointWorld - m_centerOfMassWorld);
 }
 
+Bounds RigidBody::GetBounds() const
+{
+	Bounds bounds;
+	if (m_colliders.empty())
+	{
+		bounds.SetAsPoint(m_position);
+		return bounds;
+	}
+	bounds = m_colliders[0]->GetBounds();
+	for (unsigned int i = 1; i < m_colliders.size(); ++i)
+		bounds.Combine(m_colliders[i]->GetBounds());
+	return bounds;
+}
+
 void RigidBody::SetMass(float mass)
 {
 	m_mass = mass;
@@ -46,6 +71,20 @@ void RigidBody::SetMass(float mass)
 		m_inverseMass = 0.0f;
 }
 
+void RigidBody::SetVelocity(const Vector3f& velocity)
+{
+	m_velocity = velocity;
+	if (velocity.LengthSquared() > 0.0f)
+		WakeUp();
+}
+
+void RigidBody::SetAngularVelocity(const Vector3f& angularVelocity)
+{
+	m_angularVelocity = angularVelocity;
+	if (angularVelocity.LengthSquared() > 0.0f)
+		WakeUp();
+}
+
 void RigidBody::SetCollider(Collider* collider)
 {
 	AddCollider(collider);
@@ -55,10 +94,18 @@ void RigidBody::AddCollider(Collider* collider)
 {
 	collider->m_body = this;
 	m_colliders.push_back(collider);
+	if (m_physicsEngine != nullptr)
+	{
+		collider->CalcDerivedData();
+		m_physicsEngine->MarkSceneQueryDirty(this);
+	}
 }
 
 void RigidBody::ClearColliders()
 {
+	if (m_physicsEngine != nullptr)
+		m_physicsEngine->RemoveFromSceneQueries(this);
+
 	// Delete colliders.
 	for (unsigned int i = 0; i < m_colliders.size(); ++i)
 		delete m_colliders[i];
@@ -66,24 +113,67 @@ void RigidBody::ClearColliders()
 }
 
 
+void RigidBody::WakeUp()
+{
+	if (m_isAwake)
+		return;
+
+	// Wake the whole island, as its bodies may be resting on each other
+	RigidBody* body = this;
+	do
+	{
+		RigidBody* next = body->m_nextInIsland;
+		body->m_isAwake = true;
+		body->m_sleepTime = 0.0f;
+		body->m_nextInIsland = nullptr;
+		body = next;
+	}
+	while (body != nullptr && body != this);
+}
+
+void RigidBody::PutToSleep()
+{
+	if (!m_allowSleep || m_inverseMass == 0.0f)
+		return;
+	if (m_isAwake)
+	{
+		m_isAwake = false;
+		m_nextInIsland = this;
+	}
+	m_velocity.SetZero();
+	m_angularVelocity.SetZero();
+	ClearAccumulators();
+}
+
+void RigidBody::SetAllowSleep(bool allowSleep)
+{
+	m_allowSleep = allowSleep;
+	if (!allowSleep)
+		WakeUp();
+}
+
 void RigidBody::ApplyForce(const Vector3f& force, const Vector3f& contactPoint)
 {
+	WakeUp();
 	m_force += force;
 	m_torque += Vector3f::Cross(contactPoint - m_centerOfMassWorld, force);
 }
 
 void RigidBody::ApplyForceLinear(const Vector3f& force)
 {
+	WakeUp();
 	m_force += force;
 }
 
 void RigidBody::ApplyTorque(const Vector3f& torque)
 {
+	WakeUp();
 	m_torque += torque;
 }
 
 void RigidBody::ApplyImpulse(const Vector3f& impulse, const Vector3f& contactPoint)
 {
+	WakeUp();
 	//m_velocityAccumulator += impulse * m_inverseMass;
 	//m_angularVelocityAccumulator += m_inverseInertiaTensorWorld * (contactPoint - m_centerOfMassWorld).Cross(impulse);
 	m_velocity += impulse * m_inverseMass;
@@ -37,9 +37,15 @@ public:
 	inline unsigned int GetId() const { return m_id; }
 	inline Collider* GetCollider() { return (m_colliders.size() > 0 ? m_colliders[0] : nullptr); }
 	inline PhysicsEngine* GetPhysicsEngine() { return m_physicsEngine; }
+	inline bool IsAwake() const { return m_isAwake; }
+	inline bool IsSleepingAllowed() const { return m_allowSleep; }
+	inline float GetSleepTime() const { return m_sleepTime; }
 
 	inline const Matrix4f& GetBodyToWorld() const { return m_bodyToWorld; }
 	inline const Matrix4f& GetWorldToBody() const { return m_worldToBody; }
+
+	// World-space bounds of all colliders, valid after CalculateDerivedData
+	Bounds GetBounds() const;
 	
 	Vector3f GetVelocityAtPoint(const Vector3f& pointWorld) const;
 
@@ -49,8 +55,8 @@ public:
 	// Setters
 	inline void SetPosition(const Vector3f& position) { m_position = position; }
 	inline void SetOrientation(const Quaternion& orientation) { m_orientation = orientation; }
-	inline void SetVelocity(const Vector3f& velocity) { m_velocity = velocity; }
-	inline void SetAngularVelocity(const Vector3f& angularVelocity) { m_angularVelocity = angularVelocity; }
+	void SetVelocity(const Vector3f& velocity);
+	void SetAngularVelocity(const Vector3f& angularVelocity);
 	inline void SetInverseMass(float inverseMass) { m_inverseMass = inverseMass; m_mass = (inverseMass != 0.0f ? 1.0f / inverseMass : 0.0f); }
 	inline void SetInverseInertiaTensor(const Matrix3f& inverseInertiaTensor) { m_inverseInertiaTensor = inverseInertiaTensor; }
 	inline void SetRestitution(float restitution) { m_restitution = restitution; }
@@ -60,6 +66,12 @@ public:
 	void AddCollider(Collider* collider);
 	void ClearColliders();
 
+	// Sleeping. Waking a body wakes every body in its sleeping island, and
+	// putting a body to sleep clears its velocity. Static bodies never sleep.
+	void WakeUp();
+	void PutToSleep();
+	void SetAllowSleep(bool allowSleep);
+
 	/*inline void SetPrimitive(CollisionPrimitive* primitive)
 	{
 		AddPrimitive(primitive, Matrix4f::IDENTITY);
@@ -124,9 +136,21 @@ private:
 public:
 
 	unsigned int	m_id;
+	int				m_proxyId; // Broadphase proxy, or -1 if not added yet
 
 	PhysicsEngine*	m_physicsEngine;
 
+	// Sleeping
+	bool			m_isAwake;
+	bool			m_allowSleep;
+	float			m_sleepTime; // Time spent moving slower than the sleep thresholds
+	Vector3f		m_previousPosition; // Transform at the start of the step
+	Quaternion		m_previousOrientation;
+	RigidBody*		m_nextInIsland; // Circular list of a sleeping island's bodies
+	unsigned int	m_islandIndex; // Index into the engine's island union-find
+	int				m_solverIndex; // Index into the contact solver's bodies, or -1
+	bool			m_isSceneQueryDirty; // In the engine's list of bodies to refit
+
 	// Dynamics
 	Vector3f		m_position;
 	Quaternion		m_orientation;
@@ -0,0 +1,365 @@
+#include "cmgSceneQuery.h"
+#include <cmgCore/cmgAssert.h>
+#include <cmgPhysics/cmgGJK.h>
+#include <algorithm>
+
+
+const float SceneQuery::PACKET_MIN_COSINE = 0.9f;
+
+
+//-----------------------------------------------------------------------------
+// Ray packets
+//-----------------------------------------------------------------------------
+
+// Rays in structure-of-arrays form, so one node box is tested against all of
+// them in a single loop
+struct SceneQuery::RayPacket
+{
+	uint32 count;
+	float originX[RAY_PACKET_SIZE];
+	float originY[RAY_PACKET_SIZE];
+	float originZ[RAY_PACKET_SIZE];
+	float invDirectionX[RAY_PACKET_SIZE];
+	float invDirectionY[RAY_PACKET_SIZE];
+	float invDirectionZ[RAY_PACKET_SIZE];
+
+	// Negative once a ray is finished
+	float maxDistance[RAY_PACKET_SIZE];
+
+	void Set(uint32 index, const Vector3f& origin,
+		const Vector3f& direction, float distance)
+	{
+		originX[index] = origin.x;
+		originY[index] = origin.y;
+		originZ[index] = origin.z;
+		invDirectionX[index] = GetInverse(direction.x);
+		invDirectionY[index] = GetInverse(direction.y);
+		invDirectionZ[index] = GetInverse(direction.z);
+		maxDistance[index] = distance;
+	}
+
+	// Bit mask of the rays whose segments touch the box, by the slab test
+	inline uint32 TestBounds(const Bounds& bounds) const
+	{
+		uint32 mask = 0;
+		for (uint32 i = 0; i < count; i++)
+		{
+			float x1 = (bounds.mins.x - originX[i]) * invDirectionX[i];
+			float x2 = (bounds.maxs.x - originX[i]) * invDirectionX[i];
+			float y1 = (bounds.mins.y - originY[i]) * invDirectionY[i];
+			float y2 = (bounds.maxs.y - originY[i]) * invDirectionY[i];
+			float z1 = (bounds.mins.z - originZ[i]) * invDirectionZ[i];
+			float z2 = (bounds.maxs.z - originZ[i]) * invDirectionZ[i];
+			float tmin = Math::Max(Math::Max(Math::Min(x1, x2), Math::Min(y1, y2)),
+				Math::Max(Math::Min(z1, z2), 0.0f));
+			float tmax = Math::Min(Math::Min(Math::Max(x1, x2), Math::Max(y1, y2)),
+				Math::Min(Math::Max(z1, z2), maxDistance[i]));
+			mask |= (uint32) (tmin <= tmax) << i;
+		}
+		return mask;
+	}
+
+	// A large finite value for zero components avoids 0 * infinity in the
+	// slab test
+	static inline float GetInverse(float x)
+	{
+		return (x != 0.0f ? 1.0f / x : 1.0e30f);
+	}
+};
+
+
+//-----------------------------------------------------------------------------
+// Internal functions
+//-----------------------------------------------------------------------------
+
+static SceneQueryHit MakeHit(Collider* collider, uint32 queryIndex,
+	float distance, const Vector3f& point, const Vector3f& normal)
+{
+	SceneQueryHit hit;
+	hit.collider = collider;
+	hit.body = (collider != nullptr ? collider->GetBody() : nullptr);
+	hit.queryIndex = queryIndex;
+	hit.distance = distance;
+	hit.point = point;
+	hit.normal = normal;
+	return hit;
+}
+
+static bool LessHit(const SceneQueryHit& a, const SceneQueryHit& b)
+{
+	if (a.queryIndex != b.queryIndex)
+		return (a.queryIndex < b.queryIndex);
+	return (a.distance < b.distance);
+}
+
+// Interleave the lower 10 bits of x with two zero bits each
+static uint32 SpreadBits(uint32 x)
+{
+	x &= 0x3FF;
+	x = (x | (x << 16)) & 0x030000FF;
+	x = (x | (x << 8)) & 0x0300F00F;
+	x = (x | (x << 4)) & 0x030C30C3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+
+SceneQuery::SceneQuery()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Colliders
+//-----------------------------------------------------------------------------
+
+void SceneQuery::Clear()
+{
+	m_tree.Clear();
+}
+
+void SceneQuery::AddCollider(Collider* collider)
+{
+	CMG_ASSERT(collider->m_queryProxyId < 0);
+	collider->m_queryProxyId = m_tree.CreateProxy(collider->GetBounds(), collider);
+}
+
+void SceneQuery::RemoveCollider(Collider* collider)
+{
+	if (collider->m_queryProxyId >= 0)
+	{
+		m_tree.DestroyProxy(collider->m_queryProxyId);
+		collider->m_queryProxyId = -1;
+	}
+}
+
+void SceneQuery::UpdateCollider(Collider* collider)
+{
+	if (collider->m_queryProxyId < 0)
+		AddCollider(collider);
+	else
+		m_tree.MoveProxy(collider->m_queryProxyId, collider->GetBounds(), Vector3f::ZERO);
+}
+
+
+//-----------------------------------------------------------------------------
+// Queries
+//-----------------------------------------------------------------------------
+
+bool SceneQuery::CastRay(const Ray& ray, float maxDistance,
+	SceneQueryMode mode, Array<SceneQueryHit>& outHits) const
+{
+	uint32 index = 0;
+	outHits.clear();
+	if (mode != SceneQueryMode::k_all)
+		outHits.resize(1);
+	CastRayPacket(&ray, &maxDistance, &index, 1, mode, outHits);
+
+	if (mode == SceneQueryMode::k_all)
+		std::sort(outHits.begin(), outHits.end(), LessHit);
+	else if (outHits[0].collider == nullptr)
+		outHits.clear();
+	return !outHits.empty();
+}
+
+void SceneQuery::CastRays(const Ray* rays, const float* maxDistances,
+	uint32 count, SceneQueryMode mode, Array<SceneQueryHit>& outHits) const
+{
+	outHits.clear();
+	if (count == 0)
+		return;
+	if (mode != SceneQueryMode::k_all)
+		outHits.resize(count);
+
+	// Sort the rays by direction octant and then along a Morton curve of
+	// their origins, so each packet holds rays that visit the same nodes
+	Bounds originBounds;
+	originBounds.SetAsPoint(rays[0].origin);
+	for (uint32 i = 1; i < count; i++)
+		originBounds.Encapsulate(rays[i].origin);
+	Vector3f scale = originBounds.GetSize();
+	for (uint32 axis = 0; axis < 3; axis++)
+		scale.v[axis] = (scale.v[axis] > 0.0f ? 1023.0f / scale.v[axis] : 0.0f);
+
+	Array<std::pair<uint64, uint32>> keys(count);
+	for (uint32 i = 0; i < count; i++)
+	{
+		const Ray& ray = rays[i];
+		uint64 octant = (ray.direction.x < 0.0f ? 1 : 0) |
+			(ray.direction.y < 0.0f ? 2 : 0) | (ray.direction.z < 0.0f ? 4 : 0);
+		uint32 morton = 0;
+		for (uint32 axis = 0; axis < 3; axis++)
+		{
+			uint32 cell = (uint32) ((ray.origin.v[axis] -
+				originBounds.mins.v[axis]) * scale.v[axis]);
+			morton |= SpreadBits(cell) << axis;
+		}
+		keys[i] = std::make_pair((octant << 30) | morton, i);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	Array<uint32> order(count);
+	for (uint32 i = 0; i < count; i++)
+		order[i] = keys[i].second;
+	for (uint32 start = 0; start < count; start += RAY_PACKET_SIZE)
+	{
+		// Rays heading in different directions visit different nodes, so a
+		// packet of them would test each ray against the nodes of all of
+		// them. Those are cast one at a time instead.
+		uint32 packetSize = Math::Min(RAY_PACKET_SIZE, count - start);
+		const uint32* indices = order.data() + start;
+		bool coherent = true;
+		for (uint32 i = 1; i < packetSize && coherent; i++)
+		{
+			coherent = (rays[indices[i]].direction.Dot(rays[indices[0]].direction) >=
+				PACKET_MIN_COSINE);
+		}
+		if (coherent)
+		{
+			CastRayPacket(rays, maxDistances, indices, packetSize, mode, outHits);
+		}
+		else
+		{
+			for (uint32 i = 0; i < packetSize; i++)
+				CastRayPacket(rays, maxDistances, indices + i, 1, mode, outHits);
+		}
+	}
+
+	if (mode == SceneQueryMode::k_all)
+		std::sort(outHits.begin(), outHits.end(), LessHit);
+}
+
+bool SceneQuery::Overlap(Collider* shape, SceneQueryMode mode,
+	Array<SceneQueryHit>& outHits) const
+{
+	outHits.clear();
+	m_tree.Query(shape->GetBounds(), [&](int32 proxyId) {
+		Collider* collider = (Collider*) m_tree.GetUserData(proxyId);
+		if (collider == shape || !GJK::TestIntersection(shape, collider))
+			return true;
+		outHits.push_back(MakeHit(collider, 0, 0.0f, Vector3f::ZERO, Vector3f::ZERO));
+		return (mode == SceneQueryMode::k_all);
+	});
+	return !outHits.empty();
+}
+
+bool SceneQuery::Sweep(Collider* shape, const Vector3f& direction,
+	float maxDistance, SceneQueryMode mode, Array<SceneQueryHit>& outHits) const
+{
+	outHits.clear();
+
+	// Cull by sweeping the center of the shape's box against node boxes
+	// grown by its extents
+	Bounds shapeBounds = shape->GetBounds();
+	Vector3f extents = shapeBounds.GetExtents();
+	RayPacket packet;
+	packet.count = 1;
+	packet.Set(0, shapeBounds.GetCenter(), direction, maxDistance);
+
+	SceneQueryHit closestHit = MakeHit(nullptr, 0, maxDistance,
+		Vector3f::ZERO, Vector3f::ZERO);
+	m_tree.Traverse(
+		[&](const Bounds& bounds) {
+			return (packet.TestBounds(Bounds(
+				bounds.mins - extents, bounds.maxs + extents)) != 0);
+		},
+		[&](int32 proxyId) {
+			Collider* collider = (Collider*) m_tree.GetUserData(proxyId);
+			float distance = packet.maxDistance[0];
+			Vector3f normal;
+			Vector3f point;
+			if (collider == shape || !GJK::Cast(shape, collider, Vector3f::ZERO,
+				direction, distance, normal, &point))
+				return true;
+
+			SceneQueryHit hit = MakeHit(collider, 0, distance, point, normal);
+			if (mode == SceneQueryMode::k_closest)
+			{
+				closestHit = hit;
+				packet.maxDistance[0] = distance;
+				return true;
+			}
+			outHits.push_back(hit);
+			return (mode == SceneQueryMode::k_all);
+		});
+
+	if (closestHit.collider != nullptr)
+		outHits.push_back(closestHit);
+	else if (mode == SceneQueryMode::k_all)
+		std::sort(outHits.begin(), outHits.end(), LessHit);
+	return !outHits.empty();
+}
+
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+void SceneQuery::CastRayPacket(const Ray* rays, const float* maxDistances,
+	const uint32* indices, uint32 count, SceneQueryMode mode,
+	Array<SceneQueryHit>& outHits) const
+{
+	RayPacket packet;
+	packet.count = count;
+	for (uint32 i = 0; i < count; i++)
+	{
+		uint32 rayIndex = indices[i];
+		float maxDistance = (maxDistances != nullptr ?
+			maxDistances[rayIndex] : FLT_MAX);
+		packet.Set(i, rays[rayIndex].origin, rays[rayIndex].direction, maxDistance);
+		if (mode != SceneQueryMode::k_all)
+		{
+			outHits[rayIndex] = MakeHit(nullptr, rayIndex, maxDistance,
+				Vector3f::ZERO, Vector3f::ZERO);
+		}
+	}
+
+	// The node test leaves the mask of rays touching each leaf for the
+	// callback
+	uint32 mask = 0;
+	uint32 numActive = count;
+	m_tree.Traverse(
+		[&](const Bounds& bounds) {
+			mask = packet.TestBounds(bounds);
+			return (mask != 0);
+		},
+		[&](int32 proxyId) {
+			Collider* collider = (Collider*) m_tree.GetUserData(proxyId);
+			for (uint32 i = 0; i < count; i++)
+			{
+				if ((mask & (1u << i)) == 0)
+					continue;
+				uint32 rayIndex = indices[i];
+				const Ray& ray = rays[rayIndex];
+				float distance = packet.maxDistance[i];
+				Vector3f normal;
+				if (!collider->CastBoundedRay(ray, distance, normal))
+					continue;
+
+				SceneQueryHit hit = MakeHit(collider, rayIndex, distance,
+					ray.GetPoint(distance), normal);
+				if (mode == SceneQueryMode::k_all)
+				{
+					outHits.push_back(hit);
+				}
+				else if (mode == SceneQueryMode::k_closest)
+				{
+					outHits[rayIndex] = hit;
+					packet.maxDistance[i] = distance;
+				}
+				else
+				{
+					outHits[rayIndex] = hit;
+					packet.maxDistance[i] = -1.0f;
+					if (--numActive == 0)
+						return false;
+				}
+			}
+			return true;
+		});
+}
+
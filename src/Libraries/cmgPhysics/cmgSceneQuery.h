@@ -0,0 +1,90 @@
+#ifndef _CMG_PHYSICS_SCENE_QUERY_H_
+#define _CMG_PHYSICS_SCENE_QUERY_H_
+
+#include <cmgPhysics/cmgDynamicAABBTree.h>
+#include <cmgPhysics/colliders/cmgCollider.h>
+
+
+//-----------------------------------------------------------------------------
+// SceneQueryMode
+//-----------------------------------------------------------------------------
+enum class SceneQueryMode
+{
+	k_closest = 0,	// The nearest hit
+	k_any,			// The first hit found, which is the cheapest to find
+	k_all,			// Every hit, sorted by distance
+
+	k_count,
+};
+
+
+struct SceneQueryHit
+{
+	Collider* collider; // Null for a miss
+	RigidBody* body;
+	uint32 queryIndex; // Index of the ray in a batch
+	float distance;
+	Vector3f point;
+	Vector3f normal;
+};
+
+
+//-----------------------------------------------------------------------------
+// SceneQuery - Ray casts, overlap tests and shape sweeps against the
+// colliders of a scene, culled by a dynamic AABB tree of the collider bounds.
+//
+// Rays and sweeps report distances in units of their direction, which
+// should normally be unit length. Rays use each collider's CastBoundedRay,
+// while overlaps and sweeps use GJK, so the query shape can be any collider
+// placed with SetShapeToWorld. Overlaps don't have a closest hit, so the
+// closest mode works the same as the any mode for them.
+//-----------------------------------------------------------------------------
+class SceneQuery
+{
+public:
+	// Rays in a batch are sorted to be near each other and traverse the tree
+	// together in packets of this size
+	static const uint32 RAY_PACKET_SIZE = 16;
+
+	// Packets are only cast together when the directions of their rays are
+	// within this cosine of the first ray's
+	static const float PACKET_MIN_COSINE;
+
+public:
+	SceneQuery();
+
+	void Clear();
+	void AddCollider(Collider* collider);
+	void RemoveCollider(Collider* collider);
+	void UpdateCollider(Collider* collider);
+
+	// Getters
+	inline const DynamicAABBTree& GetTree() const { return m_tree; }
+
+	// Queries. Each returns true if anything was hit, replacing the hits.
+	bool CastRay(const Ray& ray, float maxDistance, SceneQueryMode mode,
+		Array<SceneQueryHit>& outHits) const;
+	bool Overlap(Collider* shape, SceneQueryMode mode,
+		Array<SceneQueryHit>& outHits) const;
+	bool Sweep(Collider* shape, const Vector3f& direction, float maxDistance,
+		SceneQueryMode mode, Array<SceneQueryHit>& outHits) const;
+
+	// Cast a batch of rays, with an optional array of max distances. For the
+	// closest and any modes, there is one hit per ray, with a null collider
+	// for misses. For the all mode, the hits are sorted by ray and then
+	// distance.
+	void CastRays(const Ray* rays, const float* maxDistances, uint32 count,
+		SceneQueryMode mode, Array<SceneQueryHit>& outHits) const;
+
+private:
+	struct RayPacket;
+
+	void CastRayPacket(const Ray* rays, const float* maxDistances,
+		const uint32* indices, uint32 count, SceneQueryMode mode,
+		Array<SceneQueryHit>& outHits) const;
+
+	DynamicAABBTree m_tree;
+};
+
+
+#endif // _CMG_PHYSICS_SCENE_QUERY_H_
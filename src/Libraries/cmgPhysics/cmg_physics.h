@@ -7,7 +7,9 @@
 #include <cmgPhysics/cmgPhysicsEngine.h>
 #include <cmgPhysics/cmgPhysicsPrimitives.h>
 #include <cmgPhysics/cmgContact.h>
+#include <cmgPhysics/cmgContactSolver.h>
 #include <cmgPhysics/cmgGJK.h>
+#include <cmgPhysics/cmgSceneQuery.h>
 #include <cmgPhysics/colliders/cmgCollider.h>
 #include <cmgPhysics/colliders/cmgBoxCollider.h>
 #include <cmgPhysics/colliders/cmgCapsuleCollider.h>
@@ -1,5 +1,5 @@
 #include "cmgBoxCollider.h"
-#include <cmgMath/geometry/cmgPlane.h>
+#include <algorithm>
 
 
 //-----------------------------------------------------------------------------
@@ -44,54 +44,76 @@ Vector3f BoxCollider::GetSupportPoint(const Vector3f& direction) const
 	return point;
 }
 
-bool BoxCollider::CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const
+Bounds BoxCollider::GetBounds() const
 {
-	bool hit = false;
-
-	Vector3f position = m_shapeToWorld.c3.xyz;
+	// Project the oriented box onto each world axis
+	Vector3f center = m_shapeToWorld.c3.xyz;
+	Vector3f extents;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		extents.v[axis] =
+			(Math::Abs(m_shapeToWorld.c0.xyz.v[axis]) * m_halfSize.x) +
+			(Math::Abs(m_shapeToWorld.c1.xyz.v[axis]) * m_halfSize.y) +
+			(Math::Abs(m_shapeToWorld.c2.xyz.v[axis]) * m_halfSize.z);
+	}
+	return Bounds(center - extents, center + extents);
+}
 
-	for (unsigned int i = 0; i < 6; ++i)
+bool BoxCollider::CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const
+{
+	// Clip the ray against the slabs of each axis in local box space.
+	Vector3f origin = m_worldToShape.TransformAffine(ray.origin);
+	Vector3f direction = m_worldToShape.Rotate(ray.direction);
+	float tmin = 0.0f;
+	float tmax = inOutDistance;
+	int hitAxis = -1;
+	float hitSign = 0.0f;
+
+	for (unsigned int axis = 0; axis < 3; ++axis)
 	{
-		unsigned int axis = i / 2;
-		
-		// create point and normal in local box space
-		Vector3f normal = Vector3f::ZERO;
-		normal.v[axis] = (i % 2 == 0 ? 1.0f : -1.0f);
-		Vector3f point = Vector3f::ZERO;
-		point.v[axis] = m_halfSize.v[axis] * normal.v[axis];
-	
-		// transform into world space
-		normal = m_shapeToWorld.Rotate(normal);
-		point = m_shapeToWorld * point;
-		Plane plane = Plane(normal, point);
-
-		// Cast onto the infinite face plane.
-		float dist;
-		if (plane.CastRay(ray, PLANE_SIDE_FRONT, dist) && dist < inOutDistance)
+		if (Math::Abs(direction.v[axis]) < FLT_EPSILON)
+		{
+			// Parallel to the slab.
+			if (Math::Abs(origin.v[axis]) > m_halfSize.v[axis])
+				return false;
+			continue;
+		}
+
+		float invDirection = 1.0f / direction.v[axis];
+		float t1 = (-m_halfSize.v[axis] - origin.v[axis]) * invDirection;
+		float t2 = (m_halfSize.v[axis] - origin.v[axis]) * invDirection;
+		float sign = -1.0f;
+		if (t1 > t2)
 		{
-			// Make sure the point is within the face's rectangular area.
-			Vector3f hitPoint = ray.GetPoint(inOutDistance);
-			unsigned int tangentAxis1 = (axis + 1) % 3;
-			unsigned int tangentAxis2 = (axis + 2) % 3;
-			Vector3f tangent1 = m_shapeToWorld.col[tangentAxis1].xyz;
-			Vector3f tangent2 = m_shapeToWorld.col[tangentAxis2].xyz;
-			float dist1 = Math::Abs(Vector3f::Dot(hitPoint, tangent1) -
-				Vector3f::Dot(position, tangent1));
-			float dist2 = Math::Abs(Vector3f::Dot(hitPoint, tangent2) -
-				Vector3f::Dot(position, tangent2));
-
-			if (dist1 <= m_halfSize.v[tangentAxis1] &&
-				dist2 <= m_halfSize.v[tangentAxis2])
-			{
-				inOutDistance = dist;
-				outNormal = plane.normal;
-				hit = true;
-			}
+			std::swap(t1, t2);
+			sign = 1.0f;
 		}
+		if (t1 > tmin)
+		{
+			tmin = t1;
+			hitAxis = (int) axis;
+			hitSign = sign;
+		}
+		tmax = Math::Min(tmax, t2);
+		if (tmin > tmax)
+			return false;
 	}
 
-	return hit;
+	if (tmin >= inOutDistance)
+		return false;
 
-	return false;
+	// Rays starting inside the box hit immediately.
+	if (hitAxis >= 0)
+	{
+		Vector3f normal = Vector3f::ZERO;
+		normal.v[hitAxis] = hitSign;
+		outNormal = m_shapeToWorld.Rotate(normal);
+	}
+	else
+	{
+		outNormal = -Vector3f::Normalize(ray.direction);
+	}
+	inOutDistance = tmin;
+	return true;
 }
 
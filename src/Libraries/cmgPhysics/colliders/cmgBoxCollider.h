@@ -14,6 +14,7 @@ public:
 	float GetVolume() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
 
 	inline const Vector3f& GetHalfSize() const { return m_halfSize; }
 	
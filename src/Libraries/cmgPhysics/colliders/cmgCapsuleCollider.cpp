@@ -56,3 +56,14 @@ Vector3f CapsuleCollider::GetSupportPoint(const Vector3f& direction) const
 	point.y += yOffset;
 	return m_shapeToWorld.TransformAffine(point);
 }
+
+Bounds CapsuleCollider::GetBounds() const
+{
+	// Bounds of the inner segment grown by the radius
+	Vector3f axis = m_shapeToWorld.c1.xyz * m_halfHeight;
+	Bounds bounds;
+	bounds.SetAsPoint(m_shapeToWorld.c3.xyz + axis);
+	bounds.Encapsulate(m_shapeToWorld.c3.xyz - axis);
+	bounds.Expand(m_radius);
+	return bounds;
+}
@@ -1,12 +1,14 @@
 #include "cmgCollider.h"
 #include "cmgRigidBody.h"
+#include <cmgPhysics/cmgGJK.h>
 
 
 Collider::Collider(ColliderType type, const Matrix4f& offset) :
 	m_type(type),
 	m_shapeToBody(offset),
 	m_bodyToShape(offset),
-	m_body(nullptr)
+	m_body(nullptr),
+	m_queryProxyId(-1)
 {
 	m_bodyToShape.InvertAffine();
 }
@@ -17,4 +19,28 @@ void Collider::CalcDerivedData()
 	m_worldToShape = m_bodyToShape * m_body->GetWorldToBody();
 }
 
+void Collider::SetShapeToWorld(const Matrix4f& shapeToWorld)
+{
+	m_shapeToWorld = shapeToWorld;
+	m_worldToShape = shapeToWorld.GetAffineInverse();
+}
+
+Bounds Collider::GetBounds() const
+{
+	Bounds bounds;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		Vector3f direction = Vector3f::ZERO;
+		direction.v[axis] = 1.0f;
+		bounds.maxs.v[axis] = GetSupportPoint(direction).v[axis];
+		bounds.mins.v[axis] = GetSupportPoint(-direction).v[axis];
+	}
+	return bounds;
+}
+
+bool Collider::CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const
+{
+	return GJK::Cast(nullptr, this, ray.origin, ray.direction,
+		inOutDistance, outNormal);
+}
 
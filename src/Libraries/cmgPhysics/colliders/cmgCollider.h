@@ -4,6 +4,7 @@
 #include <cmgMath/types/cmgMatrix3f.h>
 #include <cmgMath/types/cmgMatrix4f.h>
 #include <cmgMath/geometry/cmgRay.h>
+#include <cmgMath/geometry/cmgBounds.h>
 #include <cmgMath/cmgMathLib.h>
 
 class RigidBody;
@@ -37,9 +38,11 @@ class Collider
 {
 public:
 	friend class RigidBody;
+	friend class SceneQuery;
 
 public:
 	Collider(ColliderType type, const Matrix4f& offset = Matrix4f::IDENTITY);
+	virtual ~Collider() {}
 	
 	// Getters
 	inline ColliderType GetType() const { return m_type; }
@@ -56,10 +59,21 @@ public:
 	virtual Matrix3f CalcInertiaTensor(float mass) const { return Matrix3f::IDENTITY; }
 	virtual Vector3f GetSupportPoint(const Vector3f& direction) const { return Vector3f::ZERO; }
 
+	// World-space bounding box, valid after CalcDerivedData. The default is
+	// found from the support points along each axis.
+	virtual Bounds GetBounds() const;
+
 
 	void CalcDerivedData();
 
-	virtual bool CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const { return false; }
+	// Place a collider that isn't part of a body, such as a shape used for
+	// scene queries
+	void SetShapeToWorld(const Matrix4f& shapeToWorld);
+
+	// Cast a ray, reporting hits closer than inOutDistance. Rays starting
+	// inside the shape hit at distance zero. The default uses GJK ray
+	// casting on the support points.
+	virtual bool CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const;
 
 
 protected:
@@ -80,6 +94,9 @@ protected:
 
 	Matrix4f m_shapeToWorld;
 	Matrix4f m_worldToShape;
+
+	// Proxy in the scene query tree, or -1
+	int m_queryProxyId;
 };
 
 
@@ -59,3 +59,19 @@ Vector3f ConeCollider::GetSupportPoint(const Vector3f& direction) const
 		return m_shapeToWorld.TransformAffine(point);
 	}
 }
+
+Bounds ConeCollider::GetBounds() const
+{
+	// Bounds of the base disc, plus the tip
+	Vector3f center = m_shapeToWorld.c3.xyz;
+	Vector3f up = m_shapeToWorld.c1.xyz;
+	Vector3f extents;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		extents.v[axis] = m_radius * Math::Sqrt(
+			Math::Max(0.0f, 1.0f - (up.v[axis] * up.v[axis])));
+	}
+	Bounds bounds(center - extents, center + extents);
+	bounds.Encapsulate(center + (up * m_height));
+	return bounds;
+}
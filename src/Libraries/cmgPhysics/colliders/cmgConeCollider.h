@@ -14,6 +14,7 @@ public:
 	Vector3f GetCenterOfMassOffset() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
 
 	inline float GetRadius() const { return m_radius; }
 	inline float GetHeight() const { return m_height; }
@@ -43,4 +43,18 @@ Vector3f ConvexMeshCollider::GetSupportPoint(const Vector3f& direction) const
 	return bestVertex;
 }
 
+Bounds ConvexMeshCollider::GetBounds() const
+{
+	Bounds bounds;
+	if (m_vertices.empty())
+	{
+		bounds.SetAsPoint(m_shapeToWorld.c3.xyz);
+		return bounds;
+	}
+	bounds.SetAsPoint(m_shapeToWorld.TransformAffine(m_vertices[0].position));
+	for (unsigned int i = 1; i < m_vertices.size(); ++i)
+		bounds.Encapsulate(m_shapeToWorld.TransformAffine(m_vertices[i].position));
+	return bounds;
+}
+
 
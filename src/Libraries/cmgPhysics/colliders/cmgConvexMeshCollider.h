@@ -73,6 +73,7 @@ public:
 	float GetVolume() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
 
 	inline const ConvexMeshVertex& GetVertex(unsigned int index) const { return m_vertices[index]; }
 	inline unsigned int GetNumVertices() const { return m_vertices.size(); }
@@ -44,3 +44,19 @@ Vector3f CylinderCollider::GetSupportPoint(const Vector3f& direction) const
 	point.z = xz.y;
 	return m_shapeToWorld.TransformAffine(point);
 }
+
+Bounds CylinderCollider::GetBounds() const
+{
+	// The end caps are discs whose extent along a world axis depends on
+	// how far that axis is from the cylinder's up axis
+	Vector3f center = m_shapeToWorld.c3.xyz;
+	Vector3f up = m_shapeToWorld.c1.xyz;
+	Vector3f extents;
+	for (unsigned int axis = 0; axis < 3; ++axis)
+	{
+		float upComponent = up.v[axis];
+		extents.v[axis] = (Math::Abs(upComponent) * m_halfHeight) + (m_radius *
+			Math::Sqrt(Math::Max(0.0f, 1.0f - (upComponent * upComponent))));
+	}
+	return Bounds(center - extents, center + extents);
+}
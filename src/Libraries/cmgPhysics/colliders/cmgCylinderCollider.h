@@ -13,6 +13,7 @@ public:
 	float GetVolume() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
 
 	inline float GetRadius() const { return m_radius; }
 	inline float GetHalfHeight() const { return m_halfHeight; }
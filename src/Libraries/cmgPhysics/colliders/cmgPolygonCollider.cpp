@@ -45,4 +45,18 @@ Vector3f PolygonCollider::GetSupportPoint(const Vector3f& direction) const
 	return bestVertex;
 }
 
+Bounds PolygonCollider::GetBounds() const
+{
+	Bounds bounds;
+	if (m_vertices.empty())
+	{
+		bounds.SetAsPoint(m_shapeToWorld.c3.xyz);
+		return bounds;
+	}
+	bounds.SetAsPoint(m_shapeToWorld.TransformAffine(m_vertices[0]));
+	for (unsigned int i = 1; i < m_vertices.size(); ++i)
+		bounds.Encapsulate(m_shapeToWorld.TransformAffine(m_vertices[i]));
+	return bounds;
+}
+
 
@@ -14,6 +14,7 @@ public:
 	float GetVolume() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
 
 	inline const Vector3f& GetVertex(unsigned int index) const { return m_vertices[index]; }
 	inline unsigned int GetNumVertices() const { return m_vertices.size(); }
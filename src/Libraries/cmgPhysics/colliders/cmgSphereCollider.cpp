@@ -32,3 +32,40 @@ Vector3f SphereCollider::GetSupportPoint(const Vector3f& direction) const
 	return m_shapeToWorld.c3.xyz +
 		(direction * (m_radius / direction.Length()));
 }
+
+Bounds SphereCollider::GetBounds() const
+{
+	Vector3f center = m_shapeToWorld.c3.xyz;
+	Vector3f extents(m_radius, m_radius, m_radius);
+	return Bounds(center - extents, center + extents);
+}
+
+bool SphereCollider::CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const
+{
+	Vector3f center = m_shapeToWorld.c3.xyz;
+	Vector3f offset = ray.origin - center;
+	float a = ray.direction.LengthSquared();
+	float b = offset.Dot(ray.direction);
+	float c = offset.LengthSquared() - (m_radius * m_radius);
+
+	// Rays starting inside the sphere hit immediately.
+	if (c <= 0.0f)
+	{
+		if (inOutDistance <= 0.0f)
+			return false;
+		inOutDistance = 0.0f;
+		outNormal = -Vector3f::Normalize(ray.direction);
+		return true;
+	}
+
+	// Solve for the nearer intersection of the ray and sphere.
+	float discriminant = (b * b) - (a * c);
+	if (b >= 0.0f || discriminant < 0.0f)
+		return false;
+	float distance = (-b - Math::Sqrt(discriminant)) / a;
+	if (distance >= inOutDistance)
+		return false;
+	inOutDistance = distance;
+	outNormal = (ray.GetPoint(distance) - center) / m_radius;
+	return true;
+}
@@ -13,6 +13,8 @@ public:
 	float GetVolume() const override;
 	Matrix3f CalcInertiaTensor(float mass) const override;
 	Vector3f GetSupportPoint(const Vector3f& direction) const override;
+	Bounds GetBounds() const override;
+	bool CastBoundedRay(const Ray& ray, float& inOutDistance, Vector3f& outNormal) const override;
 
 	inline float GetRadius() const { return m_radius; }
 
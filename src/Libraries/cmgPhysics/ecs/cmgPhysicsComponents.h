@@ -5,6 +5,7 @@
 #include <cmgMath/types/cmgMatrix4f.h>
 #include <cmgMath/ecs/cmgTransformComponent.h>
 #include <cmgPhysics/cmgMotionIntegrators.h>
+#include <cmgPhysics/cmgBatchIntegrators.h>
 
 
 struct LinearMotionComponent : public ECSComponent<LinearMotionComponent>
@@ -26,38 +27,112 @@ struct AngularMotionComponent : public ECSComponent<AngularMotionComponent>
 };
 
 
-class LinearMotionSystem : public BaseECSSystem
+class LinearMotionSystem : public ECSBatchSystem<
+	TransformComponent, LinearMotionComponent>
 {
 public:
-	LinearMotionSystem() : BaseECSSystem()
+	LinearMotionSystem() : ECSBatchSystem()
 	{
 		AddComponentType<TransformComponent>();
 		AddComponentType<LinearMotionComponent>();
+		SetName("LinearMotionSystem");
 	}
 
-	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	virtual void UpdateBatch(float delta, uint32 count,
+		ComponentSpan<TransformComponent> transforms,
+		ComponentSpan<LinearMotionComponent> motions) override
 	{
-		TransformComponent* transform = (TransformComponent*) components[0];
-		LinearMotionComponent* motion = (LinearMotionComponent*) components[1];
-		integrators::ModifiedEuler(transform->transform.position,
-			motion->velocity, motion->acceleration, delta);
+		// Same as integrators::ModifiedEuler, written per component so the
+		// loop can be inlined and vectorized
+		for (uint32 i = 0; i < count; i++)
+		{
+			Vector3f& position = transforms[i].transform.position;
+			Vector3f& velocity = motions[i].velocity;
+			const Vector3f& acceleration = motions[i].acceleration;
+			velocity.x += acceleration.x * delta;
+			velocity.y += acceleration.y * delta;
+			velocity.z += acceleration.z * delta;
+			position.x += velocity.x * delta;
+			position.y += velocity.y * delta;
+			position.z += velocity.z * delta;
+		}
 	}
 };
 
-class AngularMotionSystem : public BaseECSSystem
+class AngularMotionSystem : public ECSBatchSystem<
+	TransformComponent, AngularMotionComponent>
 {
 public:
-	AngularMotionSystem() : BaseECSSystem()
+	AngularMotionSystem() : ECSBatchSystem()
 	{
 		AddComponentType<TransformComponent>();
 		AddComponentType<AngularMotionComponent>();
+		SetName("AngularMotionSystem");
 	}
 
-	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	virtual void UpdateBatch(float delta, uint32 count,
+		ComponentSpan<TransformComponent> transforms,
+		ComponentSpan<AngularMotionComponent> motions) override
 	{
-		TransformComponent* transform = (TransformComponent*) components[0];
-		AngularMotionComponent* motion = (AngularMotionComponent*) components[1];
+		// Gather blocks of bodies into streams for the batch integrator
+		float data[19][BLOCK_SIZE];
+		integrators::AngularMotionStreams streams = {
+			data[0], data[1], data[2], data[3], data[4], data[5], data[6],
+			data[7], data[8], data[9], data[10], data[11], data[12],
+			data[13], data[14], data[15], data[16], data[17], data[18] };
+		for (uint32 begin = 0; begin < count; begin += BLOCK_SIZE)
+		{
+			uint32 blockSize = Math::Min(BLOCK_SIZE, count - begin);
+			for (uint32 i = 0; i < blockSize; i++)
+			{
+				const Transform3f& transform = transforms[begin + i].transform;
+				const AngularMotionComponent& motion = motions[begin + i];
+				data[0][i] = transform.position.x;
+				data[1][i] = transform.position.y;
+				data[2][i] = transform.position.z;
+				data[3][i] = transform.rotation.x;
+				data[4][i] = transform.rotation.y;
+				data[5][i] = transform.rotation.z;
+				data[6][i] = transform.rotation.w;
+				data[7][i] = motion.velocity.x;
+				data[8][i] = motion.velocity.y;
+				data[9][i] = motion.velocity.z;
+				data[10][i] = motion.acceleration.x;
+				data[11][i] = motion.acceleration.y;
+				data[12][i] = motion.acceleration.z;
+				data[13][i] = motion.originOffset.x;
+				data[14][i] = motion.originOffset.y;
+				data[15][i] = motion.originOffset.z;
+			}
+			integrators::AngularMotionBatch(streams, blockSize, delta);
+			for (uint32 i = 0; i < blockSize; i++)
+			{
+				Transform3f& transform = transforms[begin + i].transform;
+				AngularMotionComponent& motion = motions[begin + i];
+				transform.position.x = data[0][i];
+				transform.position.y = data[1][i];
+				transform.position.z = data[2][i];
+				transform.rotation.x = data[3][i];
+				transform.rotation.y = data[4][i];
+				transform.rotation.z = data[5][i];
+				transform.rotation.w = data[6][i];
+				motion.velocity.x = data[7][i];
+				motion.velocity.y = data[8][i];
+				motion.velocity.z = data[9][i];
+				motion.originOffsetWorld.x = data[16][i];
+				motion.originOffsetWorld.y = data[17][i];
+				motion.originOffsetWorld.z = data[18][i];
+				motion.bodyToWorld.InitRotation(transform.rotation);
+				motion.bodyToWorld.c3.xyz = transform.position;
+			}
+		}
+	}
 
+	// Update a single body, one step at a time. This gives the same results
+	// as the batched update, within rounding.
+	static void UpdateMotion(float delta, TransformComponent* transform,
+		AngularMotionComponent* motion)
+	{
 		motion->velocity += motion->acceleration * delta;
 
 		// Calculate the origin's world position
@@ -94,6 +169,9 @@ public:
 		motion->bodyToWorld.c3.xyz = transform->transform.position;
 		motion->originOffsetWorld = motion->bodyToWorld.TransformAffine(motion->originOffset);
 	}
+
+private:
+	static const uint32 BLOCK_SIZE = 64;
 };
 
 
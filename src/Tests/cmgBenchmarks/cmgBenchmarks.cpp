@@ -0,0 +1,108 @@
+// Benchmark measurement and reporting
+
+#include "cmgBenchmarks.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+
+
+//-----------------------------------------------------------------------------
+// Allocation counting
+//-----------------------------------------------------------------------------
+
+static std::atomic<size_t> g_allocationCount(0);
+
+void* operator new(size_t size)
+{
+	g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* memory = malloc(size > 0 ? size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t size) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t size) noexcept
+{
+	free(memory);
+}
+
+size_t GetAllocationCount()
+{
+	return g_allocationCount.load(std::memory_order_relaxed);
+}
+
+FrameMeasurement MeasureFrames(uint32 frames,
+	const std::function<void()>& frame)
+{
+	size_t allocations = GetAllocationCount();
+	FrameMeasurement result;
+	result.milliseconds = MeasureAverageMilliseconds(frames, frame);
+	result.allocations = (GetAllocationCount() - allocations) / (double) frames;
+	return result;
+}
+
+
+//-----------------------------------------------------------------------------
+// BenchmarkReport
+//-----------------------------------------------------------------------------
+
+bool BenchmarkReport::WriteJSON(const String& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "{\n  \"benchmarks\": [\n");
+	for (uint32 i = 0; i < m_results.size(); i++)
+	{
+		const BenchmarkResult& result = m_results[i];
+		fprintf(file, "    {\"suite\": \"%s\", \"scenario\": \"%s\", "
+			"\"storage\": \"%s\", \"entities\": %u, \"frames\": %u, "
+			"\"ms_per_frame\": %.6f, \"ns_per_entity\": %.3f, "
+			"\"allocations_per_frame\": %.2f}%s\n",
+			result.suite.c_str(), result.scenario.c_str(),
+			result.storage.c_str(), result.entities, result.frames,
+			result.msPerFrame, result.nsPerEntity, result.allocationsPerFrame,
+			(i + 1 < m_results.size() ? "," : ""));
+	}
+	fprintf(file, "  ]\n}\n");
+	return (fclose(file) == 0);
+}
+
+bool BenchmarkReport::WriteCSV(const String& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "suite,scenario,storage,entities,frames,ms_per_frame,"
+		"ns_per_entity,allocations_per_frame\n");
+	for (uint32 i = 0; i < m_results.size(); i++)
+	{
+		const BenchmarkResult& result = m_results[i];
+		fprintf(file, "%s,%s,%s,%u,%u,%.6f,%.3f,%.2f\n",
+			result.suite.c_str(), result.scenario.c_str(),
+			result.storage.c_str(), result.entities, result.frames,
+			result.msPerFrame, result.nsPerEntity, result.allocationsPerFrame);
+	}
+	return (fclose(file) == 0);
+}
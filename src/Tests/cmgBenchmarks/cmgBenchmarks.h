@@ -0,0 +1,83 @@
+#ifndef _CMG_BENCHMARKS_H_
+#define _CMG_BENCHMARKS_H_
+
+#include <cmgCore/cmgBase.h>
+#include <cmgCore/ecs/cmgECS.h>
+#include <cmgCore/containers/cmgArray.h>
+#include <cmgCore/string/cmgString.h>
+#include <cmgCore/time/cmgTimer.h>
+#include <functional>
+
+
+// Run a function a number of times and return the average time per run in
+// milliseconds
+inline double MeasureAverageMilliseconds(uint32 iterations,
+	const std::function<void()>& function)
+{
+	Timer timer;
+	timer.Start();
+	for (uint32 i = 0; i < iterations; i++)
+		function();
+	timer.Stop();
+	return timer.GetElapsedMilliseconds() / (double) iterations;
+}
+
+// Number of calls to the global operator new so far. The benchmark program
+// replaces operator new to count them.
+size_t GetAllocationCount();
+
+// Average time and number of allocations per frame
+struct FrameMeasurement
+{
+	double milliseconds;
+	double allocations;
+};
+
+FrameMeasurement MeasureFrames(uint32 frames,
+	const std::function<void()>& frame);
+
+
+//-----------------------------------------------------------------------------
+// BenchmarkReport - Results of measured scenarios, which can be written out
+// as JSON or CSV for comparing runs
+//-----------------------------------------------------------------------------
+struct BenchmarkResult
+{
+	String suite;
+	String scenario;
+	String storage;
+	uint32 entities;
+	uint32 frames;
+	double msPerFrame;
+	double nsPerEntity;
+	double allocationsPerFrame;
+};
+
+class BenchmarkReport
+{
+public:
+	inline const Array<BenchmarkResult>& GetResults() const { return m_results; }
+	inline void AddResult(const BenchmarkResult& result) { m_results.push_back(result); }
+
+	// Returns false if the file couldn't be written
+	bool WriteJSON(const String& path) const;
+	bool WriteCSV(const String& path) const;
+
+private:
+	Array<BenchmarkResult> m_results;
+};
+
+
+// Short name of a storage mode, used in the result tables
+const char* GetStorageModeName(ECSStorageMode storageMode);
+
+void RunECSBenchmarks();
+
+// Fixed-seed ECS scenarios at 1k entities and up by factors of 10
+void RunECSMicroBenchmarks(BenchmarkReport& report, uint32 maxEntities);
+
+// Motion integration of 100k bodies, one at a time and in batches
+void RunPhysicsBenchmarks(BenchmarkReport& report);
+
+
+#endif // _CMG_BENCHMARKS_H_
@@ -0,0 +1,532 @@
+// ECS Benchmarks
+
+#include "cmgBenchmarks.h"
+#include <cmgCore/ecs/cmgECS.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgCore/time/cmgTimer.h>
+#include <cmgMath/ecs/cmgTransformHierarchy.h>
+#include <cmgPhysics/ecs/cmgPhysicsComponents.h>
+#include <stdio.h>
+
+
+struct BenchPositionComponent : public ECSComponent<BenchPositionComponent>
+{
+	float x, y, z;
+};
+
+struct BenchVelocityComponent : public ECSComponent<BenchVelocityComponent>
+{
+	float x, y, z;
+};
+
+struct BenchHealthComponent : public ECSComponent<BenchHealthComponent>
+{
+	float health;
+	float regeneration;
+};
+
+struct BenchTagComponent : public ECSComponent<BenchTagComponent>
+{
+	uint32 tag;
+};
+
+class BenchMotionSystem : public BaseECSSystem
+{
+public:
+	BenchMotionSystem() : BaseECSSystem()
+	{
+		AddComponentType<BenchPositionComponent>();
+		AddComponentType<BenchVelocityComponent>(FLAG_READ_ONLY);
+		SetThreadSafe(true);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		BenchPositionComponent* position = (BenchPositionComponent*) components[0];
+		BenchVelocityComponent* velocity = (BenchVelocityComponent*) components[1];
+		position->x += velocity->x * delta;
+		position->y += velocity->y * delta;
+		position->z += velocity->z * delta;
+	}
+};
+
+class BenchHealthSystem : public BaseECSSystem
+{
+public:
+	BenchHealthSystem() : BaseECSSystem()
+	{
+		AddComponentType<BenchHealthComponent>();
+		AddComponentType<BenchTagComponent>(FLAG_OPTIONAL | FLAG_READ_ONLY);
+		SetThreadSafe(true);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		BenchHealthComponent* health = (BenchHealthComponent*) components[0];
+		health->health += health->regeneration * delta;
+	}
+};
+
+// LinearMotionSystem without batching, for comparison
+class PerEntityLinearMotionSystem : public BaseECSSystem
+{
+public:
+	PerEntityLinearMotionSystem() : BaseECSSystem()
+	{
+		AddComponentType<TransformComponent>();
+		AddComponentType<LinearMotionComponent>();
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		TransformComponent* transform = (TransformComponent*) components[0];
+		LinearMotionComponent* motion = (LinearMotionComponent*) components[1];
+		integrators::ModifiedEuler(transform->transform.position,
+			motion->velocity, motion->acceleration, delta);
+	}
+};
+
+
+//-----------------------------------------------------------------------------
+// Storage mode comparison
+//-----------------------------------------------------------------------------
+
+const char* GetStorageModeName(ECSStorageMode storageMode)
+{
+	if (storageMode == ECSStorageMode::k_archetypes)
+		return "archetypes";
+	return "pools";
+}
+
+// Populate the ECS with a mix of entity layouts, so that component pools
+// contain components of entities that a system doesn't care about
+static void CreateBenchmarkEntities(ECS& ecs, uint32 count,
+	Array<EntityHandle>& entities)
+{
+	RandomNumberGenerator random(1234);
+	BenchPositionComponent position;
+	BenchVelocityComponent velocity;
+	BenchHealthComponent health;
+	BenchTagComponent tag;
+	position.x = 0.0f;
+	position.y = 0.0f;
+	position.z = 0.0f;
+	health.health = 100.0f;
+	health.regeneration = 1.0f;
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		velocity.x = random.NextFloat();
+		velocity.y = random.NextFloat();
+		velocity.z = random.NextFloat();
+		tag.tag = i;
+
+		switch (i % 4)
+		{
+		case 0: entities.push_back(ecs.CreateEntity(position, velocity)); break;
+		case 1: entities.push_back(ecs.CreateEntity(position, velocity, health)); break;
+		case 2: entities.push_back(ecs.CreateEntity(position, health, tag)); break;
+		case 3: entities.push_back(ecs.CreateEntity(position, velocity, health, tag)); break;
+		}
+	}
+}
+
+static void BenchmarkStorageMode(ECSStorageMode storageMode, uint32 count)
+{
+	const uint32 numFrames = 50;
+	ECSSystemList systems;
+	BenchMotionSystem motionSystem;
+	BenchHealthSystem healthSystem;
+	systems.AddSystem(motionSystem);
+	systems.AddSystem(healthSystem);
+
+	ECS* ecs = new ECS(storageMode);
+	Array<EntityHandle> entities;
+	entities.reserve(count);
+
+	double createTime = MeasureAverageMilliseconds(1, [&]() {
+		CreateBenchmarkEntities(*ecs, count, entities);
+	});
+
+	double updateTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs->UpdateSystems(systems, 1.0f / 60.0f);
+	});
+
+	// Random access by entity handle
+	RandomNumberGenerator random(5678);
+	Array<EntityHandle> lookups(count);
+	for (uint32 i = 0; i < count; i++)
+		lookups[i] = entities[((random.NextInt() *
+			(RandomNumberGenerator::RANDOM_MAX + 1)) + random.NextInt()) % count];
+	float sum = 0.0f;
+	double lookupTime = MeasureAverageMilliseconds(1, [&]() {
+		for (uint32 i = 0; i < count; i++)
+			sum += ecs->GetComponent<BenchPositionComponent>(lookups[i])->x;
+	});
+
+	// Add and remove a component on every entity, moving it between layouts
+	BenchTagComponent tag;
+	tag.tag = 0;
+	double churnTime = MeasureAverageMilliseconds(1, [&]() {
+		for (uint32 i = 0; i < count; i += 4)
+		{
+			ecs->AddComponent(entities[i], tag);
+			ecs->RemoveComponent<BenchHealthComponent>(entities[i + 1]);
+		}
+	});
+
+	double destroyTime = MeasureAverageMilliseconds(1, [&]() {
+		delete ecs;
+	});
+
+	printf("%-10s %8u %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+		GetStorageModeName(storageMode), count, createTime, updateTime,
+		(updateTime * 1000000.0) / count, lookupTime, churnTime, destroyTime);
+	if (sum == 1.0f)
+		printf("\n");
+}
+
+// Spawn 10k projectiles per second at 60 frames per second, each living for
+// one second, so entity slots are continuously recycled
+static void BenchmarkProjectileChurn(ECSStorageMode storageMode)
+{
+	const uint32 spawnsPerFrame = 10000 / 60;
+	const uint32 lifetimeFrames = 60;
+	const uint32 numFrames = 600;
+	ECSSystemList systems;
+	BenchMotionSystem motionSystem;
+	systems.AddSystem(motionSystem);
+
+	ECS ecs(storageMode);
+	Array<EntityHandle> projectiles;
+	uint32 oldest = 0;
+	BenchPositionComponent position;
+	BenchVelocityComponent velocity;
+	position.x = 0.0f;
+	position.y = 0.0f;
+	position.z = 0.0f;
+	velocity.x = 1.0f;
+	velocity.y = 0.0f;
+	velocity.z = 0.0f;
+
+	double frameTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		if (projectiles.size() - oldest >= spawnsPerFrame * lifetimeFrames)
+		{
+			for (uint32 i = 0; i < spawnsPerFrame; i++)
+				ecs.RemoveEntity(projectiles[oldest++]);
+		}
+		for (uint32 i = 0; i < spawnsPerFrame; i++)
+			projectiles.push_back(ecs.CreateEntity(position, velocity));
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+
+	printf("%-10s %8u %10.3f\n", GetStorageModeName(storageMode),
+		ecs.GetNumEntities(), frameTime);
+}
+
+// Update the motion and health systems, which touch disjoint components,
+// with an increasing number of threads
+static void BenchmarkParallelUpdate(ECSStorageMode storageMode, uint32 count)
+{
+	const uint32 numFrames = 50;
+	ECSSystemList systems;
+	BenchMotionSystem motionSystem;
+	BenchHealthSystem healthSystem;
+	systems.AddSystem(motionSystem);
+	systems.AddSystem(healthSystem);
+
+	ECS ecs(storageMode);
+	Array<EntityHandle> entities;
+	CreateBenchmarkEntities(ecs, count, entities);
+
+	uint32 threadCounts[] = { 1, 2, 4, 8 };
+	for (uint32 i = 0; i < 4; i++)
+	{
+		ThreadPool threadPool(threadCounts[i]);
+		ecs.SetThreadPool(&threadPool);
+		double updateTime = MeasureAverageMilliseconds(numFrames, [&]() {
+			ecs.UpdateSystems(systems, 1.0f / 60.0f);
+		});
+		ecs.SetThreadPool(nullptr);
+		printf("%-10s %8u %8u %10.3f\n", GetStorageModeName(storageMode),
+			count, threadCounts[i], updateTime);
+	}
+}
+
+// Compare the batched LinearMotionSystem with per-entity updates
+static void BenchmarkLinearMotionBatching(ECSStorageMode storageMode, uint32 count)
+{
+	const uint32 numFrames = 50;
+	LinearMotionSystem batchSystem;
+	PerEntityLinearMotionSystem perEntitySystem;
+	ECSSystemList batchSystems;
+	ECSSystemList perEntitySystems;
+	batchSystems.AddSystem(batchSystem);
+	perEntitySystems.AddSystem(perEntitySystem);
+
+	ECS ecs(storageMode);
+	RandomNumberGenerator random(1234);
+	TransformComponent transform;
+	LinearMotionComponent motion;
+	for (uint32 i = 0; i < count; i++)
+	{
+		motion.velocity = Vector3f(random.NextFloat(),
+			random.NextFloat(), random.NextFloat());
+		motion.acceleration = Vector3f(0.0f, -9.8f, 0.0f);
+		ecs.CreateEntity(transform, motion);
+	}
+
+	double perEntityTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.UpdateSystems(perEntitySystems, 1.0f / 60.0f);
+	});
+	double batchTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.UpdateSystems(batchSystems, 1.0f / 60.0f);
+	});
+
+	printf("%-10s %8u %10.3f %10.3f %10.2fx\n",
+		GetStorageModeName(storageMode), count, perEntityTime, batchTime,
+		perEntityTime / batchTime);
+}
+
+// NextInt only has 15 bits, which is too few for large entity counts
+static uint32 RandomIndex(RandomNumberGenerator& random, uint32 count)
+{
+	return (((uint32) random.NextInt() << 15) | (uint32) random.NextInt()) % count;
+}
+
+// Join transforms with linear motion after churn has scattered the pools,
+// then co-sort the pools a millisecond per frame and join them again
+static void BenchmarkCoSortComponents(uint32 count)
+{
+	const uint32 numFrames = 50;
+	const double budgetMilliseconds = 1.0;
+	PerEntityLinearMotionSystem system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	// Static props only have a transform, and motion is added to a random
+	// subset of the entities and removed again, as projectiles come and go
+	ECS ecs;
+	RandomNumberGenerator random(1234);
+	TransformComponent transform;
+	LinearMotionComponent motion;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < count; i++)
+		entities.push_back(ecs.CreateEntity(transform));
+	for (uint32 i = 0; i < count; i++)
+	{
+		motion.velocity = Vector3f(random.NextFloat(),
+			random.NextFloat(), random.NextFloat());
+		ecs.AddComponent(entities[RandomIndex(random, count)], motion);
+	}
+	for (uint32 i = 0; i < count / 4; i++)
+		ecs.RemoveComponent<LinearMotionComponent>(entities[RandomIndex(random, count)]);
+	ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	const ECSQuery& query = system.GetQuery();
+	float ratioBefore = query.GetSequentialAccessRatio();
+
+	double beforeTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+	uint32 numPassFrames = 1;
+	Timer timer;
+	timer.Start();
+	while (!ecs.CoSortComponents(system, budgetMilliseconds))
+		numPassFrames++;
+	double sortTime = timer.GetElapsedMilliseconds();
+	double afterTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+
+	printf("%8u %8u %10.3f %10.3f %10.3f %10u %10.3f %10.3f %10.2fx\n",
+		count, query.GetNumMatches(), ratioBefore,
+		query.GetSequentialAccessRatio(), sortTime, numPassFrames,
+		beforeTime, afterTime, beforeTime / afterTime);
+}
+
+// Spawn bursts of 5000 identical debris entities, one at a time and from a
+// prefab
+static void BenchmarkInstantiate(ECSStorageMode storageMode)
+{
+	const uint32 burstSize = 5000;
+	const uint32 numBursts = 20;
+	BenchPositionComponent position;
+	BenchVelocityComponent velocity;
+	BenchHealthComponent health;
+	position.x = 0.0f;
+	position.y = 0.0f;
+	position.z = 0.0f;
+	velocity.x = 1.0f;
+	velocity.y = 0.0f;
+	velocity.z = 0.0f;
+	health.health = 100.0f;
+	health.regeneration = 1.0f;
+	ECSPrefab prefab(position, velocity, health);
+
+	ECS createECS(storageMode);
+	ECS instantiateECS(storageMode);
+	Array<EntityHandle> entities;
+	double createTime = MeasureAverageMilliseconds(numBursts, [&]() {
+		for (uint32 i = 0; i < burstSize; i++)
+			entities.push_back(createECS.CreateEntity(position, velocity, health));
+	});
+	entities.clear();
+	double instantiateTime = MeasureAverageMilliseconds(numBursts, [&]() {
+		instantiateECS.Instantiate(prefab, burstSize, entities);
+	});
+
+	printf("%-10s %8u %10.3f %12.3f %10.2fx\n",
+		GetStorageModeName(storageMode), burstSize, createTime,
+		instantiateTime, createTime / instantiateTime);
+}
+
+// Save a world to a snapshot and restore it over the live world, as a rewind
+// buffer would
+static void BenchmarkSnapshot(ECSStorageMode storageMode, uint32 count)
+{
+	const uint32 numFrames = 20;
+	ECS ecs(storageMode);
+	Array<EntityHandle> entities;
+	CreateBenchmarkEntities(ecs, count, entities);
+
+	Array<uint8> data;
+	double saveTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.SaveSnapshot(data).Check();
+	});
+	double restoreTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.RestoreSnapshot(data).Check();
+	});
+
+	printf("%-10s %8u %10.2f %10.3f %10.3f\n",
+		GetStorageModeName(storageMode), count,
+		data.size() / (1024.0 * 1024.0), saveTime, restoreTime);
+}
+
+// A scene of 20k hierarchy nodes: 200 skinned skeletons of 60 bones and
+// 2000 props with 3 attached parts each. Frames either change nothing, move
+// 1% or all of the roots, or reparent one prop part.
+static void BenchmarkTransformHierarchy(ECSStorageMode storageMode)
+{
+	const uint32 numFrames = 50;
+	ECS ecs(storageMode);
+	TransformHierarchySystem system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	RandomNumberGenerator random(1234);
+	TransformComponent transform;
+	HierarchyComponent hierarchy;
+	WorldTransformComponent world;
+	Array<EntityHandle> roots;
+	Array<EntityHandle> parts;
+	Array<EntityHandle> bones;
+	for (uint32 i = 0; i < 200; i++)
+	{
+		transform.transform.position = Vector3f(random.NextFloat(), 0.0f, random.NextFloat());
+		hierarchy.parent = NULL_ENTITY_HANDLE;
+		bones.clear();
+		bones.push_back(ecs.CreateEntity(transform, hierarchy, world));
+		roots.push_back(bones[0]);
+		for (uint32 j = 1; j < 60; j++)
+		{
+			transform.transform.position = Vector3f(0.0f, 0.1f, 0.0f);
+			hierarchy.parent = bones[random.NextInt((int) bones.size())];
+			bones.push_back(ecs.CreateEntity(transform, hierarchy, world));
+		}
+	}
+	for (uint32 i = 0; i < 2000; i++)
+	{
+		transform.transform.position = Vector3f(random.NextFloat(), 0.0f, random.NextFloat());
+		hierarchy.parent = NULL_ENTITY_HANDLE;
+		EntityHandle root = ecs.CreateEntity(transform, hierarchy, world);
+		roots.push_back(root);
+		transform.transform.position = Vector3f(0.0f, 1.0f, 0.0f);
+		hierarchy.parent = root;
+		for (uint32 j = 0; j < 3; j++)
+			parts.push_back(ecs.CreateEntity(transform, hierarchy, world));
+	}
+	ecs.UpdateSystems(systems, 1.0f / 60.0f);
+
+	uint32 frame = 0;
+	auto moveRoots = [&](uint32 step) {
+		for (uint32 i = frame % step; i < roots.size(); i += step)
+			ecs.GetComponent<TransformComponent>(roots[i])->transform.position.y += 0.01f;
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+		frame++;
+	};
+	double staticTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+	double movingTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		moveRoots(100);
+	});
+	uint32 numMovingUpdated = system.GetNumUpdated();
+	double allTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		moveRoots(1);
+	});
+	double reparentTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		EntityHandle part = parts[random.NextInt((int) parts.size())];
+		ecs.GetComponent<HierarchyComponent>(part)->parent =
+			roots[random.NextInt((int) roots.size())];
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+
+	printf("%-10s %8u %10.3f %10.3f %10u %10.3f %10.3f\n",
+		GetStorageModeName(storageMode), system.GetNumNodes(), staticTime,
+		movingTime, numMovingUpdated, allTime, reparentTime);
+}
+
+void RunECSBenchmarks()
+{
+	printf("ECS storage mode benchmark (times in ms, update averaged over frames)\n");
+	printf("%-10s %8s %10s %10s %10s %10s %10s %10s\n", "storage", "entities",
+		"create", "update", "ns/entity", "lookup", "churn", "destroy");
+
+	uint32 counts[] = { 1000, 10000, 100000 };
+	for (uint32 i = 0; i < 3; i++)
+	{
+		BenchmarkStorageMode(ECSStorageMode::k_componentPools, counts[i]);
+		BenchmarkStorageMode(ECSStorageMode::k_archetypes, counts[i]);
+	}
+
+	printf("\nProjectile spawn/despawn at 10k per second (ms per frame)\n");
+	printf("%-10s %8s %10s\n", "storage", "entities", "frame");
+	BenchmarkProjectileChurn(ECSStorageMode::k_componentPools);
+	BenchmarkProjectileChurn(ECSStorageMode::k_archetypes);
+
+	printf("\nBursts of debris entities (ms per burst)\n");
+	printf("%-10s %8s %10s %12s %11s\n", "storage", "entities",
+		"create", "instantiate", "speedup");
+	BenchmarkInstantiate(ECSStorageMode::k_componentPools);
+	BenchmarkInstantiate(ECSStorageMode::k_archetypes);
+
+	printf("\nWorld snapshots (ms per snapshot)\n");
+	printf("%-10s %8s %10s %10s %10s\n", "storage", "entities",
+		"MB", "save", "restore");
+	BenchmarkSnapshot(ECSStorageMode::k_componentPools, 100000);
+	BenchmarkSnapshot(ECSStorageMode::k_archetypes, 100000);
+
+	printf("\nTransform hierarchy update (ms per frame)\n");
+	printf("%-10s %8s %10s %10s %10s %10s %10s\n", "storage", "nodes",
+		"static", "moving 1%", "updated", "moving all", "reparent");
+	BenchmarkTransformHierarchy(ECSStorageMode::k_componentPools);
+	BenchmarkTransformHierarchy(ECSStorageMode::k_archetypes);
+
+	printf("\nLinearMotionSystem per-entity vs batched update (ms per frame)\n");
+	printf("%-10s %8s %10s %10s %11s\n", "storage", "entities",
+		"entity", "batch", "speedup");
+	BenchmarkLinearMotionBatching(ECSStorageMode::k_componentPools, 100000);
+	BenchmarkLinearMotionBatching(ECSStorageMode::k_archetypes, 100000);
+
+	printf("\nCo-sorting pools for joins, 1 ms per frame (times in ms)\n");
+	printf("%8s %8s %10s %10s %10s %10s %10s %10s %11s\n", "entities",
+		"joined", "ratio", "sorted", "sort", "frames", "before", "after",
+		"speedup");
+	BenchmarkCoSortComponents(100000);
+	BenchmarkCoSortComponents(1000000);
+
+	printf("\nParallel system update (ms per frame)\n");
+	printf("%-10s %8s %8s %10s\n", "storage", "entities", "threads", "update");
+	BenchmarkParallelUpdate(ECSStorageMode::k_componentPools, 1000000);
+	BenchmarkParallelUpdate(ECSStorageMode::k_archetypes, 1000000);
+}
@@ -0,0 +1,306 @@
+// ECS Micro Benchmarks
+//
+// Each scenario runs on a world of entities that all have component A, and
+// each of B, C and D with a probability of 3/4, chosen with a fixed seed.
+// Times are reported per entity updated, or per operation for the scenarios
+// that look up, add or remove components.
+
+#include "cmgBenchmarks.h"
+#include <cmgCore/cmgRandom.h>
+#include <stdio.h>
+
+
+struct MicroComponentA : public ECSComponent<MicroComponentA>
+{
+	float x, y, z;
+};
+
+struct MicroComponentB : public ECSComponent<MicroComponentB>
+{
+	float x, y, z;
+};
+
+struct MicroComponentC : public ECSComponent<MicroComponentC>
+{
+	float value;
+};
+
+struct MicroComponentD : public ECSComponent<MicroComponentD>
+{
+	uint32 tag;
+};
+
+class MicroIterateSystem : public BaseECSSystem
+{
+public:
+	MicroIterateSystem() : BaseECSSystem()
+	{
+		AddComponentType<MicroComponentA>();
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		MicroComponentA* a = (MicroComponentA*) components[0];
+		a->x += delta;
+	}
+};
+
+class MicroJoin2System : public BaseECSSystem
+{
+public:
+	MicroJoin2System() : BaseECSSystem()
+	{
+		AddComponentType<MicroComponentA>();
+		AddComponentType<MicroComponentB>(FLAG_READ_ONLY);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		MicroComponentA* a = (MicroComponentA*) components[0];
+		MicroComponentB* b = (MicroComponentB*) components[1];
+		a->x += b->x * delta;
+		a->y += b->y * delta;
+		a->z += b->z * delta;
+	}
+};
+
+class MicroJoin3System : public BaseECSSystem
+{
+public:
+	MicroJoin3System() : BaseECSSystem()
+	{
+		AddComponentType<MicroComponentA>();
+		AddComponentType<MicroComponentB>(FLAG_READ_ONLY);
+		AddComponentType<MicroComponentC>(FLAG_READ_ONLY);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		MicroComponentA* a = (MicroComponentA*) components[0];
+		MicroComponentB* b = (MicroComponentB*) components[1];
+		MicroComponentC* c = (MicroComponentC*) components[2];
+		a->x += b->x * c->value * delta;
+	}
+};
+
+class MicroJoin4System : public BaseECSSystem
+{
+public:
+	MicroJoin4System() : BaseECSSystem()
+	{
+		AddComponentType<MicroComponentA>();
+		AddComponentType<MicroComponentB>(FLAG_READ_ONLY);
+		AddComponentType<MicroComponentC>(FLAG_READ_ONLY);
+		AddComponentType<MicroComponentD>(FLAG_READ_ONLY);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		MicroComponentA* a = (MicroComponentA*) components[0];
+		MicroComponentB* b = (MicroComponentB*) components[1];
+		MicroComponentC* c = (MicroComponentC*) components[2];
+		MicroComponentD* d = (MicroComponentD*) components[3];
+		a->x += b->x * c->value * (float) d->tag * delta;
+	}
+};
+
+class MicroOptionalSystem : public BaseECSSystem
+{
+public:
+	MicroOptionalSystem() : BaseECSSystem()
+	{
+		AddComponentType<MicroComponentA>();
+		AddComponentType<MicroComponentB>(FLAG_OPTIONAL | FLAG_READ_ONLY);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		MicroComponentA* a = (MicroComponentA*) components[0];
+		MicroComponentB* b = (MicroComponentB*) components[1];
+		a->x += (b != nullptr ? b->x : 1.0f) * delta;
+	}
+};
+
+
+// Returns a random index below count, which may be larger than RANDOM_MAX
+static uint32 NextIndex(RandomNumberGenerator& random, uint32 count)
+{
+	uint32 value = ((uint32) random.NextInt() *
+		(RandomNumberGenerator::RANDOM_MAX + 1)) + (uint32) random.NextInt();
+	return value % count;
+}
+
+// Prefabs for each combination of the optional B, C and D components
+class MicroWorldPrefabs
+{
+public:
+	MicroWorldPrefabs()
+	{
+		MicroComponentA a;
+		MicroComponentB b;
+		MicroComponentC c;
+		MicroComponentD d;
+		a.x = 0.0f;
+		a.y = 0.0f;
+		a.z = 0.0f;
+		b.x = 1.0f;
+		b.y = 2.0f;
+		b.z = 3.0f;
+		c.value = 0.5f;
+		d.tag = 1;
+		for (uint32 mask = 0; mask < 8; mask++)
+		{
+			m_prefabs[mask].AddComponent(a);
+			if (mask & 1)
+				m_prefabs[mask].AddComponent(b);
+			if (mask & 2)
+				m_prefabs[mask].AddComponent(c);
+			if (mask & 4)
+				m_prefabs[mask].AddComponent(d);
+		}
+	}
+
+	const ECSPrefab& GetRandomPrefab(RandomNumberGenerator& random)
+	{
+		uint32 mask = 0;
+		for (uint32 bit = 0; bit < 3; bit++)
+		{
+			if (random.NextInt(4) != 0)
+				mask |= (1 << bit);
+		}
+		return m_prefabs[mask];
+	}
+
+private:
+	ECSPrefab m_prefabs[8];
+};
+
+// Number of frames to measure, so that each scenario does a similar amount
+// of work at every entity count
+static uint32 GetNumFrames(uint32 count)
+{
+	uint32 frames = 2000000 / count;
+	return (frames < 10 ? 10 : frames);
+}
+
+static void AddMicroResult(BenchmarkReport& report, const char* scenario,
+	ECSStorageMode storageMode, uint32 count, uint32 frames,
+	const FrameMeasurement& measurement, uint32 entitiesPerFrame)
+{
+	BenchmarkResult result;
+	result.suite = "ecs_micro";
+	result.scenario = scenario;
+	result.storage = GetStorageModeName(storageMode);
+	result.entities = count;
+	result.frames = frames;
+	result.msPerFrame = measurement.milliseconds;
+	result.nsPerEntity = (entitiesPerFrame > 0 ?
+		(measurement.milliseconds * 1000000.0) / entitiesPerFrame : 0.0);
+	result.allocationsPerFrame = measurement.allocations;
+	report.AddResult(result);
+
+	printf("%-10s %-14s %8u %8u %10.3f %10.2f %10.2f\n",
+		result.storage.c_str(), scenario, count, frames, result.msPerFrame,
+		result.nsPerEntity, result.allocationsPerFrame);
+}
+
+// Update a single system every frame
+static void BenchmarkSystemUpdate(BenchmarkReport& report, const char* scenario,
+	ECS& ecs, ECSStorageMode storageMode, uint32 count,
+	BaseECSSystem& system)
+{
+	uint32 frames = GetNumFrames(count);
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	// The first update builds the system's query
+	ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	FrameMeasurement measurement = MeasureFrames(frames, [&]() {
+		ecs.UpdateSystems(systems, 1.0f / 60.0f);
+	});
+	AddMicroResult(report, scenario, storageMode, count, frames, measurement,
+		system.GetQuery().GetNumMatches());
+}
+
+static void RunMicroBenchmarks(BenchmarkReport& report,
+	ECSStorageMode storageMode, uint32 count)
+{
+	RandomNumberGenerator random(1234);
+	MicroWorldPrefabs prefabs;
+	ECS ecs(storageMode);
+	Array<EntityHandle> entities;
+	entities.reserve(count);
+	for (uint32 i = 0; i < count; i++)
+		entities.push_back(ecs.Instantiate(prefabs.GetRandomPrefab(random)));
+
+	// Iteration and joins
+	MicroIterateSystem iterateSystem;
+	MicroJoin2System join2System;
+	MicroJoin3System join3System;
+	MicroJoin4System join4System;
+	MicroOptionalSystem optionalSystem;
+	BenchmarkSystemUpdate(report, "iterate", ecs, storageMode, count, iterateSystem);
+	BenchmarkSystemUpdate(report, "join2", ecs, storageMode, count, join2System);
+	BenchmarkSystemUpdate(report, "join3", ecs, storageMode, count, join3System);
+	BenchmarkSystemUpdate(report, "join4", ecs, storageMode, count, join4System);
+	BenchmarkSystemUpdate(report, "optional", ecs, storageMode, count, optionalSystem);
+
+	// GetComponent on random entities
+	uint32 frames = GetNumFrames(count);
+	Array<EntityHandle> lookups(count);
+	for (uint32 i = 0; i < count; i++)
+		lookups[i] = entities[NextIndex(random, count)];
+	float sum = 0.0f;
+	FrameMeasurement measurement = MeasureFrames(frames, [&]() {
+		for (uint32 i = 0; i < count; i++)
+			sum += ecs.GetComponent<MicroComponentA>(lookups[i])->x;
+	});
+	AddMicroResult(report, "random_access", storageMode, count, frames,
+		measurement, count);
+
+	// Add or remove D on 1% of the entities at random each frame
+	uint32 numChanges = (count / 100 > 0 ? count / 100 : 1);
+	MicroComponentD d;
+	d.tag = 2;
+	measurement = MeasureFrames(frames, [&]() {
+		for (uint32 i = 0; i < numChanges; i++)
+		{
+			EntityHandle entity = entities[NextIndex(random, count)];
+			if (ecs.HasComponent<MicroComponentD>(entity))
+				ecs.RemoveComponent<MicroComponentD>(entity);
+			else
+				ecs.AddComponent(entity, d);
+		}
+	});
+	AddMicroResult(report, "churn", storageMode, count, frames,
+		measurement, numChanges);
+
+	// Destroy 10% of the entities at random each frame and create as many
+	uint32 numReplaced = (count / 10 > 0 ? count / 10 : 1);
+	measurement = MeasureFrames(frames, [&]() {
+		for (uint32 i = 0; i < numReplaced; i++)
+		{
+			uint32 index = NextIndex(random, count);
+			ecs.RemoveEntity(entities[index]);
+			entities[index] = ecs.Instantiate(prefabs.GetRandomPrefab(random));
+		}
+	});
+	AddMicroResult(report, "create_destroy", storageMode, count, frames,
+		measurement, numReplaced);
+
+	if (sum == 1.0f)
+		printf("\n");
+}
+
+void RunECSMicroBenchmarks(BenchmarkReport& report, uint32 maxEntities)
+{
+	printf("ECS micro benchmarks (ms per frame, ns per entity or operation)\n");
+	printf("%-10s %-14s %8s %8s %10s %10s %10s\n", "storage", "scenario",
+		"entities", "frames", "frame", "ns/entity", "allocs");
+	for (uint32 count = 1000; count <= maxEntities; count *= 10)
+	{
+		RunMicroBenchmarks(report, ECSStorageMode::k_componentPools, count);
+		RunMicroBenchmarks(report, ECSStorageMode::k_archetypes, count);
+	}
+	printf("\n");
+}
@@ -0,0 +1,910 @@
+// Physics Benchmarks
+//
+// Motion integration of 100k moving bodies, one at a time and with the batch
+// integrators, both on structure-of-arrays streams and through the ECS
+// systems.
+//
+// Broadphase pair finding for 100, 1k and 10k moving spheres, testing every
+// pair against the dynamic AABB tree, sweep-and-prune, and sweep-and-prune
+// with a grid of regions. Spheres fill either a cube or a long, flat level.
+//
+// Scene queries of 4000 rays per frame against 1k and 10k static bodies,
+// casting against every collider, one ray at a time through the BVH, and as
+// a batch.
+//
+// Simulation steps of a level of 1k and 4k resting spheres, with one in 20
+// rows of them kept awake, with sleeping disabled and enabled.
+//
+// Stacks of boxes solved with 2, 4 and 8 velocity iterations, with and
+// without warm starting, measuring how far the top boxes drift.
+//
+// Contact solving for a settled pile of 1k and 4k boxes, one contact at a
+// time and with the wide SIMD solver, and with the parallel solver's
+// colors spread across 1, 2, 4 and 8 threads.
+//
+// Narrowphase collision detection for the broadphase pairs of the same
+// pile, serially and across 1, 2, 4 and 8 threads.
+//
+// Collision detection for 10k randomly posed pairs of each primitive collider
+// pair, through GJK and EPA and through the detector's collide functions.
+
+#include "cmgBenchmarks.h"
+#include <cmgCore/cmgRandom.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <cmgPhysics/cmgBatchIntegrators.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <cmgPhysics/colliders/cmgSphereCollider.h>
+#include <cmgPhysics/colliders/cmgCapsuleCollider.h>
+#include <cmgPhysics/broadphase/cmgAABBTreeBroadphase.h>
+#include <cmgPhysics/broadphase/cmgSweepAndPruneBroadphase.h>
+#include <cmgPhysics/ecs/cmgPhysicsComponents.h>
+#include <stdio.h>
+
+
+// AngularMotionSystem updating one body at a time, for comparison
+class PerEntityAngularMotionSystem : public BaseECSSystem
+{
+public:
+	PerEntityAngularMotionSystem() : BaseECSSystem()
+	{
+		AddComponentType<TransformComponent>();
+		AddComponentType<AngularMotionComponent>();
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		AngularMotionSystem::UpdateMotion(delta,
+			(TransformComponent*) components[0],
+			(AngularMotionComponent*) components[1]);
+	}
+};
+
+// Structure-of-arrays storage for the motion of a number of bodies
+struct MotionStreamData
+{
+	Array<float> data[19];
+
+	MotionStreamData(uint32 count)
+	{
+		RandomNumberGenerator random(1234);
+		for (uint32 i = 0; i < 19; i++)
+		{
+			data[i].resize(count);
+			for (uint32 j = 0; j < count; j++)
+				data[i][j] = random.NextFloat() - 0.5f;
+		}
+
+		// Unit orientations, and no origin offset
+		for (uint32 j = 0; j < count; j++)
+		{
+			Quaternion rotation(data[3][j], data[4][j], data[5][j], data[6][j]);
+			rotation.Normalize();
+			data[3][j] = rotation.x;
+			data[4][j] = rotation.y;
+			data[5][j] = rotation.z;
+			data[6][j] = rotation.w;
+			data[13][j] = 0.0f;
+			data[14][j] = 0.0f;
+			data[15][j] = 0.0f;
+		}
+	}
+
+	integrators::LinearMotionStreams GetLinearStreams()
+	{
+		integrators::LinearMotionStreams streams = {
+			data[0].data(), data[1].data(), data[2].data(),
+			data[7].data(), data[8].data(), data[9].data(),
+			data[10].data(), data[11].data(), data[12].data() };
+		return streams;
+	}
+
+	integrators::AngularMotionStreams GetAngularStreams()
+	{
+		integrators::AngularMotionStreams streams = {
+			data[0].data(), data[1].data(), data[2].data(),
+			data[3].data(), data[4].data(), data[5].data(), data[6].data(),
+			data[7].data(), data[8].data(), data[9].data(),
+			data[10].data(), data[11].data(), data[12].data(),
+			data[13].data(), data[14].data(), data[15].data(),
+			data[16].data(), data[17].data(), data[18].data() };
+		return streams;
+	}
+};
+
+static void AddPhysicsResult(BenchmarkReport& report, const char* scenario,
+	const char* path, uint32 count, uint32 frames, double scalarTime,
+	const FrameMeasurement& measurement)
+{
+	BenchmarkResult result;
+	result.suite = "physics";
+	result.scenario = scenario;
+	result.storage = path;
+	result.entities = count;
+	result.frames = frames;
+	result.msPerFrame = measurement.milliseconds;
+	result.nsPerEntity = (measurement.milliseconds * 1000000.0) / count;
+	result.allocationsPerFrame = measurement.allocations;
+	report.AddResult(result);
+
+	printf("%-16s %-10s %8u %10.3f %10.3f %10.2fx\n", scenario, path, count,
+		scalarTime, result.msPerFrame, scalarTime / result.msPerFrame);
+}
+
+// Spheres bouncing around inside a box sized to keep the same density for
+// any number of spheres. The box is either a cube, or a flat level stretched
+// along the X axis.
+struct BroadphaseScene
+{
+	static const float RADIUS;
+
+	Array<Vector3f> positions;
+	Array<Vector3f> velocities;
+	Array<Bounds> bounds;
+	Vector3f halfSize;
+
+	BroadphaseScene(uint32 count, bool flat)
+	{
+		RandomNumberGenerator random(1234);
+		halfSize = GetWorldBounds(count, flat).maxs;
+		positions.resize(count);
+		velocities.resize(count);
+		bounds.resize(count);
+		for (uint32 i = 0; i < count; i++)
+		{
+			positions[i] = Vector3f(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * (halfSize * 2.0f);
+			velocities[i] = Vector3f(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * 4.0f;
+			UpdateBounds(i);
+		}
+	}
+
+	static Bounds GetWorldBounds(uint32 count, bool flat)
+	{
+		Vector3f halfSize = Vector3f::ONE *
+			(Math::Pow((float) count, 1.0f / 3.0f) * RADIUS * 2.5f);
+		if (flat)
+			halfSize *= Vector3f(8.0f, 0.125f, 1.0f);
+		return Bounds(-halfSize, halfSize);
+	}
+
+	void Step(float delta)
+	{
+		for (uint32 i = 0; i < positions.size(); i++)
+		{
+			positions[i] += velocities[i] * delta;
+			for (uint32 axis = 0; axis < 3; axis++)
+			{
+				if (Math::Abs(positions[i][axis]) > halfSize[axis])
+					velocities[i][axis] = -velocities[i][axis];
+			}
+			UpdateBounds(i);
+		}
+	}
+
+	void UpdateBounds(uint32 index)
+	{
+		Vector3f extents(RADIUS, RADIUS, RADIUS);
+		bounds[index] = Bounds(positions[index] - extents, positions[index] + extents);
+	}
+};
+
+const float BroadphaseScene::RADIUS = 0.5f;
+
+static void MeasureBroadphase(BenchmarkReport& report, const char* scenario,
+	const char* path, Broadphase& broadphase, uint32 count, bool flat,
+	uint32 numFrames, double bruteTime)
+{
+	const float delta = 1.0f / 60.0f;
+	BroadphaseScene scene(count, flat);
+	Array<int32> proxies(count);
+	for (uint32 i = 0; i < count; i++)
+		proxies[i] = broadphase.CreateProxy(scene.bounds[i], nullptr, false);
+	broadphase.UpdatePairs();
+
+	FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+		scene.Step(delta);
+		for (uint32 i = 0; i < count; i++)
+		{
+			broadphase.MoveProxy(proxies[i], scene.bounds[i],
+				scene.velocities[i] * delta);
+		}
+		broadphase.UpdatePairs();
+	});
+	AddPhysicsResult(report, scenario, path, count, numFrames,
+		bruteTime, measurement);
+}
+
+static void RunBroadphaseBenchmarks(BenchmarkReport& report)
+{
+	const uint32 counts[] = { 100, 1000, 10000 };
+	const float delta = 1.0f / 60.0f;
+
+	printf("Broadphase pair finding for moving spheres (ms per frame)\n");
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"brute", "time", "speedup");
+
+	for (uint32 layout = 0; layout < 2; layout++)
+	{
+		bool flat = (layout == 1);
+		const char* scenario = (flat ? "broadphase_flat" : "broadphase");
+		for (uint32 k = 0; k < 3; k++)
+		{
+			uint32 count = counts[k];
+			uint32 numFrames = (count >= 10000 ? 10 : 50);
+
+			// Test every pair of bounds, as the narrowphase loop used to
+			BroadphaseScene bruteScene(count, flat);
+			Array<uint32> brutePairs;
+			double bruteTime = MeasureAverageMilliseconds(numFrames, [&]() {
+				bruteScene.Step(delta);
+				brutePairs.clear();
+				for (uint32 i = 0; i < count; i++)
+				{
+					for (uint32 j = i + 1; j < count; j++)
+					{
+						if (bruteScene.bounds[i].Intersects(bruteScene.bounds[j]))
+						{
+							brutePairs.push_back(i);
+							brutePairs.push_back(j);
+						}
+					}
+				}
+			});
+
+			AABBTreeBroadphase tree;
+			MeasureBroadphase(report, scenario, "aabb_tree", tree,
+				count, flat, numFrames, bruteTime);
+
+			// Sorted along the longest axis, which is X for the flat level
+			SweepAndPruneBroadphase sweepAndPrune;
+			MeasureBroadphase(report, scenario, "sap", sweepAndPrune,
+				count, flat, numFrames, bruteTime);
+
+			// A grid of regions over the level
+			SweepAndPruneBroadphase multiBox;
+			multiBox.SetRegionGrid(BroadphaseScene::GetWorldBounds(count, flat),
+				(flat ? 16 : 4), 4);
+			MeasureBroadphase(report, scenario, "mbp", multiBox,
+				count, flat, numFrames, bruteTime);
+		}
+	}
+	printf("\n");
+}
+
+static void RunSceneQueryBenchmarks(BenchmarkReport& report)
+{
+	const uint32 counts[] = { 1000, 10000 };
+	const uint32 numRays = 4000;
+	const uint32 numFrames = 10;
+	const float maxDistance = 50.0f;
+
+	printf("Scene queries of %u rays (ms per frame)\n", numRays);
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"brute", "time", "speedup");
+
+	for (uint32 k = 0; k < 2; k++)
+	{
+		// Static spheres, boxes and capsules spread out like the broadphase
+		// scene, with rays in random directions from random points
+		uint32 count = counts[k];
+		RandomNumberGenerator random(1234);
+		Vector3f halfSize = BroadphaseScene::GetWorldBounds(count, false).maxs * 2.0f;
+		PhysicsEngine engine;
+		for (uint32 i = 0; i < count; i++)
+		{
+			RigidBody* body = new RigidBody();
+			if (i % 3 == 0)
+				body->AddCollider(new SphereCollider(0.5f));
+			else if (i % 3 == 1)
+				body->AddCollider(new BoxCollider(Vector3f(0.5f, 0.25f, 1.0f)));
+			else
+				body->AddCollider(new CapsuleCollider(0.25f, 0.5f));
+			body->SetPosition(Vector3f(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * (halfSize * 2.0f));
+			body->SetOrientation(Quaternion(Vector3f::UNITY, random.NextFloat() * 6.0f));
+			body->SetInverseMass(0.0f);
+			engine.AddBody(body);
+		}
+		engine.UpdateSceneQueries();
+
+		// Rays in random directions from random points, and fans of 40 rays
+		// from each of 100 agents
+		Array<Ray> randomRays(numRays);
+		Array<Ray> fanRays(numRays);
+		Array<float> maxDistances(numRays, maxDistance);
+		for (uint32 i = 0; i < numRays; i++)
+		{
+			randomRays[i].origin = Vector3f(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * (halfSize * 2.0f);
+			randomRays[i].direction = Vector3f::Normalize(Vector3f(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) + Vector3f(0.0f, 0.0f, 0.01f));
+		}
+		for (uint32 i = 0; i < numRays; i += 40)
+		{
+			Vector3f origin = randomRays[i].origin;
+			float heading = random.NextFloat() * 6.0f;
+			for (uint32 j = 0; j < 40; j++)
+			{
+				float angle = heading + (j * 0.02f);
+				fanRays[i + j].origin = origin;
+				fanRays[i + j].direction = Vector3f(Math::Cos(angle), 0.0f, Math::Sin(angle));
+			}
+		}
+		for (uint32 layout = 0; layout < 2; layout++)
+		{
+			const Array<Ray>& rays = (layout == 0 ? randomRays : fanRays);
+			const char* scenario = (layout == 0 ? "raycast_random" : "raycast_fans");
+
+			// Cast against every collider, as PhysicsEngine::CastBoundedRay
+			// used to
+			double bruteTime = MeasureAverageMilliseconds((count >= 10000 ? 1 : 3), [&]() {
+				for (uint32 i = 0; i < numRays; i++)
+				{
+					float distance = maxDistance;
+					Vector3f normal;
+					for (uint32 j = 0; j < count; j++)
+						engine.GetBody(j)->GetCollider()->CastBoundedRay(rays[i], distance, normal);
+				}
+			});
+
+			Array<SceneQueryHit> hits;
+			FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+				for (uint32 i = 0; i < numRays; i++)
+					engine.CastRay(rays[i], maxDistance, SceneQueryMode::k_closest, hits);
+			});
+			AddPhysicsResult(report, scenario, "bvh", count, numFrames,
+				bruteTime, measurement);
+			measurement = MeasureFrames(numFrames, [&]() {
+				engine.CastRays(rays.data(), maxDistances.data(), numRays,
+					SceneQueryMode::k_closest, hits);
+			});
+			AddPhysicsResult(report, scenario, "batch", count, numFrames,
+				bruteTime, measurement);
+			measurement = MeasureFrames(numFrames, [&]() {
+				engine.CastRays(rays.data(), maxDistances.data(), numRays,
+					SceneQueryMode::k_any, hits);
+			});
+			AddPhysicsResult(report, scenario, "batch_any", count, numFrames,
+				bruteTime, measurement);
+		}
+	}
+	printf("\n");
+}
+
+// Rows of spheres resting on the floor between walls, as in the island
+// tests, with every 20th row kept awake
+struct RestingScene
+{
+	static const uint32 ROW_LENGTH = 4;
+
+	PhysicsEngine engine;
+	Array<RigidBody*> awakeBodies;
+
+	RestingScene(uint32 count, bool enableSleeping)
+	{
+		engine.SetEnableSleeping(enableSleeping);
+		uint32 numRows = count / ROW_LENGTH;
+		uint32 rowsPerLine = (uint32) Math::Sqrt((float) numRows);
+		float halfSize = rowsPerLine * 4.0f;
+
+		RigidBody* floor = new RigidBody();
+		floor->AddCollider(new BoxCollider(Vector3f(halfSize, 0.5f, halfSize)));
+		floor->SetPosition(Vector3f(halfSize, -0.5f, halfSize));
+		floor->SetInverseMass(0.0f);
+		engine.AddBody(floor);
+
+		for (uint32 row = 0; row < numRows; row++)
+		{
+			Vector3f origin((row % rowsPerLine) * 8.0f, 0.5f,
+				(row / rowsPerLine) * 3.0f + 1.0f);
+			for (uint32 i = 0; i < ROW_LENGTH; i++)
+			{
+				RigidBody* sphere = new RigidBody();
+				sphere->AddCollider(new SphereCollider(0.5f));
+				sphere->SetPosition(origin + Vector3f(1.0f + i * 0.99f, 0.0f, 0.0f));
+				engine.AddBody(sphere);
+				if (row % 20 == 0)
+					awakeBodies.push_back(sphere);
+			}
+			for (uint32 i = 0; i < 2; i++)
+			{
+				RigidBody* wall = new RigidBody();
+				wall->AddCollider(new BoxCollider(Vector3f(0.5f, 1.0f, 1.0f)));
+				wall->SetPosition(origin + Vector3f(i * (ROW_LENGTH + 1) * 0.99f, 0.5f, 0.0f));
+				wall->SetInverseMass(0.0f);
+				engine.AddBody(wall);
+			}
+		}
+
+		// Let the sleeping rows fall asleep
+		for (uint32 i = 0; i < 60; i++)
+			Step();
+	}
+
+	void Step()
+	{
+		for (uint32 i = 0; i < awakeBodies.size(); i++)
+			awakeBodies[i]->WakeUp();
+		engine.Simulate(1.0f / 60.0f);
+	}
+};
+
+static void RunSleepingBenchmarks(BenchmarkReport& report)
+{
+	const uint32 counts[] = { 1000, 4000 };
+	const uint32 numFrames = 20;
+
+	printf("Simulation of resting spheres, 5%% awake (ms per frame)\n");
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"no_sleep", "time", "speedup");
+
+	for (uint32 k = 0; k < 2; k++)
+	{
+		RestingScene awakeScene(counts[k], false);
+		double awakeTime = MeasureAverageMilliseconds(numFrames, [&]() {
+			awakeScene.Step();
+		});
+		RestingScene sleepingScene(counts[k], true);
+		FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+			sleepingScene.Step();
+		});
+		AddPhysicsResult(report, "resting_level", "sleeping", counts[k],
+			numFrames, awakeTime, measurement);
+	}
+	printf("\n");
+}
+
+// A grid of stacks of boxes resting on the floor
+struct StackScene
+{
+	static const uint32 STACK_HEIGHT = 5;
+
+	PhysicsEngine engine;
+	Array<RigidBody*> topBoxes;
+	Array<Vector3f> topPositions;
+
+	StackScene(uint32 numStacks, bool enableWarmStarting, uint32 iterations)
+	{
+		engine.SetEnableSleeping(false);
+		engine.SetEnableWarmStarting(enableWarmStarting);
+		engine.SetNumVelocityIterations(iterations);
+		uint32 stacksPerLine = (uint32) Math::Sqrt((float) numStacks);
+		float halfSize = stacksPerLine * 1.5f;
+
+		RigidBody* floor = new RigidBody();
+		floor->AddCollider(new BoxCollider(Vector3f(halfSize, 0.5f, halfSize)));
+		floor->SetPosition(Vector3f(halfSize, -0.5f, halfSize));
+		floor->SetInverseMass(0.0f);
+		engine.AddBody(floor);
+
+		for (uint32 stack = 0; stack < numStacks; stack++)
+		{
+			Vector3f origin((stack % stacksPerLine) * 3.0f + 1.5f, 0.5f,
+				(stack / stacksPerLine) * 3.0f + 1.5f);
+			RigidBody* box = nullptr;
+			for (uint32 i = 0; i < STACK_HEIGHT; i++)
+			{
+				box = new RigidBody();
+				box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+				box->SetPosition(origin + Vector3f(0.0f, (float) i, 0.0f));
+				engine.AddBody(box);
+			}
+			topBoxes.push_back(box);
+			topPositions.push_back(box->GetPosition());
+		}
+	}
+
+	void Step()
+	{
+		engine.Simulate(1.0f / 60.0f);
+	}
+
+	// Returns the average distance the top boxes have moved from where
+	// they started
+	float GetAverageDrift() const
+	{
+		float drift = 0.0f;
+		for (uint32 i = 0; i < topBoxes.size(); i++)
+			drift += (topBoxes[i]->GetPosition() - topPositions[i]).Length();
+		return drift / topBoxes.size();
+	}
+};
+
+static void RunStackingBenchmarks(BenchmarkReport& report)
+{
+	const uint32 numStacks = 25;
+	const uint32 numFrames = 300;
+	const uint32 iterations[] = { 2, 4, 8 };
+	const char* scenarios[] = { "box_stacks_2", "box_stacks_4", "box_stacks_8" };
+	const char* paths[] = { "cold", "warm_start" };
+
+	printf("Simulation of %u stacks of %u boxes over %u frames\n",
+		numStacks, StackScene::STACK_HEIGHT, numFrames);
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"iterations", "time", "top_drift");
+
+	for (uint32 k = 0; k < 3; k++)
+	{
+		for (uint32 warm = 0; warm < 2; warm++)
+		{
+			StackScene scene(numStacks, warm != 0, iterations[k]);
+			FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+				scene.Step();
+			});
+			uint32 count = numStacks * StackScene::STACK_HEIGHT;
+
+			BenchmarkResult result;
+			result.suite = "physics";
+			result.scenario = scenarios[k];
+			result.storage = paths[warm];
+			result.entities = count;
+			result.frames = numFrames;
+			result.msPerFrame = measurement.milliseconds;
+			result.nsPerEntity = (measurement.milliseconds * 1000000.0) / count;
+			result.allocationsPerFrame = measurement.allocations;
+			report.AddResult(result);
+
+			printf("%-16s %-10s %8u %10u %10.3f %10.3fm\n",
+				scenarios[k], paths[warm], count, iterations[k],
+				result.msPerFrame, scene.GetAverageDrift());
+		}
+	}
+	printf("\n");
+}
+
+// A pile of boxes ten layers high, dropped onto the floor and left to settle
+struct PileScene
+{
+	PhysicsEngine engine;
+
+	PileScene(uint32 numBoxes, ContactSolverMode mode,
+		ThreadPool* threadPool = nullptr)
+	{
+		engine.SetEnableSleeping(false);
+		engine.SetContactSolverMode(mode);
+		engine.SetThreadPool(threadPool);
+		uint32 boxesPerLine = (uint32) Math::Sqrt(numBoxes / 10.0f);
+		float halfSize = boxesPerLine * 0.6f + 1.0f;
+
+		RigidBody* floor = new RigidBody();
+		floor->AddCollider(new BoxCollider(Vector3f(halfSize, 0.5f, halfSize)));
+		floor->SetPosition(Vector3f(halfSize - 1.0f, -0.5f, halfSize - 1.0f));
+		floor->SetInverseMass(0.0f);
+		engine.AddBody(floor);
+
+		RandomNumberGenerator random(1234);
+		uint32 boxesPerLayer = boxesPerLine * boxesPerLine;
+		for (uint32 i = 0; i < numBoxes; i++)
+		{
+			uint32 layer = i / boxesPerLayer;
+			RigidBody* box = new RigidBody();
+			box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+			box->SetPosition(Vector3f(
+				(i % boxesPerLine) * 1.1f + (layer % 2) * 0.3f,
+				0.5f + layer * 1.05f,
+				((i / boxesPerLine) % boxesPerLine) * 1.1f) +
+				Vector3f(random.NextFloat(), 0.0f, random.NextFloat()) * 0.1f);
+			engine.AddBody(box);
+		}
+		for (uint32 frame = 0; frame < 30; frame++)
+			Step();
+	}
+
+	// Returns the time spent solving contact velocities, in milliseconds
+	double Step()
+	{
+		engine.Simulate(1.0f / 60.0f);
+		return engine.GetProfiler()->GetSubSection(
+			"Collision Response")->GetTotalTime() * 1000.0;
+	}
+
+	// Returns the time spent detecting collisions in the last step, in
+	// milliseconds
+	double GetDetectionTime()
+	{
+		return engine.GetProfiler()->GetSubSection(
+			"Collision Detection")->GetTotalTime() * 1000.0;
+	}
+
+	// Returns the time spent solving contact positions in the last step, in
+	// milliseconds
+	double GetPositionTime()
+	{
+		return engine.GetProfiler()->GetSubSection(
+			"Positional Correction")->GetTotalTime() * 1000.0;
+	}
+};
+
+static void RunContactSolverBenchmarks(BenchmarkReport& report)
+{
+	const uint32 counts[] = { 1000, 4000 };
+	const uint32 numFrames = 20;
+
+	printf("Contact solving for a pile of boxes with %s, %u wide "
+		"(ms per frame)\n", ContactSolver::GetBatchInstructionSet(),
+		ContactSolver::GetBatchWidth());
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"sequential", "time", "speedup");
+
+	for (uint32 k = 0; k < 2; k++)
+	{
+		PileScene sequentialScene(counts[k], ContactSolverMode::k_sequential);
+		double sequentialTime = 0.0;
+		for (uint32 frame = 0; frame < numFrames; frame++)
+			sequentialTime += sequentialScene.Step();
+		sequentialTime /= numFrames;
+
+		PileScene wideScene(counts[k], ContactSolverMode::k_wide);
+		FrameMeasurement measurement = { 0.0, 0.0 };
+		for (uint32 frame = 0; frame < numFrames; frame++)
+			measurement.milliseconds += wideScene.Step();
+		measurement.milliseconds /= numFrames;
+		AddPhysicsResult(report, "box_pile", "wide", counts[k],
+			numFrames, sequentialTime, measurement);
+	}
+	printf("\n");
+}
+
+static void RunParallelSolverBenchmarks(BenchmarkReport& report)
+{
+	const uint32 numBoxes = 4000;
+	const uint32 numFrames = 20;
+	const uint32 threadCounts[] = { 1, 2, 4, 8 };
+	const char* paths[] = { "threads_1", "threads_2", "threads_4", "threads_8" };
+
+	printf("Contact velocity and position solving for a pile of boxes across "
+		"threads (ms per frame)\n");
+	printf("%-16s %-10s %8s %10s %10s %11s %7s %10s\n", "scenario", "path",
+		"bodies", "sequential", "time", "speedup", "colors", "max_color");
+
+	PileScene sequentialScene(numBoxes, ContactSolverMode::k_sequential);
+	double sequentialTime = 0.0;
+	for (uint32 frame = 0; frame < numFrames; frame++)
+		sequentialTime += sequentialScene.Step() + sequentialScene.GetPositionTime();
+	sequentialTime /= numFrames;
+
+	for (uint32 k = 0; k < 4; k++)
+	{
+		ThreadPool threadPool(threadCounts[k]);
+		PileScene scene(numBoxes, ContactSolverMode::k_parallel, &threadPool);
+		double time = 0.0;
+		double maxColorTime = 0.0;
+		for (uint32 frame = 0; frame < numFrames; frame++)
+		{
+			time += scene.Step() + scene.GetPositionTime();
+			const ContactSolver* solver = scene.engine.GetContactSolver();
+			for (uint32 i = 0; i < solver->GetNumColors(); i++)
+				maxColorTime = Math::Max(maxColorTime, solver->GetColor(i).solveTime);
+		}
+		time /= numFrames;
+
+		BenchmarkResult result;
+		result.suite = "physics";
+		result.scenario = "box_pile_colors";
+		result.storage = paths[k];
+		result.entities = numBoxes;
+		result.frames = numFrames;
+		result.msPerFrame = time;
+		result.nsPerEntity = (time * 1000000.0) / numBoxes;
+		result.allocationsPerFrame = 0.0;
+		report.AddResult(result);
+
+		printf("%-16s %-10s %8u %10.3f %10.3f %10.2fx %7u %10.3f\n",
+			result.scenario.c_str(), paths[k], numBoxes, sequentialTime, time,
+			sequentialTime / time, scene.engine.GetContactSolver()->GetNumColors(),
+			maxColorTime * 1000.0);
+	}
+	printf("\n");
+}
+
+static void RunNarrowphaseBenchmarks(BenchmarkReport& report)
+{
+	const uint32 numBoxes = 4000;
+	const uint32 numFrames = 20;
+	const uint32 threadCounts[] = { 1, 2, 4, 8 };
+	const char* paths[] = { "threads_1", "threads_2", "threads_4", "threads_8" };
+
+	printf("Narrowphase for a pile of boxes across threads (ms per frame)\n");
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"serial", "time", "speedup");
+
+	PileScene serialScene(numBoxes, ContactSolverMode::k_sequential);
+	double serialTime = 0.0;
+	for (uint32 frame = 0; frame < numFrames; frame++)
+	{
+		serialScene.Step();
+		serialTime += serialScene.GetDetectionTime();
+	}
+	serialTime /= numFrames;
+
+	for (uint32 k = 0; k < 4; k++)
+	{
+		ThreadPool threadPool(threadCounts[k]);
+		PileScene scene(numBoxes, ContactSolverMode::k_sequential, &threadPool);
+		FrameMeasurement measurement = { 0.0, 0.0 };
+		for (uint32 frame = 0; frame < numFrames; frame++)
+		{
+			scene.Step();
+			measurement.milliseconds += scene.GetDetectionTime();
+		}
+		measurement.milliseconds /= numFrames;
+		AddPhysicsResult(report, "narrowphase", paths[k], numBoxes,
+			numFrames, serialTime, measurement);
+	}
+	printf("\n");
+}
+
+// Pairs of bodies with one collider each, posed randomly so that most of
+// them overlap
+class ColliderPairScene
+{
+public:
+	ColliderPairScene(uint32 count, const std::function<Collider*()>& createA,
+		const std::function<Collider*()>& createB)
+	{
+		RandomNumberGenerator random(1234);
+		for (uint32 i = 0; i < count * 2; i++)
+		{
+			RigidBody* body = new RigidBody();
+			body->AddCollider(i % 2 == 0 ? createA() : createB());
+			body->SetPosition(Vector3f(random.NextFloat(),
+				random.NextFloat(), random.NextFloat()));
+			Vector3f axis(random.NextFloat() - 0.5f,
+				random.NextFloat() - 0.5f, random.NextFloat() - 0.5f);
+			if (axis.LengthSquared() < 0.01f)
+				axis = Vector3f::UP;
+			axis.Normalize();
+			body->SetOrientation(Quaternion(axis,
+				random.NextFloat() * Math::TWO_PI));
+			body->CalculateDerivedData();
+			m_bodies.push_back(body);
+		}
+	}
+
+	~ColliderPairScene()
+	{
+		for (RigidBody* body : m_bodies)
+			delete body;
+	}
+
+	void Detect(bool useGJK)
+	{
+		for (uint32 i = 0; i < m_bodies.size(); i += 2)
+		{
+			Collider* a = m_bodies[i]->GetCollider();
+			Collider* b = m_bodies[i + 1]->GetCollider();
+			m_collision.numContacts = 0;
+			if (useGJK)
+				m_detector.DetectCollisionGJK(a, b, &m_collision);
+			else
+				m_detector.DetectCollision(a, b, &m_collision);
+		}
+	}
+
+private:
+	Array<RigidBody*> m_bodies;
+	CollisionDetector m_detector;
+	CollisionData m_collision;
+};
+
+static void RunCollidePairBenchmarks(BenchmarkReport& report)
+{
+	const uint32 count = 10000;
+	const uint32 numFrames = 20;
+
+	printf("Collision detection for %u collider pairs (ms per frame)\n", count);
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "pairs",
+		"gjk", "function", "speedup");
+
+	auto sphere = []() -> Collider* { return new SphereCollider(0.5f); };
+	auto box = []() -> Collider* { return new BoxCollider(Vector3f(0.5f, 0.4f, 0.3f)); };
+	auto capsule = []() -> Collider* { return new CapsuleCollider(0.3f, 0.6f); };
+	struct
+	{
+		const char* scenario;
+		std::function<Collider*()> createA;
+		std::function<Collider*()> createB;
+	} pairs[] = {
+		{ "sphere_sphere", sphere, sphere },
+		{ "sphere_box", sphere, box },
+		{ "sphere_capsule", sphere, capsule },
+		{ "capsule_capsule", capsule, capsule },
+		{ "box_box", box, box },
+	};
+
+	for (auto& pair : pairs)
+	{
+		ColliderPairScene scene(count, pair.createA, pair.createB);
+		double gjkTime = MeasureAverageMilliseconds(numFrames, [&]() {
+			scene.Detect(true);
+		});
+		FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+			scene.Detect(false);
+		});
+		AddPhysicsResult(report, pair.scenario, "function", count,
+			numFrames, gjkTime, measurement);
+	}
+	printf("\n");
+}
+
+void RunPhysicsBenchmarks(BenchmarkReport& report)
+{
+	const uint32 count = 100000;
+	const uint32 numFrames = 50;
+	const float delta = 1.0f / 60.0f;
+	const char* instructionSet = integrators::GetBatchInstructionSet();
+
+	printf("Motion integration of %u bodies (ms per frame, batches use %s)\n",
+		count, instructionSet);
+	printf("%-16s %-10s %8s %10s %10s %11s\n", "scenario", "path", "bodies",
+		"scalar", "batch", "speedup");
+
+	// Structure-of-arrays streams
+	MotionStreamData streams(count);
+	integrators::LinearMotionStreams linear = streams.GetLinearStreams();
+	integrators::AngularMotionStreams angular = streams.GetAngularStreams();
+	double scalarTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		integrators::ModifiedEulerBatchScalar(linear, count, delta);
+	});
+	FrameMeasurement measurement = MeasureFrames(numFrames, [&]() {
+		integrators::ModifiedEulerBatch(linear, count, delta);
+	});
+	AddPhysicsResult(report, "linear_streams", instructionSet, count,
+		numFrames, scalarTime, measurement);
+	scalarTime = MeasureAverageMilliseconds(numFrames, [&]() {
+		integrators::AngularMotionBatchScalar(angular, count, delta);
+	});
+	measurement = MeasureFrames(numFrames, [&]() {
+		integrators::AngularMotionBatch(angular, count, delta);
+	});
+	AddPhysicsResult(report, "angular_streams", instructionSet, count,
+		numFrames, scalarTime, measurement);
+
+	// ECS systems, for each storage mode
+	ECSStorageMode storageModes[] = {
+		ECSStorageMode::k_componentPools, ECSStorageMode::k_archetypes };
+	for (uint32 mode = 0; mode < 2; mode++)
+	{
+		ECS ecs(storageModes[mode]);
+		RandomNumberGenerator random(1234);
+		TransformComponent transform;
+		LinearMotionComponent linearMotion;
+		AngularMotionComponent angularMotion;
+		for (uint32 i = 0; i < count; i++)
+		{
+			transform.transform.rotation = Quaternion(Vector3f::UNITY, random.NextFloat());
+			linearMotion.velocity = Vector3f(random.NextFloat(), random.NextFloat(), random.NextFloat());
+			linearMotion.acceleration = Vector3f(0.0f, -9.8f, 0.0f);
+			angularMotion.velocity = Vector3f(random.NextFloat(), random.NextFloat(), random.NextFloat());
+			ecs.CreateEntity(transform, linearMotion, angularMotion);
+		}
+
+		AngularMotionSystem batchSystem;
+		PerEntityAngularMotionSystem perEntitySystem;
+		ECSSystemList batchSystems;
+		ECSSystemList perEntitySystems;
+		batchSystems.AddSystem(batchSystem);
+		perEntitySystems.AddSystem(perEntitySystem);
+		scalarTime = MeasureAverageMilliseconds(numFrames, [&]() {
+			ecs.UpdateSystems(perEntitySystems, delta);
+		});
+		measurement = MeasureFrames(numFrames, [&]() {
+			ecs.UpdateSystems(batchSystems, delta);
+		});
+		AddPhysicsResult(report, "angular_system",
+			GetStorageModeName(storageModes[mode]), count, numFrames,
+			scalarTime, measurement);
+	}
+	printf("\n");
+
+	RunBroadphaseBenchmarks(report);
+	RunSceneQueryBenchmarks(report);
+	RunSleepingBenchmarks(report);
+	RunStackingBenchmarks(report);
+	RunContactSolverBenchmarks(report);
+	RunParallelSolverBenchmarks(report);
+	RunNarrowphaseBenchmarks(report);
+	RunCollidePairBenchmarks(report);
+}
@@ -0,0 +1,72 @@
+// CMG Benchmarks
+//
+// Usage: cmgBenchmarks [--suite=all|ecs|micro|physics] [--max-entities=N]
+//                      [--json=path] [--csv=path]
+//
+// The micro and physics benchmark results can be written as JSON and/or CSV.
+
+#include "cmgBenchmarks.h"
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+
+// Returns the value of an argument like "--name=value", or null
+static const char* GetArgumentValue(const char* argument, const char* name)
+{
+	size_t length = strlen(name);
+	if (strncmp(argument, name, length) == 0 && argument[length] == '=')
+		return argument + length + 1;
+	return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+	String suite = "all";
+	String jsonPath;
+	String csvPath;
+	uint32 maxEntities = 1000000;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* value;
+		if ((value = GetArgumentValue(argv[i], "--suite")) != nullptr)
+			suite = value;
+		else if ((value = GetArgumentValue(argv[i], "--json")) != nullptr)
+			jsonPath = value;
+		else if ((value = GetArgumentValue(argv[i], "--csv")) != nullptr)
+			csvPath = value;
+		else if ((value = GetArgumentValue(argv[i], "--max-entities")) != nullptr)
+			maxEntities = (uint32) strtoul(value, nullptr, 10);
+		else
+		{
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (suite != "all" && suite != "ecs" && suite != "micro" &&
+		suite != "physics")
+	{
+		fprintf(stderr, "Unknown suite: %s\n", suite.c_str());
+		return 1;
+	}
+
+	BenchmarkReport report;
+	if (suite == "all" || suite == "micro")
+		RunECSMicroBenchmarks(report, maxEntities);
+	if (suite == "all" || suite == "physics")
+		RunPhysicsBenchmarks(report);
+	if (suite == "all" || suite == "ecs")
+		RunECSBenchmarks();
+
+	if (!jsonPath.empty() && !report.WriteJSON(jsonPath))
+	{
+		fprintf(stderr, "Failed to write %s\n", jsonPath.c_str());
+		return 1;
+	}
+	if (!csvPath.empty() && !report.WriteCSV(csvPath))
+	{
+		fprintf(stderr, "Failed to write %s\n", csvPath.c_str());
+		return 1;
+	}
+	return 0;
+}
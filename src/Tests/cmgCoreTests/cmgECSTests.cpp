@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 #include <cmgCore/ecs/cmgECS.h>
+#include <string>
 
 
 struct ECSTestComponentA : public ECSComponent<ECSTestComponentA>
@@ -16,6 +17,23 @@ struct ECSTestComponentB : public ECSComponent<ECSTestComponentB>
 	int32 y;
 };
 
+// Not trivially relocatable, so it is moved with its move constructor and
+// saved in snapshots with its own functions
+struct ECSTestComponentName : public ECSComponent<ECSTestComponentName>
+{
+	std::string name;
+
+	void Save(ECSSnapshotWriter& writer) const
+	{
+		writer.WriteString(name);
+	}
+
+	void Load(ECSSnapshotReader& reader)
+	{
+		reader.ReadString(name);
+	}
+};
+
 class ECSTestSystemA : public BaseECSSystem
 {
 public:
@@ -52,6 +70,170 @@ public:
 	}
 };
 
+// Requires A, with B optional
+class ECSTestSystemAOptionalB : public BaseECSSystem
+{
+public:
+	ECSTestSystemAOptionalB() : BaseECSSystem()
+	{
+		AddComponentType<ECSTestComponentA>();
+		AddComponentType<ECSTestComponentB>(FLAG_OPTIONAL);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		ECSTestComponentA* a = (ECSTestComponentA*) components[0];
+		ECSTestComponentB* b = (ECSTestComponentB*) components[1];
+		a->x++;
+		if (b != nullptr)
+			b->x++;
+	}
+};
+
+// Reads A and writes B, safe to run on multiple threads
+class ECSTestSystemReadAWriteB : public BaseECSSystem
+{
+public:
+	ECSTestSystemReadAWriteB() : BaseECSSystem()
+	{
+		AddComponentType<ECSTestComponentA>(FLAG_READ_ONLY);
+		AddComponentType<ECSTestComponentB>();
+		SetThreadSafe(true);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		ECSTestComponentA* a = (ECSTestComponentA*) components[0];
+		ECSTestComponentB* b = (ECSTestComponentB*) components[1];
+		b->x += a->x;
+	}
+};
+
+// Writes A, safe to run on multiple threads
+class ECSTestSystemWriteA : public BaseECSSystem
+{
+public:
+	ECSTestSystemWriteA() : BaseECSSystem()
+	{
+		AddComponentType<ECSTestComponentA>();
+		SetThreadSafe(true);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		ECSTestComponentA* a = (ECSTestComponentA*) components[0];
+		a->x++;
+	}
+};
+
+// Same update as ECSTestSystemAB, in batches
+class ECSTestBatchSystemAB : public ECSBatchSystem<ECSTestComponentA, ECSTestComponentB>
+{
+public:
+	uint32 numBatches = 0;
+
+	ECSTestBatchSystemAB() : ECSBatchSystem()
+	{
+		AddComponentType<ECSTestComponentA>();
+		AddComponentType<ECSTestComponentB>();
+	}
+
+	virtual void UpdateBatch(float delta, uint32 count,
+		ComponentSpan<ECSTestComponentA> a,
+		ComponentSpan<ECSTestComponentB> b) override
+	{
+		numBatches++;
+		for (uint32 i = 0; i < count; i++)
+		{
+			a[i].x += 5;
+			a[i].y -= 4;
+			b[i].x *= 2;
+			b[i].y /= 2;
+		}
+	}
+};
+
+// Counts the entities whose A changed, and writes B
+class ECSTestChangedSystem : public BaseECSSystem
+{
+public:
+	uint32 numUpdated = 0;
+
+	ECSTestChangedSystem() : BaseECSSystem()
+	{
+		AddComponentType<ECSTestComponentA>(FLAG_READ_ONLY | FLAG_CHANGED);
+		AddComponentType<ECSTestComponentB>();
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		ECSTestComponentB* b = (ECSTestComponentB*) components[1];
+		b->y++;
+		numUpdated++;
+	}
+};
+
+// Same as ECSTestChangedSystem, in batches
+class ECSTestChangedBatchSystem : public ECSBatchSystem<ECSTestComponentA, ECSTestComponentB>
+{
+public:
+	uint32 numUpdated = 0;
+
+	ECSTestChangedBatchSystem() : ECSBatchSystem()
+	{
+		AddComponentType<ECSTestComponentA>(FLAG_READ_ONLY | FLAG_CHANGED);
+		AddComponentType<ECSTestComponentB>();
+	}
+
+	virtual void UpdateBatch(float delta, uint32 count,
+		ComponentSpan<ECSTestComponentA> a,
+		ComponentSpan<ECSTestComponentB> b) override
+	{
+		numUpdated += count;
+	}
+};
+
+// Makes structural changes through the ECS's command buffers
+class ECSTestSpawnSystem : public BaseECSSystem
+{
+public:
+	ECSTestSpawnSystem(ECS& ecs) : BaseECSSystem(),
+		m_ecs(ecs)
+	{
+		AddComponentType<ECSTestComponentA>(FLAG_READ_ONLY);
+		SetThreadSafe(true);
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+		ECSTestComponentA* a = (ECSTestComponentA*) components[0];
+		ECSCommandBuffer& commands = m_ecs.GetCommandBuffer();
+		if (a->y == 0)
+		{
+			// Remove the entity
+			commands.RemoveEntity(a->entity);
+		}
+		else if (a->y == 1)
+		{
+			// Spawn a new entity and tag this one
+			ECSTestComponentB b;
+			b.x = a->x;
+			b.y = 0;
+			EntityHandle spawned = commands.CreateEntity(b);
+			b.y = 1;
+			commands.AddComponent(spawned, b);
+			commands.AddComponent(a->entity, b);
+		}
+		else if (a->y == 2)
+		{
+			commands.RemoveComponent<ECSTestComponentA>(a->entity);
+		}
+	}
+
+private:
+	ECS& m_ecs;
+};
+
 
 //-----------------------------------------------------------------------------
 // ECS tests
@@ -94,6 +276,13 @@ TEST(ECSComponent, GetTypeFreeFunction)
 	EXPECT_EQ(ECSTestComponentB::FREE_FUNCTION, BaseECSComponent::GetTypeFreeFunction(ECSTestComponentB::ID));
 }
 
+TEST(ECSComponent, IsTypeTriviallyRelocatable)
+{
+	EXPECT_TRUE(BaseECSComponent::IsTypeTriviallyRelocatable(ECSTestComponentA::ID));
+	EXPECT_TRUE(BaseECSComponent::IsTypeTriviallyRelocatable(ECSTestComponentB::ID));
+	EXPECT_FALSE(BaseECSComponent::IsTypeTriviallyRelocatable(ECSTestComponentName::ID));
+}
+
 TEST(ECS, CreateEntity)
 {
 	ECS ecs;
@@ -279,3 +468,1149 @@ TEST(ECS, UpdateSystemWithMultipleComponents)
 	EXPECT_EQ(bb->x, 16);
 	EXPECT_EQ(bb->y, 4);
 }
+
+
+//-----------------------------------------------------------------------------
+// Archetype storage tests
+//-----------------------------------------------------------------------------
+
+TEST(ECSArchetypes, AddGetHasComponent)
+{
+	ECS ecs(ECSStorageMode::k_archetypes);
+	ECSTestComponentA a;
+	a.x = 1;
+	a.y = 2;
+	ECSTestComponentB b;
+	b.x = 3;
+	b.y = 4;
+
+	EntityHandle entity = ecs.CreateEntity();
+	EXPECT_FALSE(ecs.HasComponent<ECSTestComponentA>(entity));
+
+	// Adding components moves the entity between archetypes
+	ecs.AddComponent(entity, a);
+	ecs.AddComponent(entity, b);
+	ASSERT_TRUE(ecs.HasComponent<ECSTestComponentA>(entity));
+	ASSERT_TRUE(ecs.HasComponent<ECSTestComponentB>(entity));
+	EXPECT_EQ(1, ecs.GetComponent<ECSTestComponentA>(entity)->x);
+	EXPECT_EQ(4, ecs.GetComponent<ECSTestComponentB>(entity)->y);
+	EXPECT_EQ(entity, ecs.GetComponent<ECSTestComponentB>(entity)->entity);
+
+	ecs.RemoveComponent<ECSTestComponentA>(entity);
+	EXPECT_FALSE(ecs.HasComponent<ECSTestComponentA>(entity));
+	ASSERT_TRUE(ecs.HasComponent<ECSTestComponentB>(entity));
+	EXPECT_EQ(3, ecs.GetComponent<ECSTestComponentB>(entity)->x);
+}
+
+// Adding an entity's own component back replaces it with an equal copy
+static void RunReplaceWithSelfTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestComponentName component;
+	component.name = "a name long enough to be allocated on the heap";
+	EntityHandle entity = ecs.CreateEntity(component);
+
+	ecs.AddComponent(entity, *ecs.GetComponent<ECSTestComponentName>(entity));
+	ASSERT_TRUE(ecs.HasComponent<ECSTestComponentName>(entity));
+	EXPECT_EQ(component.name, ecs.GetComponent<ECSTestComponentName>(entity)->name);
+	EXPECT_EQ(entity, ecs.GetComponent<ECSTestComponentName>(entity)->entity);
+}
+
+TEST(ECS, ReplaceComponentWithSelf)
+{
+	RunReplaceWithSelfTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, ReplaceComponentWithSelf)
+{
+	RunReplaceWithSelfTest(ECSStorageMode::k_archetypes);
+}
+
+TEST(ECSArchetypes, RemoveEntity)
+{
+	ECS ecs(ECSStorageMode::k_archetypes);
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.y = 0;
+	b.y = 0;
+
+	// Fill several chunks so removal relocates rows across chunks
+	Array<EntityHandle> entities;
+	for (int32 i = 0; i < 5000; i++)
+	{
+		a.x = (int16) i;
+		b.x = i;
+		entities.push_back(ecs.CreateEntity(a, b));
+	}
+	for (uint32 i = 0; i < entities.size(); i += 2)
+		ecs.RemoveEntity(entities[i]);
+	for (uint32 i = 1; i < entities.size(); i += 2)
+	{
+		ASSERT_TRUE(ecs.GetComponent<ECSTestComponentB>(entities[i]) != nullptr);
+		EXPECT_EQ((int32) i, ecs.GetComponent<ECSTestComponentB>(entities[i])->x);
+		EXPECT_EQ(entities[i], ecs.GetComponent<ECSTestComponentA>(entities[i])->entity);
+	}
+}
+
+TEST(ECSArchetypes, UpdateSystems)
+{
+	ECS ecs(ECSStorageMode::k_archetypes);
+	ECSTestSystemA systemA;
+	ECSTestSystemAB systemAB;
+	ECSSystemList systems;
+	systems.AddSystem(systemA);
+	systems.AddSystem(systemAB);
+
+	ECSTestComponentA a;
+	a.x = 3;
+	a.y = 7;
+	ECSTestComponentB b;
+	b.x = 8;
+	b.y = 8;
+
+	EntityHandle entity1 = ecs.CreateEntity(a);
+	EntityHandle entity2 = ecs.CreateEntity(a, b);
+	ecs.UpdateSystems(systems, 1.0f);
+
+	ECSTestComponentA* aa = ecs.GetComponent<ECSTestComponentA>(entity1);
+	EXPECT_EQ(4, aa->x);
+	EXPECT_EQ(6, aa->y);
+	aa = ecs.GetComponent<ECSTestComponentA>(entity2);
+	ECSTestComponentB* bb = ecs.GetComponent<ECSTestComponentB>(entity2);
+	EXPECT_EQ(9, aa->x);
+	EXPECT_EQ(2, aa->y);
+	EXPECT_EQ(16, bb->x);
+	EXPECT_EQ(4, bb->y);
+}
+
+TEST(ECS, StaleEntityHandles)
+{
+	ECS ecs;
+	ECSTestComponentA a;
+	a.x = 1;
+	a.y = 2;
+
+	EntityHandle entity1 = ecs.CreateEntity(a);
+	EXPECT_TRUE(ecs.IsEntityValid(entity1));
+	EXPECT_FALSE(ecs.IsEntityValid(NULL_ENTITY_HANDLE));
+	ecs.RemoveEntity(entity1);
+	EXPECT_FALSE(ecs.IsEntityValid(entity1));
+	EXPECT_EQ(0u, ecs.GetNumEntities());
+
+	// The slot is reused with a new generation
+	a.x = 5;
+	EntityHandle entity2 = ecs.CreateEntity(a);
+	EXPECT_EQ(entity1.index, entity2.index);
+	EXPECT_NE(entity1.generation, entity2.generation);
+	EXPECT_TRUE(ecs.IsEntityValid(entity2));
+	EXPECT_FALSE(ecs.HasComponent<ECSTestComponentA>(entity1));
+	EXPECT_TRUE(nullptr == ecs.GetComponent<ECSTestComponentA>(entity1));
+	ASSERT_TRUE(ecs.HasComponent<ECSTestComponentA>(entity2));
+	EXPECT_EQ(5, ecs.GetComponent<ECSTestComponentA>(entity2)->x);
+}
+
+
+//-----------------------------------------------------------------------------
+// Parallel update tests
+//-----------------------------------------------------------------------------
+
+TEST(ECSSystem, ConflictsWith)
+{
+	ECSTestSystemA systemA;
+	ECSTestSystemAB systemAB;
+	ECSTestSystemReadAWriteB systemReadAWriteB;
+	ECSTestSystemWriteA systemWriteA;
+
+	EXPECT_TRUE(systemA.ConflictsWith(systemAB));
+	EXPECT_TRUE(systemReadAWriteB.ConflictsWith(systemWriteA));
+	EXPECT_TRUE(systemReadAWriteB.ConflictsWith(systemReadAWriteB));
+
+	// Readers of the same component don't conflict
+	class ReadASystem : public BaseECSSystem
+	{
+	public:
+		ReadASystem()
+		{
+			AddComponentType<ECSTestComponentA>(FLAG_READ_ONLY);
+		}
+	};
+	ReadASystem systemReadA;
+	EXPECT_FALSE(systemReadA.ConflictsWith(systemReadAWriteB));
+	EXPECT_TRUE(systemReadA.ConflictsWith(systemWriteA));
+}
+
+static void RunParallelUpdateTest(ECSStorageMode storageMode)
+{
+	ThreadPool threadPool(4);
+	ECS serialEcs(storageMode);
+	ECS parallelEcs(storageMode);
+	parallelEcs.SetThreadPool(&threadPool);
+	parallelEcs.SetParallelGrainSize(64);
+
+	ECSTestSystemReadAWriteB systemReadAWriteB;
+	ECSTestSystemWriteA systemWriteA;
+	ECSTestSystemA systemA;
+	ECSSystemList systems;
+	systems.AddSystem(systemReadAWriteB);
+	systems.AddSystem(systemWriteA);
+	systems.AddSystem(systemA);
+
+	Array<EntityHandle> serialEntities;
+	Array<EntityHandle> parallelEntities;
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	for (int32 i = 0; i < 3000; i++)
+	{
+		a.x = (int16) (i % 100);
+		a.y = 0;
+		b.x = 0;
+		b.y = i;
+		if (i % 3 == 0)
+		{
+			serialEntities.push_back(serialEcs.CreateEntity(a));
+			parallelEntities.push_back(parallelEcs.CreateEntity(a));
+		}
+		else
+		{
+			serialEntities.push_back(serialEcs.CreateEntity(a, b));
+			parallelEntities.push_back(parallelEcs.CreateEntity(a, b));
+		}
+	}
+
+	for (uint32 frame = 0; frame < 5; frame++)
+	{
+		serialEcs.UpdateSystems(systems, 1.0f);
+		parallelEcs.UpdateSystems(systems, 1.0f);
+	}
+
+	// Results must match the serial update exactly
+	for (uint32 i = 0; i < serialEntities.size(); i++)
+	{
+		ECSTestComponentA* serialA = serialEcs.GetComponent<ECSTestComponentA>(serialEntities[i]);
+		ECSTestComponentA* parallelA = parallelEcs.GetComponent<ECSTestComponentA>(parallelEntities[i]);
+		EXPECT_EQ(serialA->x, parallelA->x);
+		EXPECT_EQ(serialA->y, parallelA->y);
+		ECSTestComponentB* serialB = serialEcs.GetComponent<ECSTestComponentB>(serialEntities[i]);
+		ECSTestComponentB* parallelB = parallelEcs.GetComponent<ECSTestComponentB>(parallelEntities[i]);
+		ASSERT_EQ(serialB == nullptr, parallelB == nullptr);
+		if (serialB != nullptr)
+			EXPECT_EQ(serialB->x, parallelB->x);
+	}
+}
+
+TEST(ECS, UpdateSystemsParallel)
+{
+	RunParallelUpdateTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, UpdateSystemsParallel)
+{
+	RunParallelUpdateTest(ECSStorageMode::k_archetypes);
+}
+
+
+//-----------------------------------------------------------------------------
+// Batched update tests
+//-----------------------------------------------------------------------------
+
+static void RunBatchUpdateTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestBatchSystemAB batchSystem;
+	ECSSystemList batchSystems;
+	batchSystems.AddSystem(batchSystem);
+	ECSTestSystemAB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	// Entities without B break up the runs of contiguous components
+	Array<EntityHandle> entities;
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	for (int32 i = 0; i < 1000; i++)
+	{
+		a.x = (int16) i;
+		a.y = 0;
+		b.x = i;
+		b.y = 1000;
+		if (i % 100 == 50)
+			entities.push_back(ecs.CreateEntity(a));
+		else
+			entities.push_back(ecs.CreateEntity(a, b));
+	}
+	ECSTestComponentA a2;
+	a2.x = 0;
+	a2.y = 0;
+	ecs.AddComponent(entities[10], a2);
+	ecs.RemoveEntity(entities[20]);
+
+	ecs.UpdateSystems(batchSystems, 1.0f);
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_GT(batchSystem.numBatches, 0u);
+	EXPECT_LT(batchSystem.numBatches, 100u);
+
+	for (uint32 i = 0; i < entities.size(); i++)
+	{
+		if (i == 20)
+			continue;
+		ECSTestComponentA* aa = ecs.GetComponent<ECSTestComponentA>(entities[i]);
+		ECSTestComponentB* bb = ecs.GetComponent<ECSTestComponentB>(entities[i]);
+		if (bb == nullptr)
+		{
+			EXPECT_EQ((int16) i, aa->x);
+			continue;
+		}
+		EXPECT_EQ((i == 10 ? 0 : (int16) i) + 10, aa->x);
+		EXPECT_EQ(-8, aa->y);
+		EXPECT_EQ((int32) i * 4, bb->x);
+		EXPECT_EQ(250, bb->y);
+	}
+}
+
+TEST(ECS, UpdateSystemsBatched)
+{
+	RunBatchUpdateTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, UpdateSystemsBatched)
+{
+	RunBatchUpdateTest(ECSStorageMode::k_archetypes);
+}
+
+
+//-----------------------------------------------------------------------------
+// Command buffer tests
+//-----------------------------------------------------------------------------
+
+TEST(ECSCommandBuffer, Record)
+{
+	ECSCommandBuffer commands;
+	EXPECT_TRUE(commands.IsEmpty());
+
+	ECSTestComponentA a;
+	a.x = 1;
+	a.y = 2;
+	EntityHandle entity = commands.CreateEntity(a);
+	EXPECT_TRUE(ECSCommandBuffer::IsPendingEntity(entity));
+	EXPECT_FALSE(ECSCommandBuffer::IsPendingEntity(NULL_ENTITY_HANDLE));
+	commands.RemoveComponent<ECSTestComponentB>(entity);
+	EXPECT_EQ(3u, commands.GetNumCommands());
+	EXPECT_EQ(1u, commands.GetNumPendingEntities());
+
+	// The component is copied into the buffer
+	a.x = 5;
+	const ECSCommandBuffer::Command& command = commands.GetCommand(1);
+	EXPECT_TRUE(command.type == ECSCommandBuffer::CommandType::k_addComponent);
+	EXPECT_EQ(ECSTestComponentA::ID, command.componentId);
+	EXPECT_EQ(1, ((ECSTestComponentA*) command.component)->x);
+
+	commands.Clear();
+	EXPECT_TRUE(commands.IsEmpty());
+	EXPECT_EQ(0u, commands.GetNumPendingEntities());
+}
+
+static void RunCommandBufferTest(ECSStorageMode storageMode, uint32 numThreads)
+{
+	ThreadPool threadPool(numThreads);
+	ECS ecs(storageMode);
+	if (numThreads > 1)
+		ecs.SetThreadPool(&threadPool);
+	ecs.SetParallelGrainSize(16);
+	ECSTestSpawnSystem system(ecs);
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	Array<EntityHandle> entities;
+	ECSTestComponentA a;
+	for (int32 i = 0; i < 400; i++)
+	{
+		a.x = (int16) i;
+		a.y = (int16) (i % 4);
+		entities.push_back(ecs.CreateEntity(a));
+	}
+
+	ecs.UpdateSystems(systems, 1.0f);
+
+	// 100 removed and 100 spawned
+	EXPECT_EQ(400u, ecs.GetNumEntities());
+	for (uint32 i = 0; i < entities.size(); i++)
+	{
+		uint32 y = i % 4;
+		EXPECT_EQ(y != 0, ecs.IsEntityValid(entities[i]));
+		EXPECT_EQ(y == 1, ecs.HasComponent<ECSTestComponentB>(entities[i]));
+		EXPECT_EQ(y == 1 || y == 3, ecs.HasComponent<ECSTestComponentA>(entities[i]));
+	}
+
+	// Spawned entities have the later of their two B components
+	uint32 numSpawned = 0;
+	for (uint32 i = 0; i < 1000; i++)
+	{
+		EntityHandle entity;
+		entity.index = i;
+		entity.generation = 1;
+		bool isOriginal = false;
+		for (uint32 j = 0; j < entities.size(); j++)
+			isOriginal = isOriginal || entities[j] == entity;
+		if (!isOriginal && ecs.IsEntityValid(entity))
+		{
+			ECSTestComponentB* b = ecs.GetComponent<ECSTestComponentB>(entity);
+			ASSERT_TRUE(b != nullptr);
+			EXPECT_EQ(1, b->y);
+			EXPECT_EQ(1, b->x % 4);
+			numSpawned++;
+		}
+	}
+	EXPECT_EQ(100u, numSpawned);
+	EXPECT_TRUE(ecs.GetCommandBuffer().IsEmpty());
+}
+
+TEST(ECS, CommandBuffers)
+{
+	RunCommandBufferTest(ECSStorageMode::k_componentPools, 1);
+	RunCommandBufferTest(ECSStorageMode::k_componentPools, 4);
+}
+
+TEST(ECSArchetypes, CommandBuffers)
+{
+	RunCommandBufferTest(ECSStorageMode::k_archetypes, 1);
+	RunCommandBufferTest(ECSStorageMode::k_archetypes, 4);
+}
+
+
+//-----------------------------------------------------------------------------
+// Query tests
+//-----------------------------------------------------------------------------
+
+TEST(ECSQuery, IncrementalUpdates)
+{
+	ECS ecs;
+	ECSTestSystemAB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+	const ECSQuery& query = system.GetQuery();
+	EXPECT_EQ(nullptr, query.GetECS());
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 0;
+	a.y = 0;
+	b.x = 1;
+	b.y = 0;
+	EntityHandle entities[4];
+	for (uint32 i = 0; i < 3; i++)
+		entities[i] = ecs.CreateEntity(a, b);
+	entities[3] = ecs.CreateEntity(a);
+
+	// The query is built the first time the system is updated
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(&ecs, query.GetECS());
+	EXPECT_EQ(3u, query.GetNumMatches());
+	EXPECT_EQ(1u, query.GetNumRebuilds());
+
+	ecs.AddComponent(entities[3], b);
+	EXPECT_EQ(4u, query.GetNumMatches());
+	EXPECT_EQ(1u, query.GetNumRowsAdded());
+	ecs.RemoveComponent<ECSTestComponentA>(entities[0]);
+	EXPECT_EQ(3u, query.GetNumMatches());
+	ecs.RemoveEntity(entities[1]);
+	EXPECT_EQ(2u, query.GetNumMatches());
+	EXPECT_EQ(2u, query.GetNumRowsRemoved());
+
+	// Updating again uses the same query
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1u, query.GetNumRebuilds());
+	EXPECT_EQ(2, ecs.GetComponent<ECSTestComponentB>(entities[0])->x);
+	EXPECT_EQ(10, ecs.GetComponent<ECSTestComponentA>(entities[2])->x);
+	EXPECT_EQ(4, ecs.GetComponent<ECSTestComponentB>(entities[2])->x);
+	EXPECT_EQ(5, ecs.GetComponent<ECSTestComponentA>(entities[3])->x);
+	EXPECT_EQ(2, ecs.GetComponent<ECSTestComponentB>(entities[3])->x);
+
+	// Updating the system with another ECS rebuilds its query
+	{
+		ECS ecs2;
+		ecs2.CreateEntity(a, b);
+		ecs2.UpdateSystems(systems, 1.0f);
+		EXPECT_EQ(&ecs2, query.GetECS());
+		EXPECT_EQ(1u, query.GetNumMatches());
+		EXPECT_EQ(2u, query.GetNumRebuilds());
+	}
+	EXPECT_EQ(nullptr, query.GetECS());
+	EXPECT_EQ(0u, query.GetNumMatches());
+}
+
+TEST(ECSQuery, OptionalComponents)
+{
+	ECS ecs;
+	ECSTestSystemAOptionalB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+	const ECSQuery& query = system.GetQuery();
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 0;
+	a.y = 0;
+	b.x = 0;
+	b.y = 0;
+	EntityHandle entity1 = ecs.CreateEntity(a);
+	EntityHandle entity2 = ecs.CreateEntity(a, b);
+	EntityHandle entity3 = ecs.CreateEntity(b);
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(2u, query.GetNumMatches());
+
+	// Adding or removing an optional component keeps the entity's row
+	ecs.RemoveComponent<ECSTestComponentB>(entity2);
+	ecs.AddComponent(entity1, b);
+	EXPECT_EQ(2u, query.GetNumMatches());
+	EXPECT_EQ(0u, query.GetNumRowsAdded());
+	EXPECT_EQ(0u, query.GetNumRowsRemoved());
+	ecs.AddComponent(entity3, a);
+	EXPECT_EQ(3u, query.GetNumMatches());
+
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(2, ecs.GetComponent<ECSTestComponentA>(entity1)->x);
+	EXPECT_EQ(1, ecs.GetComponent<ECSTestComponentB>(entity1)->x);
+	EXPECT_EQ(2, ecs.GetComponent<ECSTestComponentA>(entity2)->x);
+	EXPECT_EQ(1, ecs.GetComponent<ECSTestComponentA>(entity3)->x);
+	EXPECT_EQ(1, ecs.GetComponent<ECSTestComponentB>(entity3)->x);
+}
+
+TEST(ECSArchetypes, Query)
+{
+	ECS ecs(ECSStorageMode::k_archetypes);
+	ECSTestSystemA system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+	const ECSQuery& query = system.GetQuery();
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 0;
+	a.y = 0;
+	EntityHandle entity1 = ecs.CreateEntity(a);
+	ecs.CreateEntity(a);
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1u, query.GetArchetypes().size());
+	EXPECT_EQ(2u, query.GetNumMatches());
+
+	// New archetypes are added to the queries they match
+	ecs.AddComponent(entity1, b);
+	ecs.CreateEntity(b);
+	EXPECT_EQ(2u, query.GetArchetypes().size());
+	EXPECT_EQ(2u, query.GetNumMatches());
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1u, query.GetNumRebuilds());
+	EXPECT_EQ(2, ecs.GetComponent<ECSTestComponentA>(entity1)->x);
+}
+
+// Requires A and a name
+class ECSTestSystemAName : public BaseECSSystem
+{
+public:
+	ECSTestSystemAName() : BaseECSSystem()
+	{
+		AddComponentType<ECSTestComponentA>();
+		AddComponentType<ECSTestComponentName>();
+	}
+
+	virtual void UpdateComponents(float delta, BaseECSComponent** components)
+	{
+	}
+};
+
+TEST(ECSQuery, CoSortComponents)
+{
+	ECS ecs;
+	ECSTestSystemAB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+	const ECSQuery& query = system.GetQuery();
+
+	// Interleave entities with only one of the components, and remove some
+	// so that the pools are swap-removed out of order
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 2000; i++)
+	{
+		a.x = (int16) i;
+		a.y = 0;
+		b.x = (int32) i;
+		b.y = 0;
+		if (i % 5 == 0)
+			entities.push_back(ecs.CreateEntity(b));
+		else if (i % 7 == 0)
+			entities.push_back(ecs.CreateEntity(a));
+		else
+			entities.push_back(ecs.CreateEntity(b, a));
+	}
+	for (uint32 i = 0; i < entities.size(); i += 3)
+		ecs.RemoveEntity(entities[i]);
+	ecs.UpdateSystems(systems, 1.0f);
+	float ratio = query.GetSequentialAccessRatio();
+	EXPECT_LT(ratio, 0.9f);
+
+	// With no time budget, one slice is done per call
+	uint32 numCalls = 1;
+	while (!ecs.CoSortComponents(system, 0.0))
+		numCalls++;
+	EXPECT_GT(numCalls, 1u);
+	EXPECT_GT(query.GetSequentialAccessRatio(), 0.9f);
+	for (uint32 row = 0; row < query.GetNumRows(); row++)
+	{
+		if (row > 0)
+			EXPECT_LT(query.GetRowHandles(row - 1)[0], query.GetRowHandles(row)[0]);
+		EXPECT_EQ(row, query.GetRowHandles(row)[1]);
+	}
+
+	// Components stay with their entities, and the system still joins them
+	ecs.UpdateSystems(systems, 1.0f);
+	for (uint32 i = 0; i < entities.size(); i++)
+	{
+		if (i % 3 == 0)
+			continue;
+		ECSTestComponentA* componentA = ecs.GetComponent<ECSTestComponentA>(entities[i]);
+		ECSTestComponentB* componentB = ecs.GetComponent<ECSTestComponentB>(entities[i]);
+		if (i % 5 == 0)
+		{
+			EXPECT_EQ((int32) i, componentB->x);
+		}
+		else if (i % 7 == 0)
+		{
+			EXPECT_EQ((int16) i, componentA->x);
+		}
+		else
+		{
+			EXPECT_EQ((int16) (i + 10), componentA->x);
+			EXPECT_EQ((int32) (i * 4), componentB->x);
+		}
+	}
+
+	// A second pass has nothing left to move
+	EXPECT_TRUE(ecs.CoSortComponents(system, 1000.0));
+	EXPECT_EQ(1u, query.GetNumRebuilds());
+}
+
+TEST(ECSQuery, CoSortNonTrivialComponents)
+{
+	ECS ecs;
+	ECSTestSystemAName system;
+	const ECSQuery& query = system.GetQuery();
+	ECSTestComponentA a;
+	ECSTestComponentName name;
+	a.y = 0;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 100; i++)
+	{
+		a.x = (int16) i;
+		name.name = "entity " + std::to_string(i);
+		if (i % 2 == 0)
+			entities.push_back(ecs.CreateEntity(name));
+		entities.push_back(ecs.CreateEntity(name, a));
+	}
+
+	EXPECT_TRUE(ecs.CoSortComponents(system, 1000.0));
+	EXPECT_EQ(100u, query.GetNumMatches());
+	EXPECT_FLOAT_EQ(1.0f, query.GetSequentialAccessRatio());
+	for (uint32 i = 0; i < entities.size(); i++)
+	{
+		const ECSTestComponentA* componentA =
+			ecs.GetComponentReadOnly<ECSTestComponentA>(entities[i]);
+		const ECSTestComponentName* componentName =
+			ecs.GetComponentReadOnly<ECSTestComponentName>(entities[i]);
+		if (componentA != nullptr)
+			EXPECT_EQ("entity " + std::to_string(componentA->x), componentName->name);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Change tracking tests
+//-----------------------------------------------------------------------------
+
+static void RunChangeFilterTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestChangedSystem changedSystem;
+	ECSTestChangedBatchSystem changedBatchSystem;
+	ECSSystemList systems;
+	systems.AddSystem(changedSystem);
+	systems.AddSystem(changedBatchSystem);
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 0;
+	a.y = 0;
+	b.x = 0;
+	b.y = 0;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 1000; i++)
+		entities.push_back(ecs.CreateEntity(a, b));
+
+	// Everything is new for the first update
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1000u, changedSystem.numUpdated);
+	EXPECT_EQ(1000u, changedBatchSystem.numUpdated);
+	changedSystem.numUpdated = 0;
+	changedBatchSystem.numUpdated = 0;
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(0u, changedSystem.numUpdated);
+	EXPECT_EQ(0u, changedBatchSystem.numUpdated);
+
+	// Writing to, replacing, or creating a component marks it as changed,
+	// but reading it does not
+	uint32 version = ecs.GetChangeVersion();
+	ecs.GetComponent<ECSTestComponentA>(entities[5])->x = 1;
+	ecs.AddComponent(entities[700], a);
+	entities.push_back(ecs.CreateEntity(a, b));
+	ecs.GetComponentReadOnly<ECSTestComponentA>(entities[9]);
+	EXPECT_TRUE(ecs.HasComponentChanged<ECSTestComponentA>(entities[5], version - 1));
+	EXPECT_FALSE(ecs.HasComponentChanged<ECSTestComponentA>(entities[9], version - 1));
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(3u, changedSystem.numUpdated);
+	EXPECT_EQ(3u, changedBatchSystem.numUpdated);
+	EXPECT_EQ(2, ecs.GetComponentReadOnly<ECSTestComponentB>(entities[5])->y);
+	EXPECT_EQ(1, ecs.GetComponentReadOnly<ECSTestComponentB>(entities[9])->y);
+
+	// The systems' own writes to B are newer than their last update
+	EXPECT_TRUE(ecs.HasComponentChanged<ECSTestComponentB>(entities[5], version));
+	EXPECT_FALSE(ecs.HasComponentChanged<ECSTestComponentB>(entities[9], version));
+	EXPECT_EQ(changedBatchSystem.GetLastChangeVersion(),
+		ecs.GetComponentVersion<ECSTestComponentB>(entities[5]));
+
+	// Changes made by a later system are seen on the next update
+	ECSTestSystemWriteA writeSystem;
+	systems.AddSystem(writeSystem);
+	changedSystem.numUpdated = 0;
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(0u, changedSystem.numUpdated);
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1001u, changedSystem.numUpdated);
+}
+
+TEST(ECS, ChangeFilter)
+{
+	RunChangeFilterTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, ChangeFilter)
+{
+	RunChangeFilterTest(ECSStorageMode::k_archetypes);
+}
+
+
+//-----------------------------------------------------------------------------
+// Statistics tests
+//-----------------------------------------------------------------------------
+
+static void RunSystemStatsTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestChangedSystem changedSystem;
+	ECSTestSystemAB systemAB;
+	changedSystem.SetName("changed \"A\"");
+	ECSSystemList systems;
+	systems.AddSystem(changedSystem);
+	systems.AddSystem(systemAB);
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 0;
+	a.y = 0;
+	b.x = 0;
+	b.y = 0;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 100; i++)
+		entities.push_back(ecs.CreateEntity(a, b));
+	ecs.CreateEntity(a);
+	const uint32 entityBytes = (uint32) (sizeof(ECSTestComponentA) + sizeof(ECSTestComponentB));
+
+	// Every entity is new on the first update
+	ecs.UpdateSystems(systems, 1.0f);
+	const ECSSystemStats& stats = changedSystem.GetStats();
+	EXPECT_EQ(1u, stats.GetNumUpdates());
+	EXPECT_EQ(100u, stats.GetNumMatched());
+	EXPECT_EQ(100u, stats.GetNumProcessed());
+	EXPECT_EQ(100u * entityBytes, stats.GetBytesTouched());
+	EXPECT_EQ(100u, systemAB.GetStats().GetNumProcessed());
+
+	// Only changed entities are processed after that
+	for (uint32 i = 0; i < 10; i++)
+		ecs.GetComponent<ECSTestComponentA>(entities[i]);
+	for (uint32 i = 0; i < ECSSystemStats::WINDOW_SIZE + 5; i++)
+		ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(ECSSystemStats::WINDOW_SIZE + 6, stats.GetNumUpdates());
+	EXPECT_EQ(100u, stats.GetNumMatched());
+	EXPECT_EQ(ECSSystemStats::WINDOW_SIZE, stats.GetNumSamples());
+	EXPECT_EQ((uint64) 100 * (ECSSystemStats::WINDOW_SIZE + 6),
+		systemAB.GetStats().GetTotalProcessed());
+	EXPECT_LE(stats.GetMinMilliseconds(), stats.GetAverageMilliseconds());
+	EXPECT_LE(stats.GetAverageMilliseconds(), stats.GetMaxMilliseconds());
+
+	String json = ecs.GetStatsJSON(systems);
+	EXPECT_NE(String::npos, json.find("\"name\": \"changed \\\"A\\\"\""));
+	EXPECT_NE(String::npos, json.find("\"name\": \"system 1\""));
+	EXPECT_NE(String::npos, json.find("\"processed\": 100,"));
+
+	changedSystem.ResetStats();
+	EXPECT_EQ(0u, stats.GetNumUpdates());
+	EXPECT_EQ(0.0, stats.GetMaxMilliseconds());
+}
+
+TEST(ECS, SystemStats)
+{
+	RunSystemStatsTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, SystemStats)
+{
+	RunSystemStatsTest(ECSStorageMode::k_archetypes);
+}
+
+TEST(ECS, PoolStats)
+{
+	ECS ecs;
+	ECSGrowthPolicy growthPolicy;
+	growthPolicy.minCapacity = 16;
+	growthPolicy.growthFactor = 2.0f;
+	ecs.SetComponentGrowthPolicy<ECSTestComponentB>(growthPolicy);
+	ECSTestComponentB b;
+	for (uint32 i = 0; i < 100; i++)
+		ecs.CreateEntity(b);
+
+	// Grown to 16, 32, 64 and 128
+	Array<ECSPoolStats> pools;
+	ecs.GetPoolStats(pools);
+	uint32 i = 0;
+	while (i < pools.size() && pools[i].componentId != ECSTestComponentB::ID)
+		i++;
+	ASSERT_LT(i, pools.size());
+	EXPECT_EQ(100u, pools[i].size);
+	EXPECT_EQ(128u, pools[i].capacity);
+	EXPECT_EQ(4u, pools[i].numGrowths);
+	EXPECT_EQ((uint32) sizeof(ECSTestComponentB), pools[i].componentSize);
+	EXPECT_GE(pools[i].bytes, 128u * sizeof(ECSTestComponentB));
+
+	Array<ECSArchetypeStats> archetypes;
+	ecs.GetArchetypeStats(archetypes);
+	EXPECT_EQ(0u, archetypes.size());
+	ECSSystemList systems;
+	String json = ecs.GetStatsJSON(systems);
+	EXPECT_NE(String::npos, json.find("\"growths\": 4}"));
+}
+
+TEST(ECSArchetypes, ArchetypeStats)
+{
+	ECS ecs(ECSStorageMode::k_archetypes);
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	for (uint32 i = 0; i < 10; i++)
+		ecs.CreateEntity(a, b);
+
+	Array<ECSArchetypeStats> archetypes;
+	ecs.GetArchetypeStats(archetypes);
+	uint32 numEntities = 0;
+	for (uint32 i = 0; i < archetypes.size(); i++)
+	{
+		numEntities += archetypes[i].size;
+		if (archetypes[i].size > 0)
+		{
+			EXPECT_EQ(2u, archetypes[i].componentTypes.size());
+			EXPECT_EQ(1u, archetypes[i].numChunks);
+			EXPECT_GE(archetypes[i].bytes, archetypes[i].chunkCapacity *
+				(sizeof(ECSTestComponentA) + sizeof(ECSTestComponentB)));
+		}
+	}
+	EXPECT_EQ(10u, numEntities);
+}
+
+
+//-----------------------------------------------------------------------------
+// Capacity tests
+//-----------------------------------------------------------------------------
+
+TEST(ECS, ReserveComponents)
+{
+	ECS ecs;
+	ecs.ReserveComponents<ECSTestComponentA>(1000);
+	EXPECT_EQ(1000u, ecs.GetComponentCapacity<ECSTestComponentA>());
+
+	ECSTestComponentA a;
+	a.y = 0;
+	Array<EntityHandle> entities;
+	for (int32 i = 0; i < 1000; i++)
+	{
+		a.x = (int16) i;
+		entities.push_back(ecs.CreateEntity(a));
+	}
+	EXPECT_EQ(1000u, ecs.GetComponentCapacity<ECSTestComponentA>());
+	for (uint32 i = 0; i < 1000; i += 2)
+		ecs.RemoveEntity(entities[i]);
+	ecs.ShrinkToFit();
+	EXPECT_EQ(500u, ecs.GetComponentCapacity<ECSTestComponentA>());
+	for (uint32 i = 1; i < 1000; i += 2)
+		EXPECT_EQ((int16) i, ecs.GetComponentReadOnly<ECSTestComponentA>(entities[i])->x);
+
+	// Reserving less than the current capacity does nothing
+	ecs.ReserveComponents<ECSTestComponentA>(10);
+	EXPECT_EQ(500u, ecs.GetComponentCapacity<ECSTestComponentA>());
+}
+
+TEST(ECS, GrowthPolicy)
+{
+	ECS ecs;
+	ECSGrowthPolicy growthPolicy;
+	growthPolicy.growthFactor = 1.5f;
+	growthPolicy.minCapacity = 4;
+	ecs.SetComponentGrowthPolicy<ECSTestComponentA>(growthPolicy);
+
+	ECSTestComponentA a;
+	a.x = 0;
+	a.y = 0;
+	ecs.CreateEntity(a);
+	EXPECT_EQ(4u, ecs.GetComponentCapacity<ECSTestComponentA>());
+	for (uint32 i = 0; i < 4; i++)
+		ecs.CreateEntity(a);
+	EXPECT_EQ(6u, ecs.GetComponentCapacity<ECSTestComponentA>());
+	for (uint32 i = 0; i < 2; i++)
+		ecs.CreateEntity(a);
+	EXPECT_EQ(9u, ecs.GetComponentCapacity<ECSTestComponentA>());
+}
+
+static void RunNonTrivialComponentTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestComponentName name;
+	ECSTestComponentA a;
+	a.x = 0;
+	a.y = 0;
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 2000; i++)
+	{
+		name.name = "entity with a name too long for small strings " + std::to_string(i);
+		entities.push_back(ecs.CreateEntity(name));
+	}
+
+	// Remove entities and move others between archetypes, so that the
+	// remaining components get relocated
+	for (uint32 i = 0; i < entities.size(); i += 3)
+		ecs.RemoveEntity(entities[i]);
+	for (uint32 i = 1; i < entities.size(); i += 3)
+		ecs.AddComponent(entities[i], a);
+	ecs.ShrinkToFit();
+	for (uint32 i = 0; i < entities.size(); i++)
+	{
+		if (i % 3 == 0)
+			continue;
+		EXPECT_EQ("entity with a name too long for small strings " + std::to_string(i),
+			ecs.GetComponentReadOnly<ECSTestComponentName>(entities[i])->name);
+	}
+	ecs.ClearEntities();
+}
+
+TEST(ECS, NonTrivialComponents)
+{
+	RunNonTrivialComponentTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, NonTrivialComponents)
+{
+	RunNonTrivialComponentTest(ECSStorageMode::k_archetypes);
+}
+
+
+//-----------------------------------------------------------------------------
+// Prefab tests
+//-----------------------------------------------------------------------------
+
+TEST(ECSPrefab, Components)
+{
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	a.x = 1;
+	a.y = 2;
+	b.x = 3;
+	b.y = 4;
+	ECSPrefab prefab(b, a);
+	ASSERT_EQ(2u, prefab.GetNumComponents());
+	EXPECT_LT(prefab.GetComponentTypes()[0], prefab.GetComponentTypes()[1]);
+	EXPECT_EQ(1, prefab.GetComponent<ECSTestComponentA>()->x);
+	EXPECT_EQ(3, prefab.GetComponent<ECSTestComponentB>()->x);
+
+	a.x = 5;
+	prefab.AddComponent(a);
+	EXPECT_EQ(2u, prefab.GetNumComponents());
+	EXPECT_EQ(5, prefab.GetComponent<ECSTestComponentA>()->x);
+	prefab.RemoveComponent<ECSTestComponentB>();
+	EXPECT_FALSE(prefab.HasComponent<ECSTestComponentB>());
+	EXPECT_TRUE(prefab.HasComponent<ECSTestComponentA>());
+}
+
+static void RunInstantiateTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	ECSTestSystemAB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	ECSTestComponentName name;
+	a.x = 1;
+	a.y = 2;
+	b.x = 3;
+	b.y = 4;
+	name.name = "debris with a name too long for small strings";
+	ECSPrefab prefab(a, b, name);
+
+	// Free a few slots first, so the new entities reuse them
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < 10; i++)
+		entities.push_back(ecs.CreateEntity(a));
+	ecs.UpdateSystems(systems, 1.0f);
+	for (uint32 i = 0; i < 10; i += 2)
+		ecs.RemoveEntity(entities[i]);
+	uint32 first = ecs.Instantiate(prefab, 5000, entities);
+	EXPECT_EQ(10u, first);
+	ASSERT_EQ(5010u, entities.size());
+	EXPECT_EQ(5005u, ecs.GetNumEntities());
+	EXPECT_EQ(5000u, system.GetQuery().GetNumMatches());
+
+	ecs.UpdateSystems(systems, 1.0f);
+	for (uint32 i = first; i < entities.size(); i++)
+	{
+		ASSERT_TRUE(ecs.IsEntityValid(entities[i]));
+		EXPECT_EQ(6, ecs.GetComponentReadOnly<ECSTestComponentA>(entities[i])->x);
+		EXPECT_EQ(6, ecs.GetComponentReadOnly<ECSTestComponentB>(entities[i])->x);
+		EXPECT_EQ(entities[i], ecs.GetComponentReadOnly<ECSTestComponentB>(entities[i])->entity);
+		EXPECT_EQ(name.name, ecs.GetComponentReadOnly<ECSTestComponentName>(entities[i])->name);
+	}
+
+	EntityHandle entity = ecs.Instantiate(prefab);
+	EXPECT_EQ(3, ecs.GetComponentReadOnly<ECSTestComponentB>(entity)->x);
+	EXPECT_EQ(5001u, system.GetQuery().GetNumMatches());
+}
+
+TEST(ECS, Instantiate)
+{
+	RunInstantiateTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, Instantiate)
+{
+	RunInstantiateTest(ECSStorageMode::k_archetypes);
+}
+
+
+//-----------------------------------------------------------------------------
+// Snapshot tests
+//-----------------------------------------------------------------------------
+
+static void RunSnapshotTest(ECSStorageMode storageMode)
+{
+	RegisterECSSnapshotFunctions<ECSTestComponentName>();
+	ECS ecs(storageMode);
+	ECSTestSystemAB system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	// Build a world with a mix of components and some free slots
+	ECSTestComponentA a;
+	ECSTestComponentB b;
+	ECSTestComponentName name;
+	Array<EntityHandle> entities;
+	for (int32 i = 0; i < 300; i++)
+	{
+		a.x = (int16) i;
+		a.y = (int16) -i;
+		EntityHandle entity = ecs.CreateEntity(a);
+		if (i % 2 == 0)
+		{
+			b.x = i * 2;
+			b.y = i * 3;
+			ecs.AddComponent(entity, b);
+		}
+		if (i % 3 == 0)
+		{
+			name.name = "entity with a name too long for small strings " + std::to_string(i);
+			ecs.AddComponent(entity, name);
+		}
+		entities.push_back(entity);
+	}
+	for (uint32 i = 0; i < entities.size(); i += 5)
+		ecs.RemoveEntity(entities[i]);
+	ecs.UpdateSystems(systems, 1.0f);
+	uint32 numMatches = system.GetQuery().GetNumMatches();
+	EXPECT_EQ(120u, numMatches);
+
+	Array<uint8> data;
+	ASSERT_TRUE(ecs.SaveSnapshot(data).Passed());
+
+	// Restore into a changed world
+	for (uint32 i = 1; i < entities.size(); i += 5)
+		ecs.RemoveEntity(entities[i]);
+	for (uint32 i = 0; i < 50; i++)
+		ecs.CreateEntity(b);
+	ecs.UpdateSystems(systems, 1.0f);
+	uint32 version = ecs.GetChangeVersion();
+	ASSERT_TRUE(ecs.RestoreSnapshot(data).Passed());
+	EXPECT_EQ(240u, ecs.GetNumEntities());
+	EXPECT_EQ(numMatches, system.GetQuery().GetNumMatches());
+	for (int32 i = 0; i < (int32) entities.size(); i++)
+	{
+		EntityHandle entity = entities[i];
+		if (i % 5 == 0)
+		{
+			EXPECT_FALSE(ecs.IsEntityValid(entity));
+			continue;
+		}
+		ASSERT_TRUE(ecs.IsEntityValid(entity));
+		const ECSTestComponentA* restoredA = ecs.GetComponentReadOnly<ECSTestComponentA>(entity);
+		ASSERT_NE(nullptr, restoredA);
+		EXPECT_EQ(entity, restoredA->entity);
+		EXPECT_EQ((i % 2 == 0 ? i + 5 : i), restoredA->x);
+		EXPECT_TRUE(ecs.HasComponentChanged<ECSTestComponentA>(entity, version - 1));
+		EXPECT_EQ(i % 2 == 0, ecs.HasComponent<ECSTestComponentB>(entity));
+		if (i % 2 == 0)
+			EXPECT_EQ(i * 4, ecs.GetComponentReadOnly<ECSTestComponentB>(entity)->x);
+		const ECSTestComponentName* restoredName = ecs.GetComponentReadOnly<ECSTestComponentName>(entity);
+		EXPECT_EQ(i % 3 == 0, restoredName != nullptr);
+		if (restoredName != nullptr)
+		{
+			EXPECT_EQ(entity, restoredName->entity);
+			EXPECT_EQ("entity with a name too long for small strings " + std::to_string(i), restoredName->name);
+		}
+	}
+
+	// The free list is restored too, so new entities get the same slots
+	ECS copy(storageMode);
+	ASSERT_TRUE(copy.RestoreSnapshot(data).Passed());
+	EXPECT_EQ(ecs.CreateEntity(a), copy.CreateEntity(a));
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(numMatches, system.GetQuery().GetNumMatches());
+
+	// Invalid snapshots are rejected and leave the ECS empty
+	Error error = ecs.RestoreSnapshot(data.data(), (uint32) data.size() - 1);
+	EXPECT_TRUE(error.Failed());
+	EXPECT_EQ(0u, ecs.GetNumEntities());
+	EXPECT_EQ(0u, system.GetQuery().GetNumMatches());
+	EXPECT_FALSE(ecs.IsEntityValid(entities[1]));
+	data[0] ^= 0xFF;
+	EXPECT_EQ(Error::kCorruptData, ecs.RestoreSnapshot(data).Check().GetErrorCode());
+	data[0] ^= 0xFF;
+	ECS other(storageMode == ECSStorageMode::k_archetypes ?
+		ECSStorageMode::k_componentPools : ECSStorageMode::k_archetypes);
+	EXPECT_EQ(Error::kOperationNotPermitted, other.RestoreSnapshot(data).Check().GetErrorCode());
+	EXPECT_TRUE(ecs.RestoreSnapshot(data).Passed());
+	EXPECT_EQ(240u, ecs.GetNumEntities());
+}
+
+TEST(ECS, Snapshot)
+{
+	RunSnapshotTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(ECSArchetypes, Snapshot)
+{
+	RunSnapshotTest(ECSStorageMode::k_archetypes);
+}
@@ -0,0 +1,55 @@
+// Thread Pool Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+
+
+//-----------------------------------------------------------------------------
+// ThreadPool tests
+//-----------------------------------------------------------------------------
+
+TEST(ThreadPool, GetNumThreads)
+{
+	ThreadPool threadPool(4);
+	EXPECT_EQ(4u, threadPool.GetNumThreads());
+}
+
+TEST(ThreadPool, ParallelFor)
+{
+	ThreadPool threadPool(4);
+	Array<uint32> values(10000, 0);
+	Array<std::atomic<uint32>> threadCounts(threadPool.GetNumThreads());
+	for (uint32 i = 0; i < threadCounts.size(); i++)
+		threadCounts[i] = 0;
+
+	// Run several loops in a row to reuse the workers
+	for (uint32 loop = 0; loop < 10; loop++)
+	{
+		threadPool.ParallelFor((uint32) values.size(),
+			[&](uint32 index, uint32 threadIndex) {
+			ASSERT_LT(threadIndex, threadPool.GetNumThreads());
+			values[index]++;
+			threadCounts[threadIndex]++;
+		});
+	}
+
+	uint32 total = 0;
+	for (uint32 i = 0; i < values.size(); i++)
+		EXPECT_EQ(10u, values[i]);
+	for (uint32 i = 0; i < threadCounts.size(); i++)
+		total += threadCounts[i];
+	EXPECT_EQ(values.size() * 10, total);
+}
+
+TEST(ThreadPool, NestedParallelFor)
+{
+	ThreadPool threadPool(4);
+	std::atomic<uint32> count(0);
+	threadPool.ParallelFor(8, [&](uint32 index, uint32 threadIndex) {
+		threadPool.ParallelFor(8, [&](uint32 index2, uint32 threadIndex2) {
+			EXPECT_EQ(0u, threadIndex2);
+			count++;
+		});
+	});
+	EXPECT_EQ(64u, count);
+}
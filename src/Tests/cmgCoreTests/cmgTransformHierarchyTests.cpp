@@ -0,0 +1,160 @@
+// Transform Hierarchy Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <cmgMath/ecs/cmgTransformHierarchy.h>
+
+
+static void ExpectWorldPosition(ECS& ecs, EntityHandle entity, const Vector3f& position)
+{
+	Vector3f worldPosition = ecs.GetComponentReadOnly<WorldTransformComponent>(
+		entity)->worldMatrix.GetTranslation();
+	EXPECT_FLOAT_EQ(position.x, worldPosition.x);
+	EXPECT_FLOAT_EQ(position.y, worldPosition.y);
+	EXPECT_FLOAT_EQ(position.z, worldPosition.z);
+}
+
+static EntityHandle CreateNode(ECS& ecs, EntityHandle parent, const Vector3f& position)
+{
+	TransformComponent transform;
+	HierarchyComponent hierarchy;
+	WorldTransformComponent world;
+	transform.transform.position = position;
+	hierarchy.parent = parent;
+	return ecs.CreateEntity(transform, hierarchy, world);
+}
+
+static void SetPosition(ECS& ecs, EntityHandle entity, const Vector3f& position)
+{
+	ecs.GetComponent<TransformComponent>(entity)->transform.position = position;
+}
+
+static void ExpectParentsFirst(const TransformHierarchySystem& system)
+{
+	for (uint32 node = 0; node < system.GetNumNodes(); node++)
+	{
+		uint32 parent = system.GetNodeParent(node);
+		if (parent != TransformHierarchySystem::INVALID_NODE)
+			EXPECT_LT(parent, node);
+	}
+}
+
+static void RunTransformHierarchyTest(ECSStorageMode storageMode)
+{
+	ECS ecs(storageMode);
+	TransformHierarchySystem system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	// A chain of three nodes, plus a root without a HierarchyComponent
+	EntityHandle root = CreateNode(ecs, NULL_ENTITY_HANDLE, Vector3f(1, 0, 0));
+	EntityHandle child = CreateNode(ecs, root, Vector3f(0, 2, 0));
+	EntityHandle grandchild = CreateNode(ecs, child, Vector3f(0, 0, 3));
+	TransformComponent transform;
+	transform.transform.position = Vector3f(5, 5, 5);
+	EntityHandle other = ecs.CreateEntity(transform, WorldTransformComponent());
+
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(4u, system.GetNumNodes());
+	EXPECT_EQ(2u, system.GetNumRoots());
+	EXPECT_EQ(4u, system.GetNumUpdated());
+	ExpectWorldPosition(ecs, root, Vector3f(1, 0, 0));
+	ExpectWorldPosition(ecs, child, Vector3f(1, 2, 0));
+	ExpectWorldPosition(ecs, grandchild, Vector3f(1, 2, 3));
+	ExpectWorldPosition(ecs, other, Vector3f(5, 5, 5));
+	ExpectParentsFirst(system);
+
+	// Nothing is recomputed when nothing changed
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(0u, system.GetNumUpdated());
+
+	// Moving a node updates its subtree only
+	uint32 version = ecs.GetChangeVersion();
+	SetPosition(ecs, child, Vector3f(0, 4, 0));
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(2u, system.GetNumUpdated());
+	ExpectWorldPosition(ecs, grandchild, Vector3f(1, 4, 3));
+	EXPECT_TRUE(ecs.HasComponentChanged<WorldTransformComponent>(grandchild, version));
+	EXPECT_FALSE(ecs.HasComponentChanged<WorldTransformComponent>(root, version));
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(0u, system.GetNumUpdated());
+
+	// Reparenting, including to a node that comes later
+	uint32 numRebuilds = system.GetNumRebuilds();
+	ecs.GetComponent<HierarchyComponent>(root)->parent = grandchild;
+	ecs.GetComponent<HierarchyComponent>(child)->parent = other;
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(numRebuilds + 1, system.GetNumRebuilds());
+	EXPECT_EQ(1u, system.GetNumRoots());
+	ExpectWorldPosition(ecs, child, Vector3f(5, 9, 5));
+	ExpectWorldPosition(ecs, grandchild, Vector3f(5, 9, 8));
+	ExpectWorldPosition(ecs, root, Vector3f(6, 9, 8));
+	ExpectParentsFirst(system);
+
+	// Removing a parent makes its children roots
+	ecs.RemoveEntity(other);
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(3u, system.GetNumNodes());
+	EXPECT_EQ(TransformHierarchySystem::INVALID_NODE, system.FindNode(other));
+	ExpectWorldPosition(ecs, child, Vector3f(0, 4, 0));
+	ExpectWorldPosition(ecs, root, Vector3f(1, 4, 3));
+
+	// Nodes that join without their transform changing are found too
+	EntityHandle late = ecs.CreateEntity(transform);
+	ecs.UpdateSystems(systems, 1.0f);
+	ecs.AddComponent(late, WorldTransformComponent());
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(4u, system.GetNumNodes());
+	ExpectWorldPosition(ecs, late, Vector3f(5, 5, 5));
+
+	// A parent cycle is broken rather than looping forever
+	ecs.GetComponent<HierarchyComponent>(child)->parent = root;
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(2u, system.GetNumRoots());
+	ExpectParentsFirst(system);
+}
+
+TEST(TransformHierarchy, Update)
+{
+	RunTransformHierarchyTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(TransformHierarchyArchetypes, Update)
+{
+	RunTransformHierarchyTest(ECSStorageMode::k_archetypes);
+}
+
+TEST(TransformHierarchy, Parallel)
+{
+	// Many small subtrees, split across threads, must give the same results
+	ThreadPool threadPool(4);
+	ECS ecs;
+	ecs.SetThreadPool(&threadPool);
+	ecs.SetParallelGrainSize(16);
+	TransformHierarchySystem system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	Array<EntityHandle> roots;
+	Array<EntityHandle> leaves;
+	for (uint32 i = 0; i < 200; i++)
+	{
+		EntityHandle parent = CreateNode(ecs, NULL_ENTITY_HANDLE, Vector3f((float) i, 0, 0));
+		roots.push_back(parent);
+		for (uint32 depth = 0; depth < 5; depth++)
+			parent = CreateNode(ecs, parent, Vector3f(0, 1, 0));
+		leaves.push_back(parent);
+	}
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(1200u, system.GetNumUpdated());
+	EXPECT_EQ(200u, system.GetNumRoots());
+	EXPECT_LT(1u, system.GetNumTasks());
+	ExpectParentsFirst(system);
+
+	for (uint32 i = 0; i < roots.size(); i += 2)
+		SetPosition(ecs, roots[i], Vector3f((float) i, 10, 0));
+	ecs.UpdateSystems(systems, 1.0f);
+	EXPECT_EQ(600u, system.GetNumUpdated());
+	for (uint32 i = 0; i < leaves.size(); i++)
+		ExpectWorldPosition(ecs, leaves[i], Vector3f((float) i, (i % 2 == 0 ? 15.0f : 5.0f), 0));
+}
@@ -0,0 +1,223 @@
+// Batch Integrator Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgCore/ecs/cmgECS.h>
+#include <cmgPhysics/cmgBatchIntegrators.h>
+#include <cmgPhysics/ecs/cmgPhysicsComponents.h>
+
+
+static const float TOLERANCE = 1.0e-5f;
+
+// An odd number of bodies, so every batch width leaves some over
+static const uint32 NUM_BODIES = 1003;
+
+static Vector3f RandomVector(RandomNumberGenerator& random)
+{
+	return Vector3f(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f,
+		random.NextFloat() - 0.5f) * 4.0f;
+}
+
+static void ExpectNear(const Vector3f& expected, const Vector3f& actual)
+{
+	EXPECT_NEAR(expected.x, actual.x, TOLERANCE);
+	EXPECT_NEAR(expected.y, actual.y, TOLERANCE);
+	EXPECT_NEAR(expected.z, actual.z, TOLERANCE);
+}
+
+static void ExpectNear(const Quaternion& expected, const Quaternion& actual)
+{
+	EXPECT_NEAR(expected.x, actual.x, TOLERANCE);
+	EXPECT_NEAR(expected.y, actual.y, TOLERANCE);
+	EXPECT_NEAR(expected.z, actual.z, TOLERANCE);
+	EXPECT_NEAR(expected.w, actual.w, TOLERANCE);
+}
+
+// Random bodies, half of them rotating about an origin offset and some
+// without any angular velocity
+static void CreateBodies(Array<TransformComponent>& transforms,
+	Array<AngularMotionComponent>& motions)
+{
+	RandomNumberGenerator random(1234);
+	transforms.resize(NUM_BODIES);
+	motions.resize(NUM_BODIES);
+	for (uint32 i = 0; i < NUM_BODIES; i++)
+	{
+		transforms[i].transform.position = RandomVector(random);
+		transforms[i].transform.rotation = Quaternion(
+			RandomVector(random).Normalize(), random.NextFloat() * 6.0f);
+		motions[i].velocity = (i % 7 == 0 ? Vector3f::ZERO : RandomVector(random));
+		motions[i].acceleration = RandomVector(random);
+		motions[i].originOffset = (i % 2 == 0 ? Vector3f::ZERO : RandomVector(random));
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Stream tests
+//-----------------------------------------------------------------------------
+
+TEST(BatchIntegrators, ModifiedEuler)
+{
+	RandomNumberGenerator random(1234);
+	Array<float> data[2][9];
+	Array<Vector3f> positions(NUM_BODIES);
+	Array<Vector3f> velocities(NUM_BODIES);
+	Array<Vector3f> accelerations(NUM_BODIES);
+	for (uint32 i = 0; i < NUM_BODIES; i++)
+	{
+		positions[i] = RandomVector(random);
+		velocities[i] = RandomVector(random);
+		accelerations[i] = RandomVector(random);
+	}
+	integrators::LinearMotionStreams streams[2];
+	for (uint32 k = 0; k < 2; k++)
+	{
+		for (uint32 j = 0; j < 9; j++)
+			data[k][j].resize(NUM_BODIES);
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+		{
+			for (uint32 axis = 0; axis < 3; axis++)
+			{
+				data[k][axis][i] = positions[i][axis];
+				data[k][axis + 3][i] = velocities[i][axis];
+				data[k][axis + 6][i] = accelerations[i][axis];
+			}
+		}
+		integrators::LinearMotionStreams kStreams = {
+			data[k][0].data(), data[k][1].data(), data[k][2].data(),
+			data[k][3].data(), data[k][4].data(), data[k][5].data(),
+			data[k][6].data(), data[k][7].data(), data[k][8].data() };
+		streams[k] = kStreams;
+	}
+
+	const float delta = 1.0f / 60.0f;
+	for (uint32 step = 0; step < 10; step++)
+	{
+		integrators::ModifiedEulerBatch(streams[0], NUM_BODIES, delta);
+		integrators::ModifiedEulerBatchScalar(streams[1], NUM_BODIES, delta);
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+			integrators::ModifiedEuler(positions[i], velocities[i], accelerations[i], delta);
+	}
+	for (uint32 k = 0; k < 2; k++)
+	{
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+		{
+			ExpectNear(positions[i], Vector3f(data[k][0][i], data[k][1][i], data[k][2][i]));
+			ExpectNear(velocities[i], Vector3f(data[k][3][i], data[k][4][i], data[k][5][i]));
+		}
+	}
+}
+
+TEST(BatchIntegrators, AngularMotion)
+{
+	Array<TransformComponent> transforms;
+	Array<AngularMotionComponent> motions;
+	CreateBodies(transforms, motions);
+
+	Array<float> data[2][19];
+	integrators::AngularMotionStreams streams[2];
+	for (uint32 k = 0; k < 2; k++)
+	{
+		for (uint32 j = 0; j < 19; j++)
+			data[k][j].resize(NUM_BODIES, 0.0f);
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+		{
+			const Transform3f& transform = transforms[i].transform;
+			for (uint32 axis = 0; axis < 3; axis++)
+			{
+				data[k][axis][i] = transform.position[axis];
+				data[k][axis + 7][i] = motions[i].velocity[axis];
+				data[k][axis + 10][i] = motions[i].acceleration[axis];
+				data[k][axis + 13][i] = motions[i].originOffset[axis];
+			}
+			data[k][3][i] = transform.rotation.x;
+			data[k][4][i] = transform.rotation.y;
+			data[k][5][i] = transform.rotation.z;
+			data[k][6][i] = transform.rotation.w;
+		}
+		integrators::AngularMotionStreams kStreams = {
+			data[k][0].data(), data[k][1].data(), data[k][2].data(),
+			data[k][3].data(), data[k][4].data(), data[k][5].data(),
+			data[k][6].data(), data[k][7].data(), data[k][8].data(),
+			data[k][9].data(), data[k][10].data(), data[k][11].data(),
+			data[k][12].data(), data[k][13].data(), data[k][14].data(),
+			data[k][15].data(), data[k][16].data(), data[k][17].data(),
+			data[k][18].data() };
+		streams[k] = kStreams;
+	}
+
+	const float delta = 1.0f / 60.0f;
+	for (uint32 step = 0; step < 10; step++)
+	{
+		integrators::AngularMotionBatch(streams[0], NUM_BODIES, delta);
+		integrators::AngularMotionBatchScalar(streams[1], NUM_BODIES, delta);
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+			AngularMotionSystem::UpdateMotion(delta, &transforms[i], &motions[i]);
+	}
+	for (uint32 k = 0; k < 2; k++)
+	{
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+		{
+			ExpectNear(transforms[i].transform.position,
+				Vector3f(data[k][0][i], data[k][1][i], data[k][2][i]));
+			ExpectNear(transforms[i].transform.rotation,
+				Quaternion(data[k][3][i], data[k][4][i], data[k][5][i], data[k][6][i]));
+			ExpectNear(motions[i].velocity,
+				Vector3f(data[k][7][i], data[k][8][i], data[k][9][i]));
+			ExpectNear(motions[i].originOffsetWorld,
+				Vector3f(data[k][16][i], data[k][17][i], data[k][18][i]));
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// System tests
+//-----------------------------------------------------------------------------
+
+static void RunAngularMotionSystemTest(ECSStorageMode storageMode)
+{
+	Array<TransformComponent> transforms;
+	Array<AngularMotionComponent> motions;
+	CreateBodies(transforms, motions);
+
+	ECS ecs(storageMode);
+	Array<EntityHandle> entities;
+	for (uint32 i = 0; i < NUM_BODIES; i++)
+		entities.push_back(ecs.CreateEntity(transforms[i], motions[i]));
+	AngularMotionSystem system;
+	ECSSystemList systems;
+	systems.AddSystem(system);
+
+	const float delta = 1.0f / 60.0f;
+	for (uint32 step = 0; step < 10; step++)
+	{
+		ecs.UpdateSystems(systems, delta);
+		for (uint32 i = 0; i < NUM_BODIES; i++)
+			AngularMotionSystem::UpdateMotion(delta, &transforms[i], &motions[i]);
+	}
+	for (uint32 i = 0; i < NUM_BODIES; i++)
+	{
+		const TransformComponent* transform =
+			ecs.GetComponentReadOnly<TransformComponent>(entities[i]);
+		const AngularMotionComponent* motion =
+			ecs.GetComponentReadOnly<AngularMotionComponent>(entities[i]);
+		ExpectNear(transforms[i].transform.position, transform->transform.position);
+		ExpectNear(transforms[i].transform.rotation, transform->transform.rotation);
+		ExpectNear(motions[i].velocity, motion->velocity);
+		ExpectNear(motions[i].originOffsetWorld, motion->originOffsetWorld);
+		for (uint32 j = 0; j < 16; j++)
+			EXPECT_NEAR(motions[i].bodyToWorld.m[j], motion->bodyToWorld.m[j], TOLERANCE);
+	}
+}
+
+TEST(AngularMotionSystem, Update)
+{
+	RunAngularMotionSystemTest(ECSStorageMode::k_componentPools);
+}
+
+TEST(AngularMotionSystemArchetypes, Update)
+{
+	RunAngularMotionSystemTest(ECSStorageMode::k_archetypes);
+}
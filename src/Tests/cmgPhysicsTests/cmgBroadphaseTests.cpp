@@ -0,0 +1,310 @@
+// Broadphase Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgPhysics/broadphase/cmgAABBTreeBroadphase.h>
+#include <cmgPhysics/broadphase/cmgSweepAndPruneBroadphase.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <cmgPhysics/colliders/cmgSphereCollider.h>
+#include <cmgPhysics/colliders/cmgCapsuleCollider.h>
+#include <cmgPhysics/colliders/cmgCylinderCollider.h>
+#include <cmgPhysics/colliders/cmgConeCollider.h>
+#include <cmgPhysics/colliders/cmgPolygonCollider.h>
+#include <algorithm>
+
+
+static const float TOLERANCE = 1.0e-4f;
+
+static Vector3f RandomVector(RandomNumberGenerator& random, float scale)
+{
+	return Vector3f(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f,
+		random.NextFloat() - 0.5f) * scale;
+}
+
+static Bounds RandomBounds(RandomNumberGenerator& random)
+{
+	Bounds bounds;
+	Vector3f size(random.NextFloat(), random.NextFloat(), random.NextFloat());
+	bounds.SetCenterSize(RandomVector(random, 40.0f),
+		Vector3f(0.2f, 0.2f, 0.2f) + (size * 2.0f));
+	return bounds;
+}
+
+// Every pair with overlapping fat boxes, except pairs of static proxies
+static Array<BroadphasePair> FindPairsBruteForce(const Broadphase& broadphase,
+	const Array<int32>& proxies)
+{
+	Array<BroadphasePair> pairs;
+	for (uint32 i = 0; i < proxies.size(); i++)
+	{
+		for (uint32 j = i + 1; j < proxies.size(); j++)
+		{
+			int32 a = Math::Min(proxies[i], proxies[j]);
+			int32 b = Math::Max(proxies[i], proxies[j]);
+			if ((!broadphase.IsProxyStatic(a) || !broadphase.IsProxyStatic(b)) &&
+				broadphase.GetFatBounds(a).Intersects(broadphase.GetFatBounds(b)))
+				pairs.push_back(BroadphasePair(a, b));
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+	return pairs;
+}
+
+
+//-----------------------------------------------------------------------------
+// Collider bounds
+//-----------------------------------------------------------------------------
+
+TEST(Broadphase, ColliderBounds)
+{
+	// Compare each collider's bounds with the default found from support
+	// points, for a few orientations
+	Vector3f triangle[3] = { Vector3f(0.0f, 0.0f, 0.0f),
+		Vector3f(1.0f, 2.0f, 0.0f), Vector3f(-1.0f, 0.5f, 3.0f) };
+	Collider* colliders[] = {
+		new SphereCollider(0.75f),
+		new BoxCollider(Vector3f(0.5f, 1.0f, 2.0f)),
+		new CapsuleCollider(0.5f, 1.5f),
+		new CylinderCollider(0.5f, 1.5f),
+		new ConeCollider(0.5f, 2.0f),
+		new PolygonCollider(3, triangle),
+	};
+	RigidBody body;
+	for (uint32 i = 0; i < sizeof(colliders) / sizeof(colliders[0]); i++)
+		body.AddCollider(colliders[i]);
+
+	RandomNumberGenerator random(1234);
+	for (uint32 k = 0; k < 20; k++)
+	{
+		body.SetPosition(RandomVector(random, 10.0f));
+		body.SetOrientation(Quaternion(RandomVector(random, 1.0f).Normalize(),
+			random.NextFloat() * 6.0f));
+		body.CalculateDerivedData();
+		for (uint32 i = 0; i < sizeof(colliders) / sizeof(colliders[0]); i++)
+		{
+			Bounds expected = colliders[i]->Collider::GetBounds();
+			Bounds actual = colliders[i]->GetBounds();
+			for (uint32 axis = 0; axis < 3; axis++)
+			{
+				EXPECT_NEAR(expected.mins[axis], actual.mins[axis], TOLERANCE);
+				EXPECT_NEAR(expected.maxs[axis], actual.maxs[axis], TOLERANCE);
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Pair finding
+//-----------------------------------------------------------------------------
+
+// Move, replace and find pairs for proxies, some of them static, comparing
+// the pairs with testing every pair
+static void RunPairsTest(Broadphase& broadphase)
+{
+	RandomNumberGenerator random(1234);
+	Array<int32> proxies;
+	Array<Bounds> bounds;
+	Array<Vector3f> velocities;
+	for (uint32 i = 0; i < 500; i++)
+	{
+		bounds.push_back(RandomBounds(random));
+		velocities.push_back(RandomVector(random, 1.0f));
+		proxies.push_back(broadphase.CreateProxy(bounds[i], nullptr, (i % 5 == 0)));
+	}
+	EXPECT_EQ(500u, broadphase.GetNumProxies());
+
+	for (uint32 step = 0; step < 30; step++)
+	{
+		// Move the dynamic proxies
+		for (uint32 i = 0; i < proxies.size(); i++)
+		{
+			if (broadphase.IsProxyStatic(proxies[i]))
+				continue;
+			bounds[i].Translate(velocities[i]);
+			broadphase.MoveProxy(proxies[i], bounds[i], velocities[i]);
+		}
+
+		// Replace some proxies
+		for (uint32 i = step; i < proxies.size(); i += 37)
+		{
+			broadphase.DestroyProxy(proxies[i]);
+			bounds[i] = RandomBounds(random);
+			proxies[i] = broadphase.CreateProxy(bounds[i], nullptr, (i % 5 == 0));
+		}
+
+		broadphase.UpdatePairs();
+		Array<BroadphasePair> expected = FindPairsBruteForce(broadphase, proxies);
+		const Array<BroadphasePair>& pairs = broadphase.GetPairs();
+		ASSERT_EQ(expected.size(), pairs.size());
+		for (uint32 i = 0; i < pairs.size(); i++)
+		{
+			EXPECT_EQ(expected[i].proxyA, pairs[i].proxyA);
+			EXPECT_EQ(expected[i].proxyB, pairs[i].proxyB);
+		}
+	}
+
+	for (uint32 i = 0; i < proxies.size(); i++)
+		broadphase.DestroyProxy(proxies[i]);
+	EXPECT_EQ(0u, broadphase.GetNumProxies());
+	broadphase.UpdatePairs();
+	EXPECT_EQ(0u, broadphase.GetPairs().size());
+}
+
+TEST(Broadphase, AABBTreePairs)
+{
+	AABBTreeBroadphase broadphase;
+	RunPairsTest(broadphase);
+	EXPECT_TRUE(broadphase.GetTree().Validate());
+	EXPECT_EQ(0, broadphase.GetTree().GetHeight());
+}
+
+TEST(Broadphase, SweepAndPrunePairs)
+{
+	SweepAndPruneBroadphase broadphase;
+	broadphase.SetSortAxis(2);
+	RunPairsTest(broadphase);
+}
+
+TEST(Broadphase, MultiBoxPruningPairs)
+{
+	// The proxies move past the world bounds into the edge regions
+	SweepAndPruneBroadphase broadphase;
+	broadphase.SetRegionGrid(Bounds(Vector3f(-15.0f, -15.0f, -15.0f),
+		Vector3f(15.0f, 15.0f, 15.0f)), 4, 3);
+	EXPECT_EQ(12u, broadphase.GetNumRegions());
+	RunPairsTest(broadphase);
+}
+
+TEST(Broadphase, ChangeRegionGrid)
+{
+	RandomNumberGenerator random(1234);
+	SweepAndPruneBroadphase broadphase;
+	Array<int32> proxies;
+	for (uint32 i = 0; i < 200; i++)
+		proxies.push_back(broadphase.CreateProxy(RandomBounds(random), nullptr, false));
+	broadphase.UpdatePairs();
+	Array<BroadphasePair> expected = broadphase.GetPairs();
+	EXPECT_EQ(expected.size(), FindPairsBruteForce(broadphase, proxies).size());
+
+	broadphase.SetRegionGrid(Bounds(Vector3f(-20.0f, -20.0f, -20.0f),
+		Vector3f(20.0f, 20.0f, 20.0f)), 5, 5);
+	broadphase.SetSortAxis(1);
+	broadphase.UpdatePairs();
+	EXPECT_EQ(expected, broadphase.GetPairs());
+}
+
+TEST(Broadphase, SweepAndPruneStretchesAlongDisplacement)
+{
+	// A proxy moving toward another pairs with it before they touch
+	SweepAndPruneBroadphase broadphase;
+	Bounds bounds(Vector3f(0.0f, 0.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f));
+	int32 proxy = broadphase.CreateProxy(bounds, nullptr, false);
+	Bounds otherBounds = bounds;
+	otherBounds.Translate(Vector3f(-3.0f, 0.0f, 0.0f));
+	broadphase.CreateProxy(otherBounds, nullptr, true);
+	broadphase.UpdatePairs();
+	EXPECT_EQ(0u, broadphase.GetPairs().size());
+
+	Vector3f displacement(-2.5f, 0.0f, 0.0f);
+	broadphase.MoveProxy(proxy, bounds, displacement);
+	const Bounds& fatBounds = broadphase.GetFatBounds(proxy);
+	EXPECT_LE(fatBounds.mins.x, bounds.mins.x + displacement.x);
+	EXPECT_LT(fatBounds.maxs.x, bounds.maxs.x + 0.5f);
+	broadphase.UpdatePairs();
+	EXPECT_EQ(1u, broadphase.GetPairs().size());
+}
+
+
+//-----------------------------------------------------------------------------
+// Dynamic AABB tree
+//-----------------------------------------------------------------------------
+
+TEST(Broadphase, FatBoundsContainMovedBounds)
+{
+	DynamicAABBTree tree;
+	Bounds bounds(Vector3f(0.0f, 0.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f));
+	int32 proxy = tree.CreateProxy(bounds, nullptr);
+	int32 other = tree.CreateProxy(bounds, nullptr);
+
+	// Small movements stay inside the fat box
+	Bounds moved = bounds;
+	moved.Translate(Vector3f(0.05f, 0.0f, 0.0f));
+	EXPECT_FALSE(tree.MoveProxy(proxy, moved, Vector3f::ZERO));
+
+	// Large movements are stretched along the displacement
+	Vector3f displacement(0.0f, 0.0f, 5.0f);
+	moved.Translate(displacement);
+	EXPECT_TRUE(tree.MoveProxy(proxy, moved, displacement));
+	EXPECT_TRUE(DynamicAABBTree::ContainsBounds(tree.GetFatBounds(proxy), moved));
+	EXPECT_GE(tree.GetFatBounds(proxy).maxs.z, moved.maxs.z +
+		displacement.z * DynamicAABBTree::DISPLACEMENT_MULTIPLIER);
+	EXPECT_TRUE(tree.Validate());
+
+	tree.DestroyProxy(other);
+	EXPECT_TRUE(tree.Validate());
+	EXPECT_EQ(1u, tree.GetNumProxies());
+}
+
+
+//-----------------------------------------------------------------------------
+// Physics engine
+//-----------------------------------------------------------------------------
+
+static void RunPhysicsEngineTest(PhysicsEngine& engine)
+{
+	// A static floor with spheres resting on it, and one far away
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(20.0f, 0.5f, 20.0f)));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+	for (uint32 i = 0; i < 4; i++)
+	{
+		RigidBody* sphere = new RigidBody();
+		sphere->AddCollider(new SphereCollider(0.5f));
+		sphere->SetPosition(Vector3f(i * 2.0f, 0.95f, 0.0f));
+		engine.AddBody(sphere);
+	}
+	RigidBody* farSphere = new RigidBody();
+	farSphere->AddCollider(new SphereCollider(0.5f));
+	farSphere->SetPosition(Vector3f(0.0f, 100.0f, 0.0f));
+	engine.AddBody(farSphere);
+
+	engine.Simulate(1.0f / 60.0f);
+	EXPECT_EQ(4u, engine.GetBroadphase()->GetPairs().size());
+
+	uint32 numCollisions = 0;
+	for (auto it = engine.GetCollisionCache()->collisions_begin();
+		it != engine.GetCollisionCache()->collisions_end(); ++it)
+	{
+		EXPECT_EQ(floor->GetId(), it->first.idA);
+		EXPECT_NE(farSphere->GetId(), it->first.idB);
+		numCollisions++;
+	}
+	EXPECT_EQ(4u, numCollisions);
+
+	engine.RemoveBody(farSphere);
+	EXPECT_EQ(5u, engine.GetBroadphase()->GetNumProxies());
+}
+
+TEST(Broadphase, PhysicsEngineContacts)
+{
+	PhysicsEngine engine;
+	EXPECT_EQ(BroadphaseType::k_aabbTree, engine.GetBroadphase()->GetType());
+	RunPhysicsEngineTest(engine);
+}
+
+TEST(Broadphase, PhysicsEngineSweepAndPrune)
+{
+	PhysicsEngine engine;
+	engine.SetBroadphase(new SweepAndPruneBroadphase());
+	EXPECT_EQ(BroadphaseType::k_sweepAndPrune, engine.GetBroadphase()->GetType());
+	RunPhysicsEngineTest(engine);
+
+	// Switching moves the bodies into the new broadphase
+	engine.SetBroadphase(new AABBTreeBroadphase());
+	engine.Simulate(1.0f / 60.0f);
+	EXPECT_EQ(5u, engine.GetBroadphase()->GetNumProxies());
+	EXPECT_EQ(4u, engine.GetBroadphase()->GetPairs().size());
+}
@@ -0,0 +1,399 @@
+// Contact Caching and Warm Starting Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <map>
+
+
+static const float TIME_STEP = 1.0f / 60.0f;
+
+// Simulate a stack of boxes, returning how far the top box drifted
+static float SimulateStack(bool enableWarmStarting, uint32 height,
+	uint32 numSteps)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	engine.SetEnableWarmStarting(enableWarmStarting);
+	engine.SetNumVelocityIterations(8);
+
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(10.0f, 0.5f, 10.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+
+	RigidBody* top = nullptr;
+	for (uint32 i = 0; i < height; i++)
+	{
+		top = new RigidBody();
+		top->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+		top->SetPosition(Vector3f(0.0f, 0.5f + i, 0.0f));
+		engine.AddBody(top);
+	}
+
+	Vector3f start = top->GetPosition();
+	for (uint32 step = 0; step < numSteps; step++)
+		engine.Simulate(TIME_STEP);
+	return (top->GetPosition() - start).Length();
+}
+
+
+//-----------------------------------------------------------------------------
+// Collision map
+//-----------------------------------------------------------------------------
+
+TEST(Contacts, CollisionMapMatchesStdMap)
+{
+	RandomNumberGenerator random(42);
+	CollisionMap map;
+	std::map<IDPair, uint32> reference;
+
+	for (uint32 i = 0; i < 5000; i++)
+	{
+		IDPair ids(random.NextInt(50), random.NextInt(50));
+		if (random.NextInt(3) == 0)
+		{
+			// Erase the pair, if present
+			for (auto it = map.begin(); it != map.end(); ++it)
+			{
+				if (it->first == ids)
+				{
+					map.Erase(it);
+					break;
+				}
+			}
+			reference.erase(ids);
+		}
+		else
+		{
+			map.Insert(ids)->numContacts = i;
+			reference[ids] = i;
+		}
+	}
+
+	ASSERT_EQ((uint32) reference.size(), map.GetSize());
+	for (auto it = reference.begin(); it != reference.end(); ++it)
+	{
+		CollisionData* collision = map.Find(it->first);
+		ASSERT_NE(nullptr, collision);
+		EXPECT_EQ(it->second, collision->numContacts);
+	}
+	EXPECT_EQ(nullptr, map.Find(IDPair(100, 100)));
+}
+
+TEST(Contacts, CollisionMapEraseWhileIterating)
+{
+	CollisionMap map;
+	for (uint32 i = 0; i < 100; i++)
+	{
+		map.Insert(IDPair(i, i + 1));
+	}
+
+	// Erase the pairs with an odd first ID
+	for (auto it = map.begin(); it != map.end(); )
+	{
+		if (it->first.idA % 2 == 1)
+			it = map.Erase(it);
+		else
+			++it;
+	}
+
+	EXPECT_EQ(50u, map.GetSize());
+	for (uint32 i = 0; i < 100; i++)
+	{
+		EXPECT_EQ(i % 2 == 0, map.Find(IDPair(i, i + 1)) != nullptr);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Warm starting
+//-----------------------------------------------------------------------------
+
+TEST(Contacts, RestingBoxKeepsImpulses)
+{
+	PhysicsEngine engine;
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(10.0f, 0.5f, 10.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+	RigidBody* box = new RigidBody();
+	box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+	box->SetPosition(Vector3f(0.0f, 0.5f, 0.0f));
+	engine.AddBody(box);
+
+	engine.SetEnableSleeping(false);
+	for (uint32 step = 0; step < 60; step++)
+		engine.Simulate(TIME_STEP);
+
+	// The manifold has built up over several steps, and the cached
+	// impulses hold up the box's weight
+	CollisionData* collision = engine.GetCollisionCache()->GetCollision(floor, box);
+	ASSERT_NE(nullptr, collision);
+	EXPECT_GE(collision->numContacts, 3u);
+	float normalImpulse = 0.0f;
+	for (uint32 i = 0; i < collision->numContacts; i++)
+		normalImpulse += collision->contacts[i].normalImpulse;
+	EXPECT_NEAR(9.8f * TIME_STEP, normalImpulse, 0.05f);
+	EXPECT_NEAR(0.5f, box->GetPosition().y, 0.02f);
+}
+
+TEST(Contacts, WarmStartingHoldsUpStack)
+{
+	EXPECT_LT(SimulateStack(true, 5, 300), 0.5f);
+	EXPECT_GT(SimulateStack(false, 5, 300), 1.0f);
+}
+
+
+//-----------------------------------------------------------------------------
+// Contact solver
+//-----------------------------------------------------------------------------
+
+TEST(Contacts, SlidingBoxStopsWithFriction)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(20.0f, 0.5f, 20.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+	RigidBody* box = new RigidBody();
+	box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+	box->SetPosition(Vector3f(0.0f, 0.5f, 0.0f));
+	engine.AddBody(box);
+
+	engine.Simulate(TIME_STEP);
+	box->SetVelocity(Vector3f(3.0f, 0.0f, 0.0f));
+	for (uint32 step = 0; step < 120; step++)
+		engine.Simulate(TIME_STEP);
+
+	// The box slides about v^2 / (2 * mu * g) before stopping, while the
+	// static floor is left where it was
+	EXPECT_LT(box->GetVelocity().Length(), 0.1f);
+	EXPECT_GT(box->GetPosition().x, 0.5f);
+	EXPECT_LT(box->GetPosition().x, 2.5f);
+	EXPECT_NEAR(0.5f, box->GetPosition().y, 0.05f);
+	EXPECT_EQ(0.0f, floor->GetVelocity().Length());
+	EXPECT_EQ(0.0f, floor->GetAngularVelocity().Length());
+	EXPECT_EQ(-0.5f, floor->GetPosition().y);
+	EXPECT_EQ(0u, engine.GetContactSolver()->GetNumBodies());
+}
+
+// Create a pile of boxes above the floor
+static Array<RigidBody*> CreatePile(PhysicsEngine& engine)
+{
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(20.0f, 0.5f, 20.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+
+	Array<RigidBody*> boxes;
+	for (uint32 i = 0; i < 64; i++)
+	{
+		RigidBody* box = new RigidBody();
+		box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+		box->SetPosition(Vector3f((i % 4) * 1.1f, 0.5f + (i / 16) * 1.05f,
+			((i / 4) % 4) * 1.1f + (i / 16) * 0.2f));
+		engine.AddBody(box);
+		boxes.push_back(box);
+	}
+	return boxes;
+}
+
+// Drop a pile of boxes onto the floor, solving the last step with the given
+// mode, and return the boxes' final velocities
+static Array<Vector3f> SimulatePile(ContactSolverMode lastStepMode,
+	uint32 numSteps, ContactSolverMode mode = ContactSolverMode::k_sequential,
+	ThreadPool* threadPool = nullptr)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	engine.SetContactSolverMode(mode);
+	engine.SetThreadPool(threadPool);
+	Array<RigidBody*> boxes = CreatePile(engine);
+
+	for (uint32 step = 0; step + 1 < numSteps; step++)
+		engine.Simulate(TIME_STEP);
+	engine.SetContactSolverMode(lastStepMode);
+	engine.Simulate(TIME_STEP);
+
+	Array<Vector3f> velocities;
+	for (RigidBody* box : boxes)
+	{
+		velocities.push_back(box->GetVelocity());
+		velocities.push_back(box->GetAngularVelocity());
+	}
+	return velocities;
+}
+
+// Drop a single layer of 100 boxes onto the floor with the parallel solver,
+// and return the boxes' final positions. Each color holds far more floor
+// contacts than one parallel task solves.
+static Array<Vector3f> SimulateLayer(ThreadPool* threadPool, uint32 numSteps,
+	uint32* outMaxFloorContacts = nullptr)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	engine.SetContactSolverMode(ContactSolverMode::k_parallel);
+	engine.SetThreadPool(threadPool);
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(20.0f, 0.5f, 20.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+
+	Array<RigidBody*> boxes;
+	for (uint32 i = 0; i < 100; i++)
+	{
+		RigidBody* box = new RigidBody();
+		box->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+		box->SetPosition(Vector3f((i % 10) * 1.5f - 7.0f, 0.6f,
+			(i / 10) * 1.5f - 7.0f));
+		box->SetOrientation(Quaternion(Vector3f::UNITY, i * 0.1f));
+		engine.AddBody(box);
+		boxes.push_back(box);
+	}
+
+	for (uint32 step = 0; step < numSteps; step++)
+		engine.Simulate(TIME_STEP);
+
+	if (outMaxFloorContacts != nullptr)
+	{
+		ContactSolver solver;
+		solver.SetMode(ContactSolverMode::k_parallel);
+		solver.Prepare(*engine.GetCollisionCache(), 1.0f / TIME_STEP);
+		*outMaxFloorContacts = 0;
+		for (uint32 i = 0; i < solver.GetNumColors(); i++)
+		{
+			const ContactColor& color = solver.GetColor(i);
+			uint32 numFloorContacts = 0;
+			for (uint32 j = 0; j < color.numContacts; j++)
+			{
+				const SolverContact& contact = solver.GetContacts()[color.firstContact + j];
+				if (solver.GetBodies()[contact.bodyA].inverseMass == 0.0f ||
+					solver.GetBodies()[contact.bodyB].inverseMass == 0.0f)
+				{
+					numFloorContacts++;
+				}
+			}
+			*outMaxFloorContacts = Math::Max(*outMaxFloorContacts, numFloorContacts);
+		}
+		solver.Clear();
+	}
+
+	Array<Vector3f> positions;
+	for (RigidBody* box : boxes)
+		positions.push_back(box->GetPosition());
+	return positions;
+}
+
+TEST(Contacts, WideSolverMatchesSequential)
+{
+	// Contact generation makes any rounding difference grow over many
+	// steps, so only one step is compared, once the pile has settled into
+	// layers touching each other
+	Array<Vector3f> sequential = SimulatePile(ContactSolverMode::k_sequential, 30);
+	Array<Vector3f> wide = SimulatePile(ContactSolverMode::k_wide, 30);
+	for (uint32 i = 0; i < sequential.size(); i++)
+	{
+		EXPECT_NEAR(sequential[i].x, wide[i].x, 0.0001f);
+		EXPECT_NEAR(sequential[i].y, wide[i].y, 0.0001f);
+		EXPECT_NEAR(sequential[i].z, wide[i].z, 0.0001f);
+	}
+
+	// Repeating the same steps gives exactly the same result.
+	wide = SimulatePile(ContactSolverMode::k_wide, 30, ContactSolverMode::k_wide);
+	Array<Vector3f> repeat = SimulatePile(ContactSolverMode::k_wide, 30,
+		ContactSolverMode::k_wide);
+	for (uint32 i = 0; i < wide.size(); i++)
+	{
+		EXPECT_EQ(wide[i].x, repeat[i].x);
+		EXPECT_EQ(wide[i].y, repeat[i].y);
+		EXPECT_EQ(wide[i].z, repeat[i].z);
+	}
+}
+
+TEST(Contacts, ColorsDontShareMovingBodies)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	CreatePile(engine);
+	for (uint32 step = 0; step < 30; step++)
+		engine.Simulate(TIME_STEP);
+
+	ContactSolver solver;
+	solver.SetMode(ContactSolverMode::k_parallel);
+	solver.Prepare(*engine.GetCollisionCache(), 1.0f / TIME_STEP);
+	const Array<SolverContact>& contacts = solver.GetContacts();
+	const Array<SolverBody>& bodies = solver.GetBodies();
+	EXPECT_GT(solver.GetNumColors(), 1u);
+
+	uint32 numContacts = 0;
+	for (uint32 i = 0; i < solver.GetNumColors(); i++)
+	{
+		const ContactColor& color = solver.GetColor(i);
+		EXPECT_EQ(numContacts, color.firstContact);
+		EXPECT_FALSE(color.isSerial);
+		numContacts += color.numContacts;
+
+		// The floor is in every color, but no box is in a color twice.
+		Array<bool> isInColor(bodies.size(), false);
+		for (uint32 j = color.firstContact; j < numContacts; j++)
+		{
+			for (uint32 body : { contacts[j].bodyA, contacts[j].bodyB })
+			{
+				if (bodies[body].inverseMass == 0.0f)
+					continue;
+				EXPECT_FALSE(isInColor[body]);
+				isInColor[body] = true;
+			}
+		}
+	}
+	EXPECT_EQ(solver.GetNumContacts(), numContacts);
+	solver.Clear();
+}
+
+TEST(Contacts, ParallelSolverIsDeterministic)
+{
+	ContactSolverMode mode = ContactSolverMode::k_parallel;
+	ThreadPool pool2(2);
+	ThreadPool pool4(4);
+	Array<Vector3f> serial = SimulatePile(mode, 60, mode);
+	Array<Vector3f> parallel2 = SimulatePile(mode, 60, mode, &pool2);
+	Array<Vector3f> parallel4 = SimulatePile(mode, 60, mode, &pool4);
+	Array<Vector3f> repeat4 = SimulatePile(mode, 60, mode, &pool4);
+	for (uint32 i = 0; i < serial.size(); i++)
+	{
+		EXPECT_EQ(serial[i].x, parallel2[i].x);
+		EXPECT_EQ(serial[i].y, parallel2[i].y);
+		EXPECT_EQ(serial[i].z, parallel2[i].z);
+		EXPECT_EQ(serial[i].x, parallel4[i].x);
+		EXPECT_EQ(serial[i].y, parallel4[i].y);
+		EXPECT_EQ(serial[i].z, parallel4[i].z);
+		EXPECT_EQ(parallel4[i].x, repeat4[i].x);
+		EXPECT_EQ(parallel4[i].y, repeat4[i].y);
+		EXPECT_EQ(parallel4[i].z, repeat4[i].z);
+	}
+}
+
+TEST(Contacts, ParallelSolverSharesStaticBodies)
+{
+	// The floor is split across the tasks of a color, which only read it.
+	ThreadPool pool4(4);
+	uint32 maxFloorContacts = 0;
+	Array<Vector3f> serial = SimulateLayer(nullptr, 60);
+	Array<Vector3f> parallel = SimulateLayer(&pool4, 60, &maxFloorContacts);
+	EXPECT_GT(maxFloorContacts, 16u);
+	for (uint32 i = 0; i < serial.size(); i++)
+	{
+		EXPECT_EQ(serial[i].x, parallel[i].x);
+		EXPECT_EQ(serial[i].y, parallel[i].y);
+		EXPECT_EQ(serial[i].z, parallel[i].z);
+	}
+}
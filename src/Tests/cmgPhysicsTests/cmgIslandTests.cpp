@@ -0,0 +1,210 @@
+// Island and Sleeping Tests
+
+#include <gtest/gtest.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <cmgPhysics/colliders/cmgSphereCollider.h>
+
+
+static const float TIME_STEP = 1.0f / 60.0f;
+
+static RigidBody* AddFloor(PhysicsEngine& engine)
+{
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(50.0f, 0.5f, 50.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+	return floor;
+}
+
+// A row of spheres pressed together between two static walls, so that
+// they are joined into one island
+static void AddRow(PhysicsEngine& engine, float z, uint32 count,
+	Array<RigidBody*>& outBodies)
+{
+	const float spacing = 0.99f;
+	for (uint32 i = 0; i < count; i++)
+	{
+		RigidBody* sphere = new RigidBody();
+		sphere->AddCollider(new SphereCollider(0.5f));
+		sphere->SetPosition(Vector3f(i * spacing, 0.5f, z));
+		engine.AddBody(sphere);
+		outBodies.push_back(sphere);
+	}
+	for (uint32 i = 0; i < 2; i++)
+	{
+		RigidBody* wall = new RigidBody();
+		wall->AddCollider(new BoxCollider(Vector3f(0.5f, 1.0f, 1.0f)));
+		wall->SetPosition(Vector3f(i == 0 ? -spacing : count * spacing, 1.0f, z));
+		wall->SetInverseMass(0.0f);
+		engine.AddBody(wall);
+	}
+}
+
+static void Settle(PhysicsEngine& engine, uint32 maxSteps)
+{
+	for (uint32 step = 0; step < maxSteps && engine.GetNumAwakeBodies() > 0; step++)
+		engine.Simulate(TIME_STEP);
+}
+
+
+//-----------------------------------------------------------------------------
+// Sleeping
+//-----------------------------------------------------------------------------
+
+TEST(Islands, RestingRowsFallAsleep)
+{
+	PhysicsEngine engine;
+	AddFloor(engine);
+	Array<RigidBody*> spheres;
+	AddRow(engine, 0.0f, 3, spheres);
+	AddRow(engine, 5.0f, 2, spheres);
+	AddRow(engine, 10.0f, 1, spheres);
+
+	engine.Simulate(TIME_STEP);
+	EXPECT_EQ(3u, engine.GetNumIslands());
+	EXPECT_EQ(6u, engine.GetNumAwakeBodies());
+
+	Settle(engine, 600);
+	EXPECT_EQ(0u, engine.GetNumAwakeBodies());
+	EXPECT_EQ(0u, engine.GetNumIslands());
+
+	// Sleeping bodies stay put, and don't pair with static bodies
+	Array<Vector3f> positions;
+	for (uint32 i = 0; i < spheres.size(); i++)
+	{
+		EXPECT_FALSE(spheres[i]->IsAwake());
+		EXPECT_EQ(0.0f, spheres[i]->GetVelocity().Length());
+		positions.push_back(spheres[i]->GetPosition());
+	}
+	for (uint32 step = 0; step < 10; step++)
+		engine.Simulate(TIME_STEP);
+	EXPECT_EQ(0u, engine.GetBroadphase()->GetPairs().size());
+	for (uint32 i = 0; i < spheres.size(); i++)
+		EXPECT_EQ(0.0f, (spheres[i]->GetPosition() - positions[i]).Length());
+}
+
+TEST(Islands, SleepingDisabled)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	AddFloor(engine);
+	Array<RigidBody*> spheres;
+	AddRow(engine, 0.0f, 2, spheres);
+	for (uint32 step = 0; step < 300; step++)
+		engine.Simulate(TIME_STEP);
+	EXPECT_EQ(2u, engine.GetNumAwakeBodies());
+
+	// Bodies can also opt out on their own
+	engine.SetEnableSleeping(true);
+	spheres[1]->SetAllowSleep(false);
+	for (uint32 step = 0; step < 300; step++)
+		engine.Simulate(TIME_STEP);
+	EXPECT_EQ(2u, engine.GetNumAwakeBodies());
+}
+
+
+//-----------------------------------------------------------------------------
+// Waking
+//-----------------------------------------------------------------------------
+
+TEST(Islands, ImpulseWakesIsland)
+{
+	PhysicsEngine engine;
+	AddFloor(engine);
+	Array<RigidBody*> rowA;
+	Array<RigidBody*> rowB;
+	AddRow(engine, 0.0f, 3, rowA);
+	AddRow(engine, 5.0f, 3, rowB);
+	Settle(engine, 600);
+	ASSERT_EQ(0u, engine.GetNumAwakeBodies());
+
+	// Pushing the first sphere wakes its whole row but not the other
+	rowA[0]->ApplyImpulse(Vector3f(0.5f, 0.0f, 0.0f),
+		rowA[0]->GetCenterOfMassWorld());
+	for (uint32 i = 0; i < 3; i++)
+	{
+		EXPECT_TRUE(rowA[i]->IsAwake());
+		EXPECT_FALSE(rowB[i]->IsAwake());
+	}
+	engine.Simulate(TIME_STEP);
+	EXPECT_EQ(3u, engine.GetNumAwakeBodies());
+	EXPECT_EQ(1u, engine.GetNumIslands());
+
+	// Forces wake bodies too
+	Settle(engine, 600);
+	ASSERT_EQ(0u, engine.GetNumAwakeBodies());
+	rowB[2]->ApplyForceLinear(Vector3f(0.0f, 1.0f, 0.0f));
+	EXPECT_EQ(3u, engine.GetNumAwakeBodies());
+}
+
+TEST(Islands, ContactWakesIsland)
+{
+	PhysicsEngine engine;
+	AddFloor(engine);
+	Array<RigidBody*> row;
+	AddRow(engine, 0.0f, 3, row);
+	Settle(engine, 600);
+	ASSERT_EQ(0u, engine.GetNumAwakeBodies());
+
+	// Drop a sphere onto the end of the row
+	RigidBody* sphere = new RigidBody();
+	sphere->AddCollider(new SphereCollider(0.5f));
+	sphere->SetPosition(Vector3f(1.98f, 3.0f, 0.0f));
+	engine.AddBody(sphere);
+	bool woken = false;
+	for (uint32 step = 0; step < 120 && !woken; step++)
+	{
+		engine.Simulate(TIME_STEP);
+		woken = row[0]->IsAwake();
+	}
+	EXPECT_TRUE(woken);
+	for (uint32 i = 0; i < 3; i++)
+		EXPECT_TRUE(row[i]->IsAwake());
+}
+
+TEST(Islands, MovingPlatformWakesIsland)
+{
+	PhysicsEngine engine;
+	AddFloor(engine);
+	Array<RigidBody*> row;
+	AddRow(engine, 0.0f, 3, row);
+	Settle(engine, 600);
+	ASSERT_EQ(0u, engine.GetNumAwakeBodies());
+
+	// Lower a platform without mass onto the middle of the row
+	RigidBody* platform = new RigidBody();
+	platform->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+	platform->SetPosition(Vector3f(0.99f, 2.5f, 0.0f));
+	platform->SetInverseMass(0.0f);
+	platform->SetVelocity(Vector3f(0.0f, -2.0f, 0.0f));
+	engine.AddBody(platform);
+	bool woken = false;
+	for (uint32 step = 0; step < 120 && !woken; step++)
+	{
+		engine.Simulate(TIME_STEP);
+		woken = row[1]->IsAwake();
+	}
+	EXPECT_TRUE(woken);
+	for (uint32 i = 0; i < 3; i++)
+		EXPECT_TRUE(row[i]->IsAwake());
+}
+
+TEST(Islands, RemovingSupportWakesBodies)
+{
+	PhysicsEngine engine;
+	RigidBody* floor = AddFloor(engine);
+	Array<RigidBody*> row;
+	AddRow(engine, 0.0f, 2, row);
+	Settle(engine, 600);
+	ASSERT_EQ(0u, engine.GetNumAwakeBodies());
+
+	// Removing the floor lets the row fall
+	engine.RemoveBody(floor);
+	EXPECT_EQ(2u, engine.GetNumAwakeBodies());
+	float height = row[0]->GetPosition().y;
+	for (uint32 step = 0; step < 10; step++)
+		engine.Simulate(TIME_STEP);
+	EXPECT_LT(row[0]->GetPosition().y, height - 0.1f);
+}
@@ -0,0 +1,268 @@
+// Narrowphase Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgCore/thread/cmgThreadPool.h>
+#include <cmgPhysics/cmgGJK.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <cmgPhysics/colliders/cmgCapsuleCollider.h>
+#include <cmgPhysics/colliders/cmgSphereCollider.h>
+
+
+static const float TIME_STEP = 1.0f / 60.0f;
+
+// Drop a heap of boxes and spheres onto the floor, returning the ID pairs of
+// the cached collisions in the order the solver sees them, followed by the
+// bodies' final positions
+static Array<Vector3f> SimulateHeap(ThreadPool* threadPool, uint32 numSteps,
+	Array<IDPair>& outCollisions)
+{
+	PhysicsEngine engine;
+	engine.SetEnableSleeping(false);
+	engine.SetThreadPool(threadPool);
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(20.0f, 0.5f, 20.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+
+	RandomNumberGenerator random(1234);
+	Array<RigidBody*> bodies;
+	for (uint32 i = 0; i < 200; i++)
+	{
+		RigidBody* body = new RigidBody();
+		if (i % 2 == 0)
+			body->AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+		else
+			body->AddCollider(new SphereCollider(0.5f));
+		body->SetPosition(Vector3f(random.NextFloat() * 6.0f,
+			0.5f + random.NextFloat() * 10.0f, random.NextFloat() * 6.0f));
+		engine.AddBody(body);
+		bodies.push_back(body);
+	}
+
+	for (uint32 step = 0; step < numSteps; step++)
+		engine.Simulate(TIME_STEP);
+
+	CollisionCache* cache = engine.GetCollisionCache();
+	for (auto it = cache->collisions_begin(); it != cache->collisions_end(); ++it)
+		outCollisions.push_back(it->first);
+	Array<Vector3f> positions;
+	for (RigidBody* body : bodies)
+		positions.push_back(body->GetPosition());
+	return positions;
+}
+
+// Move a body to a random pose within a cube of the given size
+static void PlaceRandomly(RandomNumberGenerator& random, RigidBody* body,
+	float size)
+{
+	body->SetPosition(Vector3f(random.NextFloat() - 0.5f,
+		random.NextFloat() - 0.5f, random.NextFloat() - 0.5f) * size);
+	Vector3f axis(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f,
+		random.NextFloat() - 0.5f);
+	if (axis.LengthSquared() < 0.01f)
+		axis = Vector3f::UP;
+	axis.Normalize();
+	body->SetOrientation(Quaternion(axis, random.NextFloat() * Math::TWO_PI));
+	body->CalculateDerivedData();
+}
+
+// Returns the deepest contact of a collision, or null if it has none
+static const Contact* GetDeepestContact(const CollisionData& collision)
+{
+	const Contact* deepest = nullptr;
+	for (uint32 i = 0; i < collision.numContacts; i++)
+	{
+		if (deepest == nullptr ||
+			collision.contacts[i].penetration > deepest->penetration)
+		{
+			deepest = &collision.contacts[i];
+		}
+	}
+	return deepest;
+}
+
+// Compare the collide function for a pair of colliders against GJK and EPA
+// for random poses of their bodies
+static void ExpectCollideFunctionMatchesGJK(Collider* a, Collider* b,
+	float size)
+{
+	RigidBody bodyA;
+	RigidBody bodyB;
+	bodyA.AddCollider(a);
+	bodyB.AddCollider(b);
+	CollisionDetector detector;
+	ASSERT_TRUE(detector.HasCollideFunction(a->GetType(), b->GetType()));
+	ASSERT_TRUE(detector.HasCollideFunction(b->GetType(), a->GetType()));
+
+	RandomNumberGenerator random(1234);
+	uint32 numColliding = 0;
+	for (uint32 i = 0; i < 1000; i++)
+	{
+		PlaceRandomly(random, &bodyA, size);
+		PlaceRandomly(random, &bodyB, size);
+		CollisionData expected;
+		CollisionData actual;
+		expected.numContacts = 0;
+		actual.numContacts = 0;
+		detector.DetectCollisionGJK(a, b, &expected);
+		detector.DetectCollision(a, b, &actual);
+
+		// Shallow contacts are too close to call either way, as GJK misses
+		// some near corners and EPA gives up on some deep ones.
+		Simplex simplex;
+		bool isIntersecting = GJK::TestIntersection(a, b, &simplex);
+		const Contact* expectedContact = GetDeepestContact(expected);
+		const Contact* actualContact = GetDeepestContact(actual);
+		float expectedDepth = (expectedContact != nullptr ? expectedContact->penetration : 0.0f);
+		float actualDepth = (actualContact != nullptr ? actualContact->penetration : 0.0f);
+		if (actualDepth > 0.05f)
+			EXPECT_TRUE(isIntersecting);
+		if (expectedDepth < 0.02f)
+			continue;
+		numColliding++;
+		ASSERT_TRUE(actualContact != nullptr);
+
+		// The depth is close to EPA's, which is the smallest, and no more
+		// than how far the shapes overlap along the contact normal.
+		Vector3f normal = actualContact->contactNormal;
+		float overlap = (b->GetSupportPoint(normal) - a->GetSupportPoint(-normal)).Dot(normal);
+		EXPECT_NEAR(expectedDepth, actualDepth, 0.015f + (expectedDepth * 0.06f));
+		EXPECT_LE(actualDepth, overlap + 0.001f);
+
+		// The contacts follow the same conventions as EPA's, with the normal
+		// pointing from B to A.
+		for (uint32 j = 0; j < actual.numContacts; j++)
+		{
+			const Contact& contact = actual.contacts[j];
+			EXPECT_EQ(&bodyA, contact.bodyA);
+			EXPECT_EQ(&bodyB, contact.bodyB);
+			EXPECT_NEAR(contact.penetration, (contact.worldPositionB -
+				contact.worldPositionA).Dot(contact.contactNormal), 0.0001f);
+		}
+	}
+	EXPECT_GT(numColliding, 100u);
+}
+
+
+//-----------------------------------------------------------------------------
+// Collide functions
+//-----------------------------------------------------------------------------
+
+TEST(Narrowphase, SphereAndSphereMatchesGJK)
+{
+	ExpectCollideFunctionMatchesGJK(new SphereCollider(0.5f),
+		new SphereCollider(0.8f), 2.0f);
+}
+
+TEST(Narrowphase, SphereAndBoxMatchesGJK)
+{
+	ExpectCollideFunctionMatchesGJK(new SphereCollider(0.5f),
+		new BoxCollider(Vector3f(0.5f, 0.8f, 0.3f)), 1.8f);
+	ExpectCollideFunctionMatchesGJK(new BoxCollider(Vector3f(0.5f, 0.8f, 0.3f)),
+		new SphereCollider(0.5f), 1.8f);
+}
+
+TEST(Narrowphase, SphereAndCapsuleMatchesGJK)
+{
+	ExpectCollideFunctionMatchesGJK(new CapsuleCollider(0.4f, 0.6f),
+		new SphereCollider(0.5f), 2.0f);
+}
+
+TEST(Narrowphase, CapsuleAndCapsuleMatchesGJK)
+{
+	ExpectCollideFunctionMatchesGJK(new CapsuleCollider(0.4f, 0.6f),
+		new CapsuleCollider(0.3f, 0.8f), 2.0f);
+}
+
+TEST(Narrowphase, BoxAndBoxMatchesGJK)
+{
+	ExpectCollideFunctionMatchesGJK(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)),
+		new BoxCollider(Vector3f(0.8f, 0.3f, 0.6f)), 1.8f);
+}
+
+TEST(Narrowphase, BoxOnFloorGetsFaceContacts)
+{
+	// GJK and EPA find one contact per step, where clipping the faces
+	// finds all four corners at once.
+	RigidBody floor;
+	floor.AddCollider(new BoxCollider(Vector3f(10.0f, 0.5f, 10.0f)));
+	floor.SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor.CalculateDerivedData();
+	RigidBody box;
+	box.AddCollider(new BoxCollider(Vector3f(0.5f, 0.5f, 0.5f)));
+	box.SetPosition(Vector3f(2.0f, 0.49f, 1.0f));
+	box.SetOrientation(Quaternion(Vector3f::UP, 0.3f));
+	box.CalculateDerivedData();
+
+	CollisionDetector detector;
+	CollisionData collision;
+	detector.DetectCollision(&box, &floor, &collision);
+	ASSERT_EQ(4u, collision.numContacts);
+	for (uint32 i = 0; i < collision.numContacts; i++)
+	{
+		const Contact& contact = collision.contacts[i];
+		EXPECT_NEAR(0.01f, contact.penetration, 0.0001f);
+		EXPECT_NEAR(1.0f, contact.contactNormal.y, 0.0001f);
+		EXPECT_NEAR(-0.01f, contact.worldPositionA.y, 0.0001f);
+		EXPECT_NEAR(0.0f, contact.worldPositionB.y, 0.0001f);
+	}
+}
+
+TEST(Narrowphase, ParallelCapsulesGetTwoContacts)
+{
+	RigidBody bodyA;
+	bodyA.AddCollider(new CapsuleCollider(0.5f, 1.0f));
+	bodyA.SetOrientation(Quaternion(Vector3f::UNITZ, Math::HALF_PI));
+	bodyA.SetPosition(Vector3f(0.5f, 0.95f, 0.0f));
+	bodyA.CalculateDerivedData();
+	RigidBody bodyB;
+	bodyB.AddCollider(new CapsuleCollider(0.5f, 1.0f));
+	bodyB.SetOrientation(Quaternion(Vector3f::UNITZ, Math::HALF_PI));
+	bodyB.CalculateDerivedData();
+
+	CollisionDetector detector;
+	CollisionData collision;
+	detector.DetectCollision(&bodyA, &bodyB, &collision);
+	ASSERT_EQ(2u, collision.numContacts);
+
+	// One contact at each end of where the segments overlap
+	float x0 = collision.contacts[0].worldPositionA.x;
+	float x1 = collision.contacts[1].worldPositionA.x;
+	EXPECT_NEAR(-0.5f, Math::Min(x0, x1), 0.0001f);
+	EXPECT_NEAR(1.0f, Math::Max(x0, x1), 0.0001f);
+	for (uint32 i = 0; i < collision.numContacts; i++)
+	{
+		EXPECT_NEAR(0.05f, collision.contacts[i].penetration, 0.0001f);
+		EXPECT_NEAR(1.0f, collision.contacts[i].contactNormal.y, 0.0001f);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Parallel narrowphase
+//-----------------------------------------------------------------------------
+
+TEST(Narrowphase, ParallelMatchesSerial)
+{
+	// The threads find collisions in an order that depends on timing, but
+	// the results must not.
+	ThreadPool threadPool(4);
+	Array<IDPair> serialCollisions;
+	Array<IDPair> parallelCollisions;
+	Array<Vector3f> serial = SimulateHeap(nullptr, 90, serialCollisions);
+	Array<Vector3f> parallel = SimulateHeap(&threadPool, 90, parallelCollisions);
+
+	EXPECT_GT(serialCollisions.size(), 100u);
+	ASSERT_EQ(serialCollisions.size(), parallelCollisions.size());
+	for (uint32 i = 0; i < serialCollisions.size(); i++)
+		EXPECT_TRUE(serialCollisions[i] == parallelCollisions[i]);
+	for (uint32 i = 0; i < serial.size(); i++)
+	{
+		EXPECT_EQ(serial[i].x, parallel[i].x);
+		EXPECT_EQ(serial[i].y, parallel[i].y);
+		EXPECT_EQ(serial[i].z, parallel[i].z);
+	}
+}
@@ -0,0 +1,10 @@
+// CMG Physics Tests
+
+#include <gtest/gtest.h>
+
+
+int main(int argc, char* argv[])
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
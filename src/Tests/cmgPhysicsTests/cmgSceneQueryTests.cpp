@@ -0,0 +1,456 @@
+// Scene Query Tests
+
+#include <gtest/gtest.h>
+#include <cmgCore/cmgRandom.h>
+#include <cmgPhysics/cmgGJK.h>
+#include <cmgPhysics/cmgPhysicsEngine.h>
+#include <cmgPhysics/colliders/cmgBoxCollider.h>
+#include <cmgPhysics/colliders/cmgSphereCollider.h>
+#include <cmgPhysics/colliders/cmgCapsuleCollider.h>
+#include <cmgPhysics/colliders/cmgCylinderCollider.h>
+
+
+static const float TOLERANCE = 1.0e-3f;
+
+static Vector3f RandomVector(RandomNumberGenerator& random, float scale)
+{
+	return Vector3f(random.NextFloat() - 0.5f, random.NextFloat() - 0.5f,
+		random.NextFloat() - 0.5f) * scale;
+}
+
+static Ray RandomRay(RandomNumberGenerator& random)
+{
+	Ray ray;
+	ray.origin = RandomVector(random, 60.0f);
+	ray.direction = RandomVector(random, 1.0f);
+	if (ray.direction.LengthSquared() < 0.01f)
+		ray.direction = Vector3f::UNITX;
+	ray.direction.Normalize();
+	return ray;
+}
+
+// Add spheres, boxes, capsules and cylinders scattered around the origin,
+// some of them overlapping
+static void CreateScene(PhysicsEngine& engine, uint32 count)
+{
+	RandomNumberGenerator random(1234);
+	for (uint32 i = 0; i < count; i++)
+	{
+		RigidBody* body = new RigidBody();
+		float size = 0.5f + random.NextFloat() * 2.0f;
+		if (i % 4 == 0)
+			body->AddCollider(new SphereCollider(size));
+		else if (i % 4 == 1)
+			body->AddCollider(new BoxCollider(Vector3f(size, 0.5f * size, 1.0f)));
+		else if (i % 4 == 2)
+			body->AddCollider(new CapsuleCollider(0.5f * size, size));
+		else
+			body->AddCollider(new CylinderCollider(0.5f * size, size));
+		body->SetPosition(RandomVector(random, 40.0f));
+		body->SetOrientation(Quaternion(RandomVector(random, 1.0f).Normalize(),
+			random.NextFloat() * 6.0f));
+		body->SetInverseMass(0.0f);
+		engine.AddBody(body);
+	}
+	engine.UpdateSceneQueries();
+}
+
+// The closest hit from casting against every collider
+static bool CastRayBruteForce(PhysicsEngine& engine, const Ray& ray,
+	float maxDistance, SceneQueryHit& outHit)
+{
+	outHit.collider = nullptr;
+	outHit.distance = maxDistance;
+	for (uint32 i = 0; i < engine.GetNumBodies(); i++)
+	{
+		RigidBody* body = engine.GetBody(i);
+		for (auto it = body->colliders_begin(); it != body->colliders_end(); ++it)
+		{
+			if ((*it)->CastBoundedRay(ray, outHit.distance, outHit.normal))
+				outHit.collider = *it;
+		}
+	}
+	return (outHit.collider != nullptr);
+}
+
+
+//-----------------------------------------------------------------------------
+// Collider ray casts
+//-----------------------------------------------------------------------------
+
+TEST(SceneQuery, RayCastMatchesGJK)
+{
+	// The analytic ray casts of spheres and boxes should match GJK, except
+	// for the distance of rays that graze the surface, and for normals near
+	// the edges of boxes
+	RigidBody body;
+	Collider* colliders[] = {
+		new SphereCollider(1.5f),
+		new BoxCollider(Vector3f(0.5f, 1.0f, 2.0f)),
+	};
+	for (uint32 i = 0; i < 2; i++)
+		body.AddCollider(colliders[i]);
+
+	RandomNumberGenerator random(1234);
+	uint32 numHits = 0;
+	for (uint32 k = 0; k < 500; k++)
+	{
+		body.SetPosition(RandomVector(random, 4.0f));
+		body.SetOrientation(Quaternion(RandomVector(random, 1.0f).Normalize(),
+			random.NextFloat() * 6.0f));
+		body.CalculateDerivedData();
+		Ray ray;
+		ray.origin = RandomVector(random, 16.0f);
+		ray.direction = Vector3f::Normalize(body.GetPosition() +
+			RandomVector(random, 4.0f) - ray.origin);
+
+		for (uint32 i = 0; i < 2; i++)
+		{
+			float distance = 100.0f;
+			float expectedDistance = 100.0f;
+			Vector3f normal;
+			Vector3f expectedNormal;
+			bool hit = colliders[i]->CastBoundedRay(ray, distance, normal);
+			bool expectedHit = GJK::Cast(nullptr, colliders[i], ray.origin,
+				ray.direction, expectedDistance, expectedNormal);
+			ASSERT_EQ(expectedHit, hit);
+			if (!hit)
+				continue;
+			numHits++;
+			EXPECT_NEAR(1.0f, normal.Length(), TOLERANCE);
+			EXPECT_LE(normal.Dot(ray.direction), 0.0f);
+			if (normal.Dot(ray.direction) < -0.2f)
+				EXPECT_NEAR(expectedDistance, distance, TOLERANCE);
+			if (i == 0)
+			{
+				EXPECT_NEAR(expectedNormal.x, normal.x, 0.01f);
+				EXPECT_NEAR(expectedNormal.y, normal.y, 0.01f);
+				EXPECT_NEAR(expectedNormal.z, normal.z, 0.01f);
+			}
+		}
+	}
+	EXPECT_GT(numHits, 200u);
+}
+
+TEST(SceneQuery, SweepSphere)
+{
+	// Sweeping a sphere is the same as casting a ray against the other
+	// shape grown by the sphere's radius
+	RigidBody body;
+	SphereCollider* target = new SphereCollider(1.0f);
+	body.AddCollider(target);
+	body.SetPosition(Vector3f(10.0f, 0.0f, 0.0f));
+	body.CalculateDerivedData();
+
+	SphereCollider shape(0.5f);
+	shape.SetShapeToWorld(Matrix4f::IDENTITY);
+	float distance = 100.0f;
+	Vector3f normal;
+	Vector3f point;
+	ASSERT_TRUE(GJK::Cast(&shape, target, Vector3f::ZERO,
+		Vector3f::UNITX, distance, normal, &point));
+	EXPECT_NEAR(8.5f, distance, TOLERANCE);
+	EXPECT_NEAR(-1.0f, normal.x, TOLERANCE);
+	EXPECT_NEAR(9.0f, point.x, TOLERANCE);
+
+	// Glancing past the edge
+	distance = 100.0f;
+	shape.SetShapeToWorld(Matrix4f::CreateTranslation(0.0f, 1.2f, 0.0f));
+	ASSERT_TRUE(GJK::Cast(&shape, target, Vector3f::ZERO,
+		Vector3f::UNITX, distance, normal));
+	EXPECT_NEAR(10.0f - Math::Sqrt(1.5f * 1.5f - 1.2f * 1.2f), distance, TOLERANCE);
+
+	// Missing, and moving away
+	distance = 100.0f;
+	shape.SetShapeToWorld(Matrix4f::CreateTranslation(0.0f, 1.6f, 0.0f));
+	EXPECT_FALSE(GJK::Cast(&shape, target, Vector3f::ZERO,
+		Vector3f::UNITX, distance, normal));
+	EXPECT_FALSE(GJK::Cast(&shape, target, Vector3f::ZERO,
+		-Vector3f::UNITX, distance, normal));
+
+	// Starting out touching
+	distance = 100.0f;
+	shape.SetShapeToWorld(Matrix4f::CreateTranslation(9.0f, 0.0f, 0.0f));
+	ASSERT_TRUE(GJK::Cast(&shape, target, Vector3f::ZERO,
+		Vector3f::UNITX, distance, normal));
+	EXPECT_EQ(0.0f, distance);
+}
+
+
+//-----------------------------------------------------------------------------
+// Scene queries
+//-----------------------------------------------------------------------------
+
+TEST(SceneQuery, CastRay)
+{
+	PhysicsEngine engine;
+	CreateScene(engine, 300);
+
+	RandomNumberGenerator random(5678);
+	uint32 numHits = 0;
+	Array<SceneQueryHit> hits;
+	for (uint32 i = 0; i < 500; i++)
+	{
+		Ray ray = RandomRay(random);
+		float maxDistance = (i % 2 == 0 ? FLT_MAX : 20.0f);
+		SceneQueryHit expected;
+		bool expectedHit = CastRayBruteForce(engine, ray, maxDistance, expected);
+
+		bool hit = engine.CastRay(ray, maxDistance, SceneQueryMode::k_closest, hits);
+		ASSERT_EQ(expectedHit, hit);
+		if (!hit)
+		{
+			EXPECT_FALSE(engine.CastRay(ray, maxDistance, SceneQueryMode::k_any, hits));
+			EXPECT_FALSE(engine.CastRay(ray, maxDistance, SceneQueryMode::k_all, hits));
+			continue;
+		}
+		numHits++;
+		ASSERT_EQ(1u, hits.size());
+		EXPECT_EQ(expected.collider, hits[0].collider);
+		EXPECT_EQ(expected.collider->GetBody(), hits[0].body);
+		EXPECT_EQ(expected.distance, hits[0].distance);
+
+		// Any hit is one of all the hits, which start with the closest
+		ASSERT_TRUE(engine.CastRay(ray, maxDistance, SceneQueryMode::k_any, hits));
+		Collider* anyCollider = hits[0].collider;
+		ASSERT_TRUE(engine.CastRay(ray, maxDistance, SceneQueryMode::k_all, hits));
+		EXPECT_EQ(expected.distance, hits[0].distance);
+		bool foundAny = false;
+		for (uint32 j = 0; j < hits.size(); j++)
+		{
+			foundAny = foundAny || (hits[j].collider == anyCollider);
+			EXPECT_LE(hits[j].distance, maxDistance);
+			if (j > 0)
+				EXPECT_LE(hits[j - 1].distance, hits[j].distance);
+		}
+		EXPECT_TRUE(foundAny);
+	}
+	EXPECT_GT(numHits, 100u);
+
+	// The old interface
+	float distance;
+	Vector3f normal;
+	Ray ray;
+	ray.origin = Vector3f(0.0f, 200.0f, 0.0f);
+	ray.direction = Vector3f::DOWN;
+	ASSERT_TRUE(engine.CastRay(ray, distance, normal));
+	ASSERT_TRUE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+	EXPECT_EQ(hits[0].distance, distance);
+}
+
+TEST(SceneQuery, CastRays)
+{
+	PhysicsEngine engine;
+	CreateScene(engine, 300);
+
+	RandomNumberGenerator random(5678);
+	Array<Ray> rays;
+	Array<float> maxDistances;
+	for (uint32 i = 0; i < 1000; i++)
+	{
+		rays.push_back(RandomRay(random));
+		maxDistances.push_back(10.0f + random.NextFloat() * 50.0f);
+	}
+
+	// Each mode should match casting the rays one at a time
+	Array<SceneQueryHit> hits;
+	Array<SceneQueryHit> single;
+	engine.CastRays(rays.data(), maxDistances.data(), (uint32) rays.size(),
+		SceneQueryMode::k_closest, hits);
+	ASSERT_EQ(rays.size(), hits.size());
+	for (uint32 i = 0; i < rays.size(); i++)
+	{
+		EXPECT_EQ(i, hits[i].queryIndex);
+		if (engine.CastRay(rays[i], maxDistances[i], SceneQueryMode::k_closest, single))
+		{
+			EXPECT_EQ(single[0].collider, hits[i].collider);
+			EXPECT_EQ(single[0].distance, hits[i].distance);
+		}
+		else
+		{
+			EXPECT_EQ(nullptr, hits[i].collider);
+		}
+	}
+
+	engine.CastRays(rays.data(), maxDistances.data(), (uint32) rays.size(),
+		SceneQueryMode::k_any, hits);
+	ASSERT_EQ(rays.size(), hits.size());
+	for (uint32 i = 0; i < rays.size(); i++)
+	{
+		bool hit = engine.CastRay(rays[i], maxDistances[i], SceneQueryMode::k_any, single);
+		EXPECT_EQ(hit, (hits[i].collider != nullptr));
+	}
+
+	engine.CastRays(rays.data(), nullptr, (uint32) rays.size(),
+		SceneQueryMode::k_all, hits);
+	uint32 index = 0;
+	for (uint32 i = 0; i < rays.size(); i++)
+	{
+		engine.CastRay(rays[i], FLT_MAX, SceneQueryMode::k_all, single);
+		ASSERT_LE(index + single.size(), hits.size());
+		for (uint32 j = 0; j < single.size(); j++, index++)
+		{
+			EXPECT_EQ(i, hits[index].queryIndex);
+			EXPECT_EQ(single[j].distance, hits[index].distance);
+		}
+	}
+	EXPECT_EQ(index, hits.size());
+}
+
+TEST(SceneQuery, Overlap)
+{
+	PhysicsEngine engine;
+	CreateScene(engine, 300);
+
+	RandomNumberGenerator random(5678);
+	SphereCollider sphere(3.0f);
+	BoxCollider box(Vector3f(2.0f, 3.0f, 1.0f));
+	Collider* shapes[] = { &sphere, &box };
+	Array<SceneQueryHit> hits;
+	uint32 numHits = 0;
+	for (uint32 i = 0; i < 200; i++)
+	{
+		Collider* shape = shapes[i % 2];
+		shape->SetShapeToWorld(Matrix4f::CreateTranslation(
+			RandomVector(random, 40.0f)));
+
+		Array<Collider*> expected;
+		for (uint32 j = 0; j < engine.GetNumBodies(); j++)
+		{
+			Collider* collider = engine.GetBody(j)->GetCollider();
+			if (GJK::TestIntersection(shape, collider))
+				expected.push_back(collider);
+		}
+
+		bool hit = engine.Overlap(shape, SceneQueryMode::k_all, hits);
+		EXPECT_EQ(!expected.empty(), hit);
+		ASSERT_EQ(expected.size(), hits.size());
+		for (uint32 j = 0; j < hits.size(); j++)
+		{
+			EXPECT_NE(expected.end(), std::find(
+				expected.begin(), expected.end(), hits[j].collider));
+		}
+		numHits += (uint32) hits.size();
+
+		EXPECT_EQ(hit, engine.Overlap(shape, SceneQueryMode::k_any, hits));
+		EXPECT_EQ((hit ? 1u : 0u), hits.size());
+	}
+	EXPECT_GT(numHits, 20u);
+}
+
+TEST(SceneQuery, Sweep)
+{
+	PhysicsEngine engine;
+	CreateScene(engine, 300);
+
+	// Compare with sweeping against every collider, where overlapping
+	// colliders can tie for the closest. A sphere should hit no later than a
+	// ray from its center.
+	RandomNumberGenerator random(5678);
+	SphereCollider sphere(0.5f);
+	Array<SceneQueryHit> hits;
+	uint32 numHits = 0;
+	for (uint32 i = 0; i < 200; i++)
+	{
+		Ray ray = RandomRay(random);
+		sphere.SetShapeToWorld(Matrix4f::CreateTranslation(ray.origin));
+		SceneQueryHit expected;
+		expected.collider = nullptr;
+		expected.distance = FLT_MAX;
+		for (uint32 j = 0; j < engine.GetNumBodies(); j++)
+		{
+			Collider* collider = engine.GetBody(j)->GetCollider();
+			if (GJK::Cast(&sphere, collider, Vector3f::ZERO, ray.direction,
+				expected.distance, expected.normal))
+				expected.collider = collider;
+		}
+
+		bool hit = engine.Sweep(&sphere, ray.direction, FLT_MAX,
+			SceneQueryMode::k_closest, hits);
+		ASSERT_EQ(expected.collider != nullptr, hit);
+		if (!hit)
+			continue;
+		numHits++;
+		EXPECT_EQ(expected.distance, hits[0].distance);
+		SceneQueryHit rayHit;
+		if (CastRayBruteForce(engine, ray, FLT_MAX, rayHit))
+			EXPECT_LE(hits[0].distance, rayHit.distance + TOLERANCE);
+
+		ASSERT_TRUE(engine.Sweep(&sphere, ray.direction, FLT_MAX,
+			SceneQueryMode::k_all, hits));
+		EXPECT_EQ(expected.distance, hits[0].distance);
+		for (uint32 j = 1; j < hits.size(); j++)
+			EXPECT_LE(hits[j - 1].distance, hits[j].distance);
+		EXPECT_TRUE(engine.Sweep(&sphere, ray.direction, FLT_MAX,
+			SceneQueryMode::k_any, hits));
+	}
+	EXPECT_GT(numHits, 20u);
+}
+
+TEST(SceneQuery, MovedBodies)
+{
+	PhysicsEngine engine;
+	RigidBody* body = new RigidBody();
+	body->AddCollider(new SphereCollider(1.0f));
+	body->SetInverseMass(0.0f);
+	engine.AddBody(body);
+
+	Ray ray;
+	ray.origin = Vector3f(0.0f, 0.0f, -10.0f);
+	ray.direction = Vector3f::UNITZ;
+	Array<SceneQueryHit> hits;
+	ASSERT_TRUE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+	EXPECT_EQ(body, hits[0].body);
+
+	// Bodies moved by hand need an update
+	body->SetPosition(Vector3f(5.0f, 0.0f, 0.0f));
+	engine.UpdateSceneQueries();
+	EXPECT_FALSE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+
+	// Replaced colliders
+	body->ClearColliders();
+	EXPECT_EQ(0u, engine.GetSceneQuery()->GetTree().GetNumProxies());
+	body->AddCollider(new BoxCollider(Vector3f(10.0f, 1.0f, 1.0f)));
+	ASSERT_TRUE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+	EXPECT_NEAR(9.0f, hits[0].distance, TOLERANCE);
+
+	engine.RemoveBody(body);
+	EXPECT_EQ(0u, engine.GetSceneQuery()->GetTree().GetNumProxies());
+}
+
+TEST(SceneQuery, SimulatedBodies)
+{
+	// A sphere falling onto a static floor, both added after a step
+	PhysicsEngine engine;
+	engine.Simulate(1.0f / 60.0f);
+	RigidBody* floor = new RigidBody();
+	floor->AddCollider(new BoxCollider(Vector3f(10.0f, 0.5f, 10.0f)));
+	floor->SetPosition(Vector3f(0.0f, -0.5f, 0.0f));
+	floor->SetInverseMass(0.0f);
+	engine.AddBody(floor);
+	RigidBody* sphere = new RigidBody();
+	sphere->AddCollider(new SphereCollider(0.5f));
+	sphere->SetPosition(Vector3f(0.0f, 5.0f, 0.0f));
+	engine.AddBody(sphere);
+
+	// The simulated sphere is refitted before each query, without calling
+	// UpdateSceneQueries
+	Ray ray;
+	ray.origin = Vector3f(0.0f, 10.0f, 0.0f);
+	ray.direction = -Vector3f::UNITY;
+	Array<SceneQueryHit> hits;
+	for (uint32 step = 0; step < 120; step++)
+	{
+		ASSERT_TRUE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+		EXPECT_EQ(sphere, hits[0].body);
+		EXPECT_NEAR(9.5f - sphere->GetPosition().y, hits[0].distance, TOLERANCE);
+		engine.Simulate(1.0f / 60.0f);
+	}
+
+	// Once the sphere sleeps, the floor is still hit beside it
+	EXPECT_FALSE(sphere->IsAwake());
+	ray.origin.x = 3.0f;
+	ASSERT_TRUE(engine.CastRay(ray, FLT_MAX, SceneQueryMode::k_closest, hits));
+	EXPECT_EQ(floor, hits[0].body);
+	EXPECT_NEAR(10.0f, hits[0].distance, TOLERANCE);
+}